@@ -557,6 +557,23 @@ wrapper_for_filter(struct arithmeticparams *p, char *token, int operator)
 /***************************************************************/
 /*************            Other functions          *************/
 /***************************************************************/
+static void
+arithmetic_binary_type_check(gal_data_t *in, char *operator)
+{
+  if(in->type!=GAL_TYPE_UINT8)
+    error(EXIT_FAILURE, 0, "the dataset operand of '%s' has a type "
+          "of %s. However, it must be a binary dataset (only being equal "
+          "to zero is checked). You can use the 'uint8' operator for type "
+          "conversion, alternatively, if all your values are positive "
+          "and floating point, you can use '0 gt', if you want non-blank "
+          "values you can use 'isblank not' and many other operators that "
+          "produce a binary output", operator, gal_type_name(in->type, 1));
+}
+
+
+
+
+
 static int
 arithmetic_binary_sanity_checks(gal_data_t *in, gal_data_t *conn,
                                 char *operator)
@@ -583,14 +600,7 @@ arithmetic_binary_sanity_checks(gal_data_t *in, gal_data_t *conn,
           "operand (%zu)", operator, conn_int, in->ndim);
 
   /* Make sure the array has an unsigned 8-bit type. */
-  if(in->type!=GAL_TYPE_UINT8)
-    error(EXIT_FAILURE, 0, "the second popped operand of '%s' has a type "
-          "of %s. However, it must be a binary dataset (only being equal "
-          "to zero is checked). You can use the 'uint8' operator for type "
-          "conversion, alternatively, if all your values are positive "
-          "and floating point, you can use '0 gt', if you want non-blank "
-          "values you can use 'isblank not' and many other operators that "
-          "produce a binary output", operator, gal_type_name(in->type, 1));
+  arithmetic_binary_type_check(in, operator);
 
   /* Clean up and return the integer value of 'conn'. */
   gal_data_free(conn);
@@ -616,8 +626,12 @@ arithmetic_erode_dilate(struct arithmeticparams *p, char *token, int op)
   /* Do the operation. */
   switch(op)
     {
-    case ARITHMETIC_OP_ERODE:  gal_binary_erode(in,  1, conn_int, 1); break;
-    case ARITHMETIC_OP_DILATE: gal_binary_dilate(in, 1, conn_int, 1); break;
+    case ARITHMETIC_OP_ERODE:
+      gal_binary_erode_parallel(in, 1, conn_int, 1, p->cp.numthreads);
+      break;
+    case ARITHMETIC_OP_DILATE:
+      gal_binary_dilate_parallel(in, 1, conn_int, 1, p->cp.numthreads);
+      break;
     default:
       error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
             "problem. The operator code %d not recognized", __func__,
@@ -632,6 +646,74 @@ arithmetic_erode_dilate(struct arithmeticparams *p, char *token, int op)
 
 
 
+static void
+arithmetic_morph_radius(struct arithmeticparams *p, char *token, int op)
+{
+  double r;
+
+  /* Pop the two necessary operands. */
+  gal_data_t *radius = operands_pop(p, token);
+  gal_data_t *in     = operands_pop(p, token);
+
+  /* Read the radius and make sure the input is binary. */
+  if(radius->size!=1)
+    error(EXIT_FAILURE, 0, "the first popped operand to '%s' must be a "
+          "single number (the radius). However, it has %zu elements",
+          token, radius->size);
+  radius=gal_data_copy_to_new_type_free(radius, GAL_TYPE_FLOAT64);
+  r=((double *)(radius->array))[0];
+  if( isnan(r) || r<0 )
+    error(EXIT_FAILURE, 0, "the first popped operand to '%s' is the "
+          "radius, so it must be a non-negative number, but it is %g",
+          token, r);
+  arithmetic_binary_type_check(in, token);
+
+  /* Do the operation. */
+  switch(op)
+    {
+    case ARITHMETIC_OP_ERODE_RADIUS:
+      gal_binary_erode_radius(in, r, 1, p->cp.numthreads);
+      break;
+    case ARITHMETIC_OP_DILATE_RADIUS:
+      gal_binary_dilate_radius(in, r, 1, p->cp.numthreads);
+      break;
+    case ARITHMETIC_OP_OPEN_RADIUS:
+      gal_binary_open_radius(in, r, 1, p->cp.numthreads);
+      break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
+            "problem. The operator code %d not recognized", __func__,
+            PACKAGE_BUGREPORT, op);
+    }
+
+  /* Push the result onto the stack and clean up. */
+  operands_add(p, NULL, in);
+  gal_data_free(radius);
+}
+
+
+
+
+
+static void
+arithmetic_distance_transform(struct arithmeticparams *p, char *token)
+{
+  gal_data_t *out;
+  gal_data_t *in = operands_pop(p, token);
+
+  /* Make sure the input is binary and find the distance. */
+  arithmetic_binary_type_check(in, token);
+  out=gal_binary_distance_transform(in, 1, p->cp.numthreads);
+
+  /* Push the result onto the stack and clean up. */
+  operands_add(p, NULL, out);
+  gal_data_free(in);
+}
+
+
+
+
+
 static void
 arithmetic_number_neighbors(struct arithmeticparams *p, char *token, int op)
 {
@@ -667,7 +749,8 @@ arithmetic_connected_components(struct arithmeticparams *p, char *token)
   conn_int=arithmetic_binary_sanity_checks(in, conn, token);
 
   /* Do the connected components labeling. */
-  gal_binary_connected_components(in, &out, conn_int);
+  gal_binary_connected_components_parallel(in, &out, conn_int,
+                                           p->cp.numthreads, NULL);
 
   /* Push the result onto the stack. */
   operands_add(p, NULL, out);
@@ -693,7 +776,7 @@ arithmetic_fill_holes(struct arithmeticparams *p, char *token)
   conn_int=arithmetic_binary_sanity_checks(in, conn, token);
 
   /* Fill the holes. */
-  gal_binary_holes_fill(in, conn_int, -1);
+  gal_binary_holes_fill_parallel(in, conn_int, -1, p->cp.numthreads);
 
   /* Push the result onto the stack. */
   operands_add(p, NULL, in);
@@ -1352,6 +1435,14 @@ arithmetic_set_operator(char *string, size_t *num_operands, int *inlib)
         { op=ARITHMETIC_OP_ERODE;                 *num_operands=0; }
       else if (!strcmp(string, "dilate"))
         { op=ARITHMETIC_OP_DILATE;                *num_operands=0; }
+      else if (!strcmp(string, "erode-radius"))
+        { op=ARITHMETIC_OP_ERODE_RADIUS;          *num_operands=0; }
+      else if (!strcmp(string, "dilate-radius"))
+        { op=ARITHMETIC_OP_DILATE_RADIUS;         *num_operands=0; }
+      else if (!strcmp(string, "open-radius"))
+        { op=ARITHMETIC_OP_OPEN_RADIUS;           *num_operands=0; }
+      else if (!strcmp(string, "distance-transform"))
+        { op=ARITHMETIC_OP_DISTANCE_TRANSFORM;    *num_operands=0; }
       else if (!strcmp(string, "number-neighbors"))
         { op=ARITHMETIC_OP_NUMBER_NEIGHBORS;      *num_operands=0; }
       else if (!strcmp(string, "connected-components"))
@@ -1578,6 +1669,16 @@ arithmetic_operator_run(struct arithmeticparams *p, int operator,
           arithmetic_erode_dilate(p, operator_string, operator);
           break;
 
+        case ARITHMETIC_OP_ERODE_RADIUS:
+        case ARITHMETIC_OP_DILATE_RADIUS:
+        case ARITHMETIC_OP_OPEN_RADIUS:
+          arithmetic_morph_radius(p, operator_string, operator);
+          break;
+
+        case ARITHMETIC_OP_DISTANCE_TRANSFORM:
+          arithmetic_distance_transform(p, operator_string);
+          break;
+
         case ARITHMETIC_OP_NUMBER_NEIGHBORS:
           arithmetic_number_neighbors(p, operator_string, operator);
           break;
@@ -37,6 +37,10 @@ enum arithmetic_prog_operators
   ARITHMETIC_OP_FILTER_SIGCLIP_MEDIAN,
   ARITHMETIC_OP_ERODE,
   ARITHMETIC_OP_DILATE,
+  ARITHMETIC_OP_ERODE_RADIUS,
+  ARITHMETIC_OP_DILATE_RADIUS,
+  ARITHMETIC_OP_OPEN_RADIUS,
+  ARITHMETIC_OP_DISTANCE_TRANSFORM,
   ARITHMETIC_OP_NUMBER_NEIGHBORS,
   ARITHMETIC_OP_CONNECTED_COMPONENTS,
   ARITHMETIC_OP_FILL_HOLES,
@@ -166,7 +166,7 @@ struct argp_option program_options[] =
       UI_KEY_DOMAIN,
       "STR",
       0,
-      "Convolution domain: 'spatial', 'frequency'.",
+      "Convolution domain: 'spatial', 'frequency', 'auto'.",
       GAL_OPTIONS_GROUP_OPERATING_MODE,
       &p->domainstr,
       GAL_TYPE_STRING,
@@ -174,6 +174,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "separable",
+      UI_KEY_SEPARABLE,
+      "FLT",
+      0,
+      "Spatial: separate kernel with this tolerance.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->separable,
+      GAL_TYPE_FLOAT64,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "makekernel",
       UI_KEY_MAKEKERNEL,
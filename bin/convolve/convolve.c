@@ -30,15 +30,21 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gsl/gsl_errno.h>
 
 #include <gnuastro/wcs.h>
+#include <gnuastro/list.h>
 #include <gnuastro/tile.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/array.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/threads.h>
 #include <gnuastro/convolve.h>
+#include <gnuastro/dimension.h>
 
 #include <gnuastro-internal/timing.h>
+#include <gnuastro-internal/checkset.h>
 
 #include "main.h"
+
+#include "ui.h"
 #include "convolve.h"
 
 
@@ -90,29 +96,21 @@ complextoreal(double *c, size_t size, int action, double **output)
 
    (a+ib)*(c+id)=ac+iad+ibc-bd=(ac-bd)+i(ad-bc)
 
-   The loop is easy to understand: we want to replace two
-   variables. But changing one, will affect the other. So what we do,
-   is to store the final value of one, then replace the second, then
-   finally replace the first one.
-
-   Here, we first get the real component but don't put it in the
-   output. Then we find and replace the imaginary component, finally,
-   we put the new real component in the image.
- */
-void
-complexarraymultiply(double *a, double *b, size_t size)
+   Both the real and imaginary parts of the output depend on the real and
+   imaginary parts of the input, so the real part is first kept in a
+   temporary variable. The loop is on the index of each complex number
+   (without any condition), so it can be vectorized by the compiler. */
+static void
+complexarraymultiply_range(double *a, double *b, size_t size)
 {
-  double r, *af;
-
-  af=a+2*size;
-  do
+  size_t i;
+  double r;
+  for(i=0;i<size;++i)
     {
-      r      = (*a * *b) - (*(a+1) * *(b+1));
-      *(a+1) = (*(a+1) * *b) + (*a * *(b+1));
-      *a++=r;            /* Go onto (set) the imaginary part of a. */
-      b+=2;
+      r        = a[2*i]   * b[2*i] - a[2*i+1] * b[2*i+1];
+      a[2*i+1] = a[2*i+1] * b[2*i] + a[2*i]   * b[2*i+1];
+      a[2*i]   = r;
     }
-  while(++a<af);  /* Go onto the next complex number. */
 }
 
 
@@ -126,40 +124,192 @@ complexarraymultiply(double *a, double *b, size_t size)
                 =(ac-iad+ibc+bd)/(c^2+d^2)
                 =[(ac+bd)+i(bc-ad)]/(c^2+d^2)
 
-   See the explanations above complexarraymultiply for an explanation
-   on the loop.
+   See the explanations above 'complexarraymultiply_range' for an
+   explanation on the loop.
  */
-void
-complexarraydivide(double *a, double *b, size_t size, double minsharpspec)
+static void
+complexarraydivide_range(double *a, double *b, size_t size,
+                         double minsharpspec)
 {
-  double r, *af;
+  size_t i;
+  double r, bb;
 
-  af=a+2*size;
-  do
+  for(i=0;i<size;++i)
     {
-      if (sqrt(*b**b + *(b+1)**(b+1))>minsharpspec)
+      bb = b[2*i]*b[2*i] + b[2*i+1]*b[2*i+1];
+      if (sqrt(bb)>minsharpspec)
         {
-          r      = ( ( (*a * *b) + (*(a+1) * *(b+1)) )
-                     / ( *b * *b + *(b+1) * *(b+1) ) );
-          *(a+1) = ( ( (*(a+1) * *b) - (*a * *(b+1)) )
-                     / ( *b * *b + *(b+1) * *(b+1) ) );
-          *a=r;
+          r        = ( a[2*i]   * b[2*i] + a[2*i+1] * b[2*i+1] ) / bb;
+          a[2*i+1] = ( a[2*i+1] * b[2*i] - a[2*i]   * b[2*i+1] ) / bb;
+          a[2*i]   = r;
 
           /* Just as a sanity check (the result should never be larger than
              one. */
-          if(sqrt(*a**a + *(a+1)**(a+1))>1.00001f)
-            *a=*(a+1)=0.0f;
+          if(sqrt(a[2*i]*a[2*i] + a[2*i+1]*a[2*i+1])>1.00001f)
+            a[2*i]=a[2*i+1]=0.0f;
         }
       else
+        a[2*i]=a[2*i+1]=0.0f;
+    }
+}
+
+
+
+
+
+/* Parameters for multiplying or dividing complex arrays on threads. */
+struct complexarrayparams
+{
+  double             *a;  /* First array (also the output).            */
+  double             *b;  /* Second array.                             */
+  size_t           size;  /* Number of complex elements.               */
+  double   minsharpspec;  /* For division: minimum spectrum of 'b'.    */
+  int            divide;  /* ==1: divide, ==0: multiply.               */
+};
+
+
+
+
+
+/* Each thread will operate on separate chunks of the two arrays. */
+#define COMPLEXARRAY_CHUNK 65536
+static void *
+complexarray_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct complexarrayparams *cp=(struct complexarrayparams *)tprm->params;
+
+  size_t i, start, size;
+
+  /* Go over all the chunks given to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      start = tprm->indexs[i] * COMPLEXARRAY_CHUNK;
+      size  = ( start + COMPLEXARRAY_CHUNK > cp->size
+                ? cp->size - start : COMPLEXARRAY_CHUNK );
+      if(cp->divide)
+        complexarraydivide_range(cp->a+2*start, cp->b+2*start, size,
+                                 cp->minsharpspec);
+      else
+        complexarraymultiply_range(cp->a+2*start, cp->b+2*start, size);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Multiply or divide (when 'divide!=0') the first complex array by the
+   second (in place) on 'numthreads' threads. */
+static void
+complexarray_operate(double *a, double *b, size_t size, int divide,
+                     double minsharpspec, size_t numthreads)
+{
+  struct complexarrayparams cp;
+
+  cp.a=a;
+  cp.b=b;
+  cp.size=size;
+  cp.divide=divide;
+  cp.minsharpspec=minsharpspec;
+  gal_threads_spin_off(complexarray_on_thread, &cp,
+                       (size+COMPLEXARRAY_CHUNK-1)/COMPLEXARRAY_CHUNK,
+                       numthreads, -1, 1);
+}
+
+
+
+
+
+/* Transpose the 'n0' by 'n1' array 'in' into 'out' (each element has
+   'nelem' doubles: 1 for real and 2 for complex arrays). To avoid large
+   strides in memory, the elements are copied in small square blocks that
+   fit into the cache. Each thread works on separate groups of
+   'CONVOLVE_TRANSPOSE_BLOCK' rows of the input. */
+#define CONVOLVE_TRANSPOSE_BLOCK 32
+struct transposeparams
+{
+  double          *in;  /* Array to transpose.                          */
+  double         *out;  /* Transposed array.                            */
+  size_t           n0;  /* Number of rows of the input.                 */
+  size_t           n1;  /* Number of columns of the input.              */
+  size_t        nelem;  /* Number of doubles in each element.           */
+};
+
+static void *
+transpose_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct transposeparams *tp=(struct transposeparams *)tprm->params;
+
+  double *in=tp->in, *out=tp->out;
+  size_t i, r, c, e, r0, r1, c0, c1;
+  size_t n0=tp->n0, n1=tp->n1, ne=tp->nelem, B=CONVOLVE_TRANSPOSE_BLOCK;
+
+  /* Go over the groups of rows given to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      r0=tprm->indexs[i]*B;
+      r1 = r0+B > n0 ? n0 : r0+B;
+      for(c0=0; c0<n1; c0+=B)
         {
-          *a=0;
-          *(a+1)=0;
+          c1 = c0+B > n1 ? n1 : c0+B;
+          for(r=r0;r<r1;++r)
+            for(c=c0;c<c1;++c)
+              for(e=0;e<ne;++e)
+                out[(c*n0+r)*ne+e]=in[(r*n1+c)*ne+e];
         }
-
-      a+=2;
-      b+=2;
     }
-  while(a<af);  /* Go onto the next complex number. */
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Transpose 'in' (which has 'n0' rows and 'n1' columns) into 'out' (which
+   will have 'n1' rows and 'n0' columns) on multiple threads. */
+static void
+transpose_to(struct convolveparams *p, double *in, double *out, size_t n0,
+             size_t n1, size_t nelem)
+{
+  struct transposeparams tp;
+
+  tp.in=in;
+  tp.n0=n0;
+  tp.n1=n1;
+  tp.out=out;
+  tp.nelem=nelem;
+  gal_threads_spin_off(transpose_on_thread, &tp,
+                       (n0+CONVOLVE_TRANSPOSE_BLOCK-1)
+                       /CONVOLVE_TRANSPOSE_BLOCK, p->cp.numthreads,
+                       p->cp.minmapsize, p->cp.quietmmap);
+}
+
+
+
+
+
+/* Transpose the complex padded array '*arr' (which has 'n0' rows and 'n1'
+   columns) into the work array ('p->pwork') and swap the two pointers.
+   So no array is allocated for each transpose and 'p->pwork' can be used
+   for the next array. */
+static void
+transpose(struct convolveparams *p, double **arr, size_t n0, size_t n1)
+{
+  double *tmp;
+
+  transpose_to(p, *arr, p->pwork, n0, n1, 2);
+  tmp=*arr;
+  *arr=p->pwork;
+  p->pwork=tmp;
 }
 
 
@@ -235,6 +385,12 @@ frequency_make_padded_complex(struct convolveparams *p)
         }
       do *o++=0.0f; while(o<op);
     }
+
+
+  /* Allocate the work array that is used for transposing the padded
+     arrays (see 'transpose'). */
+  p->pwork=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*ps0*ps1, 0,
+                                __func__, "pwork");
 }
 
 
@@ -438,17 +594,21 @@ correctdeconvolve(struct convolveparams *p, double **spatial)
 /******************************************************************/
 /*************    Frequency domain convolution    *****************/
 /******************************************************************/
-/* The indexs array specifies the row or column numbers for this
-  thread to work on. If forward1backwardn1 is one, then this is the
-  forward transform, meaning that in convolution there are two
-  images. If it is -1, then this is the final backward transform and
-  there is only one image to run FFTW on and the values in indexs will
-  always be smaller than p->s0 and p->s1. When there are two images,
-  then the index numbers are going to be at most double p->s0 and
-  p->s1. In this case, those index values which are smaller than p->s0
-  or p->s1 belong to the input image and those which are equal or
-  larger than larger belong to the kernel image (after subtraction for
-  p->s0 or p->s1).*/
+/* The indexs array specifies the row numbers for this thread to work
+  on. If 'transposed' is 0, the rows have 'p->ps1' elements (there are
+  'p->ps0' of them) and if it is 1, the arrays are transposed (so each row
+  is a column of the original array). In both cases, the rows are
+  contiguous in memory.
+
+  If forward1backwardn1 is one, then this is the forward transform,
+  meaning that in convolution there are two images. If it is -1, then this
+  is the final backward transform and there is only one image to run FFT
+  on and the values in indexs will always be smaller than the number of
+  rows. When there are two images, then the index numbers are going to be
+  at most double the number of rows. In this case, those index values
+  which are smaller than the number of rows belong to the input image and
+  those which are equal or larger belong to the kernel image (after
+  subtraction of the number of rows).*/
 void *
 onedimensionfft(void *inparam)
 {
@@ -456,27 +616,21 @@ onedimensionfft(void *inparam)
   struct convolveparams *p=fp->p;
 
   double *d, *df;
-  size_t indmultip, maxindex;
+  size_t i, size, nrows;
   gsl_fft_complex_workspace *work;
   gsl_fft_complex_wavetable *wavetable;
   double *data, *pimg=p->pimg, *pker=p->pker;
+  size_t *indexs=fp->indexs;
   int forward1backwardn1=fp->forward1backwardn1;
-  size_t i, size, stride=fp->stride, *indexs=fp->indexs;
-
-  /* Set the number of points to transform,
 
-     indmultip: The value to be multiplied by the value in indexs to
-     specify the first pixel of the row or column.
-   */
-  if(stride==1)
-    { size=p->ps1; wavetable=fp->ps1wave; work=fp->ps1work;
-      maxindex=p->ps0; indmultip=p->ps1; }
+  /* Set the number of points to transform and the number of rows. */
+  if(fp->transposed)
+    { size=p->ps0; wavetable=fp->ps0wave; work=fp->ps0work; nrows=p->ps1; }
   else
-    { size=p->ps0; wavetable=fp->ps0wave; work=fp->ps0work;
-      maxindex=p->ps1; indmultip=1;      }
+    { size=p->ps1; wavetable=fp->ps1wave; work=fp->ps1work; nrows=p->ps0; }
 
 
-  /* Go over all the rows or columns given for this thread.
+  /* Go over all the rows given for this thread.
 
      NOTE: The final array (after the two FFT'd arrays are multiplied
      by each other) is stored in p->pimg. So the check below works
@@ -484,18 +638,18 @@ onedimensionfft(void *inparam)
   */
   for(i=0; indexs[i]!=GAL_BLANK_SIZE_T; ++i)
     {
-      data = ( indexs[i]<maxindex
-               ? &pimg[ 2*indexs[i]*indmultip ]   /* *2 because complex. */
-               : &pker[ 2*(indexs[i]-maxindex)*indmultip ] );
+      data = ( indexs[i]<nrows
+               ? &pimg[ 2*indexs[i]*size ]   /* *2 because complex. */
+               : &pker[ 2*(indexs[i]-nrows)*size ] );
 
-      gsl_fft_complex_transform(data, stride, size, wavetable, work,
+      gsl_fft_complex_transform(data, 1, size, wavetable, work,
                                 forward1backwardn1);
 
       /* Normalize in the backward transform: */
       if(forward1backwardn1==-1)
         {
-          df=(d=data)+2*size*stride;
-          do {*d/=size; *(d+1)/=size; d+=2*stride;} while(d<df);
+          df=(d=data)+2*size;
+          do {*d/=size; *(d+1)/=size; d+=2;} while(d<df);
         }
     }
 
@@ -509,14 +663,14 @@ onedimensionfft(void *inparam)
 
 
 
-/* Do the forward Fast Fourier Transform either on two input images
-   (the padded image and kernel) or on one image (the multiplication
-   of the FFT of the two). In the second case, it is assumed that we
-   are looking at the complex conjugate of the array so in practice
-   this will be a backward transform. */
-void
-twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
-                int forward1backwardn1)
+/* Do the 1D Fourier transform on all the (contiguous) rows of the image
+   (and kernel, when 'multiple==2') on threads. See 'onedimensionfft' for
+   'transposed'. */
+static void
+onedimensionfft_threads(struct convolveparams *p,
+                        struct fftonthreadparams *fp,
+                        int forward1backwardn1, size_t multiple,
+                        int transposed)
 {
   int err;
   pthread_t t;          /* All thread ids saved in this, not used. */
@@ -524,30 +678,17 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
   pthread_attr_t attr;
   pthread_barrier_t b;
   size_t i, nb, *indexs, thrdcols;
-  size_t nt=p->cp.numthreads, multiple=0;
+  size_t nt=p->cp.numthreads, nrows=transposed ? p->ps1 : p->ps0;
 
-  /* First we are going to get the 1D fourier transform on the rows of
-     both images. */
-  if(forward1backwardn1==1)       multiple=2;
-  else if(forward1backwardn1==-1) multiple=1;
-  else
-    error(EXIT_FAILURE, 0, "%s: a bug! The value of the variable "
-          "'forward1backwardn1' is %d not 1 or 2. Please contact us at %s "
-          "so we can find the cause of the problem and fix it", __func__,
-          forward1backwardn1, PACKAGE_BUGREPORT);
-
-
-  /* ==================== */
-  /* 1D FFT on each row. */
-  /* ==================== */
-  mmapname=gal_threads_dist_in_threads(multiple*p->ps0, nt,
+  /* Distribute the rows between the threads. */
+  mmapname=gal_threads_dist_in_threads(multiple*nrows, nt,
                                        p->input->minmapsize,
                                        p->cp.quietmmap,
                                        &indexs, &thrdcols);
   if(nt==1)
     {
-      fp[0].stride=1;
       fp[0].indexs=&indexs[0];
+      fp[0].transposed=transposed;
       fp[0].forward1backwardn1=forward1backwardn1;
       onedimensionfft(&fp[0]);
     }
@@ -557,7 +698,7 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
          (that spinns off the nt threads) is also a thread, so the
          number the barrier should be one more than the number of
          threads spinned off. */
-      if( multiple*p->ps0 < nt ) nb=multiple*p->ps0+1;
+      if( multiple*nrows < nt ) nb=multiple*nrows+1;
       else nb=nt+1;
       gal_threads_attr_barrier_init(&attr, &b, nb);
 
@@ -567,12 +708,12 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
           {
             fp[i].id=i;
             fp[i].b=&b;
-            fp[i].stride=1; /* On each row, stride=1 */
+            fp[i].transposed=transposed;
             fp[i].indexs=&indexs[i*thrdcols];
             fp[i].forward1backwardn1=forward1backwardn1;
             err=pthread_create(&t, &attr, onedimensionfft, &fp[i]);
             if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for rows",
+              error(EXIT_FAILURE, 0, "%s: can't create thread %zu",
                     __func__, i);
           }
 
@@ -582,52 +723,58 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
       pthread_barrier_destroy(&b);
     }
 
-  /* Clean up. */
+  /* Clean up, note that 'indexs' may be memory-mapped. */
   if(mmapname) gal_pointer_mmap_free(&mmapname, p->cp.quietmmap);
   else         free(indexs);
+}
 
 
 
-  /* ====================== */
-  /* 1D FFT on each column. */
-  /* ====================== */
-  /* No comments, exact duplicate of above, except the p->ps1s! */
-  mmapname=gal_threads_dist_in_threads(multiple*p->ps1, nt,
-                                       p->input->minmapsize,
-                                       p->cp.quietmmap,
-                                       &indexs, &thrdcols);
-  if(nt==1)
+
+
+/* Do the forward Fast Fourier Transform either on two input images
+   (the padded image and kernel) or on one image (the multiplication
+   of the FFT of the two). In the second case, it is assumed that we
+   are looking at the complex conjugate of the array so in practice
+   this will be a backward transform.
+
+   The columns of the arrays have a large stride in memory, so to avoid
+   thrashing the cache, the arrays are transposed (see 'transpose') after
+   the
+   transform of the rows: the 1D transforms of the
+   columns are then also done on contiguous rows. The outputs of the
+   forward transform are therefore transposed (this doesn't affect the
+   element-wise multiplication or division) and the backward transform
+   expects a transposed input (and will transpose it back before the
+   final transform on the rows). */
+void
+twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
+                int forward1backwardn1)
+{
+  if(forward1backwardn1==1)
     {
-      fp[0].stride=p->ps1;
-      fp[0].indexs=indexs;
-      fp[0].forward1backwardn1=forward1backwardn1;
-      onedimensionfft(&fp[0]);
+      /* 1D FFT on each row of the image and kernel. */
+      onedimensionfft_threads(p, fp, forward1backwardn1, 2, 0);
+
+      /* Transpose and do the 1D FFT on each row of the transposed arrays
+         (columns of the original arrays). */
+      transpose(p, &p->pimg, p->ps0, p->ps1);
+      transpose(p, &p->pker, p->ps0, p->ps1);
+      onedimensionfft_threads(p, fp, forward1backwardn1, 2, 1);
     }
-  else
+  else if(forward1backwardn1==-1)
     {
-      if( multiple*p->ps1 < nt ) nb=multiple*p->ps1+1;
-      else nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            fp[i].b=&b;
-            fp[i].stride=p->ps1; /* On each column, stride is p->ps1 */
-            fp[i].indexs=&indexs[i*thrdcols];
-            fp[i].forward1backwardn1=forward1backwardn1;
-            err=pthread_create(&t, &attr, onedimensionfft, &fp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for columns",
-                    __func__, i);
-          }
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
+      /* Similar to above, but in reverse order on the transposed
+         array. */
+      onedimensionfft_threads(p, fp, forward1backwardn1, 1, 1);
+      transpose(p, &p->pimg, p->ps1, p->ps0);
+      onedimensionfft_threads(p, fp, forward1backwardn1, 1, 0);
     }
-
-  /* Clean up, note that 'indexs' may be memory-mapped. */
-  if(mmapname) gal_pointer_mmap_free(&mmapname, p->cp.quietmmap);
-  else         free(indexs);
+  else
+    error(EXIT_FAILURE, 0, "%s: a bug! The value of the variable "
+          "'forward1backwardn1' is %d not 1 or 2. Please contact us at %s "
+          "so we can find the cause of the problem and fix it", __func__,
+          forward1backwardn1, PACKAGE_BUGREPORT);
 }
 
 
@@ -684,13 +831,17 @@ convolve_frequency(struct convolveparams *p)
     gal_timing_report(&t1, "Images converted to frequency domain.", 1);
   if(p->checkfreqsteps)
     {
+      /* The transformed arrays are transposed (see 'twodimensionfft'),
+         so they should be transposed back before viewing. */
       complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
-      data->array=tmp; data->name="input transformed";
+      transpose_to(p, tmp, p->pwork, p->ps1, p->ps0, 1);
+      data->array=p->pwork; data->name="input transformed";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
 
       complextoreal(p->pker, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
-      data->array=tmp; data->name="kernel transformed";
+      transpose_to(p, tmp, p->pwork, p->ps1, p->ps0, 1);
+      data->array=p->pwork; data->name="kernel transformed";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
     }
@@ -699,20 +850,24 @@ convolve_frequency(struct convolveparams *p)
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   if(p->makekernel)
     {
-      complexarraydivide(p->pimg, p->pker, p->ps0*p->ps1, p->minsharpspec);
+      complexarray_operate(p->pimg, p->pker, p->ps0*p->ps1, 1,
+                           p->minsharpspec, p->cp.numthreads);
       if(!p->cp.quiet)
         gal_timing_report(&t1, "Divided in the frequency domain.", 1);
     }
   else
     {
-      complexarraymultiply(p->pimg, p->pker, p->ps0*p->ps1);
+      complexarray_operate(p->pimg, p->pker, p->ps0*p->ps1, 0, 0.0f,
+                           p->cp.numthreads);
       if(!p->cp.quiet)
         gal_timing_report(&t1, "Multiplied in the frequency domain.", 1);
     }
   if(p->checkfreqsteps)
     {
       complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
-      data->array=tmp; data->name=p->makekernel ? "Divided" : "Multiplied";
+      transpose_to(p, tmp, p->pwork, p->ps1, p->ps0, 1);
+      data->array=p->pwork;
+      data->name=p->makekernel ? "Divided" : "Multiplied";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
     }
@@ -738,6 +893,7 @@ convolve_frequency(struct convolveparams *p)
   gal_data_free(data);
   free(p->pimg);
   free(p->pker);
+  free(p->pwork);
 
   /* Crop out the center, numbers smaller than 10^{-17} are errors,
      remove them. */
@@ -768,17 +924,329 @@ convolve_frequency(struct convolveparams *p)
 
 
 
+/******************************************************************/
+/*************             Batch mode             *****************/
+/******************************************************************/
+/* Parameters for reading or writing a group of datasets (possibly on a
+   separate thread) in the batch mode. */
+struct batchioparams
+{
+  struct convolveparams *p;  /* Pointer to main program structure.      */
+  gal_list_str_t    *names;  /* Names of inputs (of the first in group). */
+  gal_data_t         *data;  /* List of datasets (read or to write).    */
+  size_t               num;  /* Number of datasets in the group.        */
+};
+
+
+
+
+
+/* Read one input of the batch mode (it should be a FITS image). */
+static gal_data_t *
+convolve_batch_read_one(struct convolveparams *p, char *filename)
+{
+  gal_data_t *in;
+  char *hdu=p->cp.hdu;
+
+  /* Make sure the input is a FITS image. */
+  if( gal_fits_file_recognized(filename)==0
+      || gal_fits_hdu_format(filename, hdu)!=IMAGE_HDU )
+    error(EXIT_FAILURE, 0, "%s (hdu: %s): is not a FITS image. When "
+          "more than one input is given, all the inputs should be FITS "
+          "images", filename, hdu);
+
+  /* Read the image and its WCS. */
+  in=gal_array_read_one_ch_to_type(filename, hdu, NULL, INPUT_USE_TYPE,
+                                   p->cp.minmapsize, p->cp.quietmmap);
+  in->wcs=gal_wcs_read(filename, hdu, p->cp.wcslinearmatrix, 0, 0,
+                       &in->nwcs);
+  in->ndim=gal_dimension_remove_extra(in->ndim, in->dsize, in->wcs);
+
+  /* Do the same checks as a single input, its dimensions should also be
+     the same as the kernel. */
+  ui_check_input(p, in, filename, 1);
+  if(in->ndim!=p->kernel->ndim)
+    error(EXIT_FAILURE, 0, "%s (hdu %s) has %zu dimensions, but the "
+          "kernel has %zu dimensions", filename, hdu, in->ndim,
+          p->kernel->ndim);
+  return in;
+}
+
+
+
+
+
+/* Read the next group of inputs: starting from 'bp->names', the inputs
+   are read until their total number of pixels reaches
+   'CONVOLVE_BATCH_GROUP_PIXELS' (or there are no more inputs). */
+static void *
+convolve_batch_read(void *inparam)
+{
+  struct batchioparams *bp=(struct batchioparams *)inparam;
+
+  size_t npix=0;
+  gal_list_str_t *name;
+  gal_data_t *in, *last=NULL;
+
+  bp->num=0;
+  bp->data=NULL;
+  for(name=bp->names; name!=NULL; name=name->next)
+    {
+      /* Read this input and add it to the end of the list. */
+      in=convolve_batch_read_one(bp->p, name->v);
+      if(last) last->next=in; else bp->data=in;
+      last=in;
+
+      /* See if the group is complete. */
+      ++bp->num;
+      npix+=in->size;
+      if(npix>=CONVOLVE_BATCH_GROUP_PIXELS) break;
+    }
+  return NULL;
+}
+
+
+
+
+
+/* Name of the output of the given input. When '--output' is given, it is
+   a directory (see 'ui_check_options_and_arguments'). */
+static char *
+convolve_batch_output_name(struct convolveparams *p, char *input)
+{
+  char *out, *base, *nosuffix, *suffix;
+  struct gal_options_common_params *cp=&p->cp;
+
+  /* When no output directory was given, use the automatic output. */
+  if(cp->output==NULL)
+    return gal_checkset_automatic_output(cp, input, "_convolved.fits");
+
+  /* Put the output into the given directory. */
+  base=gal_checkset_not_dir_part(input);
+  nosuffix=gal_checkset_suffix_separate(base, &suffix);
+  if( asprintf(&out, "%s%s_convolved.fits", cp->output, nosuffix)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  gal_checkset_writable_remove(out, input, cp->keep, cp->dontdelete);
+
+  /* Clean up and return. */
+  free(base);
+  free(suffix);
+  free(nosuffix);
+  return out;
+}
+
+
+
+
+
+/* Write the group of outputs in 'bp->data' (corresponding to the inputs
+   that start from 'bp->names') and free them. */
+static void *
+convolve_batch_write(void *inparam)
+{
+  struct batchioparams *bp=(struct batchioparams *)inparam;
+  struct convolveparams *p=bp->p;
+  struct gal_options_common_params *cp=&p->cp;
+
+  char *outname;
+  gal_data_t *out;
+  gal_list_str_t *name=bp->names;
+
+  while(bp->data)
+    {
+      /* Write the output. */
+      out=gal_list_data_pop(&bp->data);
+      outname=convolve_batch_output_name(p, name->v);
+      gal_fits_img_write_to_type(out, outname, NULL, PROGRAM_NAME,
+                                 cp->type);
+
+      /* Write the configuration keywords (they are freed after writing,
+         so they need to be re-built for every output). */
+      if(cp->okeys==NULL) gal_options_as_fits_keywords(cp);
+      gal_fits_key_write_filename("input", name->v, &cp->okeys, 1,
+                                  cp->quiet);
+      gal_fits_key_write_config(&cp->okeys, "Convolve configuration",
+                                "CONVOLVE-CONFIG", outname, "0");
+
+      /* Report the output if necessary. */
+      if(!cp->quiet) printf("  - Output: %s\n", outname);
+
+      /* Clean up and go onto the next. */
+      free(outname);
+      gal_data_free(out);
+      name=name->next;
+    }
+  return NULL;
+}
+
+
+
+
+
+/* Convolve all the inputs with the same kernel. The kernel's preparations
+   (its separable terms, or its Fourier transform for inputs with the same
+   size) are done once (see 'gal_convolve_batch'). The inputs are read and
+   convolved in groups and when CFITSIO is thread-safe, reading the next
+   group and writing the outputs of the previous group are done on
+   separate threads while the current group is being convolved. */
+static void
+convolve_batch(struct convolveparams *p)
+{
+  size_t i;
+  gal_data_t *outs;
+  pthread_t tread, twrite;
+  int threadio, doread, dowrite;
+  gal_convolve_batch_t cb=gal_convolve_batch_template();
+  struct batchioparams cur={0}, next={0}, towrite={0};
+
+  /* See if reading and writing can be done on separate threads (similar
+     to Crop's catalog mode, this is only possible when CFITSIO was
+     configured with '--enable-reentrant'). */
+#if GAL_CONFIG_HAVE_FITS_IS_REENTRANT == 1
+  threadio=fits_is_reentrant();
+#else
+  threadio=0;
+#endif
+
+  /* Prepare the kernel. Similar to 'convolve', the edges are always
+     corrected in one dimension. */
+  cb.kernel=p->kernel;
+  cb.numthreads=p->cp.numthreads;
+  cb.edgecorrection = p->kernel->ndim>1 ? !p->noedgecorrection : 1;
+  cb.septol=p->separable;
+  switch(p->domain)
+    {
+    case CONVOLVE_DOMAIN_SPATIAL:   cb.domain=GAL_CONVOLVE_DOMAIN_SPATIAL;
+      break;
+    case CONVOLVE_DOMAIN_FREQUENCY: cb.domain=GAL_CONVOLVE_DOMAIN_FREQUENCY;
+      break;
+    default:                        cb.domain=GAL_CONVOLVE_DOMAIN_INVALID;
+    }
+  gal_convolve_batch_init(&cb);
+
+  /* Read the first group of inputs. */
+  cur.p=next.p=towrite.p=p;
+  cur.names=p->inputs;
+  convolve_batch_read(&cur);
+
+  /* In each step, the current group is convolved while the next group is
+     read and the outputs of the previous group are written. */
+  while(cur.data || towrite.data)
+    {
+      /* The next group starts after the current group. */
+      next.num=0;
+      next.data=NULL;
+      next.names=cur.names;
+      for(i=0;i<cur.num;++i) next.names=next.names->next;
+      doread  = cur.data && next.names;
+      dowrite = towrite.data!=NULL;
+
+      /* Start reading and writing. */
+      if(threadio)
+        {
+          if(doread && pthread_create(&tread, NULL, convolve_batch_read,
+                                      &next))
+            error(EXIT_FAILURE, 0, "%s: can't create reading thread",
+                  __func__);
+          if(dowrite && pthread_create(&twrite, NULL, convolve_batch_write,
+                                       &towrite))
+            error(EXIT_FAILURE, 0, "%s: can't create writing thread",
+                  __func__);
+        }
+
+      /* Convolve the current group. */
+      outs=NULL;
+      if(cur.data)
+        {
+          outs=gal_convolve_batch(&cb, cur.data);
+          gal_list_data_free(cur.data);
+        }
+
+      /* Wait for the reading and writing to finish (or do them here if
+         they can't be done on separate threads). */
+      if(threadio)
+        {
+          if(doread)  pthread_join(tread, NULL);
+          if(dowrite) pthread_join(twrite, NULL);
+        }
+      else
+        {
+          if(dowrite) convolve_batch_write(&towrite);
+          if(doread)  convolve_batch_read(&next);
+        }
+
+      /* Go onto the next step. */
+      towrite.data=outs;
+      towrite.names=cur.names;
+      cur=next;
+    }
+
+  /* Clean up. */
+  gal_convolve_batch_free(&cb);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /******************************************************************/
 /*************          Outside function          *****************/
 /******************************************************************/
 void
 convolve(struct convolveparams *p)
 {
+  size_t d;
+  int multidim, onechannel=1;
   gal_data_t *out, *check;
-  int multidim=p->input->ndim>1;
   struct gal_options_common_params *cp=&p->cp;
 
 
+  /* When there are multiple inputs, convolve them in batch mode. */
+  if(p->numin>1) { convolve_batch(p); return; }
+  multidim=p->input->ndim>1;
+
+
+  /* When the domain should be found automatically, use the estimated
+     faster domain. The library's frequency domain convolution treats
+     blank values and edges like the spatial domain, but it can't respect
+     the channels. So when convolution shouldn't be done over the
+     channels, the spatial domain is used. */
+  if(p->domain==CONVOLVE_DOMAIN_AUTO)
+    {
+      if(multidim && cp->tl.workoverch==0)
+        for(d=0;d<p->input->ndim;++d)
+          if(cp->tl.numchannels[d]>1) onechannel=0;
+      if( onechannel
+          && ( gal_convolve_domain_auto(p->input, p->kernel)
+               == GAL_CONVOLVE_DOMAIN_FREQUENCY ) )
+        {
+          out=gal_convolve_frequency(p->input, p->kernel, cp->numthreads,
+                                     multidim ? !p->noedgecorrection : 1);
+          gal_data_free(p->input);
+          p->input=out;
+        }
+      else p->domain=CONVOLVE_DOMAIN_SPATIAL;
+      if(!cp->quiet)
+        printf("  - Domain (automatically chosen): %s\n",
+               p->domain==CONVOLVE_DOMAIN_SPATIAL ? "spatial" : "frequency");
+    }
+
+
   /* Do the convolution. */
   if(p->domain==CONVOLVE_DOMAIN_SPATIAL)
     {
@@ -797,10 +1265,19 @@ convolve(struct convolveparams *p)
          want to do spatial domain convolution with this Convolve program
          is edge correction. So by default we assume it and will only
          ignore it if the user asks.*/
-      out=gal_convolve_spatial(multidim ? cp->tl.tiles : p->input, p->kernel,
-                               cp->numthreads,
-                               multidim ? !p->noedgecorrection : 1,
-                               multidim ? cp->tl.workoverch : 1 );
+      out = ( isnan(p->separable)
+              ? gal_convolve_spatial(multidim ? cp->tl.tiles : p->input,
+                                     p->kernel, cp->numthreads,
+                                     multidim ? !p->noedgecorrection : 1,
+                                     multidim ? cp->tl.workoverch : 1 )
+              : gal_convolve_spatial_separable(multidim
+                                               ? cp->tl.tiles : p->input,
+                                               p->kernel, cp->numthreads,
+                                               multidim
+                                               ? !p->noedgecorrection : 1,
+                                               multidim
+                                               ? cp->tl.workoverch : 1,
+                                               p->separable) );
 
       /* Clean up: free the actual input and replace it's pointer with the
          convolved dataset to save as output. */
@@ -808,7 +1285,7 @@ convolve(struct convolveparams *p)
       gal_data_free(p->input);
       p->input=out;
     }
-  else
+  else if(p->domain==CONVOLVE_DOMAIN_FREQUENCY)
     convolve_frequency(p);
 
   /* Save the output (which is in p->input) array. */
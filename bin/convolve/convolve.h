@@ -32,7 +32,7 @@ struct fftonthreadparams
   size_t                id; /* The number of this thread.               */
   struct convolveparams *p; /* Pointer to main program structure.       */
   int   forward1backwardn1; /* Operate on one or two images.            */
-  size_t            stride; /* 1D FFT on rows or columns?               */
+  int           transposed; /* Rows of the transposed arrays?           */
 
   /* Pointers to GSL FFT structures: */
   gsl_fft_complex_wavetable *ps0wave;
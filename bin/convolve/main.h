@@ -41,6 +41,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define CONVFLOATINGPOINTERR 1e-10
 #define INPUT_USE_TYPE       GAL_TYPE_FLOAT32
 
+/* In batch mode (multiple inputs), the inputs are read in groups that
+   have (at least) this many pixels in total, see 'convolve_batch'. */
+#define CONVOLVE_BATCH_GROUP_PIXELS 10000000
+
 
 
 
@@ -60,6 +64,7 @@ enum domain_codes
 
   CONVOLVE_DOMAIN_SPATIAL,
   CONVOLVE_DOMAIN_FREQUENCY,
+  CONVOLVE_DOMAIN_AUTO,
 };
 
 
@@ -72,6 +77,8 @@ struct convolveparams
   /* From command-line */
   struct gal_options_common_params cp; /* Common parameters.              */
   char             *filename;  /* Name of input file.                     */
+  gal_list_str_t     *inputs;  /* All input files (in batch mode).        */
+  size_t               numin;  /* Number of input files.                  */
   char               *column;  /* Name of column if input is a table.     */
   char           *kernelname;  /* File name of kernel.                    */
   char                 *khdu;  /* HDU of kernel.                          */
@@ -83,6 +90,7 @@ struct convolveparams
   char            *domainstr;  /* String value specifying domain.         */
   size_t          makekernel;  /* Make a kernel to create input.          */
   uint8_t   noedgecorrection;  /* Do not correct spatial edge effects.    */
+  double           separable;  /* Tolerance of separable kernel terms.    */
 
   /* Internal */
   int                 isfits;  /* Input is a FITS file.                   */
@@ -92,6 +100,7 @@ struct convolveparams
   gal_data_t         *kernel;  /* Input Kernel array.                     */
   double               *pimg;  /* Padded image array.                     */
   double               *pker;  /* Padded kernel array.                    */
+  double              *pwork;  /* Work array for transposing the above.   */
   double               *rpad;  /* Real final image before removing pad'd. */
   size_t                 ps0;  /* Padded size along first C axis.         */
   size_t                 ps1;  /* Padded size along second C axis.        */
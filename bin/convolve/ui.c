@@ -22,6 +22,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <argp.h>
 #include <errno.h>
 #include <error.h>
@@ -65,7 +66,7 @@ const char *
 argp_program_bug_address = PACKAGE_BUGREPORT;
 
 static char
-args_doc[] = "ASTRdata";
+args_doc[] = "ASTRdata ...";
 
 const char
 doc[] = GAL_STRINGS_TOP_HELP_INFO PROGRAM_NAME" will convolve an input "
@@ -118,6 +119,9 @@ ui_initialize_options(struct convolveparams *p,
   cp->numthreads         = gal_threads_number();
   cp->coptions           = gal_commonopts_options;
 
+  /* Program specific initializations. */
+  p->separable           = NAN;
+
   /* Set the mandatory common options. */
   for(i=0; !gal_options_is_last(&cp->coptions[i]); ++i)
     switch(cp->coptions[i].key)
@@ -170,10 +174,12 @@ parse_opt(int key, char *arg, struct argp_state *state)
       /* The user may give a shell variable that is empty! In that case
          'arg' will be an empty string! We don't want to account for such
          cases (and give a clear error that no input has been given). */
-      if(p->filename)
-        argp_error(state, "only one argument (input file) should be given");
-      else
-        if(arg[0]!='\0') p->filename=arg;
+      if(arg[0]!='\0')
+        {
+          gal_list_str_add(&p->inputs, arg, 0);
+          if(p->filename==NULL) p->filename=arg;
+          ++p->numin;
+        }
       break;
 
 
@@ -218,14 +224,17 @@ ui_read_check_only_options(struct convolveparams *p)
     p->domain=CONVOLVE_DOMAIN_SPATIAL;
   else if( !strcmp("frequency", p->domainstr) )
     p->domain=CONVOLVE_DOMAIN_FREQUENCY;
+  else if( !strcmp("auto", p->domainstr) )
+    p->domain = p->makekernel ? CONVOLVE_DOMAIN_FREQUENCY
+                              : CONVOLVE_DOMAIN_AUTO;
   else
     error(EXIT_FAILURE, 0, "domain value '%s' not recognized. Please use "
-          "either 'spatial' or 'frequency'", p->domainstr);
+          "either 'spatial', 'frequency' or 'auto'", p->domainstr);
 
 
-  /* If we are in the spatial domain, make sure that the necessary
-     parameters are set. */
-  if( p->domain==CONVOLVE_DOMAIN_SPATIAL )
+  /* If we are in the spatial domain (or it may be chosen automatically),
+     make sure that the necessary parameters are set. */
+  if( p->domain==CONVOLVE_DOMAIN_SPATIAL || p->domain==CONVOLVE_DOMAIN_AUTO )
     if( cp->tl.tilesize==NULL || cp->tl.numchannels==NULL )
       {
         if( cp->tl.tilesize==NULL && cp->tl.numchannels==NULL )
@@ -250,6 +259,26 @@ static void
 ui_check_options_and_arguments(struct convolveparams *p)
 {
   int kernel_type;
+  struct gal_options_common_params *cp=&p->cp;
+
+  /* The inputs were added to the list in reverse order. */
+  gal_list_str_reverse(&p->inputs);
+
+  /* Batch mode: when more than one input is given, all the inputs are
+     convolved with the same kernel and each output is written in a
+     separate file (so '--output' can only be a directory). */
+  if(p->numin>1)
+    {
+      if(p->makekernel || p->checkfreqsteps || p->column
+         || cp->tl.checktiles)
+        error(EXIT_FAILURE, 0, "with more than one input, the '--%s' "
+              "option cannot be used",
+              ( p->makekernel ? "makekernel"
+                : ( p->checkfreqsteps ? "checkfreqsteps"
+                    : ( p->column ? "column" : "checktiles" ) ) ) );
+      if(cp->output)
+        gal_checkset_check_dir_write_add_slash(&cp->output);
+    }
 
   if(p->filename)
     {
@@ -471,7 +500,7 @@ ui_read_kernel(struct convolveparams *p)
 {
   /* Read the image into file. */
   if( p->kernelname
-      && p->input->ndim>1
+      && (p->input==NULL || p->input->ndim>1)
       && gal_array_name_recognized(p->kernelname)  )
     {
       p->kernel = gal_array_read_one_ch_to_type(p->kernelname, p->khdu,
@@ -486,8 +515,8 @@ ui_read_kernel(struct convolveparams *p)
     p->kernel=ui_read_column(p, 1);
 
   /* Make sure that the kernel and input have the same number of
-     dimensions. */
-  if(p->kernel->ndim!=p->input->ndim)
+     dimensions (in batch mode, this is checked for each input). */
+  if(p->input && p->kernel->ndim!=p->input->ndim)
     error(EXIT_FAILURE, 0, "input datasets must have the same number of "
           "dimensions");
 }
@@ -496,41 +525,38 @@ ui_read_kernel(struct convolveparams *p)
 
 
 
-static void
-ui_preparations(struct convolveparams *p)
+/* Check an input dataset (that has already been read from 'filename').
+   This is also used on each input of the batch mode (when 'batch' is
+   non-zero, see 'convolve_batch'). In batch mode, each input is
+   convolved as one full dataset (not tiles) and the frequency domain
+   convolution is done with 'gal_convolve_frequency' (that treats blank
+   pixels like the spatial domain), so the tile checks and the warning on
+   blank pixels are not necessary. */
+void
+ui_check_input(struct convolveparams *p, gal_data_t *input, char *filename,
+               int batch)
 {
-  int check=0;
-  double sumv=0;
-  size_t i, size;
-  gal_data_t *sum;
-  float *f, *fp, tmp, *kernel;
   struct gal_options_common_params *cp=&p->cp;
-  char *outsuffix = p->makekernel ? "_kernel.fits" : "_convolved.fits";
-
-
-  /* Read the input dataset. */
-  ui_read_input(p);
-
 
   /* Currently Convolve only works on 1D, 2D and 3D datasets. */
-  if(p->input->ndim>3)
+  if(input->ndim>3)
     error(EXIT_FAILURE, 0, "%s (hdu %s) has %zu dimensions. Currently "
           "Convolve only operates on 1D (table column, spectrum), 2D "
-          "(image), and 3D (data cube) datasets", p->filename, cp->hdu,
-          p->input->ndim);
+          "(image), and 3D (data cube) datasets", filename, cp->hdu,
+          input->ndim);
 
 
   /* Domain-specific checks. */
   if(p->domain==CONVOLVE_DOMAIN_FREQUENCY)
     {
       /* Check the dimensionality. */
-      if(p->input->ndim!=2)
+      if(input->ndim!=2)
         error(EXIT_FAILURE, 0, "%s (hdu %s) has %zu dimensions. Frequency "
               "domain convolution currently only operates on 2D images",
-              p->filename, cp->hdu, p->input->ndim);
+              filename, cp->hdu, input->ndim);
 
       /* Blank values. */
-      if( gal_blank_present(p->input, 1) )
+      if( batch==0 && gal_blank_present(input, 1) )
         fprintf(stderr, "\n----------------------------------------\n"
                 "######## %s WARNING ########\n"
                 "There are blank pixels in '%s' (hdu: '%s') and you have "
@@ -540,20 +566,50 @@ ui_preparations(struct convolveparams *p)
                 "in the input data. You can run %s again with "
                 "'--domain=spatial'\n"
                 "----------------------------------------\n\n",
-                PROGRAM_NAME, p->filename, cp->hdu, cp->output,
+                PROGRAM_NAME, filename, cp->hdu, cp->output,
                 PROGRAM_NAME);
-
-      /* Frequency domain is only implemented in 2D. */
-      if( p->input->ndim==1 )
-        error(EXIT_FAILURE, 0, "Frequency domain convolution is currently "
-              "not implemented on 1D datasets. Please use '--domain=spatial' "
-              "to convolve this dataset");
     }
   else
     {
-      if(p->input->ndim>1)
-        gal_tile_full_sanity_check(p->filename, cp->hdu, p->input, &cp->tl);
+      if(batch==0 && input->ndim>1)
+        gal_tile_full_sanity_check(filename, cp->hdu, input, &cp->tl);
     }
+}
+
+
+
+
+
+/* Read the input dataset and check it. */
+static void
+ui_read_check_input(struct convolveparams *p)
+{
+  /* Read the input dataset. */
+  ui_read_input(p);
+
+  /* Check it. */
+  ui_check_input(p, p->input, p->filename, 0);
+}
+
+
+
+
+
+static void
+ui_preparations(struct convolveparams *p)
+{
+  int check=0;
+  double sumv=0;
+  size_t i, size;
+  gal_data_t *sum;
+  float *f, *fp, tmp, *kernel;
+  struct gal_options_common_params *cp=&p->cp;
+  char *outsuffix = p->makekernel ? "_kernel.fits" : "_convolved.fits";
+
+
+  /* Read the input dataset (in batch mode, the inputs are read while
+     the convolution is being done, see 'convolve_batch'). */
+  if(p->numin<2) ui_read_check_input(p);
 
 
   /* Read the file specified by --kernel. If makekernel is specified, then
@@ -654,7 +710,9 @@ ui_preparations(struct convolveparams *p)
     }
 
 
-  /* Set the output name if the user hasn't set it. */
+  /* Set the output name if the user hasn't set it (in batch mode, the
+     output names are set when each output is written). */
+  if(p->numin>1) return;
   if(cp->output==NULL)
     cp->output=gal_checkset_automatic_output(cp, p->filename, outsuffix);
   gal_checkset_writable_remove(cp->output, p->filename, 0, cp->dontdelete);
@@ -700,8 +758,11 @@ ui_print_intro(struct convolveparams *p)
 {
   printf("%s started on %s", PROGRAM_NAME, ctime(&p->rawtime));
   printf("  - Using %zu CPU threads.\n", p->cp.numthreads);
-  printf("  - Input: %s\n",
-         gal_checkset_dataset_name(p->filename, p->cp.hdu));
+  if(p->numin>1)
+    printf("  - Inputs: %zu files (hdu: %s)\n", p->numin, p->cp.hdu);
+  else
+    printf("  - Input: %s\n",
+           gal_checkset_dataset_name(p->filename, p->cp.hdu));
   printf("  - Kernel: %s\n",
          gal_checkset_dataset_name(p->kernelname, p->khdu));
 }
@@ -801,6 +862,7 @@ ui_free_report(struct convolveparams *p, struct timeval *t1)
   free(p->cp.output);
   gal_data_free(p->input);
   gal_data_free(p->kernel);
+  gal_list_str_free(p->inputs, 0);
 
   /* Print the final message. */
   if(!p->cp.quiet)
@@ -65,12 +65,17 @@ enum option_keys_enum
   UI_KEY_NOKERNELFLIP,
   UI_KEY_NOKERNELNORM,
   UI_KEY_NOEDGECORRECTION,
+  UI_KEY_SEPARABLE,
 };
 
 
 
 
 
+void
+ui_check_input(struct convolveparams *p, gal_data_t *input, char *filename,
+               int batch);
+
 void
 ui_read_check_inputs_setup(int argc, char *argv[], struct convolveparams *p);
 
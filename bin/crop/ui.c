@@ -963,7 +963,7 @@ ui_preparations_to_img_mode_values(struct cropparams *p)
                                 NULL, NULL, NULL);
 
       /* Convert the world coordinates to image coordinates. */
-      gal_wcs_world_to_img(coords, wcs, 1);
+      gal_wcs_world_to_img_parallel(coords, wcs, 1, p->cp.numthreads);
 
       /* Clean up: we want the 'array' elements, so we'll set them to
          NULL first, then clean up the list. */
@@ -161,7 +161,7 @@ struct argp_option program_options[] =
       UI_KEY_KDTREE,
       "STR",
       0,
-      "build, internal, disable, CUSTOM-FITS-FILE.",
+      "build, internal, disable, FITS or index file.",
       UI_GROUP_CATALOGMATCH,
       &p->kdtree,
       GAL_TYPE_STRING,
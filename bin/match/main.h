@@ -25,6 +25,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Include necessary headers */
 #include <gnuastro/data.h>
+#include <gnuastro/kdtree.h>
 
 #include <gnuastro-internal/options.h>
 
@@ -51,6 +52,7 @@ enum kdtree_modes
   MATCH_KDTREE_INTERNAL,
   MATCH_KDTREE_DISABLE,
   MATCH_KDTREE_FILE,
+  MATCH_KDTREE_INDEX,
 };
 
 
@@ -88,6 +90,7 @@ struct matchparams
   int              kdtreemode;  /* The k-d tree mode.                   */
   gal_data_t      *kdtreedata;  /* The k-d tree data.                   */
   size_t           kdtreeroot;  /* The root node of the k-d tree.       */
+  gal_kdtree_t   *kdtreeindex;  /* k-d tree from an index file.         */
 
   /* Output: */
   time_t              rawtime;  /* Starting time of the program.        */
@@ -555,6 +555,39 @@ match_catalog_write_one_col(struct matchparams *p, gal_data_t *a,
 
 
 
+/* Build the k-d tree and write it as an index file (that can be used
+   directly without reading the first input's coordinates). */
+static void
+match_catalog_kdtree_build_index(struct matchparams *p)
+{
+  char *msg;
+  struct timeval t1;
+  gal_kdtree_t *tree;
+
+  /* Construct the k-d tree. */
+  if(!p->cp.quiet) gettimeofday(&t1, NULL);
+  tree=gal_kdtree_build(p->cols1, p->cp.numthreads, p->cp.minmapsize,
+                        p->cp.quietmmap);
+  if(!p->cp.quiet)
+    {
+      if( asprintf(&msg, "k-d tree constructed (%zu rows).",
+                   p->cols1->size)<0 )
+        error(EXIT_FAILURE, errno, "asprintf allocation");
+      gal_timing_report(&t1, msg, 1);
+      free(msg);
+    }
+
+  /* Write the index and let the user know. */
+  gal_kdtree_save(tree, p->out1name);
+  gal_kdtree_free(tree);
+  if(!p->cp.quiet)
+    fprintf(stdout, "  - Output (k-d tree index): %s\n", p->out1name);
+}
+
+
+
+
+
 static void
 match_catalog_kdtree_build(struct matchparams *p)
 {
@@ -568,10 +601,14 @@ match_catalog_kdtree_build(struct matchparams *p)
   char *unit = "index";
   char *comment = "k-d tree root index (counting from 0).";
 
+  /* If the output is an index file, build it separately. */
+  if( gal_kdtree_name_is_index(p->out1name) )
+    { match_catalog_kdtree_build_index(p); return; }
+
   /* Construct a k-d tree from 'p->cols1': the index of root is stored in
      'root'. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  kdtree = gal_kdtree_create(p->cols1, &root);
+  kdtree = gal_kdtree_create_parallel(p->cols1, p->cp.numthreads, &root);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "k-d tree constructed (%zu rows).",
@@ -620,15 +657,19 @@ match_catalog_kdtree(struct matchparams *p, size_t *nummatched)
 
     /* Do the k-d tree matching. */
     case MATCH_KDTREE_FILE:
+    case MATCH_KDTREE_INDEX:
     case MATCH_KDTREE_INTERNAL:
 
       /* If the k-d tree should be constructed internally, build it,
-         otherwise, we have already read an checked the k-d tree in 'ui.c',
-         so go directly to the matching. */
+         otherwise, we have already read an checked the k-d tree (or
+         mapped its index file) in 'ui.c', so go directly to the
+         matching. */
       if(p->kdtreemode==MATCH_KDTREE_INTERNAL)
         {
           if(!p->cp.quiet) gettimeofday(&t1, NULL);
-          p->kdtreedata = gal_kdtree_create(p->cols1, &p->kdtreeroot);
+          p->kdtreedata = gal_kdtree_create_parallel(p->cols1,
+                                                     p->cp.numthreads,
+                                                     &p->kdtreeroot);
           if(!p->cp.quiet)
             gal_timing_report(&t1, "Internal k-d tree constructed.", 1);
         }
@@ -639,10 +680,16 @@ match_catalog_kdtree(struct matchparams *p, size_t *nummatched)
           gettimeofday(&t1, NULL);
           printf("  - Match using the k-d tree ...\n");
         }
-      out = gal_match_kdtree(p->cols1, p->cols2, p->kdtreedata,
-                             p->kdtreeroot, p->aperture->array,
-                             p->cp.numthreads, p->cp.minmapsize,
-                             p->cp.quietmmap, nummatched);
+      out = ( p->kdtreemode==MATCH_KDTREE_INDEX
+              ? gal_match_kdtree_prebuilt(p->kdtreeindex, p->cols2,
+                                          p->aperture->array,
+                                          p->cp.numthreads,
+                                          p->cp.minmapsize,
+                                          p->cp.quietmmap, nummatched)
+              : gal_match_kdtree(p->cols1, p->cols2, p->kdtreedata,
+                                 p->kdtreeroot, p->aperture->array,
+                                 p->cp.numthreads, p->cp.minmapsize,
+                                 p->cp.quietmmap, nummatched) );
       if(!p->cp.quiet)
         {
           if( asprintf(&msg, "... %zu matches found, done!",
@@ -652,6 +699,8 @@ match_catalog_kdtree(struct matchparams *p, size_t *nummatched)
           free(msg);
         }
       gal_list_data_free(p->kdtreedata);
+      gal_kdtree_free(p->kdtreeindex);
+      p->kdtreeindex=NULL;
       break;
 
     /* Abort if the mode isn't recognized (its a bug!). */
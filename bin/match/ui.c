@@ -226,13 +226,16 @@ ui_read_check_only_options(struct matchparams *p)
     else if( !strcmp(p->kdtree,"internal") ) p->kdtreemode=MATCH_KDTREE_INTERNAL;
     else if( !strcmp(p->kdtree,"disable")  ) p->kdtreemode=MATCH_KDTREE_DISABLE;
     else if( gal_fits_name_is_fits(p->kdtree) ) p->kdtreemode=MATCH_KDTREE_FILE;
+    else if( gal_kdtree_name_is_index(p->kdtree) )
+      p->kdtreemode=MATCH_KDTREE_INDEX;
     else
       error(EXIT_FAILURE, 0, "'%s' is not valid for '--kdtree'. The "
             "following values are accepted: 'build' (to build the k-d tree in "
             "the file given to '--output'), 'internal' (to force internal "
             "usage of a k-d tree for the matching), 'disable' (to not use a "
-            "k-d tree at all), a FITS file name (the file to read a created "
-            "k-d tree from)", p->kdtree);
+            "k-d tree at all), a FITS file name or a k-d tree index file "
+            "name (ending in '.%s'; the file to read a created k-d tree "
+            "from)", p->kdtree, GAL_KDTREE_INDEX_SUFFIX);
 
     /* Make sure that the k-d tree build mode is not called with
        '--outcols'. */
@@ -624,8 +627,17 @@ ui_set_columns_sanity_check_read_aperture(struct matchparams *p)
 {
   size_t ccol1n=0, ccol2n=0;
 
-  /* Make sure the columns to match are given. */
-  if(p->coord || p->kdtreemode==MATCH_KDTREE_BUILD)
+  /* Make sure the columns to match are given. With a k-d tree index, the
+     coordinates of the first input are within the index (so '--ccol1'
+     isn't necessary). */
+  if(p->kdtreemode==MATCH_KDTREE_INDEX)
+    {
+      if(p->coord==NULL && p->ccol2==NULL)
+        error(EXIT_FAILURE, 0, "no value given to '--ccol2' (necessary "
+              "with a k-d tree index file, to specify the columns of the "
+              "second input to match)");
+    }
+  else if(p->coord || p->kdtreemode==MATCH_KDTREE_BUILD)
     {
       if(p->ccol1==NULL)
         error(EXIT_FAILURE, 0, "no value given to '--ccol1' (necessary "
@@ -642,13 +654,16 @@ ui_set_columns_sanity_check_read_aperture(struct matchparams *p)
   /* Make sure the same number of columns is given to both. Note that a
      second catalog is only necessary when we aren't building a k-d
      tree. */
-  ccol1n = p->ccol1->size;
+  ccol1n = ( p->kdtreemode==MATCH_KDTREE_INDEX
+             ? p->kdtreeindex->ndim
+             : p->ccol1->size );
   if( p->kdtreemode!=MATCH_KDTREE_BUILD )
     {
       ccol2n = p->coord ? p->coord->size : p->ccol2->size;
       if(ccol1n!=ccol2n)
         error(EXIT_FAILURE, 0, "number of coordinates given to '--ccol1' "
-              "(%zu) and '--%s' (%zu) must be equal.\n\n"
+              "(or in the k-d tree index; %zu) and '--%s' (%zu) must be "
+              "equal.\n\n"
               "If you didn't call these options, run with '--checkconfig' "
               "to see which configuration file is responsible. You can "
               "always override the configuration file values by calling "
@@ -849,6 +864,42 @@ ui_read_kdtree(struct matchparams *p)
 
 
 
+/* Map the k-d tree index file into memory and make sure it has the same
+   number of rows as the first input (only the table's meta-data are read
+   for this check). */
+static void
+ui_read_kdtree_index(struct matchparams *p)
+{
+  int tableformat;
+  gal_data_t *colinfo;
+  size_t numcols, numrows;
+
+  /* Map the index. */
+  p->kdtreeindex=gal_kdtree_load(p->kdtree);
+
+  /* Find the number of rows in the first input. */
+  if(p->stdinlines==NULL)
+    p->stdinlines=gal_options_check_stdin(p->input1name,
+                                          p->cp.stdintimeout, "input");
+  colinfo=gal_table_info(p->input1name, p->cp.hdu,
+                         p->input1name ? NULL : p->stdinlines, &numcols,
+                         &numrows, &tableformat);
+  gal_data_array_free(colinfo, numcols, 1);
+
+  /* Make sure the index corresponds to the first input. */
+  if(numrows!=p->kdtreeindex->size)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree index (given to '--kdtree') "
+          "has %zu rows, but the first input (%s) has %zu rows. The index "
+          "should be built from the first input with '--kdtree=build "
+          "--output=INDEX.%s'", p->kdtree, p->kdtreeindex->size,
+          gal_fits_name_save_as_string(p->input1name, p->cp.hdu), numrows,
+          GAL_KDTREE_INDEX_SUFFIX);
+}
+
+
+
+
+
 /* Read catalog columns */
 static void
 ui_read_columns(struct matchparams *p)
@@ -857,26 +908,34 @@ ui_read_columns(struct matchparams *p)
   char **strarr1, **strarr2;
   gal_list_str_t *cols1=NULL, *cols2=NULL;
 
+  /* With a k-d tree index file, the coordinates of the first input are
+     within the index, so they aren't read. */
+  if( p->kdtreemode==MATCH_KDTREE_INDEX )
+    ui_read_kdtree_index(p);
+
   /* Basic sanity checks and reading of aperture values. */
   ndim=ui_set_columns_sanity_check_read_aperture(p);
 
   /* Convert the array of strings to a list of strings for the column
      names. */
-  strarr1 = p->ccol1->array;
+  strarr1 = ( p->kdtreemode==MATCH_KDTREE_INDEX
+              ? NULL
+              : p->ccol1->array );
   strarr2 = ( (p->coord || p->kdtreemode==MATCH_KDTREE_BUILD)
               ? NULL
               : p->ccol2->array );
   for(i=0;i<ndim;++i)
     {
-      gal_list_str_add(&cols1, strarr1[i], 1);
+      if(strarr1) gal_list_str_add(&cols1, strarr1[i], 1);
       if(strarr2) gal_list_str_add(&cols2, strarr2[i], 1);
     }
-  gal_list_str_reverse(&cols1);
+  if(cols1) gal_list_str_reverse(&cols1);
   if(cols2) gal_list_str_reverse(&cols2);
 
   /* Read-in the columns. */
-  p->cols1=ui_read_columns_to_double(p, p->input1name, p->cp.hdu,
-                                     cols1, ndim);
+  if(cols1)
+    p->cols1=ui_read_columns_to_double(p, p->input1name, p->cp.hdu,
+                                       cols1, ndim);
   if( p->kdtreemode!=MATCH_KDTREE_BUILD )
     p->cols2=( p->coord
                ? ui_set_columns_from_coord(p)
@@ -894,7 +953,8 @@ ui_read_columns(struct matchparams *p)
   if( !p->cp.quiet
       && p->kdtreemode!=MATCH_KDTREE_BUILD
       && p->kdtreemode!=MATCH_KDTREE_DISABLE
-      && p->cols1->size > (2*p->cols2->size) )
+      && ( p->cols1 ? p->cols1->size : p->kdtreeindex->size )
+         > (2*p->cols2->size) )
     error(EXIT_SUCCESS, 0, "TIP: the matching speed will GREATLY IMPROVE "
           "if you swap the two inputs. Currently the second input has "
           "fewer rows than the first. In the k-d tree based matching, "
@@ -1237,10 +1297,12 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct matchparams *p)
              p->kdtree ? "k-d tree" : "sort-based");
       printf("  - Input-1: %s; %zu rows\n",
              gal_fits_name_save_as_string(p->input1name, p->cp.hdu),
-             p->cols1->size);
+             p->cols1 ? p->cols1->size : p->kdtreeindex->size);
       if(p->kdtreemode==MATCH_KDTREE_FILE)
         printf("  - Input-1 k-d tree: %s\n",
                gal_fits_name_save_as_string(p->kdtree, p->kdtreehdu));
+      if(p->kdtreemode==MATCH_KDTREE_INDEX)
+        printf("  - Input-1 k-d tree index: %s\n", p->kdtree);
       if(p->kdtreemode!=MATCH_KDTREE_BUILD)
         printf("  - Input-2: %s; %zu rows\n",
                p->coord ? "from --coord"
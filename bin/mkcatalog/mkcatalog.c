@@ -307,33 +307,35 @@ mkcatalog_wcs_conversion(struct mkcatalogparams *p)
 {
   gal_data_t *c;
   gal_data_t *column;
+  size_t nt=p->cp.numthreads;
+  struct wcsprm *wcs=p->objects->wcs;
 
   /* Flux weighted center positions for clumps and objects. */
   if(p->wcs_vo)
     {
-      gal_wcs_img_to_world(p->wcs_vo, p->objects->wcs, 1);
+      gal_wcs_img_to_world_parallel(p->wcs_vo, wcs, 1, nt);
       if(p->wcs_vc)
-        gal_wcs_img_to_world(p->wcs_vc, p->objects->wcs, 1);
+        gal_wcs_img_to_world_parallel(p->wcs_vc, wcs, 1, nt);
     }
 
 
   /* Geometric center positions for clumps and objects. */
   if(p->wcs_go)
     {
-      gal_wcs_img_to_world(p->wcs_go, p->objects->wcs, 1);
+      gal_wcs_img_to_world_parallel(p->wcs_go, wcs, 1, nt);
       if(p->wcs_gc)
-        gal_wcs_img_to_world(p->wcs_gc, p->objects->wcs, 1);
+        gal_wcs_img_to_world_parallel(p->wcs_gc, wcs, 1, nt);
     }
 
 
   /* All clumps flux weighted center. */
   if(p->wcs_vcc)
-    gal_wcs_img_to_world(p->wcs_vcc, p->objects->wcs, 1);
+    gal_wcs_img_to_world_parallel(p->wcs_vcc, wcs, 1, nt);
 
 
   /* All clumps geometric center. */
   if(p->wcs_gcc)
-    gal_wcs_img_to_world(p->wcs_gcc, p->objects->wcs, 1);
+    gal_wcs_img_to_world_parallel(p->wcs_gcc, wcs, 1, nt);
 
 
   /* Go over all the object columns and fill in the values. */
@@ -367,8 +367,10 @@ oneprofile_pix_by_pix(struct mkonthread *mkp)
   double truncr=mkp->truncr, approx, hp=0.5f/mkp->p->oversample;
   size_t i, p, *dinc=gal_dimension_increment(ndim, dsize);
 
-  /* lQ: Largest. sQ: Smallest in queue */
-  gal_list_dosizet_t *lQ=NULL, *sQ;
+  /* lQ: Largest. sQ: Smallest in queue. The nodes of both lists are
+     taken from the arena (the 'size_t' nodes are smaller). */
+  gal_list_dosizet_t *lQ=NULL, *sQ, *tmp;
+  gal_list_arena_t *arena;
 
   /* Find the nearest pixel to the profile center and add it to the
      queue. */
@@ -387,7 +389,9 @@ oneprofile_pix_by_pix(struct mkonthread *mkp)
 
   /* Start the queue: */
   byt[p]=1;
-  gal_list_dosizet_add( &lQ, &sQ, p, oneprofile_r_circle(p, mkp) );
+  arena=gal_list_arena_alloc(sizeof *lQ, 0);
+  gal_list_dosizet_add_arena( &lQ, &sQ, p, oneprofile_r_circle(p, mkp),
+                              arena );
 
   /* If random points are necessary, then do it: */
   switch(mkp->func)
@@ -406,7 +410,7 @@ oneprofile_pix_by_pix(struct mkonthread *mkp)
              and use them to estimate the elliptical radius of the
              pixel. If the pixel is outside the truncation radius, ignore
              it. */
-          p=gal_list_dosizet_pop_smallest(&lQ, &sQ, &circ_r);
+          p=gal_list_dosizet_pop_smallest_arena(&lQ, &sQ, &circ_r, arena);
           oneprofile_set_coord(mkp, p);
           oneprofile_r_el(mkp);
           if(mkp->r > truncr) continue;
@@ -444,8 +448,9 @@ oneprofile_pix_by_pix(struct mkonthread *mkp)
               if(byt[nind]==0)
                 {
                   byt[nind]=1;
-                  gal_list_dosizet_add( &lQ, &sQ, nind,
-                                        oneprofile_r_circle(nind, mkp) );
+                  gal_list_dosizet_add_arena( &lQ, &sQ, nind,
+                                              oneprofile_r_circle(nind, mkp),
+                                              arena );
                 }
             } );
 
@@ -455,14 +460,21 @@ oneprofile_pix_by_pix(struct mkonthread *mkp)
 
 
   /* All the pixels that required integration or random points are now
-     done, so we don't need an ordered array any more. */
-  gal_list_dosizet_to_sizet(lQ, &Q);
+     done, so we don't need an ordered array any more (similar to
+     'gal_list_dosizet_to_sizet', but the nodes go back to the arena). */
+  while(lQ)
+    {
+      tmp=lQ->next;
+      gal_list_sizet_add_arena(&Q, lQ->v, arena);
+      gal_list_arena_return(arena, lQ);
+      lQ=tmp;
+    }
 
 
   /* Order doesn't matter any more, add all the pixels you find. */
   while(Q)
     {
-      p=gal_list_sizet_pop(&Q);
+      p=gal_list_sizet_pop_arena(&Q, arena);
       oneprofile_set_coord(mkp, p);
       oneprofile_r_el(mkp);
 
@@ -495,12 +507,13 @@ oneprofile_pix_by_pix(struct mkonthread *mkp)
           if(byt[nind]==0)
             {
               byt[nind]=1;
-              gal_list_sizet_add(&Q, nind);
+              gal_list_sizet_add_arena(&Q, nind, arena);
             }
         } );
     }
 
   /* Clean up. */
+  gal_list_arena_free(arena);
   free(byt);
   free(dinc);
 }
@@ -119,9 +119,10 @@ detection_initial(struct noisechiselparams *p)
 
   /* Erode the image. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  gal_binary_erode(p->binary, p->erode,
-                   detection_ngb_to_connectivity(p->input->ndim,
-                                                 p->erodengb), 1);
+  gal_binary_erode_parallel(p->binary, p->erode,
+                            detection_ngb_to_connectivity(p->input->ndim,
+                                                          p->erodengb), 1,
+                            p->cp.numthreads);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "Eroded %zu time%s (%zu-connected).", p->erode,
@@ -145,9 +146,10 @@ detection_initial(struct noisechiselparams *p)
 
   /* Do the opening. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  gal_binary_open(p->binary, p->opening,
-                  detection_ngb_to_connectivity(p->input->ndim,
-                                                p->openingngb), 1);
+  gal_binary_open_parallel(p->binary, p->opening,
+                           detection_ngb_to_connectivity(p->input->ndim,
+                                                         p->openingngb), 1,
+                           p->cp.numthreads);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "Opened (depth: %zu, %zu-connected).",
@@ -168,8 +170,9 @@ detection_initial(struct noisechiselparams *p)
 
 
   /* Label the connected components. */
-  p->numinitialdets=gal_binary_connected_components(p->binary, &p->olabel,
-                                                    p->binary->ndim);
+  p->numinitialdets=gal_binary_connected_components_parallel(p->binary,
+                                                &p->olabel, p->binary->ndim,
+                                                p->cp.numthreads, NULL);
   if(p->detectionname)
     {
       p->olabel->name="OPENED-AND-LABELED";
@@ -1080,12 +1083,15 @@ detection_quantile_expand(struct noisechiselparams *p, gal_data_t *workbin)
       o=p->olabel->array;
       bf=(b=workbin->array)+workbin->size;
       do *b = (*o++ == 1); while(++b<bf);
-      workbin=gal_binary_dilate(workbin, 1, 1, 1);
-      gal_binary_holes_fill(workbin, 1, p->detgrowmaxholesize);
+      workbin=gal_binary_dilate_parallel(workbin, 1, 1, 1,
+                                         p->cp.numthreads);
+      gal_binary_holes_fill_parallel(workbin, 1, p->detgrowmaxholesize,
+                                     p->cp.numthreads);
 
       /* Get the labeled image. */
-      numexpanded=gal_binary_connected_components(workbin, &p->olabel,
-                                                  workbin->ndim);
+      numexpanded=gal_binary_connected_components_parallel(workbin,
+                                                &p->olabel, workbin->ndim,
+                                                p->cp.numthreads, NULL);
 
       /* Set all the input's blank pixels to blank in the labeled and
          binary arrays. */
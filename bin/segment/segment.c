@@ -392,7 +392,7 @@ typedef struct segment_relab_list_t
 
 static void
 segment_relab_list_add(struct segment_relab_list_t **list, size_t ngbid,
-                       double value)
+                       double value, gal_list_arena_t *arena)
 {
   int done=0;
   struct segment_relab_list_t *tmp=NULL;
@@ -412,12 +412,8 @@ segment_relab_list_add(struct segment_relab_list_t **list, size_t ngbid,
      we need to allocate a new node and add it to the list. */
   if(done==0)
     {
-      /* Allocate a new node. */
-      errno=0;
-      tmp=malloc(sizeof *tmp);
-      if(tmp==NULL)
-        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes "
-              "for 'tmp'", __func__, sizeof tmp);
+      /* Take a new node from the arena. */
+      tmp=gal_list_arena_node(arena);
 
       /* Fill in the node. */
       tmp->num=1;
@@ -448,6 +444,7 @@ segment_relab_to_objects_list(struct clumps_thread_params *cltprm)
   double var=cltprm->std*cltprm->std;
   gal_list_sizet_t **adjacency, *atmp;
   segment_relab_list_t **rlist, *rtmp;
+  gal_list_arena_t *arena=gal_list_arena_alloc(sizeof *rtmp, 0);
   double ave, rpsum, c=sqrt(1/p->cpscorr);
   size_t nngb=gal_dimension_num_neighbors(ndim);
   size_t *dinc=gal_dimension_increment(ndim, dsize);
@@ -523,9 +520,9 @@ segment_relab_to_objects_list(struct clumps_thread_params *cltprm)
                   /* For safety and ease of processing, we will fill
                      both sides of the diagonal. */
                   segment_relab_list_add(&rlist[ ngblabs[i] ], ngblabs[j],
-                                         rpsum/rpnum);
+                                         rpsum/rpnum, arena);
                   segment_relab_list_add(&rlist[ ngblabs[j] ], ngblabs[i],
-                                         rpsum/rpnum);
+                                         rpsum/rpnum, arena);
                 }
       }
   while(++s<sf);
@@ -555,8 +552,10 @@ segment_relab_to_objects_list(struct clumps_thread_params *cltprm)
                     { addadj=0; break; }
                 if(addadj)
                   {
-                    gal_list_sizet_add(&adjacency[i], rtmp->ngbid);
-                    gal_list_sizet_add(&adjacency[rtmp->ngbid], i);
+                    gal_list_sizet_add_arena(&adjacency[i], rtmp->ngbid,
+                                             arena);
+                    gal_list_sizet_add_arena(&adjacency[rtmp->ngbid], i,
+                                             arena);
                   }
               }
           }
@@ -595,11 +594,8 @@ segment_relab_to_objects_list(struct clumps_thread_params *cltprm)
                                                p->cp.quietmmap,
                                                &cltprm->numobjects);
 
-  /* Clean up. */
-  for(i=1; i<amwidth; ++i)
-    while(rlist[i]!=NULL)
-      { rtmp=rlist[i]->next; free(rlist[i]); rlist[i]=rtmp; }
-  for(i=1; i<amwidth; ++i) gal_list_sizet_free(adjacency[i]);
+  /* Clean up (all the nodes of both lists are in the arena). */
+  gal_list_arena_free(arena);
   free(adjacency);
   free(ngblabs);
   free(rlist);
@@ -136,6 +136,32 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "chunksize",
+      UI_KEY_CHUNKSIZE,
+      "INT",
+      0,
+      "Read/process/write input in chunks of INT rows.",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->chunksize,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "writecache",
+      UI_KEY_WRITECACHE,
+      0,
+      0,
+      "Write binary cache of input for faster reads.",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->writecache,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
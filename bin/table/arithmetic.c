@@ -110,6 +110,42 @@ arithmetic_token_free(struct arithmetic_token *list)
 
 
 
+/* Return a fully allocated copy of the given list of tokens. This is
+   necessary when the same arithmetic should be applied on separate chunks
+   of the input rows: the constant operands are moved into the output
+   columns after each usage. */
+struct arithmetic_token *
+arithmetic_token_copy(struct arithmetic_token *list)
+{
+  struct arithmetic_token *tmp, *node, *out=NULL;
+
+  for(tmp=list; tmp!=NULL; tmp=tmp->next)
+    {
+      /* Allocate a new node and copy the simple elements. */
+      node=arithmetic_add_new_to_end(&out);
+      node->index=tmp->index;
+      node->inlib=tmp->inlib;
+      node->operator=tmp->operator;
+      node->num_operands=tmp->num_operands;
+      node->num_at_usage=tmp->num_at_usage;
+      node->id_at_usage=tmp->id_at_usage;
+
+      /* Copy the allocated elements. */
+      if(tmp->constant) node->constant=gal_data_copy(tmp->constant);
+      if(tmp->loadcol)  node->loadcol=gal_data_copy(tmp->loadcol);
+      if(tmp->name_def)
+        gal_checkset_allocate_copy(tmp->name_def, &node->name_def);
+      if(tmp->name_use)
+        gal_checkset_allocate_copy(tmp->name_use, &node->name_use);
+    }
+
+  return out;
+}
+
+
+
+
+
 
 
 
@@ -362,6 +398,80 @@ arithmetic_init(struct tableparams *p, struct arithmetic_token **arith,
 
 
 
+/* Return the name of the first operator that needs all the rows of its
+   operand(s) (for example to find their minimum or to sort them), or
+   NULL if there is no such operator. Columns from other files are also
+   read with all their rows, so the 'load-col-' operator is also
+   included. */
+char *
+arithmetic_needs_all_rows(struct tableparams *p)
+{
+  struct column_pack *tmp;
+  struct arithmetic_token *atmp;
+
+  for(tmp=p->colpack;tmp!=NULL;tmp=tmp->next)
+    for(atmp=tmp->arith;atmp!=NULL;atmp=atmp->next)
+      {
+        /* Columns from other files. */
+        if(atmp->loadcol) return "load-col-";
+
+        /* Operators that need all the rows of the column. */
+        switch(atmp->operator)
+          {
+          case GAL_ARITHMETIC_OP_MINVAL:
+          case GAL_ARITHMETIC_OP_MAXVAL:
+          case GAL_ARITHMETIC_OP_NUMBERVAL:
+          case GAL_ARITHMETIC_OP_SUMVAL:
+          case GAL_ARITHMETIC_OP_MEANVAL:
+          case GAL_ARITHMETIC_OP_STDVAL:
+          case GAL_ARITHMETIC_OP_MEDIANVAL:
+          case GAL_ARITHMETIC_OP_UNIQUE:
+          case GAL_ARITHMETIC_OP_NOBLANK:
+          case GAL_ARITHMETIC_OP_MKNOISE_SIGMA:
+          case GAL_ARITHMETIC_OP_MKNOISE_POISSON:
+          case GAL_ARITHMETIC_OP_MKNOISE_UNIFORM:
+          case GAL_ARITHMETIC_OP_RANDOM_FROM_HIST:
+          case GAL_ARITHMETIC_OP_RANDOM_FROM_HIST_RAW:
+          case GAL_ARITHMETIC_OP_STITCH:
+          case GAL_ARITHMETIC_OP_MAKENEW:
+          case GAL_ARITHMETIC_OP_SIZE:
+          case GAL_ARITHMETIC_OP_INDEX:
+          case GAL_ARITHMETIC_OP_COUNTER:
+          case GAL_ARITHMETIC_OP_INDEXONLY:
+          case GAL_ARITHMETIC_OP_COUNTERONLY:
+          case GAL_ARITHMETIC_OP_POOLMAX:
+          case GAL_ARITHMETIC_OP_POOLMIN:
+          case GAL_ARITHMETIC_OP_POOLSUM:
+          case GAL_ARITHMETIC_OP_POOLMEAN:
+          case GAL_ARITHMETIC_OP_POOLMEDIAN:
+          case ARITHMETIC_TABLE_OP_SORTEDTOINTERVAL:
+            return arithmetic_operator_name(atmp->operator);
+          }
+      }
+
+  /* No such operator was found. */
+  return NULL;
+}
+
+
+
+
+
+/* When the input is processed in chunks of rows ('--chunksize'), the
+   operators that need all the rows of a column can't be used. */
+void
+arithmetic_check_chunked(struct tableparams *p)
+{
+  char *opname=arithmetic_needs_all_rows(p);
+  if(opname)
+    error(EXIT_FAILURE, 0, "the '%s' operator needs all the rows of the "
+          "input, so it cannot be used with '--chunksize'", opname);
+}
+
+
+
+
+
 /* Set the final index of each package of columns (possibly containing
    processing columns that will change in number and contents).  */
 void
@@ -630,7 +740,7 @@ arithmetic_wcs(struct tableparams *p, gal_data_t **stack, int operator)
   if(operator==ARITHMETIC_TABLE_OP_WCSTOIMG)
     {
       /* Do the conversion. */
-      gal_wcs_world_to_img(coord[0], wcs, 1);
+      gal_wcs_world_to_img_parallel(coord[0], wcs, 1, p->cp.numthreads);
 
       /* For image coordinates, we don't need much precision. */
       for(i=0;i<ndim;++i)
@@ -643,7 +753,7 @@ arithmetic_wcs(struct tableparams *p, gal_data_t **stack, int operator)
     }
   else
     {
-      gal_wcs_img_to_world(coord[0], wcs, 1);
+      gal_wcs_img_to_world_parallel(coord[0], wcs, 1, p->cp.numthreads);
       arithmetic_update_metadata(coord[0], wcs->ctype[0], wcs->cunit[0],
                                  "Converted from pixel coordinates");
       arithmetic_update_metadata(coord[1], coord[1]?wcs->ctype[1]:NULL,
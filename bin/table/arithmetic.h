@@ -60,6 +60,15 @@ arithmetic_init(struct tableparams *p, struct arithmetic_token **arith,
 void
 arithmetic_token_free(struct arithmetic_token *list);
 
+struct arithmetic_token *
+arithmetic_token_copy(struct arithmetic_token *list);
+
+char *
+arithmetic_needs_all_rows(struct tableparams *p);
+
+void
+arithmetic_check_chunked(struct tableparams *p);
+
 void
 arithmetic_operate(struct tableparams *p);
 
@@ -132,6 +132,8 @@ struct tableparams
   char          *txtf64fmtstr;  /* Floating point formats (exp, flt).   */
   int         txtf32precision;  /* Precision of float32 in text.        */
   int         txtf64precision;  /* Precision of float32 in text.        */
+  size_t            chunksize;  /* Num. rows to process in each chunk.  */
+  uint8_t          writecache;  /* Write a binary cache of the input.   */
 
   /* Internal. */
   struct column_pack *colpack;  /* Output column packages.              */
@@ -157,6 +159,17 @@ struct tableparams
   uint8_t        txtf32format;  /* Floating point formats (exp, flt).   */
   uint8_t        txtf64format;  /* Floating point formats (exp, flt).   */
 
+  /* For processing the input in chunks of rows ('--chunksize') or only
+     reading the selected rows (when 'pushdown' is 1). */
+  uint8_t            pushdown;  /* Only read rows that pass selection.  */
+  size_t            numrowsin;  /* Number of rows in the input table.   */
+  size_t              nselect;  /* Number of row-selection columns.     */
+  size_t          origoutncols; /* Number of requested output columns.  */
+  size_t           sortindout;  /* Index of sort column in read ones.   */
+  size_t           *selectind;  /* Index of selection columns in input. */
+  size_t        *selectindout;  /* Index of selection columns in read.  */
+  size_t       *selecttypeout;  /* Type of selection columns.           */
+
   /* For arithmetic operators. */
   gal_list_str_t  *wcstoimg_p;  /* Pointer to the node.                 */
   gal_list_str_t  *imgtowcs_p;  /* Pointer to the node.                 */
@@ -40,11 +40,13 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/qsort.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/polygon.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/arithmetic.h>
 #include <gnuastro/statistics.h>
 #include <gnuastro/permutation.h>
 
 #include <gnuastro-internal/checkset.h>
+#include <gnuastro-internal/tablecache.h>
 
 #include "main.h"
 
@@ -426,21 +428,15 @@ table_selection_equal_or_notequal(struct tableparams *p, gal_data_t *col,
 
 
 
-static void
-table_select_by_value(struct tableparams *p)
+/* Build a mask with a value of 1 for the rows that don't pass all the
+   selection criteria (and should be removed). */
+static gal_data_t *
+table_select_mask(struct tableparams *p)
 {
-  gal_data_t *rowids;
-  size_t i, *s, ngood=0;
   struct list_select *tmp;
-  uint8_t *u, *uf, *ustart;
   int inplace=GAL_ARITHMETIC_FLAG_INPLACE;
   gal_data_t *mask, *col, *blmask, *addmask=NULL;
 
-  /* It may happen that the input table is empty! In such cases, just
-     return and don't bother with this step. */
-  if(p->table->size==0 || p->table->array==NULL || p->table->dsize==NULL)
-    return;
-
   /* Allocate datasets for the necessary numbers and write them in. */
   mask=gal_data_alloc(NULL, GAL_TYPE_UINT8, 1, &p->table->dsize[0],
                       NULL, 1, p->cp.minmapsize, p->cp.quietmmap,
@@ -537,6 +533,22 @@ table_select_by_value(struct tableparams *p)
       gal_data_free(addmask);
     }
 
+  /* Return the mask. */
+  return mask;
+}
+
+
+
+
+
+/* Return the IDs of the rows that have a value of 0 in the mask. */
+static gal_data_t *
+table_select_rowids(struct tableparams *p, gal_data_t *mask)
+{
+  size_t *s, ngood=0;
+  gal_data_t *rowids;
+  uint8_t *u, *uf, *ustart;
+
   /* Find the final number of elements to print and allocate the array to
      keep them. */
   uf=(u=mask->array)+mask->size;
@@ -550,15 +562,45 @@ table_select_by_value(struct tableparams *p)
   ustart=mask->array;
   uf=(u=mask->array)+mask->size;
   do if(*u==0) *s++ = u-ustart; while(++u<uf);
+  return rowids;
+}
+
+
+
+
 
-  /* Move the desired rows to the top of the table. */
-  table_bring_to_top(p->table, rowids);
+static void
+table_select_by_value(struct tableparams *p)
+{
+  size_t i;
+  struct list_select *tmp;
+  gal_data_t *mask, *rowids;
 
-  /* If the sort column is not in the table (the proper range has already
-     been applied to it), and we need to sort the resulting columns
-     afterwards, we should also apply the permutation on the sort
-     column. */
-  if(p->sortcol && p->sortin==0) table_bring_to_top(p->sortcol, rowids);
+  /* It may happen that the input table is empty! In such cases, just
+     return and don't bother with this step. */
+  if(p->table->size==0 || p->table->array==NULL || p->table->dsize==NULL)
+    return;
+
+  /* When only the selected rows were read (see 'table_select_pushdown'),
+     the selection has already been applied. */
+  if(p->pushdown==0)
+    {
+      /* Find the rows that should be kept. */
+      mask=table_select_mask(p);
+      rowids=table_select_rowids(p, mask);
+
+      /* Move the desired rows to the top of the table. */
+      table_bring_to_top(p->table, rowids);
+
+      /* If the sort column is not in the table (the proper range has
+         already been applied to it), and we need to sort the resulting
+         columns afterwards, we should also apply the permutation on the
+         sort column. */
+      if(p->sortcol && p->sortin==0)
+        table_bring_to_top(p->sortcol, rowids);
+      gal_data_free(mask);
+      gal_data_free(rowids);
+    }
 
   /* Clean up. */
   i=0;
@@ -566,8 +608,6 @@ table_select_by_value(struct tableparams *p)
     { if(p->freeselect[i]) {gal_data_free(tmp->col); tmp->col=NULL;} ++i; }
   ui_list_select_free(p->selectcol, 0);
   free(p->freeselect);
-  gal_data_free(mask);
-  gal_data_free(rowids);
 }
 
 
@@ -1588,9 +1628,562 @@ table_row(struct tableparams *p)
 
 
 
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/***************      Processing in chunks      ***************/
+/**************************************************************/
+struct table_chunk_params
+{
+  struct tableparams       *p;  /* Main program parameters.            */
+  size_t           firstchunk;  /* Index of first chunk in this batch.  */
+  gal_data_t             **out; /* Output table of each chunk.         */
+};
+
+
+
+
+
+/* Copy a list of datasets (the copies have the same order). */
+static gal_data_t *
+table_chunk_copy_data_list(gal_data_t *list)
+{
+  gal_data_t *tmp, *out=NULL;
+  for(tmp=list; tmp!=NULL; tmp=tmp->next)
+    gal_list_data_add(&out, gal_data_copy(tmp));
+  gal_list_data_reverse(&out);
+  return out;
+}
+
+
+
+
+
+/* Read, select, process and keep the output of one chunk of rows. Several
+   steps (for example '--range' or column arithmetic) consume their
+   parameters while they are applied. So each chunk works on its own copy
+   of the main parameters structure with its own copy of such
+   parameters. */
+static void
+table_chunk_one(struct tableparams *p, size_t chunk, gal_data_t **out)
+{
+  gal_list_str_t *tmp;
+  struct tableparams cp=*p;
+
+  /* Set the parameters that are particular to this chunk. Each chunk is
+     already processed in a separate thread. */
+  cp.cp.numthreads=1;
+  cp.sortcol=NULL;
+  cp.colarray=NULL;
+  cp.selectcol=NULL;
+  cp.freeselect=NULL;
+  cp.noblankend=NULL;
+  cp.head=GAL_BLANK_SIZE_T;   /* Applied over all chunks in 'table'. */
+  cp.range=table_chunk_copy_data_list(p->range);
+  cp.equal=table_chunk_copy_data_list(p->equal);
+  cp.notequal=table_chunk_copy_data_list(p->notequal);
+  cp.colpack=p->colpack ? ui_colpack_copy(p->colpack) : NULL;
+  cp.wcs=p->wcs ? gal_wcs_copy(p->wcs) : NULL;
+  for(tmp=p->noblankend; tmp!=NULL; tmp=tmp->next)
+    gal_list_str_add(&cp.noblankend, tmp->v, 1);
+  gal_list_str_reverse(&cp.noblankend);
+  cp.colmatch = ( p->colpack
+                  ? gal_pointer_allocate(GAL_TYPE_SIZE_T,
+                                         gal_list_str_number(p->columns),
+                                         1, __func__, "cp.colmatch")
+                  : NULL);
+
+  /* Read the desired rows. */
+  cp.table=gal_table_read_rows(p->filename, p->cp.hdu, p->columns,
+                               chunk*p->chunksize, p->chunksize,
+                               p->cp.searchin, p->cp.ignorecase, 1,
+                               p->cp.minmapsize, p->cp.quietmmap,
+                               cp.colmatch);
+  if(cp.table==NULL)
+    error(EXIT_FAILURE, 0, "%s: no usable data rows", p->filename);
+
+  /* Separate the selection columns. */
+  if(p->selection)
+    ui_check_select_sort_after(&cp, p->nselect, p->origoutncols,
+                               p->sortindout, p->selectindout,
+                               p->selecttypeout);
+
+  /* Do the requested operations. */
+  if(cp.rowfirst) { table_row(&cp);    table_column(&cp); }
+  else            { table_column(&cp); table_row(&cp);    }
+  if(cp.colmetadata) table_colmetadata(&cp);
+  if(cp.noblankend) table_noblankend(&cp);
+  table_txt_formats(&cp);
+
+  /* Keep the output and clean up. */
+  *out=cp.table;
+  if(cp.wcs) gal_wcs_free(cp.wcs);
+  if(cp.colmatch) free(cp.colmatch);
+  if(cp.colpack) ui_colpack_free(cp.colpack);
+  gal_list_data_free(cp.range);
+  gal_list_data_free(cp.equal);
+  gal_list_data_free(cp.notequal);
+  gal_list_str_free(cp.noblankend, 1);
+}
+
+
+
+
+
+static void *
+table_chunk_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct table_chunk_params *cprm=(struct table_chunk_params *)tprm->params;
+
+  size_t i, ind;
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      table_chunk_one(cprm->p, cprm->firstchunk+ind, &cprm->out[ind]);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* In plain-text outputs, the width of each column is found from its
+   values (for example the length of the strings, the blank string or if
+   there are negative values) when it is written. So to have the same
+   column widths in the full output table, the widths of the first chunk
+   (that are written into its columns) are kept and used for the rest. */
+static int *
+table_chunk_widths_get(gal_data_t *tbl)
+{
+  int *widths;
+  size_t i, num=gal_list_data_number(tbl);
+
+  errno=0;
+  widths=malloc(num*sizeof *widths);
+  if(widths==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'widths'", __func__, num*sizeof *widths);
+  for(i=0;tbl!=NULL;tbl=tbl->next) widths[i++]=tbl->disp_width;
+  return widths;
+}
+
+
+
+
+
+static void
+table_chunk_widths_set(gal_data_t *tbl, int *widths)
+{
+  size_t i;
+  for(i=0;tbl!=NULL;tbl=tbl->next) tbl->disp_width=widths[i++];
+}
+
+
+
+
+
+/* Process the input table in chunks of '--chunksize' rows, so the memory
+   usage is independent of the size of the input table. Chunks are
+   processed in parallel (one chunk per thread) and written in order.  */
+static void
+table_chunked(struct tableparams *p)
+{
+  int *widths=NULL;
+  gal_data_t *tbl;
+  struct tableparams hp;
+  size_t i, nrows, nbatch, written=0;
+  struct table_chunk_params cprm;
+  size_t nchunks = ( p->numrowsin
+                     ? (p->numrowsin + p->chunksize - 1) / p->chunksize
+                     : 1 );
+
+  /* Separate threads can only read the input when CFITSIO is
+     reentrant. */
+#if GAL_CONFIG_HAVE_FITS_IS_REENTRANT == 1
+  size_t nthreads = fits_is_reentrant() ? p->cp.numthreads : 1;
+#else
+  size_t nthreads=1;
+#endif
+
+  /* Allocate the array to keep the outputs of each batch of chunks. */
+  cprm.p=p;
+  errno=0;
+  cprm.out=calloc(nthreads, sizeof *cprm.out);
+  if(cprm.out==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'cprm.out'", __func__, nthreads*sizeof *cprm.out);
+
+  /* Process the chunks in batches of 'nthreads'. */
+  for(cprm.firstchunk=0; cprm.firstchunk<nchunks;
+      cprm.firstchunk+=nthreads)
+    {
+      /* Process this batch of chunks. */
+      nbatch = ( cprm.firstchunk+nthreads > nchunks
+                 ? nchunks-cprm.firstchunk : nthreads );
+      gal_threads_spin_off(table_chunk_worker, &cprm, nbatch, nthreads,
+                           p->cp.minmapsize, p->cp.quietmmap);
+
+      /* Write the outputs (in order). */
+      for(i=0;i<nbatch;++i)
+        {
+          /* If the output has no columns, we can't continue. */
+          tbl=cprm.out[i];
+          cprm.out[i]=NULL;
+          if(tbl==NULL) error(EXIT_FAILURE, 0, "no output columns");
+
+          /* If the rows requested by '--head' have already been written,
+             ignore this chunk. */
+          if(cprm.firstchunk+i && p->head!=GAL_BLANK_SIZE_T
+             && written>=p->head)
+            { gal_list_data_free(tbl); continue; }
+
+          /* Apply '--head' (over all the chunks). */
+          nrows = tbl->dsize ? tbl->dsize[0] : 0;
+          if(p->head!=GAL_BLANK_SIZE_T && written+nrows>p->head)
+            {
+              hp=*p;
+              hp.table=tbl;
+              hp.head=p->head-written;
+              table_select_by_position(&hp);
+              tbl=hp.table;
+              nrows=hp.head;
+            }
+
+          /* The first chunk creates the output (with its metadata), the
+             rest are appended to it. */
+          if(cprm.firstchunk+i==0)
+            {
+              gal_table_write_parallel(tbl, NULL, NULL,
+                                       p->cp.tableformat, p->cp.output,
+                                       "TABLE", p->colinfoinstdout,
+                                       p->cp.numthreads);
+              if(p->cp.tableformat==GAL_TABLE_FORMAT_TXT)
+                widths=table_chunk_widths_get(tbl);
+            }
+          else if(nrows)
+            {
+              if(widths) table_chunk_widths_set(tbl, widths);
+              gal_table_write_append(tbl, p->cp.output);
+            }
+          written+=nrows;
+          gal_list_data_free(tbl);
+        }
+
+      /* If the desired number of rows has been written, stop. */
+      if(p->head!=GAL_BLANK_SIZE_T && written>=p->head) break;
+    }
+
+  /* Clean up. */
+  free(widths);
+  free(cprm.out);
+}
+
+
+
+
+
+/**************************************************************/
+/***************   Only reading selected rows   ***************/
+/**************************************************************/
+/* Number of rows that are read (and checked) at once when only the rows
+   passing the selection criteria should be read. */
+#define TABLE_PUSHDOWN_BLOCKSIZE 1000000
+
+/* When the input has a cache (see '--writecache'), the minimum and
+   maximum of each block of rows is available for numeric columns. So
+   blocks that can't contain any row within the '--range' values can be
+   skipped without reading them. The first selection criteria are from
+   '--range' (in the same order as 'p->range'). If all the blocks may
+   contain good rows (or there is no cache), this function will return
+   NULL. Otherwise, the IDs of the rows in the remaining blocks are
+   returned. */
+static gal_data_t *
+table_select_pushdown_blocks(struct tableparams *p)
+{
+  double *darr;
+  gal_data_t *tmp, *out=NULL;
+  char *cachename=gal_tablecache_usable(p->filename, p->cp.hdu);
+  size_t i, r, nblocks, blocksize, ngood, numrows, *s;
+  uint8_t *blocks, *good=NULL, allgood=1, *bf, *b, *g;
+
+  /* If there is no cache or no '--range', there is nothing to do. */
+  if(cachename==NULL || p->range==NULL) { free(cachename); return NULL; }
+
+  /* Go over all the ranges and flag the blocks that may contain good
+     rows. */
+  i=0;
+  for(tmp=p->range; tmp!=NULL; tmp=tmp->next)
+    {
+      darr=tmp->array;
+      blocks=gal_tablecache_blocks_in_range(cachename, p->selectind[i++],
+                                            darr[0], darr[1], &nblocks,
+                                            &blocksize, &numrows);
+      if(blocks==NULL) continue;
+      if(good)
+        {
+          bf=(b=blocks)+nblocks; g=good;
+          do *g++ &= *b; while(++b<bf);
+          free(blocks);
+        }
+      else good=blocks;
+    }
+
+  /* If any block can be removed, build the IDs of the remaining rows. */
+  if(good)
+    {
+      bf=(b=good)+nblocks; do if(*b==0) allgood=0; while(++b<bf);
+      if(allgood==0)
+        {
+          /* Count the remaining rows (the last block may be smaller). */
+          ngood=0;
+          for(i=0;i<nblocks;++i)
+            if(good[i])
+              ngood += ( (i+1)*blocksize>numrows
+                         ? numrows-i*blocksize : blocksize );
+
+          /* Write the row IDs. */
+          out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &ngood, NULL, 0,
+                             p->cp.minmapsize, p->cp.quietmmap, NULL,
+                             NULL, NULL);
+          s=out->array;
+          for(i=0;i<nblocks;++i)
+            if(good[i])
+              for(r=i*blocksize; r<(i+1)*blocksize && r<numrows; ++r)
+                *s++=r;
+        }
+      free(good);
+    }
+
+  /* Clean up and return. */
+  free(cachename);
+  return out;
+}
+
+
+
+
+
+/* Read the selection columns in one block of rows, apply the selection
+   criteria on them and return the IDs (within the full table) of the
+   rows that pass. When 'brows' is not NULL, it contains the IDs of the
+   rows in this block (from 'table_select_pushdown_blocks'), otherwise,
+   the block is the 'n' rows starting from 'start'. */
+static gal_data_t *
+table_select_pushdown_block(struct tableparams *p, gal_list_str_t *cols,
+                            size_t nread, size_t *selectindout,
+                            gal_data_t *brows, size_t start, size_t n)
+{
+  size_t i, *r, *c;
+  struct tableparams sp=*p;
+  gal_data_t *mask, *rowids;
+
+  /* The selection consumes the values of some options, so use a copy of
+     the main parameters with copies of those options. */
+  sp.sort=NULL;
+  sp.sortcol=NULL;
+  sp.selectcol=NULL;
+  sp.freeselect=NULL;
+  sp.range=table_chunk_copy_data_list(p->range);
+  sp.equal=table_chunk_copy_data_list(p->equal);
+  sp.notequal=table_chunk_copy_data_list(p->notequal);
+
+  /* Read the selection columns in this block. */
+  sp.table = ( brows
+               ? gal_table_read_rowids(p->filename, p->cp.hdu, cols, brows,
+                                       p->cp.searchin, p->cp.ignorecase,
+                                       p->cp.numthreads, p->cp.minmapsize,
+                                       p->cp.quietmmap, NULL)
+               : gal_table_read_rows(p->filename, p->cp.hdu, cols, start,
+                                     n, p->cp.searchin, p->cp.ignorecase,
+                                     p->cp.numthreads, p->cp.minmapsize,
+                                     p->cp.quietmmap, NULL) );
+  if(sp.table==NULL)
+    error(EXIT_FAILURE, 0, "%s: no usable data rows", p->filename);
+  ui_check_select_sort_after(&sp, p->nselect, nread, GAL_BLANK_SIZE_T,
+                             selectindout, p->selecttypeout);
+
+  /* Find the rows that pass the selection and convert their IDs (within
+     this block) to IDs within the full table. */
+  if(sp.table->size==0 || sp.table->array==NULL)
+    rowids=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &sp.table->size,
+                          NULL, 0, -1, 1, NULL, NULL, NULL);
+  else
+    {
+      mask=table_select_mask(&sp);
+      rowids=table_select_rowids(p, mask);
+      gal_data_free(mask);
+      r=rowids->array;
+      if(brows)
+        { c=brows->array; for(i=0;i<rowids->size;++i) r[i]=c[r[i]]; }
+      else
+        for(i=0;i<rowids->size;++i) r[i]+=start;
+    }
+
+  /* Clean up and return. */
+  free(sp.freeselect);
+  gal_list_data_free(sp.table);
+  gal_list_data_free(sp.range);
+  gal_list_data_free(sp.equal);
+  gal_list_data_free(sp.notequal);
+  ui_list_select_free(sp.selectcol, 0);
+  return rowids;
+}
+
+
+
+
+
+/* Read the selection columns, find the rows that pass all the selection
+   criteria and only read those rows of the desired columns. To keep the
+   memory usage bounded, the selection columns are read and checked in
+   blocks of 'TABLE_PUSHDOWN_BLOCKSIZE' rows (only within the blocks of
+   the cache that may contain good rows). The selection is therefore only
+   evaluated once: 'table_select_by_value' (called in 'table_row') will
+   only free the selection columns when 'p->pushdown' is set. */
+static void
+table_select_pushdown(struct tableparams *p)
+{
+  char *str;
+  int tableformat;
+  gal_list_str_t *cols=NULL;
+  gal_data_t *tmp, *allcols, *rowids, *brows, *candidates, *blocks=NULL;
+  size_t *readind, *selectindout;
+  size_t i, j, n, nread=0, ngood=0, numcols, numrows;
+
+  /* Each input column should only be read once (the same column may be
+     used in multiple selection criteria). */
+  readind=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->nselect, 0, __func__,
+                               "readind");
+  selectindout=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->nselect, 0,
+                                    __func__, "selectindout");
+  for(i=0;i<p->nselect;++i)
+    {
+      for(j=0;j<nread;++j) if(readind[j]==p->selectind[i]) break;
+      if(j==nread)
+        {
+          readind[nread++]=p->selectind[i];
+          if( asprintf(&str, "%zu", p->selectind[i]+1)==-1 )
+            error(EXIT_FAILURE, errno, "%s: asprintf error", __func__);
+          gal_list_str_add(&cols, str, 0);
+        }
+      selectindout[i]=j;
+    }
+  gal_list_str_reverse(&cols);
+
+  /* Apply the selection on each block of rows (only in the blocks of the
+     cache that may pass the range criteria). */
+  candidates=table_select_pushdown_blocks(p);
+  if(candidates)
+    for(i=0; i<candidates->size; i+=TABLE_PUSHDOWN_BLOCKSIZE)
+      {
+        /* Use the respective part of the candidate rows (the array
+           belongs to 'candidates', so it shouldn't be freed here). */
+        n = ( candidates->size-i < TABLE_PUSHDOWN_BLOCKSIZE
+              ? candidates->size-i : TABLE_PUSHDOWN_BLOCKSIZE );
+        brows=gal_data_alloc((size_t *)(candidates->array)+i,
+                             GAL_TYPE_SIZE_T, 1, &n, NULL, 0, -1, 1, NULL,
+                             NULL, NULL);
+        gal_list_data_add(&blocks,
+                          table_select_pushdown_block(p, cols, nread,
+                                                      selectindout, brows,
+                                                      0, n));
+        brows->array=NULL;
+        gal_data_free(brows);
+      }
+  else
+    {
+      allcols=gal_table_info(p->filename, p->cp.hdu, NULL, &numcols,
+                             &numrows, &tableformat);
+      gal_data_array_free(allcols, numcols, 0);
+      for(i=0; i<numrows; i+=TABLE_PUSHDOWN_BLOCKSIZE)
+        gal_list_data_add(&blocks,
+                          table_select_pushdown_block(p, cols, nread,
+                                                      selectindout, NULL, i,
+                                                  TABLE_PUSHDOWN_BLOCKSIZE));
+    }
+
+  /* Merge the selected rows of all the blocks (in order). */
+  gal_list_data_reverse(&blocks);
+  for(tmp=blocks; tmp!=NULL; tmp=tmp->next) ngood+=tmp->size;
+  rowids=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &ngood, NULL, 0,
+                        ngood ? p->cp.minmapsize : -1,
+                        p->cp.quietmmap, NULL, NULL, NULL);
+  j=0;
+  for(tmp=blocks; tmp!=NULL; tmp=tmp->next)
+    if(tmp->size)
+      {
+        memcpy((size_t *)(rowids->array)+j, tmp->array,
+               tmp->size*sizeof(size_t));
+        j+=tmp->size;
+      }
+  gal_list_data_free(blocks);
+
+  /* Only read the selected rows of the desired columns. */
+  p->colmatch = ( p->colpack
+                  ? gal_pointer_allocate(GAL_TYPE_SIZE_T,
+                                         gal_list_str_number(p->columns),
+                                         1, __func__, "p->colmatch")
+                  : NULL);
+  p->table=gal_table_read_rowids(p->filename, p->cp.hdu, p->columns,
+                                 rowids, p->cp.searchin, p->cp.ignorecase,
+                                 p->cp.numthreads, p->cp.minmapsize,
+                                 p->cp.quietmmap, p->colmatch);
+  if(p->table==NULL)
+    error(EXIT_FAILURE, 0, "%s: no usable data rows", p->filename);
+  ui_check_select_sort_after(p, p->nselect, p->origoutncols,
+                             p->sortindout, p->selectindout,
+                             p->selecttypeout);
+
+  /* Clean up. */
+  free(readind);
+  free(selectindout);
+  gal_data_free(rowids);
+  gal_data_free(candidates);
+  gal_list_str_free(cols, 1);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 void
 table(struct tableparams *p)
 {
+  /* When the input should be processed in chunks of rows, all the steps
+     are done there. */
+  if(p->chunksize) { table_chunked(p); return; }
+
+  /* When only the rows that pass the selection criteria should be read,
+     read them before starting. */
+  if(p->pushdown) table_select_pushdown(p);
+
   /* Do the requested operations. */
   if(p->rowfirst) { table_row(p);    table_column(p); }
   else            { table_column(p); table_row(p);    }
@@ -1603,8 +2196,9 @@ table(struct tableparams *p)
   if(p->table)
     {
       table_txt_formats(p);
-      gal_table_write(p->table, NULL, NULL, p->cp.tableformat, p->cp.output,
-                      "TABLE", p->colinfoinstdout);
+      gal_table_write_parallel(p->table, NULL, NULL, p->cp.tableformat,
+                               p->cp.output, "TABLE", p->colinfoinstdout,
+                               p->cp.numthreads);
     }
   else
     error(EXIT_FAILURE, 0, "no output columns");
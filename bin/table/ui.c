@@ -37,6 +37,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
 #include <gnuastro-internal/checkset.h>
+#include <gnuastro-internal/tablecache.h>
 #include <gnuastro-internal/tableintern.h>
 #include <gnuastro-internal/fixedstringmacros.h>
 
@@ -327,6 +328,19 @@ ui_read_check_only_options(struct tableparams *p)
               "row counter)", darr[0], darr[1]);
     }
 
+  /* When the input is processed in chunks of rows, operations that need
+     all the rows of the table (or another table) are not possible. */
+  if(p->chunksize)
+    {
+      if(p->sort || p->tail!=GAL_BLANK_SIZE_T || p->rowrange
+         || p->rowrandom || p->transpose || p->catcolumnfile
+         || p->catrowfile)
+        error(EXIT_FAILURE, 0, "'--chunksize' cannot be called with "
+              "any of these options (they need all the rows of the "
+              "table): '--sort', '--tail', '--rowrange', '--rowrandom', "
+              "'--transpose', '--catcolumnfile' or '--catrowfile'");
+    }
+
   /* If '--colmetadata' is given, make sure none of the given options have
      more than three values. */
   if(p->colmetadata)
@@ -588,6 +602,27 @@ ui_colpack_free(struct column_pack *list)
 
 
 
+/* Return a copy of the given list of packaged columns (the arithmetic
+   tokens in each package are also copied). */
+struct column_pack *
+ui_colpack_copy(struct column_pack *list)
+{
+  struct column_pack *tmp, *node, *out=NULL;
+
+  for(tmp=list; tmp!=NULL; tmp=tmp->next)
+    {
+      node=ui_colpack_add_new_to_end(&out);
+      node->start=tmp->start;
+      node->numsimple=tmp->numsimple;
+      node->arith=arithmetic_token_copy(tmp->arith);
+    }
+  return out;
+}
+
+
+
+
+
 
 
 
@@ -1132,9 +1167,10 @@ ui_check_select_sort_before(struct tableparams *p, gal_list_str_t *lines,
     }
 
 
-  /* Clean up. */
+  /* Clean up ('selectind' is kept for reading only the selected rows, see
+     'ui_select_pushdown'). */
+  p->selectind=selectind;
   gal_list_sizet_free(indexll);
-  if(selectind) free(selectind);
   if(selecttype) free(selecttype);
   gal_data_array_free(allcols, numcols, 0);
   if(inpolytmp) gal_list_data_free(inpolytmp);
@@ -1145,7 +1181,7 @@ ui_check_select_sort_before(struct tableparams *p, gal_list_str_t *lines,
 
 
 
-static void
+void
 ui_check_select_sort_after(struct tableparams *p, size_t nselect,
                            size_t origoutncols, size_t sortindout,
                            size_t *selectindout, size_t *selecttypeout)
@@ -1226,15 +1262,80 @@ ui_check_select_sort_after(struct tableparams *p, size_t nselect,
 
 
 
+/* See if the input has a usable cache (see '--writecache'). */
+static int
+ui_input_has_cache(struct tableparams *p, gal_list_str_t *lines)
+{
+  int out=0;
+  char *cachename;
+  if(lines==NULL && p->filename)
+    {
+      cachename=gal_tablecache_usable(p->filename, p->cp.hdu);
+      if(cachename) { out=1; free(cachename); }
+    }
+  return out;
+}
+
+
+
+
+
+/* When the input is a FITS table (or has a cache), the rows that don't
+   pass the selection criteria don't need to be read at all: the
+   selection columns can be read first and only the remaining rows of the
+   desired columns can be read afterwards (see 'table_select_pushdown').
+   This is only possible when the rows of the input aren't changed (in
+   number or order) before the selection is applied. */
+static uint8_t
+ui_select_pushdown(struct tableparams *p, gal_list_str_t *lines)
+{
+  /* This is only possible on FITS tables or tables with a cache. */
+  if( p->selection==0 || lines || p->filename==NULL
+      || ( !gal_fits_name_is_fits(p->filename)
+           && !ui_input_has_cache(p, lines) ) )
+    return 0;
+
+  /* Rows from other tables are added before the selection, and columns
+     from other tables should have the same number of rows as the
+     input. */
+  if(p->catrowfile || p->catcolumnfile) return 0;
+
+  /* When column arithmetic is done before the row selection, its
+     operators should not need all the rows. */
+  if(p->colpack && p->rowfirst==0 && arithmetic_needs_all_rows(p))
+    return 0;
+
+  /* Everything is good for reading only the selected rows. */
+  return 1;
+}
+
+
+
+
+
 static void
 ui_preparations(struct tableparams *p)
 {
+  int tableformat;
+  gal_data_t *allcols;
   gal_list_str_t *lines;
-  size_t nselect=0, origoutncols=0;
+  size_t numcols, nselect=0, origoutncols=0;
   size_t sortindout=GAL_BLANK_SIZE_T;
   struct gal_options_common_params *cp=&p->cp;
   size_t *selectindout=NULL, *selecttypeout=NULL;
 
+  /* If a cache of the input is requested, write it before anything
+     else, so all the reading below is done from the cache. */
+  if(p->writecache)
+    {
+      if(p->filename==NULL)
+        error(EXIT_FAILURE, 0, "'--writecache' is not available when the "
+              "input is from the standard input");
+      gal_table_cache_write(p->filename, cp->hdu, cp->numthreads,
+                            cp->minmapsize, cp->quietmmap);
+    }
+
+
   /* If there were no columns specified or the user has asked for
      information on the columns, we want the full set of columns. */
   if(p->information)
@@ -1245,6 +1346,16 @@ ui_preparations(struct tableparams *p)
   lines=gal_options_check_stdin(p->filename, p->cp.stdintimeout, "input");
 
 
+  /* When the input should be processed in chunks of rows, we need to
+     directly read the desired rows from the file. */
+  if(p->chunksize
+     && ( lines || ( !gal_fits_name_is_fits(p->filename)
+                     && !ui_input_has_cache(p, lines) ) ) )
+    error(EXIT_FAILURE, 0, "%s: '--chunksize' is currently only "
+          "available for FITS tables (or tables with a cache, see "
+          "'--writecache')", lines ? "stdin" : p->filename);
+
+
   /* Prepare the column names. */
   ui_columns_prepare(p, lines);
 
@@ -1262,35 +1373,68 @@ ui_preparations(struct tableparams *p)
                                 &selecttypeout);
 
 
-  /* If we have any arithmetic operations, we need to make sure how many
-     columns match every given column name. */
-  p->colmatch = ( p->colpack
-                  ? gal_pointer_allocate(GAL_TYPE_SIZE_T,
-                                         gal_list_str_number(p->columns),
-                                         1, __func__, "p->colmatch")
-                  : NULL);
-
-
-  /* Read the necessary columns. */
-  p->table=gal_table_read(p->filename, cp->hdu, lines, p->columns,
-                          cp->searchin, cp->ignorecase, cp->numthreads,
-                          cp->minmapsize, p->cp.quietmmap, p->colmatch);
-  if(p->filename==NULL) p->filename="stdin";
-  gal_list_str_free(lines, 1);
-
-
-  /* If row sorting or selection are requested, keep them as separate
-     datasets.*/
-  if(p->selection || p->sort)
-    ui_check_select_sort_after(p, nselect, origoutncols, sortindout,
-                               selectindout, selecttypeout);
+  /* When the input is processed in chunks, the columns are only read
+     (and processed) in 'table.c'. Here, we just need to keep the
+     selection information (that is necessary for every chunk) and the
+     number of rows in the input. */
+  if(p->chunksize)
+    {
+      if(p->colpack) arithmetic_check_chunked(p);
+      allcols=gal_table_info(p->filename, cp->hdu, NULL, &numcols,
+                             &p->numrowsin, &tableformat);
+      gal_data_array_free(allcols, numcols, 0);
+    }
+  else
+    p->pushdown=ui_select_pushdown(p, lines);
+  if(p->chunksize || p->pushdown)
+    {
+      p->nselect=nselect;
+      p->sortindout=sortindout;
+      p->origoutncols=origoutncols;
+      p->selectindout=selectindout;
+      p->selecttypeout=selecttypeout;
+      selectindout=selecttypeout=NULL;
+    }
+  if(p->chunksize)
+    {
+      gal_checkset_writable_remove(p->cp.output, p->filename, 0,
+                                   p->cp.dontdelete);
+      return;
+    }
 
 
-  /* If there was no actual data in the file, then inform the user and
-     abort. */
-  if(p->table==NULL)
-    error(EXIT_FAILURE, 0, "%s: no usable data rows (non-commented and "
-          "non-blank lines)", p->filename);
+  /* When only the selected rows should be read, the columns are read in
+     'table.c' (after the selection columns have been read and checked).
+     Otherwise, read the necessary columns here. */
+  if(p->pushdown==0)
+    {
+      /* If we have any arithmetic operations, we need to make sure how
+         many columns match every given column name. */
+      p->colmatch = ( p->colpack
+                      ? gal_pointer_allocate(GAL_TYPE_SIZE_T,
+                                             gal_list_str_number(p->columns),
+                                             1, __func__, "p->colmatch")
+                      : NULL);
+
+      /* Read the necessary columns. */
+      p->table=gal_table_read(p->filename, cp->hdu, lines, p->columns,
+                              cp->searchin, cp->ignorecase, cp->numthreads,
+                              cp->minmapsize, p->cp.quietmmap, p->colmatch);
+      if(p->filename==NULL) p->filename="stdin";
+      gal_list_str_free(lines, 1);
+
+      /* If row sorting or selection are requested, keep them as separate
+         datasets.*/
+      if(p->selection || p->sort)
+        ui_check_select_sort_after(p, nselect, origoutncols, sortindout,
+                                   selectindout, selecttypeout);
+
+      /* If there was no actual data in the file, then inform the user and
+         abort. */
+      if(p->table==NULL)
+        error(EXIT_FAILURE, 0, "%s: no usable data rows (non-commented "
+              "and non-blank lines)", p->filename);
+    }
 
 
   /* Make sure the (possible) output name is writable. */
@@ -1433,6 +1577,9 @@ ui_free_report(struct tableparams *p)
   gal_list_data_free(p->colmetadata);
   gal_list_str_free(p->catcolumnhdu, 1);
   gal_list_str_free(p->catcolumnfile, 1);
+  if(p->selectind) free(p->selectind);
+  if(p->selectindout) free(p->selectindout);
+  if(p->selecttypeout) free(p->selecttypeout);
 
   /* If a random number generator was allocated, free it. */
   if(p->rng) gsl_rng_free(p->rng);
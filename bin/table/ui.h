@@ -82,6 +82,8 @@ enum option_keys_enum
   UI_KEY_ENVSEED,
   UI_KEY_ROWRANGE,
   UI_KEY_TOVECTOR,
+  UI_KEY_CHUNKSIZE,
+  UI_KEY_WRITECACHE,
   UI_KEY_ROWFIRST,
   UI_KEY_ROWRANDOM,
   UI_KEY_INPOLYGON,
@@ -104,6 +106,14 @@ ui_list_select_free(struct list_select *list, int freevalue);
 void
 ui_colpack_free(struct column_pack *list);
 
+struct column_pack *
+ui_colpack_copy(struct column_pack *list);
+
+void
+ui_check_select_sort_after(struct tableparams *p, size_t nselect,
+                           size_t origoutncols, size_t sortindout,
+                           size_t *selectindout, size_t *selecttypeout);
+
 void
 ui_free_report(struct tableparams *p);
 
@@ -184,6 +184,32 @@ struct argp_option program_options[] =
       GAL_OPTIONS_MANDATORY,
       GAL_OPTIONS_NOT_SET,
     },
+    {
+      "kernel",
+      UI_KEY_KERNEL,
+      "STR",
+      0,
+      "area, nearest, bilinear, bicubic, lanczos3.",
+      UI_GROUP_ALIGN,
+      &p->kernel,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "maxinterperr",
+      UI_KEY_MAXINTERPERR,
+      "FLT",
+      0,
+      "Max. error (input pix) of interpolated WCS grid.",
+      UI_GROUP_ALIGN,
+      &p->wa.maxinterperr,
+      GAL_TYPE_FLOAT64,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "gridfile",
       UI_KEY_GRIDFILE,
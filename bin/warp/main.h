@@ -46,6 +46,8 @@ struct warpparams
   struct gal_options_common_params cp; /* Common parameters.             */
   gal_warp_wcsalign_t  wa;  /* Nonlinear-specific parameters.            */
   char         *inputname;  /* Name of input file.                       */
+  gal_list_str_t  *inputs;  /* All input files (in batch mode).          */
+  size_t            numin;  /* Number of input files.                    */
   size_t        hstartwcs;  /* Header keyword No. to start reading WCS.  */
   size_t          hendwcs;  /* Header keyword No. to end reading WCS.    */
   uint8_t         keepwcs;  /* Wrap the warped/transfomed pixels.        */
@@ -55,6 +57,7 @@ struct warpparams
   uint8_t      widthinpix;  /* If the given width is in units of pixels. */
   char           *gridhdu;  /* Extension to use for output's WCS.        */
   char          *gridfile;  /* File to use for output's WCS.             */
+  char            *kernel;  /* Name of kernel to find output values.     */
 
   /* Internal parameters: */
   gal_data_t       *input;  /* Input data structure.                     */
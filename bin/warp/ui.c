@@ -23,6 +23,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <argp.h>
 #include <errno.h>
 #include <error.h>
@@ -64,7 +65,7 @@ const char *
 argp_program_bug_address = PACKAGE_BUGREPORT;
 
 static char
-args_doc[] = "ASTRdata";
+args_doc[] = "ASTRdata ...";
 
 const char
 doc[] = GAL_STRINGS_TOP_HELP_INFO PROGRAM_NAME" will resample the pixel "
@@ -184,10 +185,12 @@ parse_opt(int key, char *arg, struct argp_state *state)
       /* The user may give a shell variable that is empty! In that case
          'arg' will be an empty string! We don't want to account for such
          cases (and give a clear error that no input has been given). */
-      if(p->inputname)
-        argp_error(state, "only one argument (input file) should be given");
-      else
-        if(arg[0]!='\0') p->inputname=arg;
+      if(arg[0]!='\0')
+        {
+          gal_list_str_add(&p->inputs, arg, 0);
+          if(p->inputname==NULL) p->inputname=arg;
+          ++p->numin;
+        }
       break;
 
     /* This is an option, set its value. */
@@ -569,6 +572,29 @@ ui_check_wcsalign_width(struct warpparams *p)
 
 
 
+/* Read the kernel code from its name. */
+static uint8_t
+ui_kernel_from_name(char *name)
+{
+  if(name==NULL || !strcmp(name, "area")) return GAL_WARP_KERNEL_AREA;
+  else if( !strcmp(name, "nearest") )      return GAL_WARP_KERNEL_NEAREST;
+  else if( !strcmp(name, "bilinear") )     return GAL_WARP_KERNEL_BILINEAR;
+  else if( !strcmp(name, "bicubic") )      return GAL_WARP_KERNEL_BICUBIC;
+  else if( !strcmp(name, "lanczos3") )     return GAL_WARP_KERNEL_LANCZOS3;
+  else
+    error(EXIT_FAILURE, 0, "'%s' not recognized as a kernel for "
+          "'--kernel'. The acceptable values are 'area' (default: "
+          "flux-conserving pixel mixing), 'nearest', 'bilinear', "
+          "'bicubic' and 'lanczos3'", name);
+
+  /* Control should not reach here. */
+  return GAL_WARP_KERNEL_AREA;
+}
+
+
+
+
+
 static void *
 ui_check_options_and_arguments_wcsalign(struct warpparams *p)
 {
@@ -672,6 +698,43 @@ ui_check_options_and_arguments(struct warpparams *p)
         error(EXIT_FAILURE, 0, "no '--edgesampling' provided");
     }
 
+  /* Read the kernel (so an invalid name is rejected in any mode). The
+     kernel and the interpolation of the output pixel vertices are only
+     used when aligning with the WCS: linear warps always use the exact
+     pixel mixing of the 'area' kernel. */
+  p->wa.kernel=ui_kernel_from_name(p->kernel);
+  if(p->wcsalign==0)
+    {
+      if(p->wa.kernel!=GAL_WARP_KERNEL_AREA)
+        error(EXIT_FAILURE, 0, "'--kernel=%s' can only be used when "
+              "aligning with the WCS (not with linear warps, for example "
+              "with '--rotate' or '--matrix'). Linear warps always use "
+              "the flux-conserving pixel mixing of the 'area' kernel",
+              p->kernel);
+      if( !isnan(p->wa.maxinterperr) && p->wa.maxinterperr!=0.0f )
+        error(EXIT_FAILURE, 0, "'--maxinterperr' can only be used when "
+              "aligning with the WCS (not with linear warps, for example "
+              "with '--rotate' or '--matrix')");
+    }
+
+  /* Batch mode: when more than one input is given, all the inputs are
+     aligned to the same output grid (re-using the overlaps of the output
+     and input pixels when the inputs have the same WCS) and each output
+     is written in a separate file (so '--output' can only be a
+     directory). The inputs were added to the list in reverse order. */
+  gal_list_str_reverse(&p->inputs);
+  if(p->numin>1)
+    {
+      if(p->wcsalign==0)
+        error(EXIT_FAILURE, 0, "more than one input can only be given "
+              "when aligning with the WCS (not with linear warps)");
+      if(p->wa.checkmaxfrac)
+        error(EXIT_FAILURE, 0, "with more than one input, the "
+              "'--checkmaxfrac' option cannot be used");
+      if(p->cp.output)
+        gal_checkset_check_dir_write_add_slash(&p->cp.output);
+    }
+
   /* Read the input image as double type and its WCS structure. */
   p->input=gal_array_read_one_ch_to_type(p->inputname, p->cp.hdu,
                                          NULL, GAL_TYPE_FLOAT64,
@@ -1113,13 +1176,17 @@ ui_preparations(struct warpparams *p)
   /* Set the output name. This needs to be done before 'ui_finalize_matrix'
      because that function will free the linked list of modular warpings
      which we will need to determine the suffix if no output name is
-     specified. */
-  if(p->cp.output)
-    gal_checkset_writable_remove(p->cp.output, p->inputname, 0,
-                                 p->cp.dontdelete);
-  else
-    p->cp.output=gal_checkset_automatic_output(&p->cp, p->inputname,
-                                               ui_set_suffix(p));
+     specified. In batch mode, the output names are set for each input
+     while writing them. */
+  if(p->numin<2)
+    {
+      if(p->cp.output)
+        gal_checkset_writable_remove(p->cp.output, p->inputname, 0,
+                                     p->cp.dontdelete);
+      else
+        p->cp.output=gal_checkset_automatic_output(&p->cp, p->inputname,
+                                                   ui_set_suffix(p));
+    }
 
   /* Prepare the final warping matrix if in linear mode. */
   if(p->wcsalign == 0) ui_matrix_finalize(p);
@@ -1206,7 +1273,10 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct warpparams *p)
              ctime(&p->rawtime));
       printf(" Using %zu CPU thread%s\n", p->cp.numthreads,
              p->cp.numthreads==1 ? "." : "s.");
-      printf(" Input: %s (hdu: %s)\n", p->inputname, p->cp.hdu);
+      if(p->numin>1)
+        printf(" Inputs: %zu files (hdu: %s)\n", p->numin, p->cp.hdu);
+      else
+        printf(" Input: %s (hdu: %s)\n", p->inputname, p->cp.hdu);
       if(p->gridfile)
         printf(" Pixel grid: %s (hdu %s)\n", p->gridfile, p->gridhdu);
       if(p->wcsalign)
@@ -1261,6 +1331,8 @@ ui_free_report(struct warpparams *p, struct timeval *t1)
   if(p->inverse) free(p->inverse);
   if(p->gridhdu) free(p->gridhdu);
   if(p->gridfile) free(p->gridfile);
+  if(p->kernel) free(p->kernel);
+  gal_list_str_free(p->inputs, 0);
   if(p->matrix) gal_data_free(p->matrix);
   if(p->inwcsmatrix) free(p->inwcsmatrix);
   if(p->modularll) gal_data_free(p->modularll);
@@ -71,6 +71,8 @@ enum option_keys_enum
   UI_KEY_CENTERONCORNER = 1000,
   UI_KEY_CHECKMAXFRAC,
   UI_KEY_EDGESAMPLING,
+  UI_KEY_MAXINTERPERR,
+  UI_KEY_KERNEL,
   UI_KEY_WIDTHINPIX,
   UI_KEY_HSTARTWCS,
   UI_KEY_HENDWCS,
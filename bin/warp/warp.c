@@ -23,6 +23,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <errno.h>
 #include <error.h>
 #include <stdio.h>
@@ -31,12 +32,15 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/array.h>
 #include <gnuastro/warp.h>
 #include <gnuastro/polygon.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/threads.h>
+#include <gnuastro/dimension.h>
 
 #include <gnuastro-internal/timing.h>
+#include <gnuastro-internal/checkset.h>
 
 #include "main.h"
 #include "warp.h"
@@ -63,6 +67,30 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/* When the linear warp is only a scaling and/or shift along each axis (no
+   rotation, shear or projection), the overlap of each output pixel with
+   each input pixel is the product of the overlaps of their sides along
+   each axis. So the overlaps along each axis are found once (for each
+   output row or column) and used for all the pixels. */
+struct warp_separable_axis
+{
+  size_t         maxnum;  /* Maximum num. of input pixels on one output. */
+  size_t           *num;  /* Num. input pixels covered by each output.   */
+  size_t           *pix;  /* Input pixels (from 0, 'maxnum' per output). */
+  double             *w;  /* Overlap with each input pixel.              */
+};
+
+struct warp_separable_params
+{
+  struct warpparams          *p;  /* Main program parameters.            */
+  struct warp_separable_axis  x;  /* Along the horizontal (first) axis.  */
+  struct warp_separable_axis  y;  /* Along the vertical (second) axis.   */
+};
+
+
+
+
+
 
 
 
@@ -236,6 +264,79 @@ warp_onthread_linear(void *inparam)
 
 
 
+/* Similar to 'warp_onthread_linear', but for separable warps (see the
+   description of 'struct warp_separable_axis'). Each thread works on full
+   rows of the output: the contribution of each covered input row is
+   added to all the pixels of the output row together (the input and
+   output rows are contiguous in memory). */
+static void *
+warp_onthread_separable(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct warp_separable_params *sp=
+    (struct warp_separable_params *)tprm->params;
+  struct warpparams *p=sp->p;
+  struct warp_separable_axis *xa=&sp->x, *ya=&sp->y;
+
+  size_t i, j, k, c, r, *xpix, *numinput;
+  double a, v, wy, *row, *out, *xw, *filled;
+  double *input=p->input->array, *output=p->output->array;
+  size_t is1=p->input->dsize[1], os1=p->output->dsize[1];
+
+  /* Allocate the per-pixel values for one output row. */
+  filled=gal_pointer_allocate(GAL_TYPE_FLOAT64, os1, 0, __func__,
+                              "filled");
+  numinput=gal_pointer_allocate(GAL_TYPE_SIZE_T, os1, 0, __func__,
+                                "numinput");
+
+  /* Go over the output rows given to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Initialize the output row. */
+      r=tprm->indexs[i];
+      out=output+r*os1;
+      for(c=0;c<os1;++c) { out[c]=filled[c]=0.0f; numinput[c]=0; }
+
+      /* Add the contribution of each input row that is covered. */
+      for(k=0;k<ya->num[r];++k)
+        {
+          wy=ya->w[r*ya->maxnum+k];
+          row=input+ya->pix[r*ya->maxnum+k]*is1;
+          for(c=0;c<os1;++c)
+            {
+              xw=xa->w+c*xa->maxnum;
+              xpix=xa->pix+c*xa->maxnum;
+              for(j=0;j<xa->num[c];++j)
+                if( !isnan(v=row[xpix[j]]) )
+                  {
+                    a=wy*xw[j];
+                    ++numinput[c];
+                    filled[c]+=a;
+                    out[c]+=v*a;
+                  }
+            }
+        }
+
+      /* Check the coverage (similar to 'warp_onthread_linear'). */
+      for(c=0;c<os1;++c)
+        {
+          if(numinput[c] && filled[c]/p->opixarea < p->coveredfrac-1e-5)
+            numinput[c]=0;
+          if(numinput[c]==0) out[c]=NAN;
+        }
+    }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  free(filled);
+  free(numinput);
+  if(tprm->b) { pthread_barrier_wait(tprm->b); }
+  return NULL;
+}
+
+
+
+
+
 
 
 
@@ -397,6 +498,101 @@ warp_linear_init(struct warpparams *p)
 
 
 
+/* If the inverse transformation only scales and/or shifts each axis, the
+   linear warp can be done separately along each axis. */
+static int
+warp_linear_is_separable(struct warpparams *p)
+{
+  double *t=p->inverse;
+  return t[1]==0.0f && t[3]==0.0f && t[6]==0.0f && t[7]==0.0f;
+}
+
+
+
+
+
+/* Find the overlap of each output pixel with the input pixels along one
+   axis. 'scale' and 'shift' define the inverse transformation along this
+   axis, 'fpix' is the position of the first output pixel, and 'onum' and
+   'inum' are the number of output and input pixels along it. The covered
+   input pixels are found similar to 'warp_onthread_linear'. */
+static void
+warp_separable_axis(struct warp_separable_axis *a, size_t onum,
+                    size_t inum, double fpix, double scale, double shift)
+{
+  size_t c, n;
+  long x, start, end;
+  double t0, t1, lo, hi, o;
+
+  /* Allocate the arrays (an interval of length 'L' can cover at most
+     'L+2' pixels). */
+  a->maxnum=ceil(fabs(scale))+2;
+  a->num=gal_pointer_allocate(GAL_TYPE_SIZE_T, onum, 0, __func__,
+                              "a->num");
+  a->pix=gal_pointer_allocate(GAL_TYPE_SIZE_T, onum*a->maxnum, 0,
+                              __func__, "a->pix");
+  a->w=gal_pointer_allocate(GAL_TYPE_FLOAT64, onum*a->maxnum, 0,
+                            __func__, "a->w");
+
+  /* Go over each output pixel along this axis. */
+  for(c=0;c<onum;++c)
+    {
+      /* The range of this output pixel on the input. */
+      t0=scale*((double)c-0.5f+fpix)+shift;
+      t1=scale*((double)c+0.5f+fpix)+shift;
+      if(t0<t1) { lo=t0; hi=t1; } else { lo=t1; hi=t0; }
+
+      /* The input pixels (that are within the input) and the length of
+         their overlap. */
+      n=0;
+      start=GAL_DIMENSION_NEARESTINT_HALFHIGHER(lo);
+      end=GAL_DIMENSION_NEARESTINT_HALFLOWER(hi)+1;
+      for(x=start;x<end;++x)
+        if( x>=1 && x<=(long)inum )
+          {
+            o = ( (hi < x+0.5f ? hi : x+0.5f)
+                  - (lo > x-0.5f ? lo : x-0.5f) );
+            a->pix[c*a->maxnum+n]=x-1;
+            a->w[c*a->maxnum+n] = o>0.0f ? o : 0.0f;
+            ++n;
+          }
+      a->num[c]=n;
+    }
+}
+
+
+
+
+
+/* Do a separable linear warp (see 'struct warp_separable_axis'). */
+static void
+warp_separable(struct warpparams *p)
+{
+  double *t=p->inverse;
+  struct warp_separable_params sp;
+
+  /* Find the overlaps along each axis. */
+  sp.p=p;
+  warp_separable_axis(&sp.x, p->output->dsize[1], p->input->dsize[1],
+                      p->outfpixval[0], t[0]/t[8], t[2]/t[8]);
+  warp_separable_axis(&sp.y, p->output->dsize[0], p->input->dsize[0],
+                      p->outfpixval[1], t[4]/t[8], t[5]/t[8]);
+
+  /* Fill the output image (each thread works on separate rows). */
+  gal_threads_spin_off(warp_onthread_separable, &sp, p->output->dsize[0],
+                       p->cp.numthreads, p->cp.minmapsize,
+                       p->cp.quietmmap);
+
+  /* Clean up. */
+  free(sp.x.w);   free(sp.y.w);
+  free(sp.x.num); free(sp.y.num);
+  free(sp.x.pix); free(sp.y.pix);
+}
+
+
+
+
+
 static void
 warp_write_to_file(struct warpparams *p, int hasmatrix)
 {
@@ -519,6 +715,184 @@ warp_write_wcs_linear(struct warpparams *p)
 
 
 
+
+
+
+
+
+/***************************************************************/
+/**************          Batch mode           ******************/
+/***************************************************************/
+/* Read one of the inputs (similar to the reading of the first input in
+   'ui.c'). */
+static gal_data_t *
+warp_batch_read(struct warpparams *p, char *filename)
+{
+  gal_data_t *input;
+
+  /* Read the image and its WCS. */
+  input=gal_array_read_one_ch_to_type(filename, p->cp.hdu, NULL,
+                                      GAL_TYPE_FLOAT64, p->cp.minmapsize,
+                                      p->cp.quietmmap);
+  input->wcs=gal_wcs_read(filename, p->cp.hdu, p->cp.wcslinearmatrix,
+                          p->hstartwcs, p->hendwcs, &input->nwcs);
+  input->ndim=gal_dimension_remove_extra(input->ndim, input->dsize,
+                                         input->wcs);
+
+  /* Basic checks. */
+  if(input->ndim!=2)
+    error(EXIT_FAILURE, 0, "%s (hdu %s): has %zu dimensions but Warp "
+          "currently only works on 2D images", filename, p->cp.hdu,
+          input->ndim);
+  if(input->wcs==NULL)
+    error(EXIT_FAILURE, 0, "%s (hdu %s): no WCS could be read, but it is "
+          "necessary for aligning with the WCS", filename, p->cp.hdu);
+  return input;
+}
+
+
+
+
+
+/* Write the output of one input ('p->output') and free it. */
+static void
+warp_batch_write(struct warpparams *p, char *input, char *outdir)
+{
+  char *out, *base, *nosuffix, *suffix;
+  struct gal_options_common_params *cp=&p->cp;
+
+  /* Set the output name: when no output directory was given, use the
+     automatic output. */
+  if(outdir)
+    {
+      base=gal_checkset_not_dir_part(input);
+      nosuffix=gal_checkset_suffix_separate(base, &suffix);
+      if( asprintf(&out, "%s%s_aligned.fits", outdir, nosuffix)<0 )
+        error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+      gal_checkset_writable_remove(out, input, cp->keep, cp->dontdelete);
+      free(nosuffix);
+      free(suffix);
+      free(base);
+    }
+  else
+    out=gal_checkset_automatic_output(cp, input, "_aligned.fits");
+
+  /* The configuration keywords are freed after writing each output, so
+     they need to be re-built for every output. */
+  if(cp->okeys==NULL) gal_options_as_fits_keywords(cp);
+
+  /* Write the output. */
+  p->inputname=input;
+  cp->output=out;
+  warp_write_to_file(p, 0);
+  if(!cp->quiet) printf("  - Output: %s\n", out);
+
+  /* Clean up. */
+  free(out);
+  cp->output=NULL;
+  gal_list_data_free(p->output);
+  p->output=NULL;
+}
+
+
+
+
+
+/* When more than one input is given, all of them are aligned to the
+   output grid of the first. The overlaps of the output pixels with the
+   input pixels are kept in a plan (sparse matrix), so any input with the
+   same WCS (for example exposures on the same pointing) is aligned with
+   a simple sparse matrix-vector product. When an input's WCS differs, a
+   new plan is built for it (on the same output grid). */
+static void
+warp_batch(struct warpparams *p)
+{
+  size_t two=2;
+  struct timeval t0;
+  gal_list_str_t *name;
+  gal_data_t *input, *widthinpix;
+  gal_warp_plan_t *plan, *newplan;
+  gal_warp_wcsalign_t *wa=&p->wa, nwa;
+  char *outdir=p->cp.output, *firstname=p->inputname;
+
+  /* Build the plan with the first input (this also aligns it). */
+  if(!p->cp.quiet)
+    {
+      gal_timing_report(NULL, "Building the plan with the first "
+                        "input...", 1);
+      gettimeofday(&t0, NULL);
+    }
+  plan=gal_warp_plan_make(wa);
+  if(!p->cp.quiet) gal_timing_report(&t0, "Done", 2);
+  p->output=wa->output;
+  wa->output=NULL;
+  warp_batch_write(p, p->inputs->v, outdir);
+
+  /* The output size of the plan (for new plans). */
+  widthinpix=gal_data_alloc(plan->outsize, GAL_TYPE_SIZE_T, 1, &two, NULL,
+                            0, -1, 1, NULL, NULL, NULL);
+
+  /* Align the rest of the inputs. */
+  for(name=p->inputs->next; name!=NULL; name=name->next)
+    {
+      /* Read the input. */
+      input=warp_batch_read(p, name->v);
+
+      /* If the current plan can't be used, build a new one on the same
+         output grid. */
+      if( gal_warp_plan_usable(plan, input) )
+        p->output=gal_warp_plan_apply(plan, input);
+      else
+        {
+          if(!p->cp.quiet)
+            printf("  - %s: different WCS, building a new plan.\n",
+                   name->v);
+          nwa=gal_warp_wcsalign_template();
+          nwa.input=input;
+          nwa.twcs=plan->owcs;
+          nwa.kernel=wa->kernel;
+          nwa.widthinpix=widthinpix;
+          nwa.numthreads=wa->numthreads;
+          nwa.coveredfrac=wa->coveredfrac;
+          nwa.edgesampling=wa->edgesampling;
+          nwa.maxinterperr=wa->maxinterperr;
+          newplan=gal_warp_plan_make(&nwa);
+          p->output=nwa.output;
+
+          /* 'nwa.twcs' was in the old plan, so it should be freed after
+             the new plan is built. The output size array is also in the
+             old plan. */
+          widthinpix->array=newplan->outsize;
+          gal_warp_plan_free(plan);
+          plan=newplan;
+        }
+
+      /* Write the output and clean up. */
+      warp_batch_write(p, name->v, outdir);
+      gal_data_free(input);
+    }
+
+  /* Clean up. Note that 'widthinpix->array' is within the plan. */
+  widthinpix->array=NULL;
+  gal_data_free(widthinpix);
+  gal_warp_plan_free(plan);
+  p->inputname=firstname;
+  p->cp.output=outdir;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 
 
 
@@ -533,6 +907,9 @@ warp(struct warpparams *p)
   struct timeval t0;
   gal_warp_wcsalign_t *wa=&p->wa;
 
+  /* Batch mode (more than one input). */
+  if(p->numin>1) { warp_batch(p); return; }
+
   /* Do the preparations and set the pointers to the functions to use. */
   if( p->wcsalign )
     {
@@ -566,10 +943,14 @@ warp(struct warpparams *p)
     {
       warp_linear_init(p);
 
-      /* Fill the output image */
-      gal_threads_spin_off(warp_onthread_linear, p, p->output->size,
-                           p->cp.numthreads, p->cp.minmapsize,
-                           p->cp.quietmmap);
+      /* Fill the output image. When the warp is only a scaling and/or
+         shift along each axis, the faster separable method is used. */
+      if( warp_linear_is_separable(p) )
+        warp_separable(p);
+      else
+        gal_threads_spin_off(warp_onthread_linear, p, p->output->size,
+                             p->cp.numthreads, p->cp.minmapsize,
+                             p->cp.quietmmap);
 
       /* Fix the linear matrix before saving the output image to disk */
       warp_write_wcs_linear(p);
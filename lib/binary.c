@@ -22,6 +22,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
@@ -33,6 +34,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/blank.h>
 #include <gnuastro/binary.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/dimension.h>
 
 
@@ -46,248 +48,550 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /*********************************************************************/
 /*****************      Erosion and dilation      ********************/
 /*********************************************************************/
-static void
-binary_erode_dilate_1d(gal_data_t *input, int dilate0_erode1)
+/* Erosion and dilation are done on bit-packed copies of the dataset:
+   each line along the fastest dimension is kept in 64-bit words, in two
+   bit-planes: one for the elements that grow ('f', which is 1 for
+   dilation and 0 for erosion) and one for the elements that may change
+   into 'f' ('b'). Elements with any other value (for example blank) are
+   in neither, so they don't change and don't affect their neighbors.
+
+   In each iteration, the neighbors of the 64 elements of a word are
+   found with a bit-wise OR over the words of the neighboring lines and
+   their one-bit shifts. The lines are distributed between the threads
+   and each iteration reads from one pair of planes and writes into
+   another, so no temporary value is necessary within the dataset.
+
+   When the dataset only has 0 or 1 valued elements, multiple iterations
+   are equivalent to a (digital) distance to the nearest 'f' element, so
+   they are fused:
+
+     - With the maximum connectivity, 'num' iterations are a box of
+       half-width 'num'. It is separable, so it is done along each
+       dimension with a few OR-shifts of the bit-planes (each stage
+       can only double the box's width: the elements outside the
+       dataset aren't kept, so the shift must not leave a gap).
+
+     - With a connectivity of 1, 'num' iterations are the elements with
+       a city-block (L1) distance of 'num' or less. When 'num' is large,
+       the distance is found with a separable distance transform (two
+       passes over each line along every dimension), independent of
+       'num'. */
+#define BINARY_MORPH_DT_MINNUM   64
+#define BINARY_MORPH_DT_INF      (UINT32_MAX/2)
+#define BINARY_MORPH_MAXSLOW     9       /* 3^(ndim-1) for 3D. */
+
+enum binary_morph_steps
+{
+  BINARY_MORPH_INVALID,         /* ==0 by C standard. */
+
+  BINARY_MORPH_PACK,
+  BINARY_MORPH_ITERATE,
+  BINARY_MORPH_BOX,
+  BINARY_MORPH_UNPACK,
+  BINARY_MORPH_DT_INIT,
+  BINARY_MORPH_DT_AXIS,
+  BINARY_MORPH_DT_UNPACK,
+};
+
+struct binary_morph_slow
+{
+  long               lshift;  /* Shift (in lines) to the neighbor line.  */
+  int                o[2];    /* Offset along the slow dimensions.       */
+  uint8_t            center;  /* Use the element in the same position.   */
+  uint8_t              side;  /* Use the elements on the two sides.      */
+};
+
+struct binary_morph_params
 {
-  size_t i, nr=input->dsize[0];
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-          "fix this problem. The value to 'dilate0_erode1' is %u while it "
-          "should be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
-
-  /* Set the foreground and background values. */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
-
-  /* Check the two extremes. */
-  if(byt[0]==b && byt[1]==f ) byt[0]=GAL_BINARY_TMP_VALUE;
-  if(nr>2)
-    if(byt[nr-1]==b && byt[nr-2]==f) byt[nr-1] = GAL_BINARY_TMP_VALUE;
-
-  /* Go over the full array. */
-  for(i=1;i<nr;++i)
-    if( byt[i]==b && ( byt[i-1]==f || byt[i+1]==f ) )
-      byt[i]=GAL_BINARY_TMP_VALUE;
-
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+  gal_data_t        *input;   /* Input 'uint8' dataset (modified).       */
+  uint8_t                f;   /* Value that grows.                       */
+  uint8_t                b;   /* Value that can change to 'f'.           */
+  size_t               num;   /* Number of erosions or dilations.        */
+  size_t        numthreads;   /* Number of threads to use.               */
+  size_t             nfast;   /* Number of elements along fastest dim.   */
+  size_t            nlines;   /* Number of lines along fastest dim.      */
+  size_t                nw;   /* Number of 64-bit words in each line.    */
+  uint64_t        lastmask;   /* Mask of usable bits in last word.       */
+  size_t           linc[2];   /* Increment (in lines) of slow dims.      */
+  size_t             nslow;   /* Number of neighboring lines.            */
+  struct binary_morph_slow slow[BINARY_MORPH_MAXSLOW];
+
+  int                 step;   /* The step that the threads should do.    */
+  size_t              axis;   /* Dimension of current box/DT step.       */
+  size_t             shift;   /* Shift of the current box step.          */
+  size_t             *dinc;   /* Increment along each dimension.         */
+  uint64_t           *orig;   /* Original 'f' bit-plane.                 */
+  uint64_t            *fin;   /* Input 'f' bit-plane of this step.       */
+  uint64_t            *bin;   /* Input 'b' bit-plane of this step.       */
+  uint64_t           *fout;   /* Output 'f' bit-plane of this step.      */
+  uint64_t           *bout;   /* Output 'b' bit-plane of this step.      */
+  uint32_t           *dist;   /* Distance (for the distance transform).  */
+  uint8_t           *other;   /* Element other than 0 or 1 (per thread). */
+};
+
+
+
+
+
+/* Range of jobs of this thread (out of 'total'). */
+static size_t
+binary_morph_range(struct binary_morph_params *mprm, size_t total,
+                   size_t id, size_t *first)
+{
+  size_t size, nt=mprm->numthreads;
+  size   = total/nt;
+  *first = total/nt*id;
+  if(id==nt-1 && nt>1) size=total-(nt-1)*size;
+  return size;
 }
 
 
 
 
 
-static void
-binary_erode_dilate_2d_4con(gal_data_t *input, int dilate0_erode1)
-{
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
+/* Coordinate of a line along a slow dimension. */
+#define BINARY_MORPH_LCOORD(MPRM, L, D)                                 \
+  ( ( (L) / (MPRM)->linc[D] ) % (MPRM)->input->dsize[D] )
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-          "fix this problem. The value to 'dilate0_erode1' is %u while it "
-          "should be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
 
-  /* Set the foreground and background values. */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
 
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f || byt[nc]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[nc-1]==b && (byt[nc-2]==f || byt[2*nc-1]==f))
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[(nr-1)*nc]==b
-     && (byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
+/* Put the 'f' and 'b' elements of the lines into the bit-planes. */
+static void
+binary_morph_pack(struct binary_morph_params *mprm, size_t id)
+{
+  uint64_t fw, bw;
+  uint8_t v, *in=mprm->input->array;
+  size_t i, k, w, L, first, size, nk, nfast=mprm->nfast;
 
-  if(byt[nr*nc-1]==b
-     && (byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
+  size=binary_morph_range(mprm, mprm->nlines, id, &first);
+  for(L=first; L<first+size; ++L)
+    for(w=0; w<mprm->nw; ++w)
+      {
+        fw=bw=0;
+        i=L*nfast+w*64;
+        nk = nfast-w*64 < 64 ? nfast-w*64 : 64;
+        for(k=0;k<nk;++k)
+          {
+            v=in[i+k];
+            if(v==mprm->f)      fw |= (uint64_t)1<<k;
+            else if(v==mprm->b) bw |= (uint64_t)1<<k;
+            else                mprm->other[id]=1;
+          }
+        mprm->orig[L*mprm->nw+w]=fw;
+        mprm->bin[L*mprm->nw+w]=bw;
+      }
+}
 
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && (byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
 
-  for(j=1;j<nc-1;++j)
-    {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
+
+
+/* One erosion or dilation over the lines of this thread. */
+static void
+binary_morph_iterate(struct binary_morph_params *mprm, size_t id)
+{
+  int *o;
+  struct binary_morph_slow *s;
+  uint64_t v, acc, *x, *src[BINARY_MORPH_MAXSLOW];
+  size_t d, j, w, L, ind, first, size, nsrc, nw=mprm->nw;
+  uint8_t center[BINARY_MORPH_MAXSLOW], side[BINARY_MORPH_MAXSLOW];
+
+  size=binary_morph_range(mprm, mprm->nlines, id, &first);
+  for(L=first; L<first+size; ++L)
     {
-      ind=i*nc;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      /* The neighboring lines that are within the dataset. */
+      nsrc=0;
+      for(j=0;j<mprm->nslow;++j)
+        {
+          s=mprm->slow+j;
+          o=s->o;
+          for(d=0;d<mprm->input->ndim-1;++d)
+            if( ( o[d]==-1 && BINARY_MORPH_LCOORD(mprm, L, d)==0 )
+                || ( o[d]==1 && ( BINARY_MORPH_LCOORD(mprm, L, d)
+                                  == mprm->input->dsize[d]-1 ) ) )
+              break;
+          if(d<mprm->input->ndim-1) continue;
+          src[nsrc]=mprm->fin+(L+s->lshift)*nw;
+          center[nsrc]=s->center;
+          side[nsrc++]=s->side;
+        }
+
+      /* Find the neighbors of every word and set the output. */
+      for(w=0;w<nw;++w)
+        {
+          acc=0;
+          for(j=0;j<nsrc;++j)
+            {
+              x=src[j];
+              v=x[w];
+              if(center[j]) acc |= v;
+              if(side[j])
+                acc |= ( (v<<1) | (v>>1)
+                         | ( w      ? x[w-1]>>63 : 0 )
+                         | ( w<nw-1 ? x[w+1]<<63 : 0 ) );
+            }
+          ind=L*nw+w;
+          mprm->fout[ind] = mprm->fin[ind] | (mprm->bin[ind] & acc);
+          mprm->bout[ind] = mprm->bin[ind] & ~acc;
+        }
     }
+}
+
+
+
 
-  for(i=1;i<nr-1;++i)
+
+/* One stage of a box dilation of the 'f' bit-plane along one dimension:
+   each element is the OR of itself and the elements at 'shift' before
+   and after it. */
+static void
+binary_morph_box(struct binary_morph_params *mprm, size_t id)
+{
+  uint64_t *x, *y;
+  size_t c, w, L, first, size, nw=mprm->nw, ndim=mprm->input->ndim;
+  size_t s=mprm->shift, q=mprm->shift/64, r=mprm->shift%64, linc, n;
+
+  size=binary_morph_range(mprm, mprm->nlines, id, &first);
+  for(L=first; L<first+size; ++L)
     {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      x=mprm->fin+L*nw;
+      y=mprm->fout+L*nw;
+
+      /* Along the fastest dimension (a shift of bits). */
+      if(mprm->axis==ndim-1)
+        {
+          for(w=0;w<nw;++w)
+            {
+              y[w]=x[w];
+              if(w>=q)       y[w] |= x[w-q]<<r;
+              if(r && w>q)   y[w] |= x[w-q-1]>>(64-r);
+              if(w+q<nw)     y[w] |= x[w+q]>>r;
+              if(r && w+q+1<nw) y[w] |= x[w+q+1]<<(64-r);
+            }
+          y[nw-1] &= mprm->lastmask;
+        }
+
+      /* Along a slower dimension (a shift of lines). */
+      else
+        {
+          linc=mprm->linc[mprm->axis];
+          n=mprm->input->dsize[mprm->axis];
+          c=BINARY_MORPH_LCOORD(mprm, L, mprm->axis);
+          for(w=0;w<nw;++w)
+            {
+              y[w]=x[w];
+              if(c>=s)  y[w] |= (x-s*linc*nw)[w];
+              if(c+s<n) y[w] |= (x+s*linc*nw)[w];
+            }
+        }
     }
+}
+
+
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
+
+
+/* Write the changed elements of this thread's lines into the dataset:
+   the bits that are set in 'fin' but weren't set originally. */
+static void
+binary_morph_unpack(struct binary_morph_params *mprm, size_t id)
+{
+  uint64_t bits;
+  uint8_t *in=mprm->input->array;
+  size_t i, k, w, L, first, size, nw=mprm->nw;
+
+  size=binary_morph_range(mprm, mprm->nlines, id, &first);
+  for(L=first; L<first+size; ++L)
+    for(w=0;w<nw;++w)
       {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f     || byt[ind+1]==f
-               || byt[ind+nc]==f || byt[ind-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
+        bits = mprm->fin[L*nw+w] & ~mprm->orig[L*nw+w];
+        i=L*mprm->nfast+w*64;
+        for(k=0; bits; ++k, bits>>=1)
+          if( (bits & 1) && in[i+k]==mprm->b ) in[i+k]=mprm->f;
       }
+}
+
+
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+
+
+/* Initialize the distance of every element: zero on 'f' elements. */
+static void
+binary_morph_dt_init(struct binary_morph_params *mprm, size_t id)
+{
+  uint8_t *in=mprm->input->array;
+  size_t i, first, size=binary_morph_range(mprm, mprm->input->size, id,
+                                           &first);
+  for(i=first;i<first+size;++i)
+    mprm->dist[i] = in[i]==mprm->f ? 0 : BINARY_MORPH_DT_INF;
 }
 
 
 
 
 
-/* 8 connected dilation and erosion. b0_f1==0: Dilate the
-   foreground. b0_f1==1: Erode the foreground. */
+/* City-block distance along one dimension: a forward and backward pass
+   over every line along that dimension. */
 static void
-binary_erode_dilate_2d_8con(gal_data_t *input, unsigned char dilate0_erode1)
+binary_morph_dt_axis(struct binary_morph_params *mprm, size_t id)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
-
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can fix "
-          "this problem. The value to dilate0_erode1 is %u while it should "
-          "be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
-
-  /* Set the foreground and background values: */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
-
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f
-                   || byt[nc]==f || byt[nc+1]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nc-1]==b && (byt[nc-2]==f
-                      || byt[2*nc-1]==f
-                      || byt[2*nc-2]==f) )
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[(nr-1)*nc]==b
-     && ( byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f
-          || byt[(nr-2)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nr*nc-1]==b
-     && ( byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f
-          || byt[nr*nc-2-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
-
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && ( byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f
-            || byt[j-1+nc]==f || byt[j+1+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
-
-  for(j=1;j<nc-1;++j)
-    {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f
-              || byt[ind-1-nc]==f || byt[ind+1-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
+  uint32_t *d=mprm->dist;
+  size_t a=mprm->axis, n=mprm->input->dsize[a], inc=mprm->dinc[a];
+  size_t i, l, p, start, first, size;
 
-  for(i=1;i<nr-1;++i)
+  size=binary_morph_range(mprm, mprm->input->size/n, id, &first);
+  for(l=first; l<first+size; ++l)
     {
-      ind=i*nc;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-              || byt[ind+1-nc]==f || byt[ind+1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      start = (l/inc)*inc*n + l%inc;
+      for(i=1;i<n;++i)
+        {
+          p=start+i*inc;
+          if(d[p-inc]+1<d[p]) d[p]=d[p-inc]+1;
+        }
+      for(i=n-1;i>0;--i)
+        {
+          p=start+(i-1)*inc;
+          if(d[p+inc]+1<d[p]) d[p]=d[p+inc]+1;
+        }
     }
+}
 
-  for(i=1;i<nr-1;++i)
+
+
+
+
+/* Change the 'b' elements that are within the distance. */
+static void
+binary_morph_dt_unpack(struct binary_morph_params *mprm, size_t id)
+{
+  uint8_t *in=mprm->input->array;
+  size_t i, first, size=binary_morph_range(mprm, mprm->input->size, id,
+                                           &first);
+  for(i=first;i<first+size;++i)
+    if(in[i]==mprm->b && mprm->dist[i]<=mprm->num) in[i]=mprm->f;
+}
+
+
+
+
+
+static void *
+binary_morph_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_morph_params *mprm=
+    (struct binary_morph_params *)tprm->params;
+
+  /* Do the requested step. */
+  switch(mprm->step)
     {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-             || byt[ind-1-nc]==f || byt[ind-1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+    case BINARY_MORPH_PACK:      binary_morph_pack(mprm, tprm->id);    break;
+    case BINARY_MORPH_ITERATE:   binary_morph_iterate(mprm, tprm->id); break;
+    case BINARY_MORPH_BOX:       binary_morph_box(mprm, tprm->id);     break;
+    case BINARY_MORPH_UNPACK:    binary_morph_unpack(mprm, tprm->id);  break;
+    case BINARY_MORPH_DT_INIT:   binary_morph_dt_init(mprm, tprm->id); break;
+    case BINARY_MORPH_DT_AXIS:   binary_morph_dt_axis(mprm, tprm->id); break;
+    case BINARY_MORPH_DT_UNPACK:
+      binary_morph_dt_unpack(mprm, tprm->id);
+      break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+            "the problem. The value %d isn't recognized for 'step'",
+            __func__, PACKAGE_BUGREPORT, mprm->step);
     }
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
-      {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f        || byt[ind+1]==f
-               || byt[ind+nc]==f    || byt[ind-nc]==f
-               || byt[ind-1-nc]==f  || byt[ind+1+nc]==f
-               || byt[ind-1+nc]==f  || byt[ind+1-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
-      }
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+/* Run one step on all the threads. */
+static void
+binary_morph_step(struct binary_morph_params *mprm, int step)
+{
+  mprm->step=step;
+  gal_threads_spin_off(binary_morph_on_thread, mprm, mprm->numthreads,
+                       mprm->numthreads, mprm->input->minmapsize,
+                       mprm->input->quietmmap);
 }
 
 
 
 
 
-/* This is a general erosion and dilation function. It is less efficient
-   than the more specialized cases above. */
+/* The neighboring lines (along the slow dimensions) of a line, and if
+   the element in the same position and/or the two sides (along the
+   fastest dimension) should be used. */
 static void
-binary_erode_dilate_general(gal_data_t *input, unsigned char dilate0_erode1,
+binary_morph_slow_neighbors(struct binary_morph_params *mprm,
                             int connectivity)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, *dinc=gal_dimension_increment(input->ndim, input->dsize);
+  int o[2];
+  size_t i, d, nz, total=1, nd=mprm->input->ndim-1;
+  struct binary_morph_slow *s;
+
+  mprm->nslow=0;
+  for(d=0;d<nd;++d) total*=3;
+  for(i=0;i<total;++i)
+    {
+      /* Offset along each slow dimension ('i' in base 3). */
+      o[0] = nd>0 ? (int)( nd==1 ? i : i/3 ) - 1 : 0;
+      o[1] = nd>1 ? (int)( i%3 ) - 1 : 0;
+      nz = (o[0]!=0) + (o[1]!=0);
+      if(nz>(size_t)connectivity) continue;
+
+      /* Keep this neighbor. */
+      s=mprm->slow+mprm->nslow++;
+      s->o[0]=o[0];
+      s->o[1]=o[1];
+      s->center = nz>0;
+      s->side   = nz+1<=(size_t)connectivity;
+      s->lshift = 0;
+      for(d=0;d<nd;++d) s->lshift += o[d]*(long)mprm->linc[d];
+    }
+}
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can fix "
-          "this problem. The value to dilate0_erode1 is %u while it should "
-          "be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
 
-  /* Set the foreground and background values: */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
 
-  /* Go over the neighbors of each pixel. */
-  for(i=0;i<input->size;++i)
-    if(byt[i]==b)
-      GAL_DIMENSION_NEIGHBOR_OP(i, input->ndim, input->dsize, connectivity,
-                                dinc,{
-                                  if(byt[i]!=GAL_BINARY_TMP_VALUE
-                                     && byt[nind]==f)
-                                    byt[i]=GAL_BINARY_TMP_VALUE;
-                                });
-
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+input->size;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+
+
+/* Erode or dilate the dataset 'num' times with the given number of
+   threads. 'binary' must have a 'uint8' type and not be a tile. */
+static void
+binary_morph(gal_data_t *binary, size_t num, int connectivity,
+             size_t numthreads, int d0e1)
+{
+  gal_data_t *dist;
+  size_t i, r, nplane;
+  uint64_t *planes, *tmp;
+  int fuse=0, other=0;
+  struct binary_morph_params mprm;
+  size_t d, ndim=binary->ndim;
+
+  /* Basic sanity checks. */
+  if(ndim>3)
+    error(EXIT_FAILURE, 0, "%s: currently doesn't work on %zu "
+          "dimensional datasets", __func__, ndim);
+  if(connectivity<1 || connectivity>(int)ndim)
+    error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity "
+          "in a %zuD dataset", __func__, connectivity, ndim);
+  if(num==0 || binary->size==0) return;
+
+
+  /* Basic parameters. */
+  mprm.num=num;
+  mprm.input=binary;
+  mprm.f = d0e1 ? 0 : 1;
+  mprm.b = d0e1 ? 1 : 0;
+  mprm.nfast=binary->dsize[ndim-1];
+  mprm.nlines=binary->size/mprm.nfast;
+  mprm.nw=(mprm.nfast+63)/64;
+  mprm.lastmask = ( mprm.nfast%64
+                    ? ((uint64_t)1<<(mprm.nfast%64))-1
+                    : ~(uint64_t)0 );
+  mprm.numthreads = ( numthreads==0 ? 1
+                      : ( numthreads>mprm.nlines
+                          ? mprm.nlines : numthreads ) );
+  mprm.dinc=gal_dimension_increment(ndim, binary->dsize);
+  for(d=0;d<ndim-1;++d) mprm.linc[d]=mprm.dinc[d]/mprm.nfast;
+  binary_morph_slow_neighbors(&mprm, connectivity);
+  mprm.other=gal_pointer_allocate(GAL_TYPE_UINT8, mprm.numthreads, 1,
+                                  __func__, "mprm.other");
+
+
+  /* Allocate the bit-planes (the original 'f' plane and two pairs of
+     planes for the input and output of each step). */
+  nplane=mprm.nlines*mprm.nw;
+  planes=gal_pointer_allocate(GAL_TYPE_UINT64, 5*nplane, 0, __func__,
+                              "planes");
+  mprm.orig=planes;
+  mprm.bin=planes+nplane;
+  mprm.fout=planes+2*nplane;
+  mprm.bout=planes+3*nplane;
+
+
+  /* Pack the dataset and see if it has any elements other than 0 or
+     1. */
+  binary_morph_step(&mprm, BINARY_MORPH_PACK);
+  for(i=0;i<mprm.numthreads;++i) if(mprm.other[i]) { other=1; break; }
+  if(other==0 && num>1)
+    {
+      if(connectivity==(int)ndim) fuse=BINARY_MORPH_BOX;
+      else if(connectivity==1 && num>=BINARY_MORPH_DT_MINNUM)
+        fuse=BINARY_MORPH_DT_INIT;
+    }
+
+
+  /* Do the operation. */
+  switch(fuse)
+    {
+    /* Box: separable stages along each dimension, starting from the
+       original 'f' plane and ping-ponging between the two other
+       planes. */
+    case BINARY_MORPH_BOX:
+      mprm.fin=mprm.orig;
+      mprm.fout=planes+2*nplane;
+      for(d=0;d<ndim;++d)
+        for(r=0; r<num; r+=mprm.shift)
+          {
+            mprm.axis=d;
+            mprm.shift = r+1 < num-r ? r+1 : num-r;
+            binary_morph_step(&mprm, BINARY_MORPH_BOX);
+            mprm.fin=mprm.fout;
+            mprm.fout = ( mprm.fout==planes+2*nplane
+                          ? planes+3*nplane : planes+2*nplane );
+          }
+      binary_morph_step(&mprm, BINARY_MORPH_UNPACK);
+      break;
+
+    /* City-block distance transform. */
+    case BINARY_MORPH_DT_INIT:
+      dist=gal_data_alloc(NULL, GAL_TYPE_UINT32, ndim, binary->dsize,
+                          NULL, 0, binary->minmapsize, binary->quietmmap,
+                          NULL, NULL, NULL);
+      mprm.dist=dist->array;
+      binary_morph_step(&mprm, BINARY_MORPH_DT_INIT);
+      for(d=0;d<ndim;++d)
+        {
+          mprm.axis=d;
+          binary_morph_step(&mprm, BINARY_MORPH_DT_AXIS);
+        }
+      binary_morph_step(&mprm, BINARY_MORPH_DT_UNPACK);
+      gal_data_free(dist);
+      break;
+
+    /* Iterate 'num' times, the first iteration reads from the original
+       'f' plane (which is kept for the unpacking). */
+    default:
+      mprm.fin=mprm.orig;
+      for(i=0;i<num;++i)
+        {
+          binary_morph_step(&mprm, BINARY_MORPH_ITERATE);
+          if(i==0)
+            {
+              mprm.fin=mprm.fout; mprm.bin=mprm.bout;
+              mprm.fout=planes+4*nplane; mprm.bout=planes+nplane;
+            }
+          else
+            {
+              tmp=mprm.fin; mprm.fin=mprm.fout; mprm.fout=tmp;
+              tmp=mprm.bin; mprm.bin=mprm.bout; mprm.bout=tmp;
+            }
+        }
+      binary_morph_step(&mprm, BINARY_MORPH_UNPACK);
+    }
+
+
+  /* Clean up. */
+  free(planes);
+  free(mprm.dinc);
+  free(mprm.other);
 }
 
 
@@ -305,11 +609,9 @@ binary_erode_dilate_general(gal_data_t *input, unsigned char dilate0_erode1,
    when the input's type isn't 'uint8_t', 'inplace' is irrelevant. */
 static gal_data_t *
 binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
-                    int inplace, int d0e1)
+                    int inplace, size_t numthreads, int d0e1)
 {
-  size_t counter;
   gal_data_t *binary;
-  size_t *dinc=gal_dimension_increment(input->ndim, input->dsize);
 
   /* Currently this only works on blocks. */
   if(input->block)
@@ -322,38 +624,20 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
              ? input
              : gal_data_copy_to_new_type(input, GAL_TYPE_UINT8) );
 
-  /* Go over every element and do the erosion. */
-  switch(binary->ndim)
-    {
-    case 1:
-      binary_erode_dilate_1d(binary, d0e1);
-      break;
+  /* Do the erosion or dilation and return. */
+  binary_morph(binary, num, connectivity, numthreads, d0e1);
+  return binary;
+}
 
-    case 2:
-      for(counter=0;counter<num;++counter)
-        switch(connectivity)
-          {
-          case 1: binary_erode_dilate_2d_4con(binary, d0e1); break;
-          case 2: binary_erode_dilate_2d_8con(binary, d0e1); break;
-          default:
-            error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity "
-                  "in a 2D dataset", __func__, connectivity);
-          }
-      break;
 
-    case 3:
-      for(counter=0;counter<num;++counter)
-        binary_erode_dilate_general(binary, d0e1, connectivity);
-      break;
 
-    default:
-      error(EXIT_FAILURE, 0, "%s: currently doesn't work on %zu "
-            "dimensional datasets", __func__, binary->ndim);
-    }
 
-  /* Clean up and return. */
-  free(dinc);
-  return binary;
+
+gal_data_t *
+gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
+                 int inplace)
+{
+  return binary_erode_dilate(input, num, connectivity, inplace, 1, 1);
 }
 
 
@@ -361,10 +645,11 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
 
 
 gal_data_t *
-gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
-                 int inplace)
+gal_binary_erode_parallel(gal_data_t *input, size_t num, int connectivity,
+                          int inplace, size_t numthreads)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 1);
+  return binary_erode_dilate(input, num, connectivity, inplace,
+                             numthreads, 1);
 }
 
 
@@ -375,7 +660,19 @@ gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
                   int inplace)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 0);
+  return binary_erode_dilate(input, num, connectivity, inplace, 1, 0);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_dilate_parallel(gal_data_t *input, size_t num, int connectivity,
+                           int inplace, size_t numthreads)
+{
+  return binary_erode_dilate(input, num, connectivity, inplace,
+                             numthreads, 0);
 }
 
 
@@ -385,16 +682,28 @@ gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
                 int inplace)
+{
+  return gal_binary_open_parallel(input, num, connectivity, inplace, 1);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_open_parallel(gal_data_t *input, size_t num, int connectivity,
+                         int inplace, size_t numthreads)
 {
   gal_data_t *out;
 
   /* First do the necessary number of erosions. */
-  out=gal_binary_erode(input, num, connectivity, inplace);
+  out=gal_binary_erode_parallel(input, num, connectivity, inplace,
+                                numthreads);
 
   /* If 'inplace' was called, then 'out' is the same as 'input', if it
      wasn't, then 'out' is a newly allocated array. In any case, we should
      dilate in the same allocated space. */
-  gal_binary_dilate(input, num, connectivity, 1);
+  gal_binary_dilate_parallel(out, num, connectivity, 1, numthreads);
 
   /* Return the output dataset. */
   return out;
@@ -419,6 +728,321 @@ gal_binary_open(gal_data_t *input, size_t num, int connectivity,
 
 
 
+/*********************************************************************/
+/*****************   Euclidean distance transform   ******************/
+/*********************************************************************/
+/* The exact Euclidean distance transform is separable: the squared
+   distance is first found along each line of the fastest dimension and
+   then used as the input of the same operation along the next
+   dimension(s). Along each line, the squared distance is the lower
+   envelope of parabolas that are centered on each element, with a height
+   equal to its input value (Felzenszwalb & Huttenlocher 2012, Theory of
+   Computing, 8, 415). It is found in linear time and the lines of each
+   dimension are distributed between the threads. */
+struct binary_edt_params
+{
+  gal_data_t        *input;   /* Input 'uint8' dataset.                  */
+  uint8_t            value;   /* Value to find the distance to.          */
+  double              *sqd;   /* Squared distance of every element.      */
+  size_t             *dinc;   /* Increment along each dimension.         */
+  size_t              axis;   /* Dimension to work on in this step.      */
+  size_t        numthreads;   /* Number of threads.                      */
+};
+
+
+
+
+
+/* Squared distance along one line: 'f' is the input (with 'INFINITY' for
+   elements that have no distance yet) and 'd' is the output. 'v' (the
+   position of the parabolas in the envelope) and 'z' (the boundaries of
+   each parabola) must have space for 'n' and 'n+1' elements. */
+static void
+binary_edt_line(double *f, size_t n, double *d, size_t *v, double *z)
+{
+  double s;
+  size_t q, k=0, first;
+
+  /* Find the first element with a finite value, if there is none, the
+     distance along this line is infinity. */
+  for(first=0;first<n;++first) if( !isinf(f[first]) ) break;
+  if(first==n) { for(q=0;q<n;++q) d[q]=INFINITY; return; }
+
+  /* Build the lower envelope of the parabolas. */
+  v[0]=first;
+  z[0]=-INFINITY;
+  z[1]=INFINITY;
+  for(q=first+1;q<n;++q)
+    if( !isinf(f[q]) )
+      {
+        s = ( (f[q]+(double)q*q) - (f[v[k]]+(double)v[k]*v[k]) )
+            / (2.0*q - 2.0*v[k]);
+        while(s<=z[k])
+          {
+            --k;
+            s = ( (f[q]+(double)q*q) - (f[v[k]]+(double)v[k]*v[k]) )
+                / (2.0*q - 2.0*v[k]);
+          }
+        ++k;
+        v[k]=q;
+        z[k]=s;
+        z[k+1]=INFINITY;
+      }
+
+  /* Fill the distances from the envelope. */
+  k=0;
+  for(q=0;q<n;++q)
+    {
+      while(z[k+1]<q) ++k;
+      d[q] = ((double)q-v[k])*((double)q-v[k]) + f[v[k]];
+    }
+}
+
+
+
+
+
+/* Distance along all the lines of one dimension that are assigned to
+   this thread. */
+static void *
+binary_edt_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_edt_params *eprm=(struct binary_edt_params *)tprm->params;
+
+  size_t *v;
+  double *f, *z, *o, *d=eprm->sqd;
+  uint8_t *in=eprm->input->array;
+  size_t a=eprm->axis, n=eprm->input->dsize[a], inc=eprm->dinc[a];
+  size_t i, l, start, first, size, nt=eprm->numthreads;
+  int isfirst = a==eprm->input->ndim-1; /* Fastest dimension is first. */
+
+  /* This thread's range of lines. */
+  size  = eprm->input->size/n/nt;
+  first = eprm->input->size/n/nt*tprm->id;
+  if(tprm->id==nt-1 && nt>1) size=eprm->input->size/n-(nt-1)*size;
+
+  /* Allocate the space for one line (input, boundaries and output). */
+  f=gal_pointer_allocate(GAL_TYPE_FLOAT64, 3*n+1, 0, __func__, "f");
+  v=gal_pointer_allocate(GAL_TYPE_SIZE_T, n, 0, __func__, "v");
+  z=f+n;
+  o=z+n+1;
+
+  /* Go over the lines. */
+  for(l=first; l<first+size; ++l)
+    {
+      /* Copy the input of this line (on the first dimension, it is
+         from the input dataset). */
+      start = (l/inc)*inc*n + l%inc;
+      if(isfirst)
+        for(i=0;i<n;++i)
+          f[i] = in[start+i*inc]==eprm->value ? 0.0 : INFINITY;
+      else
+        for(i=0;i<n;++i) f[i]=d[start+i*inc];
+
+      /* Find the distance along this line. When the line is contiguous,
+         the output can be directly written into the final array. */
+      if(inc==1) binary_edt_line(f, n, d+start, v, z);
+      else
+        {
+          binary_edt_line(f, n, o, v, z);
+          for(i=0;i<n;++i) d[start+i*inc]=o[i];
+        }
+    }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  free(f);
+  free(v);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Squared Euclidean distance of every element in 'input' to the nearest
+   element with a value of 'value' (as a 'float64' dataset). */
+static gal_data_t *
+binary_edt(gal_data_t *input, uint8_t value, size_t numthreads)
+{
+  size_t d;
+  gal_data_t *out;
+  struct binary_edt_params eprm;
+
+  /* Basic sanity checks. */
+  if(input->type!=GAL_TYPE_UINT8)
+    error(EXIT_FAILURE, 0, "%s: the input data set type must be 'uint8'",
+          __func__);
+  if(input->block)
+    error(EXIT_FAILURE, 0, "%s: currently, the input data structure to "
+          "must not be a tile", __func__);
+
+  /* Allocate the output and set the parameters. */
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, input->ndim, input->dsize,
+                     input->wcs, 0, input->minmapsize, input->quietmmap,
+                     NULL, NULL, NULL);
+  eprm.sqd=out->array;
+  eprm.input=input;
+  eprm.value=value;
+  eprm.numthreads=numthreads ? numthreads : 1;
+  eprm.dinc=gal_dimension_increment(input->ndim, input->dsize);
+
+  /* Find the distance along each dimension, starting from the fastest
+     (where the lines are contiguous). */
+  for(d=input->ndim; d>0; --d)
+    {
+      eprm.axis=d-1;
+      gal_threads_spin_off(binary_edt_on_thread, &eprm, eprm.numthreads,
+                           eprm.numthreads, input->minmapsize,
+                           input->quietmmap);
+    }
+
+  /* Clean up and return. */
+  free(eprm.dinc);
+  return out;
+}
+
+
+
+
+
+/* Euclidean distance of every element to the nearest element with a
+   value of 'value'. */
+gal_data_t *
+gal_binary_distance_transform(gal_data_t *input, uint8_t value,
+                              size_t numthreads)
+{
+  size_t i;
+  float *o;
+  double *s;
+  gal_data_t *sqd, *out;
+  uint8_t *in=input->array;
+  int hasblank=gal_blank_present(input, 0);
+
+  /* Find the squared distances. */
+  sqd=binary_edt(input, value, numthreads);
+
+  /* Write the distance in the output. */
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, input->ndim, input->dsize,
+                     input->wcs, 0, input->minmapsize, input->quietmmap,
+                     "DISTANCE", NULL, NULL);
+  o=out->array;
+  s=sqd->array;
+  for(i=0;i<input->size;++i)
+    o[i] = ( hasblank && in[i]==GAL_BLANK_UINT8
+             ? GAL_BLANK_FLOAT32
+             : sqrt(s[i]) );
+
+  /* Clean up and return. */
+  gal_data_free(sqd);
+  return out;
+}
+
+
+
+
+
+/* Erode or dilate by a radius: the 'b' elements that are within 'radius'
+   of an 'f' element are changed to 'f' (like 'binary_erode_dilate', only
+   elements with a value of 0 or 1 are touched). */
+static gal_data_t *
+binary_erode_dilate_radius(gal_data_t *input, double radius, int inplace,
+                           size_t numthreads, int d0e1)
+{
+  size_t i;
+  double *s, r2;
+  uint8_t *b, f, bv;
+  gal_data_t *binary, *sqd;
+
+  /* Sanity checks. */
+  if(input->block)
+    error(EXIT_FAILURE, 0, "%s: currently only works on a fully "
+          "allocated block of memory, but the input is a tile (its 'block' "
+          "element is not NULL)", __func__);
+  if( isnan(radius) || radius<0 )
+    error(EXIT_FAILURE, 0, "%s: the radius (%g) must be a positive number",
+          __func__, radius);
+
+  /* Set the dataset to work on. */
+  binary = ( (inplace && input->type==GAL_TYPE_UINT8)
+             ? input
+             : gal_data_copy_to_new_type(input, GAL_TYPE_UINT8) );
+  if(radius==0) return binary;
+
+  /* Find the squared distance to the nearest 'f' element and change the
+     'b' elements that are within the radius. */
+  f  = d0e1 ? 0 : 1;
+  bv = d0e1 ? 1 : 0;
+  r2 = radius*radius;
+  b=binary->array;
+  sqd=binary_edt(binary, f, numthreads);
+  s=sqd->array;
+  for(i=0;i<binary->size;++i)
+    if(b[i]==bv && s[i]<=r2) b[i]=f;
+
+  /* Clean up and return. */
+  gal_data_free(sqd);
+  return binary;
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_erode_radius(gal_data_t *input, double radius, int inplace,
+                        size_t numthreads)
+{
+  return binary_erode_dilate_radius(input, radius, inplace, numthreads, 1);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_dilate_radius(gal_data_t *input, double radius, int inplace,
+                         size_t numthreads)
+{
+  return binary_erode_dilate_radius(input, radius, inplace, numthreads, 0);
+}
+
+
+
+
+
+gal_data_t *
+gal_binary_open_radius(gal_data_t *input, double radius, int inplace,
+                       size_t numthreads)
+{
+  gal_data_t *out;
+
+  /* Erode the input, then dilate the output in its own space. */
+  out=gal_binary_erode_radius(input, radius, inplace, numthreads);
+  gal_binary_dilate_radius(out, radius, 1, numthreads);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*********************************************************************/
 /*****************            Neighbors           ********************/
 /*********************************************************************/
@@ -485,25 +1109,494 @@ gal_binary_number_neighbors(gal_data_t *input, int connectivity, int inplace)
 /*********************************************************************/
 /*****************      Connected components      ********************/
 /*********************************************************************/
-/* Find connected components in an intput dataset. */
+/* The connected components are labeled with a two-pass, union-find
+   algorithm: in the first pass, each foreground pixel is given the label
+   of its neighbors that have already been parsed (before it in memory),
+   or a new provisional label if none of them is foreground. When the
+   neighbors have different provisional labels, they are merged in the
+   'parent' array (the smaller label always becomes the root). In the
+   second pass, each provisional label is replaced with the final label
+   of its root.
+
+   The first pass is done in parallel on strips along the slowest
+   dimension: the neighbors before the start of each strip are ignored
+   and the strips are merged afterwards (only the first slab of each
+   strip needs to be checked). To let the threads use the same 'parent'
+   array without any locking, the provisional labels of each strip start
+   at an offset: along the fastest dimension, two neighboring pixels can
+   never both get a new label, so each line of the fastest dimension can
+   have at most half its width (rounded up) of new labels.
+
+   Since the provisional labels increase in the same order as the pixels
+   and the roots are the smallest label of each component, renumbering
+   the roots in increasing order gives exactly the same labels as the
+   breadth-first search (where the labels are in the order of the first
+   pixel of each component). */
+#define BINARY_CCL_MAXNEIGHBORS 13 /* 3D, connectivity 3: (27-1)/2. */
+
+struct binary_ccl_params
+{
+  gal_data_t     *binary;  /* Input binary dataset.                      */
+  gal_data_t        *lab;  /* Output labeled dataset.                    */
+  int32_t        *parent;  /* Parent of each provisional label.          */
+  size_t           *dinc;  /* Increment along each dimension.            */
+  size_t         *nstrip;  /* Number of slabs (along dim 0) in a strip.  */
+  size_t        numslabs;  /* Number of slabs (dsize[0] or 1 for 1D).    */
+  size_t       slabwidth;  /* Number of elements in each slab.           */
+  size_t         perslab;  /* Maximum new labels within each slab.       */
+  size_t      numthreads;  /* Number of threads (and strips).            */
+  size_t            nbrs;  /* Number of backward neighbor offsets.       */
+  size_t          *bdinc;  /* Increment along each dim. in input's block. */
+  int           hasblank;  /* Input has blank elements.                  */
+  int              zeros;  /* Label the zero-valued elements.            */
+  int   offset[BINARY_CCL_MAXNEIGHBORS*3]; /* Offsets of the neighbors.  */
+};
+
+
+
+
+
+/* Pointer to the element of the input with the given index ('coord' will
+   keep its coordinates). The input may be a tile, so the position in
+   memory is found with the increments of its allocated block. */
+static uint8_t *
+binary_tile_element(gal_data_t *input, size_t *bdinc, size_t index,
+                    size_t *coord)
+{
+  size_t d, start=0;
+  gal_dimension_index_to_coord(index, input->ndim, input->dsize, coord);
+  for(d=0;d<input->ndim;++d) start += coord[d]*bdinc[d];
+  return (uint8_t *)(input->array)+start;
+}
+
+
+
+
+
+/* Find the root of a provisional label (with path-halving, so the later
+   searches are faster). */
+static int32_t
+binary_ccl_find(int32_t *parent, int32_t x)
+{
+  while(parent[x]!=x) { parent[x]=parent[parent[x]]; x=parent[x]; }
+  return x;
+}
+
+
+
+
+
+/* Merge the two trees that contain the given labels: the larger root
+   will point to the smaller one. */
+static void
+binary_ccl_union(int32_t *parent, int32_t a, int32_t b)
+{
+  a=binary_ccl_find(parent, a);
+  b=binary_ccl_find(parent, b);
+  if(a<b)      parent[b]=a;
+  else if(b<a) parent[a]=b;
+}
+
+
+
+
+
+/* The neighbors that come before each element in memory: all offsets
+   within '{-1,0,1}' over all dimensions that have at most 'connectivity'
+   non-zero components and where the first non-zero component is -1. Note
+   that the dimensions in 'offset' are in the same order as 'dsize' (the
+   first is the slowest). */
+static size_t
+binary_ccl_neighbors(size_t ndim, int connectivity, int *offset)
+{
+  int o[3];
+  size_t i, d, nz, num=0, total=1;
+
+  for(d=0;d<ndim;++d) total*=3;
+  for(i=0;i<total;++i)
+    {
+      /* Set the offset along each dimension ('i' in base 3). */
+      nz=0;
+      for(d=0;d<ndim;++d)
+        {
+          o[ndim-d-1] = (int)( (i/(d==0?1:(d==1?3:9)))%3 ) - 1;
+          if(o[ndim-d-1]) ++nz;
+        }
+
+      /* Only keep the offsets that are before this element. */
+      if(nz==0 || nz>(size_t)connectivity) continue;
+      for(d=0;d<ndim;++d) if(o[d]) break;
+      if(o[d]==1) continue;
+
+      /* Keep this offset. */
+      for(d=0;d<ndim;++d) offset[num*3+d]=o[d];
+      ++num;
+    }
+  return num;
+}
+
+
+
+
+
+/* Check if an offset is within the dataset on the slow dimensions (all
+   dimensions except the fastest). 'start' is the first slab that is
+   usable (to ignore the neighbors before a strip). */
+static int
+binary_ccl_slow_valid(struct binary_ccl_params *cprm, size_t *coord,
+                      int *o, size_t start)
+{
+  size_t d, ndim=cprm->binary->ndim, *dsize=cprm->binary->dsize;
+
+  /* The slowest dimension (strips are along this one). */
+  if( ndim>1 && ( (o[0]==-1 && coord[0]==start)
+                  || (o[0]==1 && coord[0]==dsize[0]-1) ) )
+    return 0;
+
+  /* The middle dimension(s). */
+  for(d=1;d<ndim-1;++d)
+    if( (o[d]==-1 && coord[d]==0) || (o[d]==1 && coord[d]==dsize[d]-1) )
+      return 0;
+  return 1;
+}
+
+
+
+
+
+/* Memory offset of a neighbor. */
+static long
+binary_ccl_neighbor_shift(struct binary_ccl_params *cprm, int *o)
+{
+  size_t d;
+  long shift=0;
+  for(d=0;d<cprm->binary->ndim;++d) shift += o[d] * (long)cprm->dinc[d];
+  return shift;
+}
+
+
+
+
+
+/* First pass over one strip. */
+static void *
+binary_ccl_first_pass(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_ccl_params *cprm=(struct binary_ccl_params *)tprm->params;
+
+  int *o;
+  uint8_t *b, v;
+  int32_t n, lab, next;
+  int32_t *l=cprm->lab->array, *parent=cprm->parent;
+  long shift[BINARY_CCL_MAXNEIGHBORS];
+  uint8_t pre[BINARY_CCL_MAXNEIGHBORS];
+  size_t i, j, x, line, firstslab, numslabs, coord[3];
+  size_t nt=cprm->numthreads, ndim=cprm->binary->ndim;
+  size_t nfast=cprm->binary->dsize[ndim-1], nlines;
+
+  /* This thread's range of slabs. */
+  numslabs  = cprm->numslabs/nt;
+  firstslab = cprm->numslabs/nt*tprm->id;
+  if(tprm->id==nt-1 && nt>1) numslabs=cprm->numslabs-(nt-1)*numslabs;
+  cprm->nstrip[tprm->id]=numslabs;
+
+  /* Memory offset of each neighbor and the first provisional label of
+     this strip (the labels start from 1). */
+  for(j=0;j<cprm->nbrs;++j)
+    shift[j]=binary_ccl_neighbor_shift(cprm, cprm->offset+j*3);
+  next=firstslab*cprm->perslab;
+
+  /* Go over the lines (along the fastest dimension) of this strip. */
+  nlines = numslabs * cprm->slabwidth / nfast;
+  for(line=0; line<nlines; ++line)
+    {
+      /* Coordinates of the first element of this line and the
+         neighbors that are usable in the slower dimensions. */
+      i = firstslab*cprm->slabwidth + line*nfast;
+      b = binary_tile_element(cprm->binary, cprm->bdinc, i, coord);
+      for(j=0;j<cprm->nbrs;++j)
+        pre[j]=binary_ccl_slow_valid(cprm, coord, cprm->offset+j*3,
+                                     firstslab);
+
+      /* Parse the line. */
+      for(x=0; x<nfast; ++x, ++i)
+        {
+          /* Elements that shouldn't be labeled: when labeling the zero
+             valued elements, all others are given a label of 0, when
+             labeling the non-zero elements, blank elements are blank. */
+          v=b[x];
+          if(cprm->zeros)
+            { if( v!=0 ) { l[i]=0; continue; } }
+          else
+            {
+              if( v==0 ) { l[i]=0; continue; }
+              if( cprm->hasblank && v==GAL_BLANK_UINT8 )
+                { l[i]=GAL_BLANK_INT32; continue; }
+            }
+
+          /* Check the neighbors that are already labeled. */
+          lab=0;
+          for(j=0;j<cprm->nbrs;++j)
+            if(pre[j])
+              {
+                o=cprm->offset+j*3;
+                if( (o[ndim-1]==-1 && x==0)
+                    || (o[ndim-1]==1 && x==nfast-1) ) continue;
+                n=l[i+shift[j]];
+                if(n>0)
+                  {
+                    if(lab==0) lab=n;
+                    else if(n!=lab) binary_ccl_union(parent, lab, n);
+                  }
+              }
+
+          /* If none of the neighbors were labeled, this is a new
+             provisional label. */
+          if(lab==0) { lab=++next; parent[lab]=lab; }
+          l[i]=lab;
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Merge the first slab of each strip with the last slab of the previous
+   strip. */
+static void
+binary_ccl_merge(struct binary_ccl_params *cprm)
+{
+  int *o;
+  long shift;
+  int32_t n, m;
+  size_t i, j, x, s, line, firstslab=0, coord[3];
+  int32_t *l=cprm->lab->array, *parent=cprm->parent;
+  size_t ndim=cprm->binary->ndim, nfast=cprm->binary->dsize[ndim-1];
+
+  for(s=0;s<cprm->numthreads;++s)
+    {
+      /* The first strip, and empty strips, don't need to be merged. */
+      if(s && cprm->nstrip[s] && firstslab)
+        for(line=0; line<cprm->slabwidth/nfast; ++line)
+          {
+            i = firstslab*cprm->slabwidth + line*nfast;
+            gal_dimension_index_to_coord(i, ndim, cprm->binary->dsize,
+                                         coord);
+            for(j=0;j<cprm->nbrs;++j)
+              {
+                /* Only the neighbors in the previous slab. */
+                o=cprm->offset+j*3;
+                if( o[0]!=-1 || !binary_ccl_slow_valid(cprm, coord, o, 0) )
+                  continue;
+
+                /* Go over the line. */
+                shift=binary_ccl_neighbor_shift(cprm, o);
+                for(x=0; x<nfast; ++x)
+                  {
+                    if( (o[ndim-1]==-1 && x==0)
+                        || (o[ndim-1]==1 && x==nfast-1) ) continue;
+                    n=l[i+x];
+                    m=l[i+x+shift];
+                    if(n>0 && m>0) binary_ccl_union(parent, n, m);
+                  }
+              }
+          }
+      firstslab+=cprm->nstrip[s];
+    }
+}
+
+
+
+
+
+/* Second pass: replace the provisional labels with the final ones. */
+static void *
+binary_ccl_second_pass(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_ccl_params *cprm=(struct binary_ccl_params *)tprm->params;
+
+  size_t i, size, first, nt=cprm->numthreads;
+  int32_t *l=cprm->lab->array, *parent=cprm->parent;
+
+  /* This thread's range of elements. */
+  size  = cprm->lab->size/nt;
+  first = cprm->lab->size/nt*tprm->id;
+  if(tprm->id==nt-1 && nt>1) size=cprm->lab->size-(nt-1)*size;
+
+  /* Relabel the elements. */
+  for(i=first;i<first+size;++i) if(l[i]>0) l[i]=parent[l[i]];
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Put the indexs of each label into a separate dataset (with a counting
+   sort, so the indexs of each label are in increasing order). */
+static gal_data_t *
+binary_ccl_indexs(gal_data_t *lab, size_t numlabs)
+{
+  int32_t *l=lab->array;
+  gal_data_t *tmp, *out=NULL;
+  size_t i, *counts, **ptr, nonzero;
+
+  /* Count the number of elements in each label. */
+  counts=gal_pointer_allocate(GAL_TYPE_SIZE_T, numlabs+1, 1, __func__,
+                              "counts");
+  for(i=0;i<lab->size;++i) if(l[i]>0) ++counts[l[i]];
+
+  /* Allocate the datasets (the list is built in reverse, so it will be
+     sorted by label). */
+  errno=0;
+  ptr=malloc((numlabs+1)*sizeof *ptr);
+  if(ptr==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'ptr'", __func__,
+          (numlabs+1)*sizeof *ptr);
+  for(i=numlabs;i>0;--i)
+    {
+      nonzero=counts[i];
+      tmp=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &nonzero, NULL, 0,
+                         lab->minmapsize, lab->quietmmap, NULL, NULL, NULL);
+      ptr[i]=tmp->array;
+      tmp->next=out;
+      out=tmp;
+    }
+
+  /* Fill the indexs. */
+  for(i=0;i<lab->size;++i) if(l[i]>0) *ptr[l[i]]++ = i;
+
+  /* Clean up and return. */
+  free(ptr);
+  free(counts);
+  return out;
+}
+
+
+
+
+
+/* Label the connected components of 'binary' into the (already
+   allocated, 'int32' and contiguous) 'lab' and return the number of
+   labels. When 'zeros' is non-zero, the zero-valued elements are labeled
+   (not the non-zero ones). 'binary' may be a tile. */
+static size_t
+binary_ccl(gal_data_t *binary, gal_data_t *lab, int connectivity,
+           size_t numthreads, int zeros)
+{
+  size_t k, nlab, maxlab;
+  int32_t cur=0, *parent;
+  struct binary_ccl_params cprm;
+  size_t ndim=binary->ndim, *dsize=binary->dsize;
+
+  /* Basic parameters (one dimensional datasets are only one strip). */
+  cprm.lab=lab;
+  cprm.zeros=zeros;
+  cprm.binary=binary;
+  cprm.dinc=gal_dimension_increment(ndim, dsize);
+  cprm.bdinc = ( binary->block
+                 ? gal_dimension_increment(ndim,
+                                           gal_tile_block(binary)->dsize)
+                 : cprm.dinc );
+  cprm.numslabs  = ndim==1 ? 1 : dsize[0];
+  cprm.slabwidth = binary->size/cprm.numslabs;
+  cprm.perslab   = cprm.slabwidth/dsize[ndim-1] * ((dsize[ndim-1]+1)/2);
+  cprm.hasblank  = zeros ? 0 : gal_blank_present(binary, 0);
+  cprm.nbrs      = binary_ccl_neighbors(ndim, connectivity, cprm.offset);
+  cprm.numthreads= ( numthreads==0 ? 1
+                     : (numthreads>cprm.numslabs
+                        ? cprm.numslabs : numthreads) );
+  cprm.nstrip=gal_pointer_allocate(GAL_TYPE_SIZE_T, cprm.numthreads, 0,
+                                   __func__, "cprm.nstrip");
+
+
+  /* The parent of each provisional label. */
+  maxlab=cprm.numslabs*cprm.perslab;
+  if(maxlab>=INT32_MAX)
+    error(EXIT_FAILURE, 0, "%s: the dataset is too large for 32-bit "
+          "labels", __func__);
+  parent=cprm.parent=gal_pointer_allocate(GAL_TYPE_INT32, maxlab+1, 1,
+                                          __func__, "cprm.parent");
+
+
+  /* First pass (on threads) and merge the strips. */
+  gal_threads_spin_off(binary_ccl_first_pass, &cprm, cprm.numthreads,
+                       cprm.numthreads, binary->minmapsize,
+                       binary->quietmmap);
+  binary_ccl_merge(&cprm);
+
+
+  /* Final labels: the provisional labels are parsed in increasing
+     order. Every non-root label points to a smaller label that already
+     contains the final label, and unused labels are 0. */
+  for(k=1;k<=maxlab;++k)
+    if(parent[k])
+      parent[k] = parent[k]==(int32_t)k ? ++cur : parent[parent[k]];
+  nlab=cur;
+
+
+  /* Second pass (on threads). */
+  gal_threads_spin_off(binary_ccl_second_pass, &cprm, cprm.numthreads,
+                       cprm.numthreads, binary->minmapsize,
+                       binary->quietmmap);
+
+
+  /* Clean up and return the total number. */
+  if(cprm.bdinc!=cprm.dinc) free(cprm.bdinc);
+  free(parent);
+  free(cprm.dinc);
+  free(cprm.nstrip);
+  return nlab;
+}
+
+
+
+
+
+/* Find the connected components in a binary dataset with the given
+   number of threads. When 'indexs!=NULL', a list of datasets (one for
+   each label, sorted by label) containing the indexs of each label will
+   also be put in it. */
 size_t
-gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
-                                int connectivity)
+gal_binary_connected_components_parallel(gal_data_t *binary,
+                                         gal_data_t **out,
+                                         int connectivity,
+                                         size_t numthreads,
+                                         gal_data_t **indexs)
 {
-  int32_t *l;
-  uint8_t *b, *bf;
+  size_t nlab;
   gal_data_t *lab;
-  size_t p, i, curlab=1;
-  gal_list_sizet_t *Q=NULL;
-  size_t *dinc=gal_dimension_increment(binary->ndim, binary->dsize);
+  size_t ndim=binary->ndim;
 
-  /* Two small sanity checks. */
+  /* Small sanity checks. */
   if(binary->type!=GAL_TYPE_UINT8)
     error(EXIT_FAILURE, 0, "%s: the input data set type must be 'uint8'",
           __func__);
   if(binary->block)
     error(EXIT_FAILURE, 0, "%s: currently, the input data structure to "
           "must not be a tile", __func__);
+  if(ndim>3)
+    error(EXIT_FAILURE, 0, "%s: currently only 1, 2 and 3 dimensional "
+          "datasets are supported, your input is %zu dimensional",
+          __func__, ndim);
+  if(connectivity>(int)ndim)
+    error(EXIT_FAILURE, 0, "%s: connectivity value (%d) is larger "
+          "than the number of dimensions (%zu)", __func__, connectivity,
+          ndim);
+
+  /* Similar to 'GAL_DIMENSION_NEIGHBOR_OP', the neighbors that only
+     differ in one dimension are always used. */
+  if(connectivity<1) connectivity=1;
 
 
   /* Prepare the dataset for the labels. */
@@ -522,71 +1615,31 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
         error(EXIT_FAILURE, 0, "%s: the 'out' dataset must have 'int32' type"
               "but the array you have given is '%s' type", __func__,
               gal_type_name(lab->type, 1));
-
-      /* Reset all its values to zero. */
-      memset(lab->array, 0, lab->size * gal_type_sizeof(lab->type));
     }
   else
     lab=*out=gal_data_alloc(NULL, GAL_TYPE_INT32, binary->ndim,
-                            binary->dsize, binary->wcs, 1,
+                            binary->dsize, binary->wcs, 0,
                             binary->minmapsize, binary->quietmmap,
                             NULL, "labels", NULL);
 
 
-  /* Initialize the labels array. If we have blank pixels in the byt
-     array, then give them the blank labeled array. Note that since
-     their value will not be 0, they will also not be labeled. */
-  l=lab->array;
-  bf=(b=binary->array)+binary->size; /* Library must have no side effect,   */
-  if( gal_blank_present(binary, 0) ) /* So blank flag should not be changed.*/
-    do *l++ = *b==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : 0; while(++b<bf);
-
-
-  /* Go over all the pixels and do a breadth-first: any pixel that is not
-     labeled is used to label the full object by checking neighbors before
-     going onto the next pixels. */
-  l=lab->array;
-  b=binary->array;
-  for(i=0;i<binary->size;++i)
-    /* Check if this pixel is already labeled. */
-    if( b[i] && l[i]==0 )
-      {
-        /* This is the first pixel of this connected region that we have
-           got to. */
-        l[i]=curlab;
-
-        /* Add this pixel to the queue of pixels to work with. */
-        gal_list_sizet_add(&Q, i);
+  /* Label the components and find the indexs if necessary. */
+  nlab=binary_ccl(binary, lab, connectivity, numthreads, 0);
+  if(indexs) *indexs=binary_ccl_indexs(lab, nlab);
+  return nlab;
+}
 
-        /* While a pixel remains in the queue, continue labelling and
-           searching for neighbors. */
-        while(Q!=NULL)
-          {
-            /* Pop an element from the queue. */
-            p=gal_list_sizet_pop(&Q);
 
-            /* Go over all its neighbors and add them to the list if they
-               haven't already been labeled. */
-            GAL_DIMENSION_NEIGHBOR_OP(p, binary->ndim, binary->dsize,
-                                      connectivity, dinc,
-              {
-                if( b[ nind ] && l[ nind ]==0 )
-                  {
-                    l[ nind ] = curlab;
-                    gal_list_sizet_add(&Q, nind);
-                  }
-              } );
-          }
 
-        /* This object has been fully labeled, so increment the current
-           label. */
-        ++curlab;
-      }
 
 
-  /* Clean up and return the total number. */
-  free(dinc);
-  return curlab-1;
+/* Find connected components in an intput dataset. */
+size_t
+gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
+                                int connectivity)
+{
+  return gal_binary_connected_components_parallel(binary, out,
+                                                  connectivity, 1, NULL);
 }
 
 
@@ -605,6 +1658,7 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
   size_t p, i, onelabnum, *onelabarr;
   gal_list_sizet_t *Q=NULL, *onelab=NULL;
   size_t *dinc=gal_dimension_increment(binary->ndim, binary->dsize);
+  gal_list_arena_t *arena=gal_list_arena_alloc(sizeof *Q, 0);
 
   /* Small sanity checks. */
   if(binary->type!=GAL_TYPE_UINT8)
@@ -623,15 +1677,15 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
       {
         /* Add this pixel to the queue of pixels to work with. */
 	b[i]=BINARY_CONINDEX_VAL;
-        gal_list_sizet_add(&Q, i);
-        gal_list_sizet_add(&onelab, i);
+        gal_list_sizet_add_arena(&Q, i, arena);
+        gal_list_sizet_add_arena(&onelab, i, arena);
 
         /* While a pixel remains in the queue, continue labelling and
            searching for neighbors. */
         while(Q!=NULL)
           {
             /* Pop an element from the queue. */
-            p=gal_list_sizet_pop(&Q);
+            p=gal_list_sizet_pop_arena(&Q, arena);
 
             /* Go over all its neighbors and add them to the list if they
                haven't already been labeled. */
@@ -641,8 +1695,8 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
                 if( b[nind]==1 )
                   {
 		    b[nind]=BINARY_CONINDEX_VAL;
-                    gal_list_sizet_add(&Q, nind);
-		    gal_list_sizet_add(&onelab, nind);
+                    gal_list_sizet_add_arena(&Q, nind, arena);
+		    gal_list_sizet_add_arena(&onelab, nind, arena);
                   }
               } );
           }
@@ -652,9 +1706,9 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
 	gal_list_data_add_alloc(&lines, onelabarr, GAL_TYPE_SIZE_T, 1,
 				&onelabnum, NULL, 0, -1, 1, NULL, NULL, NULL);
 
-	/* Clean up. */
-	gal_list_sizet_free(onelab);
-	onelab=NULL;
+	/* Clean up (the nodes are returned to the arena to be used for
+	   the next component). */
+	while(onelab) gal_list_sizet_pop_arena(&onelab, arena);
       }
 
   /* Reverse the order. */
@@ -677,6 +1731,7 @@ gal_binary_connected_indexs(gal_data_t *binary, int connectivity)
 
   /* Clean up and return the total number. */
   free(dinc);
+  gal_list_arena_free(arena);
   return lines;
 }
 
@@ -696,6 +1751,7 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
   int32_t *newlabs, curlab=1;
   uint8_t *adj=adjacency->array;
   size_t i, j, p, num=adjacency->dsize[0];
+  gal_list_arena_t *arena=gal_list_arena_alloc(sizeof *Q, 0);
 
   /* Some small sanity checks. */
   if(adjacency->type != GAL_TYPE_UINT8)
@@ -728,13 +1784,13 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
     if(newlabs[i]==0)
       {
         /* Add this old label to the list that must be corrected. */
-        gal_list_sizet_add(&Q, i);
+        gal_list_sizet_add_arena(&Q, i, arena);
 
         /* Continue while the list has elements. */
         while(Q!=NULL)
           {
             /* Pop the top old-label from the list. */
-            p=gal_list_sizet_pop(&Q);
+            p=gal_list_sizet_pop_arena(&Q, arena);
 
             /* If it has already been labeled then ignore it. */
             if( newlabs[p]!=curlab )
@@ -747,7 +1803,7 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
                    that are touching it. */
                 for(j=1;j<num;++j)
                   if( adj[ p*num+j ] && newlabs[j]==0 )
-                    gal_list_sizet_add(&Q, j);
+                    gal_list_sizet_add_arena(&Q, j, arena);
               }
           }
 
@@ -760,7 +1816,8 @@ gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
   for(i=1;i<num;++i) printf("%zu: %u\n", i, newlabs[i]);
   */
 
-  /* Return the output. */
+  /* Clean up and return the output. */
+  gal_list_arena_free(arena);
   *numconnected = curlab-1;
   return newlabs_d;
 }
@@ -794,6 +1851,7 @@ gal_binary_connected_adjacency_list(gal_list_sizet_t **listarr,
   gal_data_t *newlabs_d;
   gal_list_sizet_t *Q=NULL;
   int32_t *newlabs, curlab=1;
+  gal_list_arena_t *arena=gal_list_arena_alloc(sizeof *Q, 0);
 
   /* Allocate (and clear) the output datastructure. */
   newlabs_d=gal_data_alloc(NULL, GAL_TYPE_INT32, 1, &number, NULL, 1,
@@ -807,13 +1865,13 @@ gal_binary_connected_adjacency_list(gal_list_sizet_t **listarr,
     if(newlabs[i]==0)
       {
         /* Add this old label to the list that must be corrected. */
-        gal_list_sizet_add(&Q, i);
+        gal_list_sizet_add_arena(&Q, i, arena);
 
         /* Continue while the list has elements. */
         while(Q!=NULL)
           {
             /* Pop the top old-label from the list. */
-            p=gal_list_sizet_pop(&Q);
+            p=gal_list_sizet_pop_arena(&Q, arena);
 
             /* If it has already been labeled then ignore it. */
             if( newlabs[p]!=curlab )
@@ -826,7 +1884,7 @@ gal_binary_connected_adjacency_list(gal_list_sizet_t **listarr,
                    touching it. */
                 for(tmp=listarr[p]; tmp!=NULL; tmp=tmp->next)
                   if( newlabs[tmp->v]==0 )
-                    gal_list_sizet_add(&Q, tmp->v);
+                    gal_list_sizet_add_arena(&Q, tmp->v, arena);
               }
           }
 
@@ -839,7 +1897,8 @@ gal_binary_connected_adjacency_list(gal_list_sizet_t **listarr,
   for(i=1;i<number;++i) printf("%zu: %u\n", i, newlabs[i]);
   */
 
-  /* Return the output. */
+  /* Clean up and return the output. */
+  gal_list_arena_free(arena);
   *numconnected = curlab-1;
   return newlabs_d;
 }
@@ -865,241 +1924,238 @@ gal_binary_connected_adjacency_list(gal_list_sizet_t **listarr,
 /*********************************************************************/
 /*****************            Fill holes          ********************/
 /*********************************************************************/
-/* Make the array that is the inverse of the input byt of fill
-   holes. The inverse array will also be 4 pixels larger in both
-   dimensions. This is because we might also want to fill those holes
-   that are touching the side of the image. One pixel for a pixel that
-   is one pixel away from the image border. Another pixel for those
-   objects that are touching the image border. */
-static gal_data_t *
-binary_make_padded_inverse(gal_data_t *input, gal_data_t **outtile)
+/* Parameters for the final pass over the holes. */
+struct binary_holes_params
 {
-  uint8_t *in;
-  size_t i, startind;
-  gal_data_t *inv, *tile;
-  size_t *startcoord=gal_pointer_allocate(GAL_TYPE_SIZE_T, input->ndim, 0,
-                                          __func__, "startcoord");
-  size_t *dsize=gal_pointer_allocate(GAL_TYPE_SIZE_T, input->ndim, 0,
-                                     __func__, "dsize");
-
-
-  /* Set the size of the padded inverse image and the coordinates of the
-     start. We want the inverse to be padded on the edges of each dimension
-     by 2 pixels, so each dimension should be padded by 4 pixels. */
-  for(i=0;i<input->ndim;++i)
-    {
-      startcoord[i]=2;
-      dsize[i]=input->dsize[i]+4;
-    }
+  gal_data_t        *input;  /* Input dataset (may be a tile).           */
+  gal_data_t          *lab;  /* Labels of the zero-valued elements.      */
+  int32_t             *map;  /* Hole number of each label (0: not hole). */
+  size_t            *sizes;  /* Number of elements in each hole.         */
+  size_t           maxsize;  /* Maximum size of holes to fill.           */
+  size_t            *bdinc;  /* Increments along dims. in input's block. */
+  int              tolabel;  /* ==1: write labels, ==0: fill the input.  */
+  size_t        numthreads;  /* Number of threads.                       */
+};
 
 
-  /* Allocate the inverse dataset and initialize it to 1 (mainly for the
-     edges, the inner region will be set afterwards).
-
-     PADDING MUST BE INITIALIZED WITH 1: This is done so the connected body
-     of 1 valued pixels (after inversion) gets a label of 1 after labeling
-     the connected components and any hole, will get a value larger than
-     1. */
-  inv=gal_data_alloc(NULL, GAL_TYPE_UINT8, input->ndim, dsize, NULL, 0,
-                     input->minmapsize, input->quietmmap,
-                     "INVERSE", "binary", NULL);
-  memset(inv->array, 1, inv->size);
-
-
-  /* Define a tile to fill the central regions of the inverse. */
-  startind=gal_dimension_coord_to_index(input->ndim, inv->dsize, startcoord);
-  tile=gal_data_alloc(gal_pointer_increment(inv->array, startind, inv->type),
-                      inv->type, input->ndim, input->dsize, NULL, 0, 0, 0,
-                      NULL, NULL, NULL);
-  *outtile=tile;
-  tile->block=inv;
 
 
-  /* Put the input's flags into the inverted array and the tile. */
-  inv->flag = tile->flag = input->flag;
-
-
-  /* Fill the central regions. */
-  in=input->array;
-  GAL_TILE_PARSE_OPERATE( tile, NULL, 0, 0,
-                          {*i = *in==GAL_BLANK_UINT8 ? *in : !*in; ++in;} );
 
+/* Each thread parses a contiguous range of lines (along the fastest
+   dimension). When labeling, the label of each element is written in its
+   place (-1 for foreground, 0 for background that isn't a hole and blank
+   for blank elements). When filling, the input elements within the
+   desired holes are set to 1. */
+static void *
+binary_holes_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_holes_params *hprm=(struct binary_holes_params *)tprm->params;
+
+  uint8_t *b;
+  int32_t h, *map=hprm->map;
+  int32_t *l=hprm->lab->array;
+  gal_data_t *input=hprm->input;
+  size_t i, x, line, first, num, coord[3];
+  size_t nt=hprm->numthreads, nfast=input->dsize[input->ndim-1];
+  size_t nlines=input->size/nfast;
+
+  /* This thread's range of lines. */
+  num   = nlines/nt;
+  first = nlines/nt*tprm->id;
+  if(tprm->id==nt-1 && nt>1) num=nlines-(nt-1)*num;
+
+  /* Go over the lines. */
+  for(line=first; line<first+num; ++line)
+    {
+      i=line*nfast;
+      b=binary_tile_element(input, hprm->bdinc, i, coord);
+      if(hprm->tolabel)
+        for(x=0; x<nfast; ++x, ++i)
+          l[i] = ( b[x]==0
+                   ? map[ l[i] ]
+                   : (b[x]==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : -1) );
+      else
+        for(x=0; x<nfast; ++x, ++i)
+          if( l[i] && (h=map[ l[i] ])
+              && (hprm->sizes==NULL || hprm->sizes[h]<=hprm->maxsize) )
+            b[x]=1;
+    }
 
-  /* Clean up and return. */
-  free(dsize);
-  free(startcoord);
-  return inv;
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
 }
 
 
 
 
 
-gal_data_t *
-gal_binary_holes_label(gal_data_t *input, int connectivity,
-                       size_t *numholes)
+/* Find the holes of the input (the zero-valued regions that are not
+   connected to the border of the dataset) and do the final operation
+   (labeling or filling) on them.
+
+   The zero-valued elements are labeled in place (no inverted or padded
+   copy of the input is necessary). Any label that is found on the border
+   of the dataset is not a hole, so the remaining labels are the holes and
+   are given final numbers in order of their first element. Blank elements
+   are not zero, so they are a barrier like the foreground. */
+static size_t
+binary_holes(gal_data_t *input, gal_data_t *lab, int connectivity,
+             size_t maxsize, size_t numthreads, int tolabel)
 {
-  size_t d;
-  int32_t *lab;
-  gal_data_t *inv, *tile, *holelabs=NULL;
+  int32_t *l, *map;
+  struct binary_holes_params hprm;
+  size_t d, i, k, x, nlab, line, nlines, nholes=0, coord[3];
+  size_t ndim=input->ndim, *dsize=input->dsize, nfast=dsize[ndim-1];
 
-  /* A small sanity check. */
+  /* Small sanity checks. */
   if( input->type != GAL_TYPE_UINT8 )
     error(EXIT_FAILURE, 0, "%s: input must have 'uint8' type, but its "
           "input dataset has '%s' type", __func__,
           gal_type_name(input->type, 1));
+  if(ndim>3)
+    error(EXIT_FAILURE, 0, "%s: currently only 1, 2 and 3 dimensional "
+          "datasets are supported, your input is %zu dimensional",
+          __func__, ndim);
+  if(connectivity<1 || connectivity>ndim)
+    error(EXIT_FAILURE, 0, "%s: connectivity value %d is not acceptable. "
+          "It has to be between 1 and the number of input's dimensions "
+          "(%zu)", __func__, connectivity, ndim);
+
 
+  /* Label the zero-valued elements. */
+  nlab=binary_ccl(input, lab, connectivity, numthreads, 1);
 
-  /* Make the inverse image. */
-  inv=binary_make_padded_inverse(input, &tile);
 
+  /* Labels touching the border of the dataset are not holes: on lines
+     that are on the border of a slower dimension all elements are on the
+     border, on the others only the first and last elements. */
+  l=lab->array;
+  map=gal_pointer_allocate(GAL_TYPE_INT32, nlab+1, 1, __func__, "map");
+  nlines=input->size/nfast;
+  for(line=0; line<nlines; ++line)
+    {
+      i=line*nfast;
+      gal_dimension_index_to_coord(i, ndim, dsize, coord);
+      for(d=0; d<ndim-1; ++d)
+        if( coord[d]==0 || coord[d]==dsize[d]-1 ) break;
+      if(d<ndim-1)
+        for(x=0; x<nfast; ++x) map[ l[i+x] ]=-1;
+      else
+        map[ l[i] ] = map[ l[i+nfast-1] ] = -1;
+    }
 
-  /* Label the holes. Recall that the first label is just the undetected
-     regions, so we should subtract that from the total number.*/
-  *numholes=gal_binary_connected_components(inv, &holelabs, connectivity);
-  *numholes -= 1;
 
+  /* The remaining labels are holes (in increasing order). */
+  for(k=1; k<=nlab; ++k)
+    map[k] = map[k] ? 0 : ++nholes;
+  map[0]=0;
 
-  /* Any pixel with a label larger than 1 is a hole in the input image and
-     we should invert the respective pixel. To do it, we'll use the tile
-     that was defined before, just change its block and array.*/
-  tile->array=gal_tile_block_relative_to_other(tile, holelabs);
-  tile->block=holelabs; /* has to be after correcting 'tile->array'. */
 
+  /* Number of elements in each hole (only when necessary). */
+  hprm.sizes=NULL;
+  if(tolabel==0 && maxsize!=(size_t)(-1))
+    {
+      hprm.sizes=gal_pointer_allocate(GAL_TYPE_SIZE_T, nholes+1, 1,
+                                      __func__, "hprm.sizes");
+      for(i=0; i<input->size; ++i)
+        if(l[i]) ++hprm.sizes[ map[ l[i] ] ];
+    }
 
-  /* The type of the tile is already known (it is 'int32_t') and we have no
-     output/other, so we'll just put 'int' as a place-holder. In this way
-     we can avoid the switch statement of GAL_TILE_PARSE_OPERATE, and
-     directly use the workhorse macro 'GAL_TILE_PO_OISET'. */
-  lab=(holelabs)->array;
-  GAL_TILE_PO_OISET(int32_t, int, tile, NULL, 0, 0, {
-      *lab++ = ( *i
-                 ? ( *i==1
-                     ? 0        /* Originally, was background. */
-                     : *i-1 )   /* Real label: -1 (background has 1). */
-                 : -1 );        /* Originally, was foreground. */
-    });
 
+  /* Do the final operation on threads. */
+  hprm.map=map;
+  hprm.lab=lab;
+  hprm.input=input;
+  hprm.maxsize=maxsize;
+  hprm.tolabel=tolabel;
+  hprm.numthreads = ( numthreads==0 ? 1
+                      : (numthreads>nlines ? nlines : numthreads) );
+  hprm.bdinc = ( input->block
+                 ? gal_dimension_increment(ndim,
+                                           gal_tile_block(input)->dsize)
+                 : gal_dimension_increment(ndim, dsize) );
+  gal_threads_spin_off(binary_holes_on_thread, &hprm, hprm.numthreads,
+                       hprm.numthreads, input->minmapsize,
+                       input->quietmmap);
+
+
+  /* Clean up and return the number of holes. */
+  if(hprm.sizes) free(hprm.sizes);
+  free(hprm.bdinc);
+  free(map);
+  return nholes;
+}
 
-  /* Clean up */
-  tile->array=NULL;
-  gal_data_free(inv);
-  gal_data_free(tile);
 
 
-  /* Correct the sizes of the hole labels array. We have already filled the
-     from the start, effectively removing the paddings. Therefore, ee will
-     just correct the sizes and we won't bother actually re-allocating the
-     array size in memory. According to the GNU C library's description
-     after 'realloc': "In several allocation implementations, making a
-     block smaller sometimes necessitates copying it, so it can fail if no
-     other space is available.". The extra padding is only 2 pixels wide,
-     thus, the extra space is negligible compared to the actual array. So
-     it isn't worth possibly having to copy the whole array to another
-     location. Later, when we free the space, the kernel knows how much the
-     allocated size is. */
-  for(d=0;d<input->ndim;++d)
-    holelabs->dsize[d] = input->dsize[d];
-  holelabs->size=input->size;
 
 
-  /* Return the number of holes.  */
-  return holelabs;
+/* Label the holes of the input: the output is an 'int32' dataset with the
+   same size as the input where foreground elements have a value of -1,
+   background elements that are not in a hole have a value of 0 and
+   blank elements are blank. Each hole has a positive label (counting
+   from 1). The input may be a tile. */
+gal_data_t *
+gal_binary_holes_label(gal_data_t *input, int connectivity,
+                       size_t *numholes)
+{
+  return gal_binary_holes_label_parallel(input, connectivity, numholes, 1);
 }
 
 
 
 
 
-/* Fill all the holes in an input unsigned char array.
+/* Similar to 'gal_binary_holes_label', but on 'numthreads' threads. */
+gal_data_t *
+gal_binary_holes_label_parallel(gal_data_t *input, int connectivity,
+                                size_t *numholes, size_t numthreads)
+{
+  gal_data_t *holelabs;
 
-   The basic method is this:
+  /* Allocate the output and find the holes. */
+  holelabs=gal_data_alloc(NULL, GAL_TYPE_INT32, input->ndim, input->dsize,
+                          NULL, 0, input->minmapsize, input->quietmmap,
+                          NULL, "labels", NULL);
+  *numholes=binary_holes(input, holelabs, connectivity, -1, numthreads, 1);
 
-   1. An inverse image is created:
+  /* Return the labeled holes. */
+  return holelabs;
+}
 
-        * For every pixel in the input that is 1, the inverse is 0.
 
-        * The inverse image has two extra pixels on each edge to
-          ensure that all the inv[i]==1 pixels around the image are
-          touching each other and a diagonal object passing through
-          the image does not cause the inv[i]==1 pixels on the edges
-          of the image to get a different label.
 
-   2. The 8 connected regions in this inverse image are found.
 
-   3. Since we had a 2 pixel padding on the edges of the image, we
-      know for sure that all labeled regions with a label of 1 are
-      actually connected 'holes' in the input image.
 
-      Any pixel with a label larger than 1, is therefore a bounded
-      hole that is not 8-connected to the rest of the holes.  */
+/* Fill all the holes in an input unsigned char array (in place). The
+   input may be a tile, in which case only the holes within the tile are
+   found and filled. When 'maxsize!=-1', holes with more elements than
+   'maxsize' will not be filled. */
 void
 gal_binary_holes_fill(gal_data_t *input, int connectivity, size_t maxsize)
 {
-  uint8_t *in;
-  uint32_t *i, *fi;
-  size_t numholes, *sizes;
-  gal_data_t *inv, *tile, *holelabs=NULL;
-
-  /* Small sanity checks. */
-  if( input->type != GAL_TYPE_UINT8 )
-    error(EXIT_FAILURE, 0, "%s: input must have 'uint8' type, but its "
-          "input dataset has '%s' type", __func__,
-          gal_type_name(input->type, 1));
-  if(connectivity<1 || connectivity>input->ndim)
-    error(EXIT_FAILURE, 0, "%s: connectivity value %d is not acceptable. "
-          "It has to be between 1 and the number of input's dimensions "
-          "(%zu)", __func__, connectivity, input->ndim);
-
-
-  /* Make the inverse image. */
-  inv=binary_make_padded_inverse(input, &tile);
-
+  gal_binary_holes_fill_parallel(input, connectivity, maxsize, 1);
+}
 
-  /* Label the holes */
-  numholes=gal_binary_connected_components(inv, &holelabs, connectivity);
 
 
-  /* Any pixel with a label larger than 1 is a hole in the input image and
-     we should invert the respective pixel. To do it, we'll use the tile
-     that was defined before, just change its block and array.*/
-  in=input->array;
-  tile->array=gal_tile_block_relative_to_other(tile, holelabs);
-  tile->block=holelabs; /* has to be after correcting 'tile->array'. */
 
-  /* If the user wants to only fill holes to a certain size, then remove
-     those with a larger size. */
-  if(maxsize<-1)
-    {
-      /* Allocate space to keep the size of each hole: */
-      sizes=gal_pointer_allocate(GAL_TYPE_SIZE_T, numholes+1, 1, __func__,
-                                 "sizes");
-      fi=(i=holelabs->array)+holelabs->size; do ++sizes[*i]; while(++i<fi);
-
-      /* Set those labels with a larger size to 1 (treat it as
-         background). */
-      fi=(i=holelabs->array)+holelabs->size;
-      do
-        if(*i!=GAL_BLANK_INT32) *i = sizes[*i]>maxsize ? 1 : *i;
-      while(++i<fi);
-
-      /* Clean up. */
-      free(sizes);
-    }
 
-  /* The type of the tile is already known (it is 'int32_t') and we have no
-     output, so we'll just put 'int' as a place-holder. In this way we can
-     avoid the switch statement of GAL_TILE_PARSE_OPERATE, and directly use
-     the workhorse macro 'GAL_TILE_PO_OISET'. */
-  GAL_TILE_PO_OISET(int32_t, int, tile, NULL, 0, 0, {
-      *in = *i>1 && *i!=GAL_BLANK_INT32 ? 1 : *in;
-      ++in;
-    });
+/* Similar to 'gal_binary_holes_fill', but on 'numthreads' threads. */
+void
+gal_binary_holes_fill_parallel(gal_data_t *input, int connectivity,
+                               size_t maxsize, size_t numthreads)
+{
+  gal_data_t *lab;
 
+  /* Labels of the zero-valued elements (only for internal use). */
+  lab=gal_data_alloc(NULL, GAL_TYPE_INT32, input->ndim, input->dsize,
+                     NULL, 0, input->minmapsize, input->quietmmap,
+                     NULL, NULL, NULL);
 
-  /* Clean up and return. */
-  tile->array=NULL;
-  gal_data_free(inv);
-  gal_data_free(tile);
-  gal_data_free(holelabs);
+  /* Fill the holes and clean up. */
+  binary_holes(input, lab, connectivity, maxsize, numthreads, 0);
+  gal_data_free(lab);
 }
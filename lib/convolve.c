@@ -22,12 +22,18 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include <gsl/gsl_linalg.h>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_complex.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+
 #include <gnuastro/list.h>
 #include <gnuastro/tile.h>
 #include <gnuastro/threads.h>
@@ -85,6 +91,133 @@ convolve_tile_is_on_edge(size_t *h, size_t *start_end_coord, size_t *k,
 
 
 
+/* The kernel can be seen as a two dimensional matrix with 'nkrows' rows
+   (all the dimensions, except the fastest, merged into one) and 'kw'
+   columns (the fastest dimension). Using Singular Value Decomposition
+   (SVD), this matrix can be written as a sum of outer products of a
+   column vector (weights of each kernel row) and a row vector (a 1D
+   kernel along the fastest dimension). For separable kernels (for example
+   a 2D Gaussian) only one such term is necessary and for many others
+   (like a Gaussian that is truncated within a circle), a few terms are
+   enough to reproduce the kernel to within the given relative tolerance
+   (relative to the maximum absolute value in the kernel).
+
+   With 'r' terms, the kernel can be applied in two 1D passes that need
+   'r*(nkrows+kw)' multiplications for each pixel, not 'nkrows*kw'. So if
+   the number of necessary terms is too large to be useful (or 'tol' is
+   NaN), this function will return 0. Otherwise, it returns the number of
+   terms and allocates and fills 'sepcol' and 'seprow'. Note that the
+   output of convolution with the terms is not bit-wise identical to
+   convolution with the kernel (the errors can be as large as 'tol'), so
+   the caller should explicitly ask for it. */
+static size_t
+convolve_kernel_separate(gal_data_t *kernel, size_t nkrows, double tol,
+                         double **sepcol, double **seprow)
+{
+  gsl_vector S;
+  gsl_matrix A, V;
+  float *k=kernel->array;
+  size_t i, j, t, rank=0, kw=kernel->size/nkrows;
+  double v, maxerr, kmax=0.0, *a, *u, *w, *err, *s;
+  size_t m = nkrows>kw ? nkrows : kw, n = nkrows>kw ? kw : nkrows;
+
+  /* Separation is only useful when it decreases the number of
+     operations (with only one term). */
+  if( isnan(tol) || nkrows==1 || kw==1 || nkrows+kw>=kernel->size )
+    return 0;
+
+  /* GSL's SVD needs a matrix with more (or equal) rows than columns, so
+     if the kernel has fewer rows, its transpose is used. */
+  a=gal_pointer_allocate(GAL_TYPE_FLOAT64, m*n, 0, __func__, "a");
+  w=gal_pointer_allocate(GAL_TYPE_FLOAT64, n*n, 0, __func__, "w");
+  s=gal_pointer_allocate(GAL_TYPE_FLOAT64, n,   0, __func__, "s");
+  err=gal_pointer_allocate(GAL_TYPE_FLOAT64, kernel->size, 0, __func__,
+                           "err");
+  for(i=0;i<nkrows;++i)
+    for(j=0;j<kw;++j)
+      {
+        v = err[i*kw+j] = k[i*kw+j];
+        if(fabs(v)>kmax) kmax=fabs(v);
+        if(nkrows>=kw) a[i*kw+j]=v; else a[j*nkrows+i]=v;
+      }
+
+  /* A kernel with no usable value can't be separated. */
+  if(kmax==0.0 || isnan(kmax))
+    {
+      free(a); free(w); free(s); free(err);
+      return 0;
+    }
+
+  /* Do the SVD (after it, 'a' will contain U). */
+  S.size=n;     S.stride=1;             S.data=s;
+  V.size1=n;    V.size2=n;    V.tda=n;  V.data=w;
+  A.size1=m;    A.size2=n;    A.tda=n;  A.data=a;
+  gsl_linalg_SV_decomp_jacobi(&A, &V, &S);
+
+  /* Add the terms (largest singular values first) until the residual is
+     within the tolerance. For the kernel rows, 'u' is the column vector
+     (along the kernel's rows) and 'w' is the row vector. */
+  *sepcol=gal_pointer_allocate(GAL_TYPE_FLOAT64, n*nkrows, 0, __func__,
+                               "sepcol");
+  *seprow=gal_pointer_allocate(GAL_TYPE_FLOAT64, n*kw, 0, __func__,
+                               "seprow");
+  for(t=0;t<n;++t)
+    {
+      /* Each term (the column vector gets the singular value). */
+      for(i=0;i<nkrows;++i)
+        (*sepcol)[t*nkrows+i] = s[t] * ( nkrows>=kw
+                                         ? a[i*n+t] : w[i*n+t] );
+      for(j=0;j<kw;++j)
+        (*seprow)[t*kw+j] = nkrows>=kw ? w[j*n+t] : a[j*n+t];
+
+      /* Remove it from the residual and find the maximum error. */
+      maxerr=0.0;
+      u=*sepcol+t*nkrows;
+      for(i=0;i<nkrows;++i)
+        for(j=0;j<kw;++j)
+          {
+            err[i*kw+j] -= u[i] * (*seprow)[t*kw+j];
+            if(fabs(err[i*kw+j])>maxerr) maxerr=fabs(err[i*kw+j]);
+          }
+      if(maxerr<=tol*kmax) { rank=t+1; break; }
+    }
+
+  /* If too many terms are necessary, don't use the separation. */
+  if( rank==0 || rank*(nkrows+kw)>=kernel->size )
+    {
+      rank=0;
+      free(*sepcol);
+      free(*seprow);
+      *sepcol=*seprow=NULL;
+    }
+
+  /* Clean up and return. */
+  free(a);
+  free(w);
+  free(s);
+  free(err);
+  return rank;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*********************************************************************/
 /********************     Spatial convolution     ********************/
 /*********************************************************************/
@@ -120,6 +253,13 @@ struct spatial_params
   gal_data_t *tocorrect;     /* (possible) convolved image to correct.    */
   int        convoverch;     /* Ignore channel edges in convolution.      */
   int    edgecorrection;     /* Correct convolution's edge effects.       */
+  double           ksum;     /* Sum of kernel (1 without edge correction).*/
+  size_t        *krowoff;    /* Offset of each kernel row (in the block). */
+  size_t         nkrows;     /* Number of rows (fastest dim.) in kernel.  */
+  size_t      halfshift;     /* Offset from kernel's first to center pix. */
+  size_t           rank;     /* Number of separable terms (0: not used).  */
+  double        *sepcol;     /* 'rank' weights for the kernel rows.       */
+  double        *seprow;     /* 'rank' 1D kernels along fastest dim.      */
   struct per_thread_spatial_prm *pprm; /* Array of per-thread parameters. */
 };
 
@@ -291,18 +431,179 @@ convolve_spatial_overlap(struct per_thread_spatial_prm *pprm, int tocorrect)
 
 
 
-/* Convolve over one tile that is not touching the edge. */
+/* Convolve a single pixel (pointed to by 'in_v') with the general method
+   (checking the overlap of the kernel and blank values in the input). */
+static void
+convolve_spatial_pixel(struct per_thread_spatial_prm *pprm, float *in_v)
+{
+  int full_overlap;
+  double sum, ksum;
+  struct spatial_params *cprm=pprm->cprm;
+  float *in=cprm->block->array, *out=cprm->out->array;
+  gal_data_t *i_overlap=pprm->i_overlap, *k_overlap=pprm->k_overlap;
+
+  /* If the input on this pixel is a NaN, then just set the output to NaN
+     too and go onto the next pixel. 'in_v' is the pointer on this
+     pixel. */
+  if( isnan(*in_v) )
+    out[ in_v - in ]=NAN;
+  else
+    {
+      /* Define the overlap region. */
+      full_overlap=convolve_spatial_overlap(pprm, 0);
+
+      /* If tocorrect has been given and we have full overlap, then just
+         ignore this pixel. */
+      if( !(cprm->tocorrect && full_overlap) )
+        {
+
+          /* If we are in correct mode, then re-calculate the full-overlap
+             and all the other necessary paramters as if the channels
+             didn't exist. */
+          if(cprm->tocorrect)
+            full_overlap=convolve_spatial_overlap(pprm, 1);
+
+          /* Initialize the necessary values. */
+          sum  = 0.0L;
+          ksum = cprm->edgecorrection ? 0.0L : 1.0L;
+
+          /* Parse over both the overlap tiles. */
+          GAL_TILE_PO_OISET(float, float, i_overlap, k_overlap, 1, 0, {
+              if( !isnan(*i) )
+                {
+                  sum += *i * *o;
+                  if(cprm->edgecorrection) ksum += *o;
+                }
+            });
+
+          /* Set the output value. */
+          out[ in_v - in ] = ksum==0.0L ? NAN : sum/ksum;
+        }
+    }
+}
+
+
+
+
+
+/* Convolve one contiguous row of 'csize' pixels of a tile that is not on
+   the edge (so the kernel fully overlaps with all its pixels). 'start' is
+   the index of the row's first pixel in the block. Instead of finding the
+   overlap for each pixel, each row of the kernel is multiplied with the
+   contiguous input row it overlaps with and accumulated into 'acc'. The
+   innermost loop is on contiguous pixels (with no conditionals), so it can
+   be vectorized by the compiler. The order of additions for each pixel is
+   the same as 'convolve_spatial_pixel', so the result is identical.
+
+   Blank input pixels within the kernel will make the accumulated value a
+   NaN, such pixels are then convolved with the general method. */
+static void
+convolve_spatial_interior_row(struct per_thread_spatial_prm *pprm,
+                              size_t start, size_t csize, double *acc)
+{
+  struct spatial_params *cprm=pprm->cprm;
+  size_t ndim=cprm->block->ndim, kw=cprm->kernel->dsize[ndim-1];
+  float *in=cprm->block->array, *out=cprm->out->array;
+  float *kernel=cprm->kernel->array;
+  float *irow, *krow, kv;
+  size_t r, x, j;
+
+  /* Accumulate the contribution of every kernel row. */
+  for(j=0;j<csize;++j) acc[j]=0.0;
+  for(r=0;r<cprm->nkrows;++r)
+    {
+      krow = kernel + r*kw;
+      irow = in + start - cprm->halfshift + cprm->krowoff[r];
+      for(x=0;x<kw;++x)
+        {
+          kv=krow[x];
+          for(j=0;j<csize;++j) acc[j] += irow[j+x] * kv;
+        }
+    }
+
+  /* Write the output (using the general method when a blank pixel was
+     within the kernel). */
+  for(j=0;j<csize;++j)
+    {
+      if( isnan(acc[j]) )
+        convolve_spatial_pixel(pprm, in+start+j);
+      else
+        out[start+j] = cprm->ksum==0.0L ? NAN : acc[j]/cprm->ksum;
+      pprm->pix[ndim-1]++;
+    }
+}
+
+
+
+
+
+/* Similar to 'convolve_spatial_interior_row', but for a kernel that has
+   been separated into 'rank' terms (see 'convolve_kernel_separate'). For
+   each term, the input rows under the kernel are first merged (weighted
+   by the term's column vector) into 'tmp' (which has 'kw-1' more
+   elements than the row), then 'tmp' is convolved with the term's 1D
+   kernel along the fastest dimension. */
+static void
+convolve_spatial_interior_row_sep(struct per_thread_spatial_prm *pprm,
+                                  size_t start, size_t csize, double *acc,
+                                  double *tmp)
+{
+  struct spatial_params *cprm=pprm->cprm;
+  size_t ndim=cprm->block->ndim, kw=cprm->kernel->dsize[ndim-1];
+  float *in=cprm->block->array, *out=cprm->out->array;
+  size_t r, t, x, j, tsize=csize+kw-1;
+  double kv, *col, *row;
+  float *irow;
+
+  /* Accumulate the contribution of every term. */
+  for(j=0;j<csize;++j) acc[j]=0.0;
+  for(t=0;t<cprm->rank;++t)
+    {
+      /* Merge the input rows under the kernel. */
+      col=cprm->sepcol+t*cprm->nkrows;
+      for(j=0;j<tsize;++j) tmp[j]=0.0;
+      for(r=0;r<cprm->nkrows;++r)
+        {
+          kv=col[r];
+          irow = in + start - cprm->halfshift + cprm->krowoff[r];
+          for(j=0;j<tsize;++j) tmp[j] += irow[j] * kv;
+        }
+
+      /* Convolve along the fastest dimension. */
+      row=cprm->seprow+t*kw;
+      for(x=0;x<kw;++x)
+        {
+          kv=row[x];
+          for(j=0;j<csize;++j) acc[j] += tmp[j+x] * kv;
+        }
+    }
+
+  /* Write the output (using the general method when a blank pixel was
+     within the kernel). */
+  for(j=0;j<csize;++j)
+    {
+      if( isnan(acc[j]) )
+        convolve_spatial_pixel(pprm, in+start+j);
+      else
+        out[start+j] = cprm->ksum==0.0L ? NAN : acc[j]/cprm->ksum;
+      pprm->pix[ndim-1]++;
+    }
+}
+
+
+
+
+
+/* Convolve over one tile. */
 static void
 convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
 {
   gal_data_t *tile=pprm->tile;
 
-  int full_overlap;
-  double sum, ksum;
+  double *acc=NULL, *tmp=NULL;
   struct spatial_params *cprm=pprm->cprm;
   gal_data_t *block=cprm->block, *kernel=cprm->kernel;
   size_t j, ndim=block->ndim, csize=tile->dsize[ndim-1];
-  gal_data_t *i_overlap=pprm->i_overlap, *k_overlap=pprm->k_overlap;
 
   /* Variables for scanning a tile ('i_*') and the region around every
      pixel of a tile ('o_*'). */
@@ -310,8 +611,7 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
   size_t i_inc, i_ninc, i_st_en[2];
 
   /* These variables depend on the type of the input. */
-  float *i_start;
-  float *in_v, *in=block->array, *out=cprm->out->array;
+  float *i_start, *in=block->array;
 
 
   /* Starting pixel for the host of this tile. Note that when we are in
@@ -340,6 +640,18 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
   if(cprm->tocorrect && pprm->on_edge==0) return;
 
 
+  /* Tiles that aren't on the edge can use the faster method (the
+     kernel fully overlaps with all their pixels). */
+  if(pprm->on_edge==0)
+    {
+      acc=gal_pointer_allocate(GAL_TYPE_FLOAT64, csize, 0, __func__, "acc");
+      if(cprm->rank)
+        tmp=gal_pointer_allocate(GAL_TYPE_FLOAT64,
+                                 csize+kernel->dsize[ndim-1]-1, 0,
+                                 __func__, "tmp");
+    }
+
+
   /* Parse over all the tile elements. */
   i_inc=0; i_ninc=1;
   i_start=gal_tile_start_end_ind_inclusive(tile, block, i_st_en);
@@ -350,63 +662,28 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
       pprm->pix[ndim-1]=start_fastdim;
 
       /* Go over each pixel to convolve. */
-      for(j=0;j<csize;++j)
-        {
-          /* Pointer to the pixel under consideration. */
-          in_v = i_start + i_inc + j;
-
-          /* If the input on this pixel is a NaN, then just set the output
-             to NaN too and go onto the next pixel. 'in_v' is the pointer
-             on this pixel. */
-          if( isnan(*in_v) )
-            out[ in_v - in ]=NAN;
-          else
-            {
-              /* Define the overlap region. */
-              full_overlap=convolve_spatial_overlap(pprm, 0);
-
-              /* If tocorrect has been given and we have full overlap, then
-                 just ignore this pixel. */
-              if( !(cprm->tocorrect && full_overlap) )
-                {
-
-                  /* If we are in correct mode, then re-calculate the
-                     full-overlap and all the other necessary paramters as
-                     if the channels didn't exist. */
-                  if(cprm->tocorrect)
-                    full_overlap=convolve_spatial_overlap(pprm, 1);
-
-                  /* Initialize the necessary values. */
-                  sum  = 0.0L;
-                  ksum = cprm->edgecorrection ? 0.0L : 1.0L;
-
-                  /* Parse over both the overlap tiles. */
-                  GAL_TILE_PO_OISET(float, float, i_overlap, k_overlap, 1, 0, {
-                      if( !isnan(*i) )
-                        {
-                          sum += *i * *o;
-                          if(cprm->edgecorrection) ksum += *o;
-                        }
-                    });
-
-                  /* Set the output value. */
-                  out[ in_v - in ] = ksum==0.0L ? NAN : sum/ksum;
-                }
-            }
-
-          /* Increment the last coordinate. */
-          pprm->pix[ndim-1]++;
-        }
+      if(tmp)
+        convolve_spatial_interior_row_sep(pprm, i_start + i_inc - in,
+                                          csize, acc, tmp);
+      else if(acc)
+        convolve_spatial_interior_row(pprm, i_start + i_inc - in, csize,
+                                      acc);
+      else
+        for(j=0;j<csize;++j)
+          {
+            convolve_spatial_pixel(pprm, i_start + i_inc + j);
+            pprm->pix[ndim-1]++;
+          }
 
       /* Increase the increment from the start of the tile for the next
          contiguous patch. */
       i_inc += gal_tile_block_increment(block, tile->dsize, i_ninc++,
                                         pprm->pix);
     }
-  /*
-  if(pprm->id==2053)
-    printf("... done.\n");
-  */
+
+  /* Clean up. */
+  free(acc);
+  free(tmp);
 }
 
 
@@ -483,13 +760,20 @@ convolve_spatial_on_thread(void *inparam)
 
 
 /* General spatial convolve function. This function is called by both
-   'gal_convolve_spatial' and 'gal_convolve_spatial_correct_ch_edge'. */
+   'gal_convolve_spatial' and 'gal_convolve_spatial_correct_ch_edge'. When
+   'cb!=NULL', the separable terms of the kernel have already been found
+   (in batch mode) and are taken from it. Otherwise, the kernel is only
+   separated when 'septol' is not NaN. */
 static gal_data_t *
 gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
                              size_t numthreads, int edgecorrection,
-                             int convoverch, gal_data_t *tocorrect)
+                             int convoverch, gal_data_t *tocorrect,
+                             gal_convolve_batch_t *cb, double septol)
 {
+  float *k, *kf;
+  size_t i, d, r, *dinc;
   struct spatial_params params;
+  size_t ndim=kernel->ndim, *kd=kernel->dsize;
   gal_data_t *out, *block=gal_tile_block(tiles);
 
 
@@ -539,6 +823,49 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
   params.edgecorrection=edgecorrection;
 
 
+  /* For the pixels that fully overlap with the kernel, the sum of the
+     kernel (when edge correction is requested) is the same. */
+  params.ksum = edgecorrection ? 0.0L : 1.0L;
+  if(edgecorrection)
+    { kf=(k=kernel->array)+kernel->size; do params.ksum+=*k; while(++k<kf); }
+
+
+  /* Offset of the first pixel of each kernel row (along the fastest
+     dimension) from the first pixel of the kernel when it is placed over
+     the block. 'halfshift' is the offset from the kernel's first pixel to
+     its center in the block. */
+  dinc=gal_dimension_increment(ndim, block->dsize);
+  params.nkrows=kernel->size/kd[ndim-1];
+  params.krowoff=gal_pointer_allocate(GAL_TYPE_SIZE_T, params.nkrows, 0,
+                                      __func__, "params.krowoff");
+  for(r=0;r<params.nkrows;++r)
+    {
+      params.krowoff[r]=0;
+      for(i=r, d=ndim-1; d-->0; i/=kd[d])
+        params.krowoff[r] += (i % kd[d]) * dinc[d];
+    }
+  params.halfshift=0;
+  for(d=0;d<ndim;++d) params.halfshift += kd[d]/2 * dinc[d];
+  free(dinc);
+
+
+  /* If the kernel can be separated into a few terms (and it is
+     requested), use them (the 'sepcol' and 'seprow' will be allocated in
+     this function). */
+  if(cb)
+    {
+      params.rank=cb->rank;
+      params.sepcol=cb->sepcol;
+      params.seprow=cb->seprow;
+    }
+  else
+    {
+      params.sepcol=params.seprow=NULL;
+      params.rank=convolve_kernel_separate(kernel, params.nkrows, septol,
+                                           &params.sepcol, &params.seprow);
+    }
+
+
   /* Allocate the per-thread parameters. */
   errno=0;
   params.pprm=malloc(numthreads * sizeof *params.pprm);
@@ -555,6 +882,8 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
 
   /* Clean up and return the output array. */
   free(params.pprm);
+  free(params.krowoff);
+  if(cb==NULL) { free(params.sepcol); free(params.seprow); }
   return out;
 }
 
@@ -577,7 +906,32 @@ gal_convolve_spatial(gal_data_t *tiles, gal_data_t *kernel,
 
   /* Call the general function. */
   return gal_convolve_spatial_general(tiles, kernel, numthreads,
-                                      edgecorrection, convoverch, NULL);
+                                      edgecorrection, convoverch, NULL,
+                                      NULL, NAN);
+}
+
+
+
+
+
+/* Similar to 'gal_convolve_spatial', but when the kernel can be
+   reproduced by a few separable terms (to within the relative tolerance
+   'septol', see 'convolve_kernel_separate'), the pixels that aren't on
+   the edge are convolved with two 1D passes for each term. This is much
+   faster for large kernels, but the output is not bit-wise identical to
+   'gal_convolve_spatial'. */
+gal_data_t *
+gal_convolve_spatial_separable(gal_data_t *tiles, gal_data_t *kernel,
+                               size_t numthreads, int edgecorrection,
+                               int convoverch, double septol)
+{
+  /* See 'gal_convolve_spatial'. */
+  if(tiles->block==NULL) convoverch=1;
+
+  /* Call the general function. */
+  return gal_convolve_spatial_general(tiles, kernel, numthreads,
+                                      edgecorrection, convoverch, NULL,
+                                      NULL, septol);
 }
 
 
@@ -609,5 +963,919 @@ gal_convolve_spatial_correct_ch_edge(gal_data_t *tiles, gal_data_t *kernel,
 
   /* Call the general function, which will do the correction. */
   gal_convolve_spatial_general(tiles, kernel, numthreads,
-                               edgecorrection, 0, tocorrect);
+                               edgecorrection, 0, tocorrect, NULL, NAN);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*********************************************************************/
+/********************    Frequency domain convolution  ***************/
+/*********************************************************************/
+/* Large inputs are convolved in independent blocks (using the
+   overlap-save method): each block is padded with the kernel's
+   half-width on every side, its real-to-complex Fourier transform is
+   multiplied with the (already transformed) kernel and the central region
+   of its inverse is kept. This is the targeted number of elements in
+   each (padded) block. */
+#define CONVOLVE_FFT_BLOCK_ELEM 1048576
+
+/* A pixel that has no non-blank neighbor within the kernel will have an
+   edge-correction value that is only floating point error. */
+#define CONVOLVE_FFT_ZERO_KSUM  1e-10
+
+/* Everything that only depends on the size of the input and the kernel:
+   so it can be used for any input of the same size. */
+struct convolve_fft
+{
+  size_t               ndim;  /* Number of dimensions.                  */
+  size_t           dsize[3];  /* Size of input.                         */
+  size_t           psize[3];  /* Size of each (padded) block.           */
+  size_t           bsize[3];  /* Size of useful region of each block.   */
+  size_t          nblock[3];  /* Number of blocks along each dimension. */
+  size_t            half[3];  /* Half of kernel width in each dimension.*/
+  size_t              nreal;  /* Number of elements in a padded block.  */
+  size_t           ncomplex;  /* Complex elements in transformed block. */
+  size_t          numblocks;  /* Total number of blocks.                */
+  double               ksum;  /* Sum of the kernel values.              */
+  double            kabssum;  /* Sum of the absolute kernel values.     */
+  double              *kfft;  /* Transform of the kernel.               */
+  gsl_fft_real_wavetable        *rwave; /* Fastest dim. forward.        */
+  gsl_fft_halfcomplex_wavetable *hwave; /* Fastest dim. inverse.        */
+  gsl_fft_complex_wavetable  *cwave[3]; /* Other dimensions.            */
+};
+
+/* Work space for each thread. */
+struct convolve_fft_work
+{
+  double              *real;  /* Real values of input block.            */
+  double             *mreal;  /* Real values of the blank mask.         */
+  double              *cimg;  /* Transform of input block.              */
+  double              *cmsk;  /* Transform of mask.                     */
+  gsl_fft_real_workspace     *rwork; /* For the fastest dimension.      */
+  gsl_fft_complex_workspace *cwork[3]; /* For the other dimensions.     */
+};
+
+/* For the threads. All the inputs have the same size, so each one has
+   'f->numblocks' blocks and the blocks of all the inputs are distributed
+   between the threads. */
+struct convolve_fft_params
+{
+  struct convolve_fft    *f;  /* Basic FFT parameters.                  */
+  gal_data_t       **inputs;  /* Input datasets.                        */
+  gal_data_t         **outs;  /* Output datasets.                       */
+  int        edgecorrection;  /* Correct the edges.                     */
+};
+
+
+
+
+
+/* Smallest size that is larger or equal to 'n' and only has prime factors
+   of 2, 3 and 5 (GSL's Fourier transforms are much faster on them). */
+static size_t
+convolve_fft_good_size(size_t n)
+{
+  size_t m;
+  for(;;++n)
+    {
+      m=n;
+      while(m%2==0) m/=2;
+      while(m%3==0) m/=3;
+      while(m%5==0) m/=5;
+      if(m==1) return n;
+    }
+  return n;
+}
+
+
+
+
+
+/* Set the size of the blocks, see the description of
+   'CONVOLVE_FFT_BLOCK_ELEM'. */
+static void
+convolve_fft_sizes(struct convolve_fft *f, size_t ndim, size_t *dsize,
+                   size_t *kdsize)
+{
+  size_t d, need;
+  double target=pow(CONVOLVE_FFT_BLOCK_ELEM, 1.0f/ndim);
+
+  f->ndim=ndim;
+  f->nreal=f->numblocks=1;
+  for(d=0;d<ndim;++d)
+    {
+      /* If the full dataset (padded by the kernel) is smaller than the
+         target, only one block is necessary in this dimension. */
+      f->dsize[d]=dsize[d];
+      f->half[d]=kdsize[d]/2;
+      need=dsize[d]+kdsize[d]-1;
+      if(need<=target)
+        {
+          f->psize[d]=convolve_fft_good_size(need);
+          f->bsize[d]=dsize[d];
+        }
+      else
+        {
+          f->psize[d]=convolve_fft_good_size( target > 2*(kdsize[d]-1)
+                                              ? target
+                                              : 2*(kdsize[d]-1) );
+          f->bsize[d]=f->psize[d]-(kdsize[d]-1);
+        }
+
+      /* Number of blocks and total sizes. */
+      f->nblock[d]=(dsize[d]+f->bsize[d]-1)/f->bsize[d];
+      f->numblocks*=f->nblock[d];
+      f->nreal*=f->psize[d];
+    }
+  f->ncomplex = f->nreal / f->psize[ndim-1] * (f->psize[ndim-1]/2+1);
+}
+
+
+
+
+
+/* Allocate the work space for one thread. */
+static void
+convolve_fft_work_alloc(struct convolve_fft *f, struct convolve_fft_work *w)
+{
+  size_t d;
+  w->real =gal_pointer_allocate(GAL_TYPE_FLOAT64, f->nreal, 0, __func__,
+                                "w->real");
+  w->mreal=gal_pointer_allocate(GAL_TYPE_FLOAT64, f->nreal, 0, __func__,
+                                "w->mreal");
+  w->cimg =gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*f->ncomplex, 0,
+                                __func__, "w->cimg");
+  w->cmsk =gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*f->ncomplex, 0,
+                                __func__, "w->cmsk");
+  w->rwork=gsl_fft_real_workspace_alloc(f->psize[f->ndim-1]);
+  for(d=0;d<f->ndim-1;++d)
+    w->cwork[d]=gsl_fft_complex_workspace_alloc(f->psize[d]);
+}
+
+
+
+
+
+static void
+convolve_fft_work_free(struct convolve_fft *f, struct convolve_fft_work *w)
+{
+  size_t d;
+  free(w->real);
+  free(w->mreal);
+  free(w->cimg);
+  free(w->cmsk);
+  gsl_fft_real_workspace_free(w->rwork);
+  for(d=0;d<f->ndim-1;++d) gsl_fft_complex_workspace_free(w->cwork[d]);
+}
+
+
+
+
+
+/* Transform the complex array along all the dimensions except the
+   fastest ('sign' is -1 for forward and 1 for inverse). */
+static void
+convolve_fft_slow_dims(struct convolve_fft *f, struct convolve_fft_work *w,
+                       double *cplx, int sign)
+{
+  size_t d, e, l, n, s, nlines, start;
+
+  for(d=0;d<f->ndim-1;++d)
+    {
+      /* Stride (in complex elements) along this dimension. */
+      s=f->psize[f->ndim-1]/2+1;
+      for(e=d+1;e<f->ndim-1;++e) s*=f->psize[e];
+
+      /* Transform each line along this dimension. */
+      n=f->psize[d];
+      nlines=f->ncomplex/n;
+      for(l=0;l<nlines;++l)
+        {
+          start = l/s*s*n + l%s;
+          if(sign<0)
+            gsl_fft_complex_forward(cplx+2*start, s, n, f->cwave[d],
+                                    w->cwork[d]);
+          else
+            gsl_fft_complex_inverse(cplx+2*start, s, n, f->cwave[d],
+                                    w->cwork[d]);
+        }
+    }
+}
+
+
+
+
+
+/* Forward real-to-complex transform of a padded block. Along the fastest
+   dimension, GSL's real transform is used and its 'half-complex' output
+   is unpacked into the first 'n/2+1' complex elements of each row. */
+static void
+convolve_fft_forward(struct convolve_fft *f, struct convolve_fft_work *w,
+                     double *real, double *cplx)
+{
+  double *row, *c;
+  size_t r, k, n=f->psize[f->ndim-1], nc=n/2+1;
+
+  /* Along the fastest dimension. */
+  for(r=0;r<f->nreal/n;++r)
+    {
+      row=real+r*n;
+      c=cplx+2*r*nc;
+      gsl_fft_real_transform(row, 1, n, f->rwave, w->rwork);
+      c[0]=row[0];
+      c[1]=0.0f;
+      for(k=1;k<nc;++k)
+        if(2*k==n) { c[2*k]=row[n-1];   c[2*k+1]=0.0f;     }
+        else       { c[2*k]=row[2*k-1]; c[2*k+1]=row[2*k]; }
+    }
+
+  /* Along the other dimensions. */
+  convolve_fft_slow_dims(f, w, cplx, -1);
+}
+
+
+
+
+
+/* Inverse of 'convolve_fft_forward' (the output is normalized). */
+static void
+convolve_fft_inverse(struct convolve_fft *f, struct convolve_fft_work *w,
+                     double *cplx, double *real)
+{
+  double *row, *c;
+  size_t r, k, n=f->psize[f->ndim-1], nc=n/2+1;
+
+  /* Along the slower dimensions. */
+  convolve_fft_slow_dims(f, w, cplx, 1);
+
+  /* Along the fastest dimension. */
+  for(r=0;r<f->nreal/n;++r)
+    {
+      row=real+r*n;
+      c=cplx+2*r*nc;
+      row[0]=c[0];
+      for(k=1;k<nc;++k)
+        if(2*k==n) row[n-1]=c[2*k];
+        else { row[2*k-1]=c[2*k]; row[2*k]=c[2*k+1]; }
+      gsl_fft_halfcomplex_inverse(row, 1, n, f->hwave, w->rwork);
+    }
+}
+
+
+
+
+
+/* Multiply the transform of a block with the transform of the kernel. */
+static void
+convolve_fft_multiply(struct convolve_fft *f, double *cplx)
+{
+  double re, *c=cplx, *k=f->kfft, *cf=cplx+2*f->ncomplex;
+  do
+    {
+      re   = c[0]*k[0] - c[1]*k[1];
+      c[1] = c[0]*k[1] + c[1]*k[0];
+      c[0] = re;
+      k+=2;
+    }
+  while( (c+=2) < cf );
+}
+
+
+
+
+
+/* Prepare everything that only depends on the size of the input and the
+   kernel, including the transform of the kernel. */
+static void
+convolve_fft_prepare(struct convolve_fft *f, gal_data_t *input,
+                     gal_data_t *kernel)
+{
+  float *k=kernel->array;
+  struct convolve_fft_work w;
+  size_t d, i, coord[3], ndim=kernel->ndim;
+
+  /* Sanity checks. */
+  if(input->ndim!=kernel->ndim)
+    error(EXIT_FAILURE, 0, "%s: The number of dimensions between the "
+          "kernel and input should be the same", __func__);
+  if(ndim>3)
+    error(EXIT_FAILURE, 0, "%s: only 1, 2 or 3 dimensional datasets are "
+          "currently supported", __func__);
+  if( input->type!=GAL_TYPE_FLOAT32 || kernel->type!=GAL_TYPE_FLOAT32 )
+    error(EXIT_FAILURE, 0, "%s: only accepts 'float32' type input and "
+          "kernel currently", __func__);
+
+  /* Set the sizes and allocate the wave tables. */
+  convolve_fft_sizes(f, ndim, input->dsize, kernel->dsize);
+  f->rwave=gsl_fft_real_wavetable_alloc(f->psize[ndim-1]);
+  f->hwave=gsl_fft_halfcomplex_wavetable_alloc(f->psize[ndim-1]);
+  for(d=0;d<ndim-1;++d)
+    f->cwave[d]=gsl_fft_complex_wavetable_alloc(f->psize[d]);
+
+  /* Put the kernel into a padded block: since Gnuastro's convolution is
+     defined such that the first kernel pixel is multiplied with the first
+     pixel of its overlap with the input, kernel pixel 'c' is put in pixel
+     'half-c' (wrapped around the padded block). Blank kernel pixels are
+     treated as zero. */
+  convolve_fft_work_alloc(f, &w);
+  memset(w.real, 0, f->nreal*sizeof *w.real);
+  f->ksum=f->kabssum=0.0f;
+  for(i=0;i<kernel->size;++i)
+    if( !isnan(k[i]) )
+      {
+        gal_dimension_index_to_coord(i, ndim, kernel->dsize, coord);
+        for(d=0;d<ndim;++d)
+          coord[d] = (f->half[d] + f->psize[d] - coord[d]) % f->psize[d];
+        w.real[ gal_dimension_coord_to_index(ndim, f->psize, coord) ]=k[i];
+        f->ksum+=k[i];
+        f->kabssum+=fabs(k[i]);
+      }
+
+  /* Transform the kernel and keep it. */
+  f->kfft=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*f->ncomplex, 0,
+                               __func__, "f->kfft");
+  convolve_fft_forward(f, &w, w.real, f->kfft);
+  convolve_fft_work_free(f, &w);
+}
+
+
+
+
+
+static void
+convolve_fft_free(struct convolve_fft *f)
+{
+  size_t d;
+  free(f->kfft);
+  gsl_fft_real_wavetable_free(f->rwave);
+  gsl_fft_halfcomplex_wavetable_free(f->hwave);
+  for(d=0;d<f->ndim-1;++d) gsl_fft_complex_wavetable_free(f->cwave[d]);
+}
+
+
+
+
+
+/* Allocate the output of frequency domain convolution (similar to
+   'gal_convolve_spatial'). */
+static gal_data_t *
+convolve_fft_output(gal_data_t *input)
+{
+  gal_data_t *out;
+
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, input->ndim, input->dsize,
+                     input->wcs, 0, input->minmapsize, input->quietmmap,
+                     NULL, input->unit, NULL);
+  out->flag = ( input->flag
+                | ( GAL_DATA_FLAG_BLANK_CH | GAL_DATA_FLAG_HASBLANK ) );
+  return out;
+}
+
+
+
+
+
+/* Convolve one block of the input. The block is first filled with the
+   input values within it (and the kernel's half-width around it), blank
+   values and pixels outside the input are set to zero. When the edges
+   should be corrected, a mask (1 for usable pixels) is also convolved and
+   the result is divided by it (for blocks that don't touch the edge and
+   have no blank value, it is just the sum of the kernel). So the output is
+   the same as spatial domain convolution with 'convoverch==1' (to within
+   floating point errors). */
+static void
+convolve_fft_block(struct convolve_fft_params *fprm,
+                   struct convolve_fft_work *w, gal_data_t *input,
+                   gal_data_t *output, size_t blockid)
+{
+  struct convolve_fft *f=fprm->f;
+  float *in=input->array, *out=output->array;
+  size_t d, i, r, o, nrows, ndim=f->ndim, last=ndim-1;
+  int needmask=0, rowin, edgecorrection=fprm->edgecorrection;
+  size_t bc[3], start[3], bl[3], psub[3], rc[3], ic[3], i0, i1, ind;
+  double m, v;
+
+  /* Coordinates of this block, its starting pixel and its size. */
+  gal_dimension_index_to_coord(blockid, ndim, f->nblock, bc);
+  for(d=0;d<ndim;++d)
+    {
+      start[d]=bc[d]*f->bsize[d];
+      bl[d] = ( start[d]+f->bsize[d] > f->dsize[d]
+                ? f->dsize[d]-start[d] : f->bsize[d] );
+      if( start[d] < f->half[d]
+          || start[d] + bl[d] + f->half[d] > f->dsize[d] )
+        needmask=edgecorrection;
+    }
+
+  /* Fill the padded block. The region to read is 'bl+2*half' along each
+     dimension (starting 'half' pixels before 'start'), it is read row by
+     row (along the fastest dimension). */
+  memset(w->real,  0, f->nreal*sizeof *w->real);
+  memset(w->mreal, 0, f->nreal*sizeof *w->mreal);
+  nrows=1;
+  for(d=0;d<last;++d) { psub[d]=bl[d]+2*f->half[d]; nrows*=psub[d]; }
+  for(r=0;r<nrows;++r)
+    {
+      /* Coordinates of this row within the block and the input. */
+      rowin=1;
+      for(i=r, d=last; d-->0; i/=psub[d])
+        {
+          rc[d] = i % psub[d];
+          if( start[d]+rc[d] < f->half[d]
+              || start[d]+rc[d]-f->half[d] >= f->dsize[d] )
+            rowin=0;
+          else ic[d]=start[d]+rc[d]-f->half[d];
+        }
+      if(rowin==0) continue;
+
+      /* Range of the fastest dimension that is within the input. */
+      i0 = start[last] < f->half[last] ? f->half[last]-start[last] : 0;
+      i1 = ( start[last]+bl[last]+f->half[last] > f->dsize[last]
+             ? f->dsize[last]+f->half[last]-start[last]
+             : bl[last]+2*f->half[last] );
+
+      /* Copy the values. */
+      rc[last]=i0;
+      ic[last]=start[last]+i0-f->half[last];
+      o=gal_dimension_coord_to_index(ndim, f->psize, rc);
+      ind=gal_dimension_coord_to_index(ndim, f->dsize, ic);
+      for(i=0;i<i1-i0;++i)
+        if( isnan(in[ind+i]) ) needmask=edgecorrection;
+        else { w->real[o+i]=in[ind+i]; w->mreal[o+i]=1.0f; }
+    }
+
+  /* Convolve the block (and the mask if necessary). */
+  convolve_fft_forward(f, w, w->real, w->cimg);
+  convolve_fft_multiply(f, w->cimg);
+  convolve_fft_inverse(f, w, w->cimg, w->real);
+  if(needmask)
+    {
+      convolve_fft_forward(f, w, w->mreal, w->cmsk);
+      convolve_fft_multiply(f, w->cmsk);
+      convolve_fft_inverse(f, w, w->cmsk, w->mreal);
+    }
+
+  /* Write the output: output pixel 'j' of the block is pixel 'half+j' of
+     the convolved padded block. */
+  nrows=1;
+  for(d=0;d<last;++d) nrows*=bl[d];
+  for(r=0;r<nrows;++r)
+    {
+      for(i=r, d=last; d-->0; i/=bl[d])
+        {
+          rc[d] = i%bl[d] + f->half[d];
+          ic[d] = i%bl[d] + start[d];
+        }
+      rc[last]=f->half[last];
+      ic[last]=start[last];
+      o=gal_dimension_coord_to_index(ndim, f->psize, rc);
+      ind=gal_dimension_coord_to_index(ndim, f->dsize, ic);
+      for(i=0;i<bl[last];++i)
+        {
+          v=w->real[o+i];
+          if( isnan(in[ind+i]) ) out[ind+i]=NAN;
+          else if(needmask)
+            {
+              m=w->mreal[o+i];
+              out[ind+i] = ( fabs(m) <= CONVOLVE_FFT_ZERO_KSUM*f->kabssum
+                             ? NAN : v/m );
+            }
+          else if(edgecorrection)
+            out[ind+i] = f->ksum==0.0f ? NAN : v/f->ksum;
+          else
+            out[ind+i] = v;
+        }
+    }
+}
+
+
+
+
+
+/* Convolve the blocks that are assigned to this thread. */
+static void *
+convolve_fft_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct convolve_fft_params *fprm=(struct convolve_fft_params *)tprm->params;
+
+  size_t i, in, nb=fprm->f->numblocks;
+  struct convolve_fft_work w;
+
+  /* Allocate the work space and go over the blocks. */
+  convolve_fft_work_alloc(fprm->f, &w);
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      in=tprm->indexs[i]/nb;
+      convolve_fft_block(fprm, &w, fprm->inputs[in], fprm->outs[in],
+                         tprm->indexs[i]%nb);
+    }
+
+  /* Clean up, wait until all other threads finish, then return. */
+  convolve_fft_work_free(fprm->f, &w);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Convolve the input with the kernel in the frequency domain (using
+   real-to-complex Fourier transforms). Large inputs are broken into
+   independent blocks that are convolved on separate threads. Blank pixels
+   are treated similar to spatial domain convolution and when
+   'edgecorrection' is non-zero, the edges are also corrected similar to
+   the spatial domain (the input is treated as one channel). */
+gal_data_t *
+gal_convolve_frequency(gal_data_t *input, gal_data_t *kernel,
+                       size_t numthreads, int edgecorrection)
+{
+  gal_data_t *out;
+  struct convolve_fft f;
+  struct convolve_fft_params fprm;
+
+  /* Prepare the basic Fourier transform parameters and the output. */
+  convolve_fft_prepare(&f, input, kernel);
+  out=convolve_fft_output(input);
+
+  /* Convolve each block on a thread. */
+  fprm.f=&f;
+  fprm.outs=&out;
+  fprm.inputs=&input;
+  fprm.edgecorrection=edgecorrection;
+  gal_threads_spin_off(convolve_fft_on_thread, &fprm, f.numblocks,
+                       numthreads, input->minmapsize, input->quietmmap);
+
+  /* Clean up and return. */
+  convolve_fft_free(&f);
+  return out;
+}
+
+
+
+
+
+/* Estimate which domain will be faster for convolving the input with the
+   kernel. The number of floating point operations are estimated as
+   '2*N*K' for the spatial domain (where 'K' is the number of operations
+   for each pixel, see 'convolve_kernel_separate') and as '5*P*log2(P)'
+   for each transform of a padded block with 'P' elements in the
+   frequency domain. 'rank' is the number of separable terms of the
+   kernel that are used in the spatial domain (0 when the kernel isn't
+   separated). */
+static int
+convolve_domain_auto(gal_data_t *input, gal_data_t *kernel, size_t rank)
+{
+  struct convolve_fft f;
+  double spatial, frequency;
+  size_t keff, ndim=kernel->ndim;
+  size_t nkrows=kernel->size/kernel->dsize[ndim-1];
+
+  /* The frequency domain is currently only implemented up to 3D. */
+  if(input->ndim!=kernel->ndim || ndim>3)
+    return GAL_CONVOLVE_DOMAIN_SPATIAL;
+
+  /* Operations in the spatial domain. */
+  keff = rank ? rank*(nkrows+kernel->dsize[ndim-1]) : kernel->size;
+  spatial = 2.0f * input->size * keff;
+
+  /* Operations in the frequency domain (a forward and inverse transform
+     and multiplication for each block). */
+  convolve_fft_sizes(&f, ndim, input->dsize, kernel->dsize);
+  frequency = f.numblocks * ( 2 * 5.0f * f.nreal * log2(f.nreal)
+                              + 6.0f * f.ncomplex );
+
+  /* Return the faster domain. */
+  return ( frequency < spatial
+           ? GAL_CONVOLVE_DOMAIN_FREQUENCY
+           : GAL_CONVOLVE_DOMAIN_SPATIAL );
+}
+
+
+
+
+
+/* Estimate which domain will be faster for convolving the input with the
+   kernel (see 'convolve_domain_auto'), when the spatial domain
+   convolution is done with 'gal_convolve_spatial'. */
+int
+gal_convolve_domain_auto(gal_data_t *input, gal_data_t *kernel)
+{
+  return convolve_domain_auto(input, kernel, 0);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*********************************************************************/
+/********************       Batch convolution     ********************/
+/*********************************************************************/
+/* For convolving separate inputs on separate threads. */
+struct convolve_batch_params
+{
+  gal_convolve_batch_t  *cb;  /* Batch convolution parameters.          */
+  gal_data_t       **inputs;  /* Input datasets.                        */
+  gal_data_t         **outs;  /* Output datasets.                       */
+};
+
+
+
+
+
+/* Return an empty set of the batch convolution data structure. */
+gal_convolve_batch_t
+gal_convolve_batch_template()
+{
+  gal_convolve_batch_t cb;
+
+  /* Initialize pointers with NULL. */
+  cb.fft=NULL;
+  cb.kernel=NULL;
+  cb.sepcol=NULL;
+  cb.seprow=NULL;
+
+  /* Initialize values. */
+  cb.rank=0;
+  cb.septol=NAN;
+  cb.edgecorrection=1;
+  cb.numthreads=GAL_BLANK_SIZE_T;
+  cb.domain=GAL_CONVOLVE_DOMAIN_INVALID;
+
+  return cb;
+}
+
+
+
+
+
+/* Do all the preparations that only depend on the kernel (finding its
+   separable terms when 'septol' isn't NaN). The transform of the kernel
+   depends on the size of the input, so it is done (and kept for later
+   inputs of the same size) when the first input is convolved in the
+   frequency domain. */
+void
+gal_convolve_batch_init(gal_convolve_batch_t *cb)
+{
+  gal_data_t *kernel=cb->kernel;
+
+  /* Sanity checks. */
+  if(kernel==NULL)
+    error(EXIT_FAILURE, 0, "%s: no kernel given", __func__);
+  if(kernel->type!=GAL_TYPE_FLOAT32)
+    error(EXIT_FAILURE, 0, "%s: only accepts a 'float32' type kernel "
+          "currently", __func__);
+  if(cb->numthreads==0 || cb->numthreads==GAL_BLANK_SIZE_T)
+    error(EXIT_FAILURE, 0, "%s: the number of threads ('numthreads') "
+          "should be given and cannot be zero", __func__);
+  if( cb->domain!=GAL_CONVOLVE_DOMAIN_INVALID
+      && cb->domain!=GAL_CONVOLVE_DOMAIN_SPATIAL
+      && cb->domain!=GAL_CONVOLVE_DOMAIN_FREQUENCY )
+    error(EXIT_FAILURE, 0, "%s: domain code %d not recognized", __func__,
+          cb->domain);
+
+  /* Find the separable terms of the kernel. */
+  cb->fft=NULL;
+  cb->sepcol=cb->seprow=NULL;
+  cb->rank=convolve_kernel_separate(kernel,
+                                    kernel->size/kernel->dsize[kernel->ndim-1],
+                                    cb->septol, &cb->sepcol, &cb->seprow);
+}
+
+
+
+
+
+/* Return the frequency domain preparations for the given input: if the
+   previous input had the same size, the same preparations (including the
+   transform of the kernel) are used. */
+static struct convolve_fft *
+convolve_batch_fft(gal_convolve_batch_t *cb, gal_data_t *input)
+{
+  size_t d;
+  struct convolve_fft *f=cb->fft;
+
+  /* See if the existing preparations can be used. */
+  if(f)
+    {
+      if(f->ndim==input->ndim)
+        {
+          for(d=0;d<f->ndim;++d)
+            if(f->dsize[d]!=input->dsize[d]) break;
+          if(d==f->ndim) return f;
+        }
+      convolve_fft_free(f);
+      free(f);
+    }
+
+  /* Prepare for this size. */
+  errno=0;
+  f=malloc(sizeof *f);
+  if(f==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'f'", __func__,
+          sizeof *f);
+  convolve_fft_prepare(f, input, cb->kernel);
+  cb->fft=f;
+  return f;
+}
+
+
+
+
+
+/* Convolve the inputs that are given to this thread in the spatial domain
+   (each input on one thread). */
+static void *
+convolve_batch_spatial_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct convolve_batch_params *bprm=
+    (struct convolve_batch_params *)tprm->params;
+
+  size_t i, ind;
+  gal_convolve_batch_t *cb=bprm->cb;
+
+  /* Go over all the inputs given to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      bprm->outs[ind]=gal_convolve_spatial_general(bprm->inputs[ind],
+                                                   cb->kernel, 1,
+                                                   cb->edgecorrection, 1,
+                                                   NULL, cb, cb->septol);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Convolve 'num' inputs that all have the same size. In the frequency
+   domain, the blocks of all the inputs are distributed between the
+   threads. In the spatial domain, when there are more inputs than
+   threads, each input is convolved on one thread (for many small inputs,
+   this is much more efficient than using all the threads on each small
+   input). */
+static void
+convolve_batch_same_size(gal_convolve_batch_t *cb, gal_data_t **inputs,
+                         gal_data_t **outs, size_t num)
+{
+  size_t i;
+  int domain=cb->domain;
+  struct convolve_fft_params fprm;
+  struct convolve_batch_params bprm;
+
+  /* Set the domain (if it should be found automatically). */
+  if(domain==GAL_CONVOLVE_DOMAIN_INVALID)
+    domain=convolve_domain_auto(inputs[0], cb->kernel, cb->rank);
+
+  /* Do the convolution. */
+  if(domain==GAL_CONVOLVE_DOMAIN_FREQUENCY)
+    {
+      fprm.f=convolve_batch_fft(cb, inputs[0]);
+      for(i=0;i<num;++i) outs[i]=convolve_fft_output(inputs[i]);
+      fprm.outs=outs;
+      fprm.inputs=inputs;
+      fprm.edgecorrection=cb->edgecorrection;
+      gal_threads_spin_off(convolve_fft_on_thread, &fprm,
+                           num*fprm.f->numblocks, cb->numthreads,
+                           inputs[0]->minmapsize, inputs[0]->quietmmap);
+    }
+  else
+    {
+      if(num>=cb->numthreads)
+        {
+          bprm.cb=cb;
+          bprm.outs=outs;
+          bprm.inputs=inputs;
+          gal_threads_spin_off(convolve_batch_spatial_on_thread, &bprm,
+                               num, cb->numthreads, inputs[0]->minmapsize,
+                               inputs[0]->quietmmap);
+        }
+      else
+        for(i=0;i<num;++i)
+          outs[i]=gal_convolve_spatial_general(inputs[i], cb->kernel,
+                                               cb->numthreads,
+                                               cb->edgecorrection, 1,
+                                               NULL, cb, cb->septol);
+    }
+}
+
+
+
+
+
+/* Convolve all the datasets in the 'inputs' list with the kernel that was
+   prepared in 'gal_convolve_batch_init'. The output is a list of the
+   convolved datasets (in the same order as the inputs). Consecutive
+   inputs with the same size are convolved together (on all the threads)
+   and the kernel's preparations are re-used for all of them. */
+gal_data_t *
+gal_convolve_batch(gal_convolve_batch_t *cb, gal_data_t *inputs)
+{
+  size_t i, j, num;
+  gal_data_t *tmp, *out, **in, **outs;
+
+  /* If there are no inputs, return NULL. */
+  num=gal_list_data_number(inputs);
+  if(num==0) return NULL;
+
+  /* Put the inputs into an array (and check them). */
+  errno=0;
+  in=malloc(num * sizeof *in);
+  outs=malloc(num * sizeof *outs);
+  if(in==NULL || outs==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'in' or 'outs'",
+          __func__, num * sizeof *in);
+  for(i=0, tmp=inputs; tmp!=NULL; tmp=tmp->next)
+    {
+      if(tmp->type!=GAL_TYPE_FLOAT32)
+        error(EXIT_FAILURE, 0, "%s: only accepts 'float32' type inputs "
+              "currently (input %zu has type '%s')", __func__, i+1,
+              gal_type_name(tmp->type, 1));
+      if(tmp->ndim!=cb->kernel->ndim)
+        error(EXIT_FAILURE, 0, "%s: The number of dimensions between the "
+              "kernel and input %zu should be the same", __func__, i+1);
+      in[i++]=tmp;
+    }
+
+  /* The convolution functions interpret a list of datasets as a list of
+     tiles, so each input is (temporarily) detached from the list. */
+  for(i=0;i<num;++i) in[i]->next=NULL;
+
+  /* Convolve each group of consecutive inputs with the same size. */
+  for(i=0;i<num;i=j)
+    {
+      for(j=i+1;j<num;++j)
+        if( gal_dimension_is_different(in[i], in[j]) ) break;
+      convolve_batch_same_size(cb, in+i, outs+i, j-i);
+    }
+
+  /* Re-build the input list and build the output list. */
+  for(i=0;i<num;++i)
+    {
+      in[i]->next   = i<num-1 ? in[i+1]   : NULL;
+      outs[i]->next = i<num-1 ? outs[i+1] : NULL;
+    }
+
+  /* Clean up and return. */
+  out=outs[0];
+  free(outs);
+  free(in);
+  return out;
+}
+
+
+
+
+
+/* Clean up ONLY the internal variables (the kernel and inputs and outputs
+   should be freed by the caller). */
+void
+gal_convolve_batch_free(gal_convolve_batch_t *cb)
+{
+  struct convolve_fft *f=cb->fft;
+
+  free(cb->sepcol);
+  free(cb->seprow);
+  if(f) { convolve_fft_free(f); free(f); }
+  cb->fft=NULL;
+  cb->sepcol=cb->seprow=NULL;
 }
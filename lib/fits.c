@@ -61,7 +61,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
  *************************************************************/
 static void
 fits_tab_write_col(fitsfile *fptr, gal_data_t *col, int tableformat,
-                   size_t *colind, char *tform, char *filename);
+                   size_t *colind, char *tform, char *filename,
+                   size_t firstrow);
 
 
 
@@ -3498,7 +3499,8 @@ gal_fits_tab_info(char *filename, char *hdu, size_t *numcols,
 static void
 fits_tab_read_ascii_float_special(char *filename, char *hdu,
                                   fitsfile *fptr, gal_data_t *out,
-                                  size_t colnum, size_t numrows,
+                                  size_t colnum, size_t rowstart,
+                                  size_t numrows, size_t outstart,
                                   size_t minmapsize, int quietmmap)
 {
   double tmp;
@@ -3524,7 +3526,7 @@ fits_tab_read_ascii_float_special(char *filename, char *hdu,
     }
 
   /* Read the column as a string. */
-  fits_read_col(fptr, TSTRING, colnum, 1, 1, out->size, NULL,
+  fits_read_col(fptr, TSTRING, colnum, rowstart+1, 1, numrows, NULL,
                 strrows->array, &anynul, &status);
   gal_fits_io_error(status, NULL);
 
@@ -3538,9 +3540,9 @@ fits_tab_read_ascii_float_special(char *filename, char *hdu,
 
       /* Write it into the output dataset. */
       if(out->type==GAL_TYPE_FLOAT32)
-        ((float *)(out->array))[i]=tmp;
+        ((float *)(out->array))[outstart+i]=tmp;
       else
-        ((double *)(out->array))[i]=tmp;
+        ((double *)(out->array))[outstart+i]=tmp;
     }
 
   /* Clean up. */
@@ -3556,7 +3558,9 @@ struct fits_tab_read_onecol_params
 {
   char              *filename;  /* Name of FITS file with table.     */
   char                   *hdu;  /* HDU of input table.               */
+  size_t             rowstart;  /* First row to read (from 0).       */
   size_t              numrows;  /* Number of rows in table to read.  */
+  size_t              *rowids;  /* Sorted row IDs to read (or NULL). */
   size_t              numcols;  /* Number of columns.                */
   size_t           minmapsize;  /* Minimum space to memory-map.      */
   int               quietmmap;  /* Don't print memory-mapping info.  */
@@ -3569,6 +3573,49 @@ struct fits_tab_read_onecol_params
 
 
 
+/* Read 'nrows' rows of one column (starting from row 'rowstart' of the
+   table, counting from zero) into the output column, starting from its
+   row 'outstart'. */
+static void
+fits_tab_read_col_rows(struct fits_tab_read_onecol_params *p,
+                       fitsfile *fptr, int hdutype, gal_data_t *col,
+                       size_t indin, size_t rowstart, size_t nrows,
+                       size_t outstart, void *blankuse)
+{
+  int anynul=0, status=0;
+  size_t nelem=col->size/p->numrows;   /* Elements in each row. */
+  int isfloat = ( col->type==GAL_TYPE_FLOAT32
+                  || col->type==GAL_TYPE_FLOAT64 );
+
+  /* Read the desired rows. */
+  fits_read_col(fptr, gal_fits_type_to_datatype(col->type), indin+1,
+                rowstart+1, 1, nrows*nelem, blankuse,
+                gal_pointer_increment(col->array, outstart*nelem,
+                                      col->type),
+                &anynul, &status);
+
+  /* In the ASCII table format some things need to be checked. */
+  if( hdutype==ASCII_TBL )
+    {
+      /* CFITSIO might not be able to read 'INF' or '-INF'. In this
+         case, it will set status to 'BAD_C2D' or 'BAD_C2F'. So, we'll use
+         our own parser for the column values. */
+      if(isfloat && (status==BAD_C2D || status==BAD_C2F) )
+        {
+          fits_tab_read_ascii_float_special(p->filename, p->hdu, fptr,
+                                            col, indin+1, rowstart, nrows,
+                                            outstart, p->minmapsize,
+                                            p->quietmmap);
+          status=0;
+        }
+    }
+  gal_fits_io_error(status, NULL); /* After 'status' correction. */
+}
+
+
+
+
+
 void *
 fits_tab_read_onecol(void *in_prm)
 {
@@ -3585,8 +3632,9 @@ fits_tab_read_onecol(void *in_prm)
   size_t dsize[2];
   gal_list_sizet_t *tmp;
   void *blank, *blankuse;
-  int isfloat, hdutype, anynul=0, status=0;
-  size_t i, j, c, ndim, strw, repeat, indout, indin=GAL_BLANK_SIZE_T;
+  int isfloat, hdutype, status=0;
+  size_t i, j, k, c, ndim, strw, repeat, indout, indin=GAL_BLANK_SIZE_T;
+  size_t *ids=p->rowids;
 
   /* Open the FITS file. */
   fptr=gal_fits_hdu_open_format(p->filename, p->hdu, 1);
@@ -3684,27 +3732,20 @@ fits_tab_read_onecol(void *in_prm)
           blankuse = ( col->type==GAL_TYPE_STRING
                        ? *((char **)blank)
                        : blank);
-          fits_read_col(fptr, gal_fits_type_to_datatype(col->type),
-                        indin+1, 1, 1, col->size, blankuse, col->array,
-                        &anynul, &status);
-
-          /* In the ASCII table format some things need to be checked. */
-          if( hdutype==ASCII_TBL )
+          if(p->rowids)
             {
-              /* CFITSIO might not be able to read 'INF' or '-INF'. In this
-                case, it will set status to 'BAD_C2D' or 'BAD_C2F'. So,
-                we'll use our own parser for the column values. */
-              if(isfloat && (status==BAD_C2D || status==BAD_C2F) )
+              /* Only the given rows should be read: read each run of
+                 contiguous rows with one call to CFITSIO. */
+              for(j=0;j<p->numrows;j=k)
                 {
-                  fits_tab_read_ascii_float_special(p->filename, p->hdu,
-                                                    fptr, col, indin+1,
-                                                    p->numrows,
-                                                    p->minmapsize,
-                                                    p->quietmmap);
-                  status=0;
+                  for(k=j+1; k<p->numrows && ids[k]==ids[k-1]+1; ++k) {}
+                  fits_tab_read_col_rows(p, fptr, hdutype, col, indin,
+                                         ids[j], k-j, j, blankuse);
                 }
             }
-          gal_fits_io_error(status, NULL); /* After 'status' correction. */
+          else
+            fits_tab_read_col_rows(p, fptr, hdutype, col, indin,
+                                   p->rowstart, p->numrows, 0, blankuse);
 
           /* Clean up and sanity check (just note that the blank value for
              strings, is an array of strings, so we need to free the
@@ -3732,11 +3773,16 @@ fits_tab_read_onecol(void *in_prm)
 
 
 
-/* Read the column indexs into a dataset. */
-gal_data_t *
-gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
-                  gal_data_t *allcols, gal_list_sizet_t *indexll,
-                  size_t numthreads, size_t minmapsize, int quietmmap)
+/* Low-level function to read the requested columns. When 'rowids' is
+   NULL, 'numrows' rows will be read, starting from row 'rowstart'
+   (counting from 0). Otherwise, 'rowids' should be a sorted array of
+   'numrows' row IDs (counting from 0) and only those rows will be read
+   ('rowstart' is ignored). */
+static gal_data_t *
+fits_tab_read_general(char *filename, char *hdu, size_t rowstart,
+                      size_t numrows, size_t *rowids, gal_data_t *allcols,
+                      gal_list_sizet_t *indexll, size_t numthreads,
+                      size_t minmapsize, int quietmmap)
 {
   size_t i;
   gal_data_t *out=NULL;
@@ -3768,7 +3814,9 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
       p.hdu = hdu;
       p.allcols = allcols;
       p.numrows = numrows;
+      p.rowids = rowids;
       p.indexll = indexll;
+      p.rowstart = rowstart;
       p.filename = filename;
       p.quietmmap = quietmmap;
       p.minmapsize = minmapsize;
@@ -3816,6 +3864,67 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
 
 
 
+/* Read the column indexs into a dataset. */
+gal_data_t *
+gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
+                  gal_data_t *allcols, gal_list_sizet_t *indexll,
+                  size_t numthreads, size_t minmapsize, int quietmmap)
+{
+  return fits_tab_read_general(filename, hdu, 0, numrows, NULL, allcols,
+                               indexll, numthreads, minmapsize,
+                               quietmmap);
+}
+
+
+
+
+
+/* Read 'numrows' rows of the requested columns, starting from row
+   'rowstart' (counting from 0). This allows reading a large table in
+   separate chunks of rows (for example to process it in constant
+   memory). */
+gal_data_t *
+gal_fits_tab_read_rows(char *filename, char *hdu, size_t rowstart,
+                       size_t numrows, gal_data_t *allcols,
+                       gal_list_sizet_t *indexll, size_t numthreads,
+                       size_t minmapsize, int quietmmap)
+{
+  return fits_tab_read_general(filename, hdu, rowstart, numrows, NULL,
+                               allcols, indexll, numthreads, minmapsize,
+                               quietmmap);
+}
+
+
+
+
+
+/* Only read the rows that are given in 'rowids' (a one-dimensional
+   'size_t' dataset of row IDs, counting from 0, sorted in increasing
+   order). Each run of contiguous rows is read with a single call to
+   CFITSIO, so when only a small fraction of the rows are desired (for
+   example after a row selection on another column), the amount of
+   input/output is greatly decreased. */
+gal_data_t *
+gal_fits_tab_read_rowids(char *filename, char *hdu, gal_data_t *rowids,
+                         gal_data_t *allcols, gal_list_sizet_t *indexll,
+                         size_t numthreads, size_t minmapsize,
+                         int quietmmap)
+{
+  /* Sanity check. */
+  if(rowids->type!=GAL_TYPE_SIZE_T)
+    error(EXIT_FAILURE, 0, "%s: the 'rowids' dataset should have a "
+          "'size_t' type", __func__);
+
+  /* Read the rows. */
+  return fits_tab_read_general(filename, hdu, 0, rowids->size,
+                               rowids->array, allcols, indexll,
+                               numthreads, minmapsize, quietmmap);
+}
+
+
+
+
+
 /* This function will allocate new copies for all elements to have the same
    length as the maximum length and set all trailing elements to '\0' for
    those that are shorter than the length. The return value is the
@@ -4147,7 +4256,8 @@ fits_write_tnull_tcomm(fitsfile *fptr, gal_data_t *col, int tableformat,
 
 static size_t
 fits_tab_write_colvec_ascii(fitsfile *fptr, gal_data_t *vector,
-                            size_t colind, char *tform, char *filename)
+                            size_t colind, char *tform, char *filename,
+                            size_t firstrow)
 {
   int status=0;
   char *keyname;
@@ -4183,7 +4293,11 @@ fits_tab_write_colvec_ascii(fitsfile *fptr, gal_data_t *vector,
       /* Write the column. */
       coli = colind + i++;
       fits_tab_write_col(fptr, ext, GAL_TABLE_FORMAT_AFITS, &coli,
-                         tform, filename);
+                         tform, filename, firstrow);
+
+      /* When appending rows to an existing table, the column names have
+         already been written. */
+      if(firstrow>1) continue;
 
       /* Set the keyword name. */
       if( asprintf(&keyname, "TTYPE%zu", coli)<0 )
@@ -4205,10 +4319,14 @@ fits_tab_write_colvec_ascii(fitsfile *fptr, gal_data_t *vector,
 
 
 
-/* Write a single column into the FITS table. */
+/* Write a single column into the FITS table. The values will be written
+   from row 'firstrow' (counting from 1, as in CFITSIO). When 'firstrow' is
+   larger than 1, we are appending rows to an existing table, so the
+   column's keywords are already in the header and are not written. */
 static void
 fits_tab_write_col(fitsfile *fptr, gal_data_t *col, int tableformat,
-                   size_t *colind, char *tform, char *filename)
+                   size_t *colind, char *tform, char *filename,
+                   size_t firstrow)
 {
   int status=0;
   char **strarr;
@@ -4222,13 +4340,14 @@ fits_tab_write_col(fitsfile *fptr, gal_data_t *col, int tableformat,
   if(tableformat==GAL_TABLE_FORMAT_AFITS && col->ndim==2 && col->dsize[1]>1)
     {
       *colind=fits_tab_write_colvec_ascii(fptr, col, *colind, tform,
-                                          filename);
+                                          filename, firstrow);
       return;
     }
 
   /* Write the blank value into the header and return a pointer to
      it. Otherwise, */
-  fits_write_tnull_tcomm(fptr, col, tableformat, *colind+1, tform);
+  if(firstrow==1)
+    fits_write_tnull_tcomm(fptr, col, tableformat, *colind+1, tform);
 
   /* Set the blank pointer if its necessary. Note that strings don't need a
      blank pointer in a FITS ASCII table. */
@@ -4257,7 +4376,7 @@ fits_tab_write_col(fitsfile *fptr, gal_data_t *col, int tableformat,
 
   /* Write the full column into the table. */
   fits_write_colnull(fptr, gal_fits_type_to_datatype(col->type),
-                     *colind+1, 1, 1, col->size, col->array, blank,
+                     *colind+1, firstrow, 1, col->size, col->array, blank,
                      &status);
   gal_fits_io_error(status, NULL);
 
@@ -4327,7 +4446,7 @@ gal_fits_tab_write(gal_data_t *cols, gal_list_str_t *comments,
      the header when necessary. */
   i=0;
   for(col=cols; col!=NULL; col=col->next)/*'i' is increment in the func.*/
-    fits_tab_write_col(fptr, col, tableformat, &i, tform[i], filename);
+    fits_tab_write_col(fptr, col, tableformat, &i, tform[i], filename, 1);
 
   /* Write the requested keywords. */
   if(keylist)
@@ -4349,3 +4468,111 @@ gal_fits_tab_write(gal_data_t *cols, gal_list_str_t *comments,
   fits_close_file(fptr, &status);
   gal_fits_io_error(status, NULL);
 }
+
+
+
+
+
+/* Append the rows in the given columns to the end of an existing FITS
+   table (in HDU 'hdu' of 'filename', or the last HDU when 'hdu==NULL'). The
+   columns have to be in the same order (and of the same types) as the
+   columns of the existing table, for example when the table was created by
+   'gal_fits_tab_write' with the first set of rows. This allows writing a
+   large table in separate chunks of rows. */
+void
+gal_fits_tab_write_append(gal_data_t *cols, char *filename, char *hdu)
+{
+  char **strarr;
+  fitsfile *fptr;
+  gal_data_t *col;
+  long nrows, repeat, width;
+  int typecode, numhdu, tableformat, filencols, status=0;
+  size_t i, maxlen, numcols=0, numrows=-1, thisnrows;
+
+  /* Open the requested HDU, or the last HDU if none was given. */
+  if(hdu)
+    fptr=gal_fits_hdu_open(filename, hdu, READWRITE, 1);
+  else
+    {
+      if( fits_open_file(&fptr, filename, READWRITE, &status) )
+        gal_fits_io_error(status, NULL);
+      fits_get_num_hdus(fptr, &numhdu, &status);
+      fits_movabs_hdu(fptr, numhdu, NULL, &status);
+      gal_fits_io_error(status, NULL);
+    }
+
+  /* Basic information of the existing table (note that
+     'gal_fits_tab_format' will abort if this HDU isn't a table). */
+  tableformat=gal_fits_tab_format(fptr);
+  fits_get_num_rows(fptr, &nrows, &status);
+  fits_get_num_cols(fptr, &filencols, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Make sure all the input columns have the same number of elements and
+     that they correspond to the columns of the existing table. */
+  for(col=cols; col!=NULL; col=col->next)
+    {
+      thisnrows = col->dsize ? col->dsize[0] : 0;
+      if(numrows==-1) numrows=thisnrows;
+      else if(thisnrows!=numrows)
+        error(EXIT_FAILURE, 0, "%s: the number of records/rows in the "
+              "input columns are not equal! The first column "
+              "has %zu rows, while column %zu has %zu rows",
+              __func__, numrows, numcols+1, thisnrows);
+      numcols += ( tableformat==GAL_TABLE_FORMAT_AFITS
+                   ? (col->ndim==1 ? 1 : col->dsize[1])
+                   : 1 );
+    }
+  if(numcols!=filencols)
+    error(EXIT_FAILURE, 0, "%s: %s (hdu: %s) has %d columns, but %zu "
+          "columns have been given to append", __func__, filename,
+          hdu?hdu:"last", filencols, numcols);
+
+  /* If there are rows to write, make sure the width of the string columns
+     in the existing table is enough for the new rows. In a binary table,
+     the width can be increased (CFITSIO will shift the data of the
+     following columns), but not in an ASCII table. */
+  if(numrows!=-1 && numrows>0)
+    {
+      i=1;
+      for(col=cols; col!=NULL; col=col->next)
+        {
+          if(col->type==GAL_TYPE_STRING)
+            {
+              maxlen=0;
+              strarr=col->array;
+              for(thisnrows=0; thisnrows<col->size; ++thisnrows)
+                if(strlen(strarr[thisnrows])>maxlen)
+                  maxlen=strlen(strarr[thisnrows]);
+              fits_get_coltype(fptr, i, &typecode, &repeat, &width,
+                               &status);
+              gal_fits_io_error(status, NULL);
+              if(tableformat==GAL_TABLE_FORMAT_BFITS)
+                {
+                  if(maxlen>repeat)
+                    fits_modify_vector_len(fptr, i, maxlen, &status);
+                  gal_fits_io_error(status, NULL);
+                }
+              else if(maxlen>width)
+                error(EXIT_FAILURE, 0, "%s: the strings of column %zu "
+                      "are longer than the width of the respective "
+                      "column in the existing FITS ASCII table of %s "
+                      "(hdu: %s). This is not possible in ASCII tables, "
+                      "please use a binary table", __func__, i, filename,
+                      hdu?hdu:"last");
+            }
+          i += ( tableformat==GAL_TABLE_FORMAT_AFITS && col->ndim==2
+                 ? col->dsize[1] : 1 );
+        }
+
+      /* Write the new rows after the last existing row. */
+      i=0;
+      for(col=cols; col!=NULL; col=col->next)/* 'i' is incremented within */
+        fits_tab_write_col(fptr, col, tableformat, &i, NULL, filename,
+                           nrows+1);
+    }
+
+  /* Close the FITS file. */
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+}
@@ -0,0 +1,99 @@
+/*********************************************************************
+tablecache -- Columnar binary cache of tables.
+This is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef __GAL_TABLECACHE_H__
+#define __GAL_TABLECACHE_H__
+
+/* Include other headers if necessary here. Note that other header files
+   must be included before the C++ preparations below */
+
+#include <sys/stat.h>
+
+#include <gnuastro/data.h>
+#include <gnuastro/list.h>
+
+
+
+/* C++ Preparations */
+#undef __BEGIN_C_DECLS
+#undef __END_C_DECLS
+#ifdef __cplusplus
+# define __BEGIN_C_DECLS extern "C" {
+# define __END_C_DECLS }
+#else
+# define __BEGIN_C_DECLS                /* empty */
+# define __END_C_DECLS                  /* empty */
+#endif
+/* End of C++ preparations */
+
+
+
+
+
+/* Actual header contants (the above were for the Pre-processor). */
+__BEGIN_C_DECLS  /* From C++ preparations */
+
+
+
+
+/* Suffix of the cache file (that is written beside the table). */
+#define GAL_TABLECACHE_SUFFIX      "gtc"
+
+/* Number of rows in each block (for the minimum and maximum of each
+   block of numeric columns). */
+#define GAL_TABLECACHE_BLOCKSIZE   65536
+
+
+
+
+
+char *
+gal_tablecache_name(char *filename, char *hdu);
+
+char *
+gal_tablecache_usable(char *filename, char *hdu);
+
+gal_data_t *
+gal_tablecache_info(char *cachename, size_t *numcols, size_t *numrows,
+                    int *tableformat);
+
+gal_data_t *
+gal_tablecache_read(char *cachename, gal_list_sizet_t *indexll,
+                    size_t rowstart, size_t numrows, size_t *rowids,
+                    size_t minmapsize, int quietmmap);
+
+uint8_t *
+gal_tablecache_blocks_in_range(char *cachename, size_t colind, double min,
+                               double max, size_t *nblocks,
+                               size_t *blocksize, size_t *numrows);
+
+void
+gal_tablecache_write(char *cachename, struct stat *source,
+                     gal_data_t *allcols, size_t numcols, size_t numrows,
+                     int tableformat, gal_data_t *cols);
+
+
+
+
+__END_C_DECLS    /* From C++ preparations */
+
+#endif           /* __GAL_TABLECACHE_H__ */
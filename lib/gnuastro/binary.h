@@ -70,14 +70,47 @@ gal_data_t *
 gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
                  int inplace);
 
+gal_data_t *
+gal_binary_erode_parallel(gal_data_t *input, size_t num, int connectivity,
+                          int inplace, size_t numthreads);
+
 gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
                   int inplace);
 
+gal_data_t *
+gal_binary_dilate_parallel(gal_data_t *input, size_t num, int connectivity,
+                           int inplace, size_t numthreads);
+
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
                 int inplace);
 
+gal_data_t *
+gal_binary_open_parallel(gal_data_t *input, size_t num, int connectivity,
+                         int inplace, size_t numthreads);
+
+
+
+/*********************************************************************/
+/*****************   Euclidean distance transform   ******************/
+/*********************************************************************/
+gal_data_t *
+gal_binary_distance_transform(gal_data_t *input, uint8_t value,
+                              size_t numthreads);
+
+gal_data_t *
+gal_binary_erode_radius(gal_data_t *input, double radius, int inplace,
+                        size_t numthreads);
+
+gal_data_t *
+gal_binary_dilate_radius(gal_data_t *input, double radius, int inplace,
+                         size_t numthreads);
+
+gal_data_t *
+gal_binary_open_radius(gal_data_t *input, double radius, int inplace,
+                       size_t numthreads);
+
 
 
 /*********************************************************************/
@@ -95,6 +128,13 @@ size_t
 gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
                                 int connectivity);
 
+size_t
+gal_binary_connected_components_parallel(gal_data_t *binary,
+                                         gal_data_t **out,
+                                         int connectivity,
+                                         size_t numthreads,
+                                         gal_data_t **indexs);
+
 gal_data_t *
 gal_binary_connected_indexs(gal_data_t *binary, int connectivity);
 
@@ -116,9 +156,17 @@ gal_data_t *
 gal_binary_holes_label(gal_data_t *input, int connectivity,
                        size_t *numholes);
 
+gal_data_t *
+gal_binary_holes_label_parallel(gal_data_t *input, int connectivity,
+                                size_t *numholes, size_t numthreads);
+
 void
 gal_binary_holes_fill(gal_data_t *input, int connectivity, size_t maxsize);
 
+void
+gal_binary_holes_fill_parallel(gal_data_t *input, int connectivity,
+                               size_t maxsize, size_t numthreads);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
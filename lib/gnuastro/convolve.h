@@ -44,16 +44,77 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* When requested, a kernel that can be separated into a few 1D terms
+   (for example a Gaussian kernel) is applied with them in the spatial
+   domain (see 'gal_convolve_spatial_separable'). The tolerance is the
+   maximum error in reproducing the kernel from its terms (relative to the
+   largest absolute value in the kernel). This is a suggested value. */
+#define GAL_CONVOLVE_SEPARABLE_TOLERANCE 1e-6
+
+/* Domain of convolution. */
+enum gal_convolve_domains
+{
+  GAL_CONVOLVE_DOMAIN_INVALID,           /* ==0 by C standard. */
+
+  GAL_CONVOLVE_DOMAIN_SPATIAL,
+  GAL_CONVOLVE_DOMAIN_FREQUENCY,
+};
+
+
+/* For convolving many datasets with the same kernel (see
+   'gal_convolve_batch'). */
+typedef struct
+{
+  /* Arguments given (and later freed) by the caller. */
+  gal_data_t       *kernel;  /* Kernel (already flipped and normalized). */
+  size_t        numthreads;  /* Number of threads to use.                */
+  int       edgecorrection;  /* Correct the edges of the outputs.        */
+  int               domain;  /* 'GAL_CONVOLVE_DOMAIN_*' (0: automatic).  */
+  double            septol;  /* Separable terms tolerance (NaN: no).    */
+
+  /* Internal variables (allocated and freed internally). */
+  size_t              rank;  /* Number of separable terms of the kernel. */
+  double           *sepcol;  /* Weights of the kernel rows in each term. */
+  double           *seprow;  /* 1D kernel (fastest dim.) of each term.   */
+  void                *fft;  /* Frequency domain preparations.           */
+} gal_convolve_batch_t;
+
+
+
 gal_data_t *
 gal_convolve_spatial(gal_data_t *tiles, gal_data_t *kernel,
                      size_t numthreads, int edgecorrection, int convoverch);
 
+gal_data_t *
+gal_convolve_spatial_separable(gal_data_t *tiles, gal_data_t *kernel,
+                               size_t numthreads, int edgecorrection,
+                               int convoverch, double septol);
+
 
 void
 gal_convolve_spatial_correct_ch_edge(gal_data_t *tiles, gal_data_t *kernel,
                                      size_t numthreads, int edgecorrection,
                                      gal_data_t *tocorrect);
 
+gal_data_t *
+gal_convolve_frequency(gal_data_t *input, gal_data_t *kernel,
+                       size_t numthreads, int edgecorrection);
+
+int
+gal_convolve_domain_auto(gal_data_t *input, gal_data_t *kernel);
+
+gal_convolve_batch_t
+gal_convolve_batch_template();
+
+void
+gal_convolve_batch_init(gal_convolve_batch_t *cb);
+
+gal_data_t *
+gal_convolve_batch(gal_convolve_batch_t *cb, gal_data_t *inputs);
+
+void
+gal_convolve_batch_free(gal_convolve_batch_t *cb);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
@@ -340,11 +340,26 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                   gal_data_t *allcols, gal_list_sizet_t *indexll,
                   size_t numthreads, size_t minmapsize, int quietmmap);
 
+gal_data_t *
+gal_fits_tab_read_rows(char *filename, char *hdu, size_t rowstart,
+                       size_t numrows, gal_data_t *allcols,
+                       gal_list_sizet_t *indexll, size_t numthreads,
+                       size_t minmapsize, int quietmmap);
+
+gal_data_t *
+gal_fits_tab_read_rowids(char *filename, char *hdu, gal_data_t *rowids,
+                         gal_data_t *allcols, gal_list_sizet_t *indexll,
+                         size_t numthreads, size_t minmapsize,
+                         int quietmmap);
+
 void
 gal_fits_tab_write(gal_data_t *cols, gal_list_str_t *comments,
                    int tableformat, char *filename, char *extname,
                    struct gal_fits_list_key_t **keywords);
 
+void
+gal_fits_tab_write_append(gal_data_t *cols, char *filename, char *hdu);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
@@ -48,13 +48,84 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* Suffix of k-d tree index files (written by 'gal_kdtree_save'). */
+#define GAL_KDTREE_INDEX_SUFFIX "gkd"
+
+
+
+/* Distance metrics of the k-NN queries ('gal_kdtree_knn_metric'). */
+enum gal_kdtree_metric
+{
+ GAL_KDTREE_METRIC_INVALID,
+
+ GAL_KDTREE_METRIC_EUCLIDEAN,
+ GAL_KDTREE_METRIC_MANHATTAN,
+};
+
+
+
+/* A k-d tree with an implicit (breadth-first) layout: the children of
+   node 'i' are nodes '2i+1' and '2i+2' and the nodes of depth 'd' split
+   the space along dimension 'd % ndim'. The coordinates of each node are
+   beside each other in 'coords' (with 'ndim' values for each node). When
+   the tree is loaded from an index file, the two arrays are within the
+   (read-only) mapping of the file. */
+typedef struct
+{
+  size_t             ndim;  /* Number of dimensions.                    */
+  size_t             size;  /* Number of nodes (points in the tree).    */
+  gal_data_t      *coords;  /* Coordinates of the nodes ('size x ndim'). */
+  gal_data_t        *rows;  /* Row of each node in the input (size_t).  */
+  void               *map;  /* Mapping of the index file (or NULL).     */
+  size_t          mapsize;  /* Number of bytes in the mapping.          */
+} gal_kdtree_t;
+
+
+
+gal_kdtree_t *
+gal_kdtree_build(gal_data_t *coords_raw, size_t numthreads,
+                 size_t minmapsize, int quietmmap);
+
+void
+gal_kdtree_free(gal_kdtree_t *tree);
+
 gal_data_t *
 gal_kdtree_create(gal_data_t *coords_raw, size_t *root);
 
+gal_data_t *
+gal_kdtree_create_parallel(gal_data_t *coords_raw, size_t numthreads,
+                           size_t *root);
+
 size_t
 gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
                              size_t root, double *point, double *least_dist);
 
+size_t
+gal_kdtree_nearest(gal_kdtree_t *tree, double *point, double maxdist,
+                   double *dist);
+
+gal_data_t *
+gal_kdtree_knn(gal_kdtree_t *tree, gal_data_t *points, size_t k,
+               size_t numthreads, size_t minmapsize, int quietmmap);
+
+gal_data_t *
+gal_kdtree_knn_metric(gal_kdtree_t *tree, gal_data_t *points, size_t k,
+                      uint8_t metric, size_t numthreads, size_t minmapsize,
+                      int quietmmap);
+
+gal_data_t *
+gal_kdtree_radius(gal_kdtree_t *tree, gal_data_t *points, double radius,
+                  size_t numthreads, size_t minmapsize, int quietmmap);
+
+int
+gal_kdtree_name_is_index(char *name);
+
+void
+gal_kdtree_save(gal_kdtree_t *tree, char *filename);
+
+gal_kdtree_t *
+gal_kdtree_load(char *filename);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
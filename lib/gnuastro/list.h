@@ -49,6 +49,38 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/****************************************************************
+ *****************     Arena of list nodes   ********************
+ ****************************************************************/
+/* Default number of nodes in each block of an arena. */
+#define GAL_LIST_ARENA_BLOCKSIZE 1024
+
+typedef struct gal_list_arena_t
+{
+  size_t  nodesize;             /* Size of each node (in bytes).        */
+  size_t blocksize;             /* Number of nodes in each block.       */
+  size_t      used;             /* Nodes used in the newest block.      */
+  void    *current;             /* Newest block (first node's address). */
+  void   *freelist;             /* Nodes that were returned to arena.   */
+  void     *blocks;             /* Allocated blocks (newest first).     */
+} gal_list_arena_t;
+
+gal_list_arena_t *
+gal_list_arena_alloc(size_t nodesize, size_t blocksize);
+
+void *
+gal_list_arena_node(gal_list_arena_t *arena);
+
+void
+gal_list_arena_return(gal_list_arena_t *arena, void *node);
+
+void
+gal_list_arena_free(gal_list_arena_t *arena);
+
+
+
+
+
 /****************************************************************
  *****************          String           ********************
  ****************************************************************/
@@ -139,9 +171,16 @@ typedef struct gal_list_sizet_t
 void
 gal_list_sizet_add(gal_list_sizet_t **list, size_t value);
 
+void
+gal_list_sizet_add_arena(gal_list_sizet_t **list, size_t value,
+                         gal_list_arena_t *arena);
+
 size_t
 gal_list_sizet_pop(gal_list_sizet_t **list);
 
+size_t
+gal_list_sizet_pop_arena(gal_list_sizet_t **list, gal_list_arena_t *arena);
+
 size_t
 gal_list_sizet_number(gal_list_sizet_t *list);
 
@@ -254,9 +293,16 @@ typedef struct gal_list_void_t
 void
 gal_list_void_add(gal_list_void_t **list, void *value);
 
+void
+gal_list_void_add_arena(gal_list_void_t **list, void *value,
+                        gal_list_arena_t *arena);
+
 void *
 gal_list_void_pop(gal_list_void_t **list);
 
+void *
+gal_list_void_pop_arena(gal_list_void_t **list, gal_list_arena_t *arena);
+
 size_t
 gal_list_void_number(gal_list_void_t *list);
 
@@ -287,9 +333,17 @@ void
 gal_list_osizet_add(gal_list_osizet_t **list,
                     size_t value, float tosort);
 
+void
+gal_list_osizet_add_arena(gal_list_osizet_t **list, size_t value,
+                          float tosort, gal_list_arena_t *arena);
+
 size_t
 gal_list_osizet_pop(gal_list_osizet_t **list, float *sortvalue);
 
+size_t
+gal_list_osizet_pop_arena(gal_list_osizet_t **list, float *sortvalue,
+                          gal_list_arena_t *arena);
+
 void
 gal_list_osizet_to_sizet_free(gal_list_osizet_t *in,
                               gal_list_sizet_t **out);
@@ -313,10 +367,20 @@ void
 gal_list_dosizet_add(gal_list_dosizet_t **largest,
                      gal_list_dosizet_t **smallest, size_t value, float tosort);
 
+void
+gal_list_dosizet_add_arena(gal_list_dosizet_t **largest,
+                           gal_list_dosizet_t **smallest, size_t value,
+                           float tosort, gal_list_arena_t *arena);
+
 size_t
 gal_list_dosizet_pop_smallest(gal_list_dosizet_t **lartest,
                               gal_list_dosizet_t **smallest, float *tosort);
 
+size_t
+gal_list_dosizet_pop_smallest_arena(gal_list_dosizet_t **largest,
+                                    gal_list_dosizet_t **smallest,
+                                    float *tosort, gal_list_arena_t *arena);
+
 void
 gal_list_dosizet_print(gal_list_dosizet_t *largest,
                        gal_list_dosizet_t *smallest);
@@ -27,6 +27,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /* Include other headers if necessary here. Note that other header files
    must be included before the C++ preparations below */
 #include <gnuastro/data.h>
+#include <gnuastro/kdtree.h>
 
 
 /* C++ Preparations */
@@ -57,6 +58,12 @@ gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
                  double *aperture, size_t numthreads, size_t minmapsize,
                  int quietmmap, size_t *nummatched);
 
+gal_data_t *
+gal_match_kdtree_prebuilt(gal_kdtree_t *tree, gal_data_t *coord2,
+                          double *aperture, size_t numthreads,
+                          size_t minmapsize, int quietmmap,
+                          size_t *nummatched);
+
 
 
 
@@ -155,6 +155,18 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
                size_t numthreads, size_t minmapsize, int quietmmap,
                size_t *colmatch);
 
+gal_data_t *
+gal_table_read_rows(char *filename, char *hdu, gal_list_str_t *cols,
+                    size_t rowstart, size_t numrows, int searchin,
+                    int ignorecase, size_t numthreads, size_t minmapsize,
+                    int quietmmap, size_t *colmatch);
+
+gal_data_t *
+gal_table_read_rowids(char *filename, char *hdu, gal_list_str_t *cols,
+                      gal_data_t *rowids, int searchin, int ignorecase,
+                      size_t numthreads, size_t minmapsize, int quietmmap,
+                      size_t *colmatch);
+
 gal_list_sizet_t *
 gal_table_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
                          size_t numcols, int searchin, int ignorecase,
@@ -162,6 +174,15 @@ gal_table_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
 
 
 
+/************************************************************************/
+/***************               Table cache                ***************/
+/************************************************************************/
+void
+gal_table_cache_write(char *filename, char *hdu, size_t numthreads,
+                      size_t minmapsize, int quietmmap);
+
+
+
 /************************************************************************/
 /***************              Write a table               ***************/
 /************************************************************************/
@@ -174,6 +195,16 @@ gal_table_write(gal_data_t *cols, struct gal_fits_list_key_t **keylist,
                 gal_list_str_t *comments, int tableformat, char *filename,
                 char *extname, uint8_t colinfoinstdout);
 
+void
+gal_table_write_parallel(gal_data_t *cols,
+                         struct gal_fits_list_key_t **keylist,
+                         gal_list_str_t *comments, int tableformat,
+                         char *filename, char *extname,
+                         uint8_t colinfoinstdout, size_t numthreads);
+
+void
+gal_table_write_append(gal_data_t *cols, char *filename);
+
 void
 gal_table_write_log(gal_data_t *logll, char *program_string,
                     time_t *rawtime, gal_list_str_t *comments,
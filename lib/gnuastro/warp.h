@@ -58,6 +58,29 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* Kernels to find the output pixel values from the input. The default
+   (area) is the flux-conserving pixel mixing; the rest are interpolation
+   kernels at the center of each output pixel (much faster, but not
+   conserving flux). */
+enum gal_warp_kernels
+{
+  GAL_WARP_KERNEL_AREA,         /* Pixel mixing (=0 by C standard).      */
+  GAL_WARP_KERNEL_NEAREST,      /* Nearest neighbor.                     */
+  GAL_WARP_KERNEL_BILINEAR,     /* Bi-linear interpolation.              */
+  GAL_WARP_KERNEL_BICUBIC,      /* Bi-cubic (Keys, a=-0.5) convolution.  */
+  GAL_WARP_KERNEL_LANCZOS3,     /* Lanczos kernel with a=3.              */
+};
+
+
+
+
+/* Maximum difference (in input pixels) of the same positions through
+   the WCS of a new input and the WCS of the input that a plan was built
+   with, for the plan to be usable on the new input. */
+#define GAL_WARP_PLAN_TOLERANCE 1e-6
+
+
+
 /* Main input/output structure. */
 typedef struct
 {
@@ -73,6 +96,8 @@ typedef struct
   gal_data_t       *cdelt;  /* WCS-Build: Pixel scale of the output.     */
   gal_data_t      *center;  /* WCS-Build: Center of output in RA and Dec.*/
   uint8_t    checkmaxfrac;  /* Check: Write max fraction per pixel.      */
+  double     maxinterperr;  /* Max. error of interpolated vertices.      */
+  uint8_t          kernel;  /* Kernel to use ('GAL_WARP_KERNEL_*').     */
 
   /* Output (must be freed by caller) */
   gal_data_t      *output;  /* Pointer to output data structure.         */
@@ -84,12 +109,38 @@ typedef struct
   size_t             gcrn;  /* Gap between corners of each row.          */
   int               isccw;  /* Rotation orientation of pixel edges.      */
   gal_data_t    *vertices;  /* Stores all vertice coords of output img.  */
+  gal_data_t     *centers;  /* Output pixel centers over input (kernel).*/
 } gal_warp_wcsalign_t;
 
 
 
 
 
+/* A reusable alignment: the weights of the input pixels in each output
+   pixel, as a sparse matrix in the compressed-rows format (row 'i' is
+   output pixel 'i'; its elements are from 'rowptr[i]' to 'rowptr[i+1]'
+   in 'colind' and 'weight'). */
+typedef struct
+{
+  uint8_t          kernel;  /* Kernel that the plan was built with.      */
+  size_t       numthreads;  /* Number of threads to use.                 */
+  double      coveredfrac;  /* Acceptable fraction of output covered.    */
+  size_t        insize[2];  /* Size of the inputs (C order).             */
+  size_t       outsize[2];  /* Size of the output (C order).             */
+  struct wcsprm     *iwcs;  /* WCS of the input that built the plan.     */
+  struct wcsprm     *owcs;  /* WCS of the output.                        */
+  size_t            nelem;  /* Number of elements in the sparse matrix.  */
+  size_t          *rowptr;  /* First element of each output pixel.       */
+  size_t          *colind;  /* Input pixel (index) of each element.      */
+  double          *weight;  /* Weight of each element.                   */
+  double           *total;  /* Total weight (all pixels) of each output. */
+  double           *scale;  /* Output pixel area (interpolation kernels).*/
+} gal_warp_plan_t;
+
+
+
+
+
 /* Return an empty set of the wcsalign data structure. */
 gal_warp_wcsalign_t
 gal_warp_wcsalign_template();
@@ -127,6 +178,32 @@ void
 gal_warp_pixelarea(gal_warp_wcsalign_t *wa);
 
 
+/* Build a reusable plan (and align 'wa->input'). */
+gal_warp_plan_t *
+gal_warp_plan_make(gal_warp_wcsalign_t *wa);
+
+
+/* Check if a plan can be used for a new input. */
+int
+gal_warp_plan_usable(gal_warp_plan_t *plan, gal_data_t *input);
+
+
+/* Align an input using the plan into an allocated output. */
+void
+gal_warp_plan_apply_to(gal_warp_plan_t *plan, gal_data_t *input,
+                       gal_data_t *output);
+
+
+/* Align an input using the plan and return the output. */
+gal_data_t *
+gal_warp_plan_apply(gal_warp_plan_t *plan, gal_data_t *input);
+
+
+/* Free the plan. */
+void
+gal_warp_plan_free(gal_warp_plan_t *plan);
+
+
 __END_C_DECLS    /* From C++ preparations */
 
 #endif           /* __GAL_WARP_H__ */
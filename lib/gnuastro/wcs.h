@@ -224,6 +224,14 @@ gal_wcs_world_to_img(gal_data_t *coords, struct wcsprm *wcs, int inplace);
 gal_data_t *
 gal_wcs_img_to_world(gal_data_t *coords, struct wcsprm *wcs, int inplace);
 
+gal_data_t *
+gal_wcs_world_to_img_parallel(gal_data_t *coords, struct wcsprm *wcs,
+                              int inplace, size_t numthreads);
+
+gal_data_t *
+gal_wcs_img_to_world_parallel(gal_data_t *coords, struct wcsprm *wcs,
+                              int inplace, size_t numthreads);
+
 
 
 
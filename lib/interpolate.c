@@ -31,6 +31,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/list.h>
 #include <gnuastro/fits.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/threads.h>
 #include <gnuastro/dimension.h>
@@ -47,10 +48,48 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /********************      Nearest neighbor       ********************/
 /***************         (Dimension agnostic)         ****************/
 /*********************************************************************/
-/* These are bit-flags, so we're using hexadecimal notation. */
-#define INTERPOLATE_FLAGS_NO          0
-#define INTERPOLATE_FLAGS_NGB_CHECKED 0x1
-#define INTERPOLATE_FLAGS_BLANK       0x2
+/* The nearest neighbors of each element are first found by checking the
+   elements around it in order of their distance (expanding from it),
+   until 'numneighbors' non-blank elements are found. Every element is
+   only added to the queue from one of its neighbors (that is nearer), so
+   no flags are necessary and the elements are checked in the exact order
+   of their distance (and index, when the distances are equal).
+
+   Over large blank regions, the number of elements that are checked
+   grows with the area of the region. So when more than
+   'INTERPOLATE_NGB_EXPAND_MAX' elements (or 16 times the number of
+   neighbors, if it is larger) have to be checked, the element is set
+   aside. Only if any element is set aside, a k-d tree (see 'kdtree.h')
+   is built over the non-blank elements (of that channel) and the
+   neighbors of the set-aside elements are found from it (with the same
+   ordering). When the blank elements are sparse, no tree is built.
+
+   The distances are integers (squared for the radial metric), so they
+   are compared exactly. */
+#define INTERPOLATE_NGB_EXPAND_MAX 1024
+
+
+
+
+
+/* An element in the queue of the expanding search. */
+struct interpolate_ngb_elem
+{
+  size_t                     dist;  /* Distance to the first element.   */
+  size_t                      ind;  /* Index of element in its channel. */
+};
+
+
+
+
+
+/* Queue (min-heap) of the expanding search on each thread. */
+struct interpolate_ngb_queue
+{
+  struct interpolate_ngb_elem *e;  /* Elements in the heap.             */
+  size_t                       n;  /* Number of elements in the heap.   */
+  size_t                  nalloc;  /* Allocated number of elements.     */
+};
 
 
 
@@ -65,10 +104,16 @@ struct interpolate_ngb_params
   gal_data_t                      *out;
   gal_data_t                   *blanks;
   size_t                  numneighbors;
-  uint8_t                *thread_flags;
   int                        onlyblank;
   gal_list_void_t            *ngb_vals;
-  float (*metric)(size_t *, size_t *, size_t );
+  uint8_t                       metric;
+  size_t                        chsize;  /* Number of elements in channel.*/
+  size_t                      *chdsize;  /* Size of channel along dims.  */
+  size_t                        budget;  /* Max. elements in expansion.  */
+  gal_data_t                     *deep;  /* Flag of set-aside elements.  */
+  size_t                     *deeplist;  /* Index of set-aside elements. */
+  size_t                      *knnrows;  /* Tree row of their neighbors. */
+  size_t                     *treeinds;  /* Index of each tree row.      */
 
   struct gal_tile_two_layer_params *tl;
 };
@@ -77,7 +122,233 @@ struct interpolate_ngb_params
 
 
 
-/* Run the interpolation on many threads. */
+/* Distance between two points (squared for the radial metric). */
+static size_t
+interpolate_ngb_distance(size_t *a, size_t *b, size_t ndim, uint8_t metric)
+{
+  size_t i, d, out=0;
+  for(i=0;i<ndim;++i)
+    {
+      d = a[i]>b[i] ? a[i]-b[i] : b[i]-a[i];
+      out += metric==GAL_INTERPOLATE_NEIGHBORS_METRIC_RADIAL ? d*d : d;
+    }
+  return out;
+}
+
+
+
+
+
+/* Return 1 if element 'a' is nearer than element 'b'. */
+static int
+interpolate_ngb_nearer(struct interpolate_ngb_elem *a,
+                       struct interpolate_ngb_elem *b)
+{
+  return a->dist<b->dist || (a->dist==b->dist && a->ind<b->ind);
+}
+
+
+
+
+
+/* Add an element to the queue. */
+static void
+interpolate_ngb_push(struct interpolate_ngb_queue *q, size_t dist,
+                     size_t ind)
+{
+  size_t i, p;
+  struct interpolate_ngb_elem t;
+
+  /* Allocate more space if necessary. */
+  if(q->n==q->nalloc)
+    {
+      q->nalloc = q->nalloc ? 2*q->nalloc : 64;
+      errno=0;
+      q->e=realloc(q->e, q->nalloc*sizeof *q->e);
+      if(q->e==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+              "'q->e'", __func__, q->nalloc*sizeof *q->e);
+    }
+
+  /* Add the element to the end of the heap and move it up. */
+  i=q->n++;
+  q->e[i].dist=dist;
+  q->e[i].ind=ind;
+  while(i)
+    {
+      p=(i-1)/2;
+      if( !interpolate_ngb_nearer(&q->e[i], &q->e[p]) ) break;
+      t=q->e[i]; q->e[i]=q->e[p]; q->e[p]=t;
+      i=p;
+    }
+}
+
+
+
+
+
+/* Remove the nearest element from the queue and return it. */
+static struct interpolate_ngb_elem
+interpolate_ngb_pop(struct interpolate_ngb_queue *q)
+{
+  size_t c, i=0;
+  struct interpolate_ngb_elem t, out=q->e[0];
+
+  /* Put the last element on top of the heap and move it down. */
+  q->e[0]=q->e[--q->n];
+  while( (c=2*i+1)<q->n )
+    {
+      if( c+1<q->n && interpolate_ngb_nearer(&q->e[c+1], &q->e[c]) ) ++c;
+      if( !interpolate_ngb_nearer(&q->e[c], &q->e[i]) ) break;
+      t=q->e[i]; q->e[i]=q->e[c]; q->e[c]=t;
+      i=c;
+    }
+  return out;
+}
+
+
+
+
+
+/* Find the nearest non-blank elements to element 'index' of a channel
+   ('blanks' points to the blank flags of the channel) and write their
+   indexs in 'ngb' (nearest first). 'icoord' and 'pcoord' have space for
+   the coordinates of an element and 'dinc' is the increment along each
+   dimension of the channel. If more than 'prm->budget' elements have to
+   be checked, 0 is returned. */
+static int
+interpolate_ngb_expand(struct interpolate_ngb_params *prm,
+                       struct interpolate_ngb_queue *q, uint8_t *blanks,
+                       size_t index, size_t *icoord, size_t *pcoord,
+                       size_t *dinc, size_t *ngb)
+{
+  struct interpolate_ngb_elem e;
+  size_t a, c, dist, checked=0, found=0;
+  size_t ndim=prm->input->ndim, *dsize=prm->chdsize;
+
+  /* Start from the element itself. */
+  q->n=0;
+  interpolate_ngb_push(q, 0, index);
+  gal_dimension_index_to_coord(index, ndim, dsize, icoord);
+
+  /* Check the elements in order of their distance. */
+  while(q->n)
+    {
+      /* The nearest element that hasn't been checked yet. */
+      if(checked++==prm->budget) return 0;
+      e=interpolate_ngb_pop(q);
+      if(blanks[e.ind]==0)
+        {
+          ngb[found]=e.ind;
+          if(++found==prm->numneighbors) return 1;
+        }
+
+      /* Add the neighbors that are one step farther from 'index'. Along
+         the dimensions where this element has the same coordinate as
+         'index', both sides are farther. Along the first dimension where
+         they differ, only the outer side is farther and the neighbors
+         along the later dimensions are added from another element (that
+         is one step nearer along this dimension). */
+      gal_dimension_index_to_coord(e.ind, ndim, dsize, pcoord);
+      for(a=0;a<ndim;++a)
+        {
+          c=pcoord[a];
+          if(c>=icoord[a] && c+1<dsize[a])
+            {
+              pcoord[a]=c+1;
+              dist=interpolate_ngb_distance(icoord, pcoord, ndim,
+                                            prm->metric);
+              interpolate_ngb_push(q, dist, e.ind+dinc[a]);
+            }
+          if(c<=icoord[a] && c>0)
+            {
+              pcoord[a]=c-1;
+              dist=interpolate_ngb_distance(icoord, pcoord, ndim,
+                                            prm->metric);
+              interpolate_ngb_push(q, dist, e.ind-dinc[a]);
+            }
+          pcoord[a]=c;
+          if(c!=icoord[a]) break;
+        }
+    }
+
+  /* There weren't enough non-blank elements (this is checked before the
+     threads are spun off, so it shouldn't happen). */
+  return 0;
+}
+
+
+
+
+
+/* Copy the values of the neighbors (with indexs 'ngb' in the channel
+   that starts at 'chstart') into 'nearest' and write the desired
+   statistic of them into element 'fullind' of the output(s). */
+static void
+interpolate_ngb_write(struct interpolate_ngb_params *prm,
+                      gal_data_t *nearest, size_t *ngb, size_t chstart,
+                      size_t fullind)
+{
+  size_t j;
+  gal_data_t *tin, *tout, *tnear, *value=NULL;
+
+  /* Copy the values of the neighbors. */
+  tin=prm->input;
+  for(tnear=nearest; tnear!=NULL; tnear=tnear->next)
+    {
+      for(j=0;j<prm->numneighbors;++j)
+        memcpy(gal_pointer_increment(tnear->array, j, tin->type),
+               gal_pointer_increment(tin->array, chstart+ngb[j],
+                                     tin->type),
+               gal_type_sizeof(tin->type));
+      tin=tin->next;
+    }
+
+  /* Calculate the desired statistic, and write it in the output. */
+  tout=prm->out;
+  for(tnear=nearest; tnear!=NULL; tnear=tnear->next)
+    {
+      /* Find the desired statistic and copy it, but first, reset the
+         flags (which remain from the last time). */
+      tnear->flag &= ~(GAL_DATA_FLAG_SORT_CH | GAL_DATA_FLAG_BLANK_CH);
+      switch(prm->function)
+        {
+        case GAL_INTERPOLATE_NEIGHBORS_FUNC_MIN:
+          value=gal_statistics_minimum(tnear); break;
+          break;
+        case GAL_INTERPOLATE_NEIGHBORS_FUNC_MAX:
+          value=gal_statistics_maximum(tnear); break;
+          break;
+        case GAL_INTERPOLATE_NEIGHBORS_FUNC_MEAN:
+          value=gal_statistics_mean(tnear); /* Out can be a diff. type */
+          value=gal_data_copy_to_new_type_free(value, tnear->type);
+          break;
+        case GAL_INTERPOLATE_NEIGHBORS_FUNC_MEDIAN:
+          value=gal_statistics_median(tnear, 1); break;
+        default:
+          error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
+                "to fix the problem. The value %d is not a recognized "
+                "interpolation function identifier", __func__,
+                PACKAGE_BUGREPORT, prm->function);
+        }
+      memcpy(gal_pointer_increment(tout->array, fullind, tout->type),
+             value->array, gal_type_sizeof(tout->type));
+
+      /* Clean up and go to next array. */
+      gal_data_free(value);
+      tout=tout->next;
+    }
+}
+
+
+
+
+
+/* Run the interpolation on many threads. Without a list of set-aside
+   elements ('prm->deeplist'), the neighbors are found with the expanding
+   search and the elements that need a larger search are flagged in
+   'prm->deep'. Otherwise, the neighbors of the set-aside elements have
+   already been found with the k-d tree. */
 static void *
 interpolate_neighbors_on_thread(void *in_prm)
 {
@@ -87,41 +358,23 @@ interpolate_neighbors_on_thread(void *in_prm)
     (struct interpolate_ngb_params *)(tprm->params);
 
   /* Higher-level variables. */
-  struct gal_tile_two_layer_params *tl=prm->tl;
-  int correct_index=(tl && tl->totchannels>1 && !tl->workoverch);
   gal_data_t *input=prm->input;
+  size_t ndim=input->ndim, k=prm->numneighbors;
 
   /* Rest of variables. */
   void *nv;
-  float dist, pdist;
-  uint8_t *b, *bf, *bb;
   gal_list_void_t *tvll;
-  size_t ngb_counter, pind;
-  gal_list_dosizet_t *lQ, *sQ;
-  size_t i, index, fullind, chstart=0, ndim=input->ndim;
-  gal_data_t *tin, *tout, *tnear, *value=NULL, *nearest=NULL;
-  size_t size = (correct_index ? tl->tottilesinch : input->size);
-  size_t *dsize = (correct_index ? tl->numtilesinch : input->dsize);
-  size_t *icoord=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
-                                      "icoord");
-  size_t *ncoord=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
-                                      "ncoord");
-  uint8_t *flag, *fullflag=&prm->thread_flags[tprm->id*input->size];
-
-  /* Based on the above. */
-  size_t *dinc=gal_dimension_increment(ndim, dsize);
-
-
-  /* Initialize the flags array. We need two flags during this processing:
-     1) to see if there are blanks. 2) to see if a neighbor has been
-     checked. These are both binary (0 or 1). So to avoid wasting space, we
-     will use bits to store them. We start with only setting the blank flag
-     once for the whole thread. Then for each interpolated pixel, we reset
-     the neighbor-check flag. */
-  flag=fullflag;
-  bb=prm->blanks->array;
-  bf=(b=fullflag)+input->size;
-  do *b = *bb++ ? INTERPOLATE_FLAGS_BLANK : 0; while(++b<bf);
+  gal_data_t *tin, *tout, *nearest=NULL;
+  struct interpolate_ngb_queue q={NULL, 0, 0};
+  uint8_t *blanks=prm->blanks->array, *deep=prm->deep->array;
+  size_t i, j, index, fullind, chstart, *ws, *icoord, *pcoord, *ngb;
+  size_t *dinc=gal_dimension_increment(ndim, prm->chdsize);
+
+  /* Work space for the coordinates and the neighbors. */
+  ws=gal_pointer_allocate(GAL_TYPE_SIZE_T, 2*ndim+k, 0, __func__, "ws");
+  icoord=ws;
+  pcoord=ws+ndim;
+  ngb=ws+2*ndim;
 
 
   /* Put the allocated space to keep the neighbor values into a structure
@@ -143,14 +396,16 @@ interpolate_neighbors_on_thread(void *in_prm)
   for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
     {
       /* For easy reading. */
-      fullind=tprm->indexs[i];
+      fullind = ( prm->deeplist
+                  ? prm->deeplist[ tprm->indexs[i] ]
+                  : tprm->indexs[i] );
 
 
       /* If the caller only wanted to interpolate over blank values and
          this value is not blank (we know from the flags), then just set
          the output value at this element to the input value and go to the
          next element. */
-      if(prm->onlyblank && !(fullflag[fullind] & INTERPOLATE_FLAGS_BLANK) )
+      if(prm->onlyblank && blanks[fullind]==0 )
         {
           tin=input;
           for(tout=prm->out; tout!=NULL; tout=tout->next)
@@ -164,159 +419,134 @@ interpolate_neighbors_on_thread(void *in_prm)
         }
 
 
-      /* Correct the index (if necessary). When the values come from a
-         tiled dataset, the caller might want to interpolate the values of
-         each channel separately (not mix values from different
-         channels). In such a case, the tiles of each channel (and their
-         values in 'input' are contiguous. So we need to correct
-         'tprm->indexs[i]' (which is the index over the whole tessellation,
-         including all channels). */
-      if(correct_index)
-        {
-          /* Index of this tile in its channel. */
-          index = fullind % tl->tottilesinch;
+      /* When the values come from a tiled dataset, the caller might want
+         to interpolate the values of each channel separately (not mix
+         values from different channels). In such a case, the tiles of
+         each channel (and their values in 'input') are contiguous. So the
+         index of this element in its channel is found from 'fullind'
+         (which is the index over the whole tessellation, including all
+         channels). Without separate channels, 'prm->chsize' is the size
+         of the whole input. */
+      chstart = (fullind / prm->chsize) * prm->chsize;
+      index = fullind - chstart;
 
-          /* Index of the first tile in this channel. */
-          chstart = (fullind / tl->tottilesinch) * tl->tottilesinch;
 
-          /* Set the channel's starting pointer for the flags. */
-          flag = gal_pointer_increment(fullflag, chstart, GAL_TYPE_UINT8);
-        }
-      else
-        {
-          chstart=0;
-          index=fullind;
-        }
+      /* Find the neighbors of this element. */
+      if(prm->deeplist)
+        for(j=0;j<k;++j)
+          ngb[j]=prm->treeinds[ prm->knnrows[ tprm->indexs[i]*k+j ] ];
+      else if( !interpolate_ngb_expand(prm, &q, blanks+chstart, index,
+                                       icoord, pcoord, dinc, ngb) )
+        { deep[fullind]=1; continue; }
 
 
-      /* Reset all checked bits in the flags array to 0. */
-      ngb_counter=0;
-      bf=(b=flag)+size;
-      do *b &= ~(INTERPOLATE_FLAGS_NGB_CHECKED); while(++b<bf);
+      /* Write the desired statistic of the neighbors into the output. */
+      interpolate_ngb_write(prm, nearest, ngb, chstart, fullind);
+    }
 
 
-      /* Get the coordinates of this pixel (to be interpolated). */
-      gal_dimension_index_to_coord(index, ndim, dsize, icoord);
+  /* Clean up. */
+  for(tin=nearest; tin!=NULL; tin=tin->next) tin->array=NULL;
+  gal_list_data_free(nearest);
+  free(dinc);
+  free(q.e);
+  free(ws);
 
 
-      /* Start parsing the neighbors. We will use a two-way ordered linked
-         list structure. To start from the nearest and go out to the
-         farthest. */
-      lQ=sQ=NULL;
-      gal_list_dosizet_add(&lQ, &sQ, index, 0.0f);
-      while(sQ)
-        {
-          /* Pop-out (p) an index from the queue: */
-          pind=gal_list_dosizet_pop_smallest(&lQ, &sQ, &pdist);
+  /* Wait for all the other threads to finish and return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
 
-          /* If this isn't a blank value then add its values to the list of
-             neighbor values. Note that we didn't check whether the values
-             were blank or not when adding this pixel to the queue. */
-          if( !(flag[pind] & INTERPOLATE_FLAGS_BLANK) )
-            {
-              tin=input;
-              for(tnear=nearest; tnear!=NULL; tnear=tnear->next)
-                {
-                  memcpy(gal_pointer_increment(tnear->array, ngb_counter,
-                                               tin->type),
-                         gal_pointer_increment(tin->array, chstart+pind,
-                                               tin->type),
-                         gal_type_sizeof(tin->type));
-                  tin=tin->next;
-                }
-
-              /* If we have filled all the elements clean up the linked
-                 list and break out. */
-              if(++ngb_counter>=prm->numneighbors)
-                {
-                  if(lQ) gal_list_dosizet_free(lQ);
-                  break;
-                }
-            }
 
-          /* Go over all the neighbors of this popped pixel and add them to
-             the list of neighbors to be checked. */
-          GAL_DIMENSION_NEIGHBOR_OP(pind, ndim, dsize, 1, dinc,
-           {
-             /* Only look at neighbors that have not been checked. VERY
-                IMPORTANT: we must not check for blank values here,
-                otherwise we won't be able to parse over extended blank
-                regions. */
-             if( !(flag[nind] & INTERPOLATE_FLAGS_NGB_CHECKED) )
-               {
-                 /* Get the coordinates of this neighbor. */
-                 gal_dimension_index_to_coord(nind, ndim, dsize, ncoord);
-
-                 /* Distance of this neighbor to the one to be filled. */
-                 dist=prm->metric(icoord, ncoord, ndim);
-
-                 /* Add this neighbor to the list. */
-                 gal_list_dosizet_add(&lQ, &sQ, nind, dist);
-
-                 /* Flag this neighbor as checked. */
-                 flag[nind] |= INTERPOLATE_FLAGS_NGB_CHECKED;
-               }
-           } );
-
-          /* If there are no more meshes to add to the queue, then this
-             shows, there were not enough points for
-             interpolation. Normally, this loop should only be exited
-             through the 'currentnum>=numnearest' check above. */
-          if(sQ==NULL)
-            error(EXIT_FAILURE, 0, "%s: only %zu neighbors found while "
-                  "you had asked to use %zu neighbors for close neighbor "
-                  "interpolation", __func__, ngb_counter,
-                  prm->numneighbors);
-        }
 
-      /* Calculate the desired statistic, and write it in the output. */
-      tout=prm->out;
-      for(tnear=nearest; tnear!=NULL; tnear=tnear->next)
-        {
-          /* Find the desired statistic and copy it, but first, reset the
-             flags (which remain from the last time). */
-          tnear->flag &= ~(GAL_DATA_FLAG_SORT_CH | GAL_DATA_FLAG_BLANK_CH);
-          switch(prm->function)
-            {
-            case GAL_INTERPOLATE_NEIGHBORS_FUNC_MIN:
-              value=gal_statistics_minimum(tnear); break;
-              break;
-            case GAL_INTERPOLATE_NEIGHBORS_FUNC_MAX:
-              value=gal_statistics_maximum(tnear); break;
-              break;
-            case GAL_INTERPOLATE_NEIGHBORS_FUNC_MEAN:
-              value=gal_statistics_mean(tnear); /* Out can be a diff. type */
-              value=gal_data_copy_to_new_type_free(value, tnear->type);
-              break;
-            case GAL_INTERPOLATE_NEIGHBORS_FUNC_MEDIAN:
-              value=gal_statistics_median(tnear, 1); break;
-            default:
-              error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
-                    "to fix the problem. The value %d is not a recognized "
-                    "interpolation function identifier", __func__,
-                    PACKAGE_BUGREPORT, prm->function);
-            }
-          memcpy(gal_pointer_increment(tout->array, fullind, tout->type),
-                 value->array, gal_type_sizeof(tout->type));
 
-          /* Clean up and go to next array. */
-          gal_data_free(value);
-          tout=tout->next;
-        }
+
+/* Find the neighbors of the elements of channel 'ch' that were set aside
+   in the expanding search (within large blank regions) with a k-d tree of
+   the non-blank elements of the channel, and interpolate them. */
+static void
+interpolate_ngb_deep(struct interpolate_ngb_params *prm, size_t ch,
+                     size_t numthreads)
+{
+  gal_kdtree_t *tree;
+  gal_data_t *tmp, *knn, *inds, *deeplist;
+  gal_data_t *coords=NULL, *points=NULL;
+  size_t i, d, n, nd, chstart=ch*prm->chsize, ndim=prm->input->ndim;
+  uint8_t *deep=(uint8_t *)(prm->deep->array)+chstart;
+  uint8_t *blanks=(uint8_t *)(prm->blanks->array)+chstart;
+  size_t minmapsize=prm->input->minmapsize, *c, *iarr, *darr;
+  int quietmmap=prm->input->quietmmap;
+
+  /* Count the set-aside and the non-blank elements of this channel. */
+  for(n=nd=i=0;i<prm->chsize;++i) { nd+=deep[i]; n+=(blanks[i]==0); }
+  if(nd==0) return;
+
+  /* Allocate the coordinates of the non-blank elements (for the tree) and
+     of the set-aside elements (for the queries). */
+  for(d=0;d<ndim;++d)
+    {
+      gal_list_data_add_alloc(&coords, NULL, GAL_TYPE_FLOAT64, 1, &n,
+                              NULL, 0, minmapsize, quietmmap, NULL, NULL,
+                              NULL);
+      gal_list_data_add_alloc(&points, NULL, GAL_TYPE_FLOAT64, 1, &nd,
+                              NULL, 0, minmapsize, quietmmap, NULL, NULL,
+                              NULL);
     }
+  inds=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &n, NULL, 0, minmapsize,
+                      quietmmap, NULL, NULL, NULL);
+  deeplist=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &nd, NULL, 0,
+                          minmapsize, quietmmap, NULL, NULL, NULL);
+  c=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__, "c");
+
+  /* Fill in the coordinates. The non-blank elements are put in the tree
+     in order of their index, so for equal distances, the neighbor with
+     the smaller index is nearer (like the expanding search). */
+  iarr=inds->array;
+  darr=deeplist->array;
+  for(n=nd=i=0;i<prm->chsize;++i)
+    if(blanks[i]==0 || deep[i])
+      {
+        gal_dimension_index_to_coord(i, ndim, prm->chdsize, c);
+        if(blanks[i]==0)
+          {
+            for(d=0, tmp=coords; tmp!=NULL; ++d, tmp=tmp->next)
+              ((double *)(tmp->array))[n]=c[d];
+            iarr[n++]=i;
+          }
+        if(deep[i])
+          {
+            for(d=0, tmp=points; tmp!=NULL; ++d, tmp=tmp->next)
+              ((double *)(tmp->array))[nd]=c[d];
+            darr[nd++]=chstart+i;
+          }
+      }
 
+  /* Build the tree and find the neighbors. */
+  tree=gal_kdtree_build(coords, numthreads, minmapsize, quietmmap);
+  knn=gal_kdtree_knn_metric(tree, points, prm->numneighbors,
+                            ( prm->metric
+                              ==GAL_INTERPOLATE_NEIGHBORS_METRIC_RADIAL
+                              ? GAL_KDTREE_METRIC_EUCLIDEAN
+                              : GAL_KDTREE_METRIC_MANHATTAN ),
+                            numthreads, minmapsize, quietmmap);
+  gal_list_data_free(coords);
+  gal_list_data_free(points);
+  gal_kdtree_free(tree);
+
+  /* Interpolate the set-aside elements. */
+  prm->deeplist=darr;
+  prm->treeinds=iarr;
+  prm->knnrows=knn->array;
+  gal_threads_spin_off(interpolate_neighbors_on_thread, prm, nd,
+                       numthreads, minmapsize, quietmmap);
+  prm->deeplist=prm->treeinds=prm->knnrows=NULL;
 
   /* Clean up. */
-  for(tnear=nearest; tnear!=NULL; tnear=tnear->next) tnear->array=NULL;
-  gal_list_data_free(nearest);
-  free(icoord);
-  free(ncoord);
-  free(dinc);
-
-
-  /* Wait for all the other threads to finish and return. */
-  if(tprm->b) pthread_barrier_wait(tprm->b);
-  return NULL;
+  free(c);
+  gal_data_free(inds);
+  gal_data_free(deeplist);
+  gal_list_data_free(knn);
 }
 
 
@@ -367,9 +597,10 @@ gal_interpolate_neighbors(gal_data_t *input,
                           size_t numthreads, int onlyblank,
                           int aslinkedlist, int function)
 {
+  uint8_t *blanks;
   gal_data_t *tin, *tout;
   struct interpolate_ngb_params prm;
-  size_t ngbvnum=numthreads*numneighbors;
+  size_t i, n, nb, ch, numchannels, ngbvnum=numthreads*numneighbors;
   int permute=(tl && tl->totchannels>1 && tl->workoverch);
 
 
@@ -388,17 +619,20 @@ gal_interpolate_neighbors(gal_data_t *input,
   prm.function     = function;
   prm.onlyblank    = onlyblank;
   prm.numneighbors = numneighbors;
+  prm.deeplist     = NULL;
+  prm.knnrows      = NULL;
+  prm.treeinds     = NULL;
   prm.num          = aslinkedlist ? gal_list_data_number(input) : 1;
+  prm.budget       = ( 16*numneighbors > INTERPOLATE_NGB_EXPAND_MAX
+                       ? 16*numneighbors : INTERPOLATE_NGB_EXPAND_MAX );
 
 
-  /* Set the metric. */
+  /* Check the metric. */
   switch(metric)
     {
     case GAL_INTERPOLATE_NEIGHBORS_METRIC_RADIAL:
-      prm.metric=gal_dimension_dist_radial;
-      break;
     case GAL_INTERPOLATE_NEIGHBORS_METRIC_MANHATTAN:
-      prm.metric=gal_dimension_dist_manhattan;
+      prm.metric=metric;
       break;
     default:
       error(EXIT_FAILURE, 0, "%s: %d is not a valid metric identifier",
@@ -464,17 +698,45 @@ gal_interpolate_neighbors(gal_data_t *input,
   gal_list_void_reverse(&prm.ngb_vals);
 
 
-  /* Allocate space for all the flag values of all the threads here (memory
-     in each thread is limited) and this is cleaner. */
-  prm.thread_flags=gal_pointer_allocate(GAL_TYPE_UINT8,
-                                        numthreads*input->size, 0, __func__,
-                                        "prm.thread_flags");
+  /* The channels that should be interpolated independently. */
+  if(tl && tl->totchannels>1 && !tl->workoverch)
+    {
+      prm.chsize=tl->tottilesinch;
+      prm.chdsize=tl->numtilesinch;
+      numchannels=tl->totchannels;
+    }
+  else
+    {
+      prm.chsize=input->size;
+      prm.chdsize=input->dsize;
+      numchannels=1;
+    }
+
+
+  /* If there aren't enough non-blank elements in a channel (that has
+     elements to interpolate), then we can't interpolate. */
+  blanks=prm.blanks->array;
+  for(ch=0;ch<numchannels;++ch)
+    {
+      for(n=nb=0, i=ch*prm.chsize; i<(ch+1)*prm.chsize; ++i)
+        if(blanks[i]) ++nb; else ++n;
+      if( n<numneighbors && (nb || !onlyblank) )
+        error(EXIT_FAILURE, 0, "%s: only %zu neighbors found while "
+              "you had asked to use %zu neighbors for close neighbor "
+              "interpolation", __func__, n, numneighbors);
+    }
 
 
-  /* Spin-off the threads. */
+  /* Interpolate the elements with the expanding search on the threads,
+     then use a k-d tree for those that were set aside. */
+  prm.deep=gal_data_alloc(NULL, GAL_TYPE_UINT8, 1, &input->size, NULL, 1,
+                          input->minmapsize, input->quietmmap, NULL, NULL,
+                          NULL);
   gal_threads_spin_off(interpolate_neighbors_on_thread, &prm,
                        input->size, numthreads, input->minmapsize,
                        input->quietmmap);
+  for(ch=0;ch<numchannels;++ch)
+    interpolate_ngb_deep(&prm, ch, numthreads);
 
 
   /* If the values were permuted for the interpolation, then re-order the
@@ -498,7 +760,7 @@ gal_interpolate_neighbors(gal_data_t *input,
 
 
   /* Clean up and return. */
-  free(prm.thread_flags);
+  gal_data_free(prm.deep);
   gal_data_free(prm.blanks);
   gal_list_void_free(prm.ngb_vals, 1);
   return prm.out;
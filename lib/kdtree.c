@@ -23,17 +23,25 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <error.h>
 #include <float.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gnuastro/data.h>
 #include <gnuastro/table.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/pointer.h>
-#include <gnuastro/permutation.h>
+#include <gnuastro/threads.h>
 
 
 
@@ -61,7 +69,6 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 struct kdtree_params
 {
   size_t ndim;            /* Number of dimentions in the nodes. */
-  size_t *input_row;      /* The indexes of the input table. */
   gal_data_t **coords;    /* The input coordinates array. */
   uint32_t *left, *right; /* The indexes of the left and right nodes. */
 
@@ -73,31 +80,6 @@ struct kdtree_params
 
 
 
-/* Swap 2 nodes of the tree. Instead of physically swaping all the values
-   we swap just the indexes of the node. */
-static void
-kdtree_node_swap(struct kdtree_params *p, size_t node1, size_t node2)
-{
-  uint32_t tmp_left=p->left[node1];
-  uint32_t tmp_right=p->right[node1];
-  size_t tmp_input_row=p->input_row[node1];
-
-  /* No need to swap same node. */
-  if(node1==node2) return;
-
-  p->left[node1]=p->left[node2];
-  p->right[node1]=p->right[node2];
-  p->input_row[node1]=p->input_row[node2];
-
-  p->left[node2]=tmp_left;
-  p->right[node2]=tmp_right;
-  p->input_row[node2]=tmp_input_row;
-}
-
-
-
-
-
 /* Return the distance between 2 given nodes. The distance is equivalent
    to the radius of the hypersphere having node as its center.
 
@@ -173,71 +155,37 @@ kdtree_prepare(struct kdtree_params *p, gal_data_t *coords_raw)
       tmp=tmp->next;
     }
 
-  /* If the 'left_col' is already defined, then we just need to do
-     some sanity checks. */
-  if(p->left_col)
-    {
-      /* Make sure there is more than one column. */
-      if(p->left_col->next==NULL)
-        error(EXIT_FAILURE, 0, "%s: the input kd-tree should be 2 columns",
-              __func__);
-
-      /* Set the right column and check if there aren't any
-         more columns. */
-      p->right_col=p->left_col->next;
-      if(p->right_col->next)
-        error(EXIT_FAILURE, 0, "%s: the input kd-tree shoudn't be more "
-              "than 2 columns", __func__);
-
-      /* Make sure they are the same size. */
-      if(p->left_col->size!=p->right_col->size)
-        error(EXIT_FAILURE, 0, "%s: left and right columns should have "
-              "same size", __func__);
-
-      /* Make sure left is 'uint32_t'. */
-      if(p->left_col->type!=GAL_TYPE_UINT32)
-        error(EXIT_FAILURE, 0, "%s: left kd-tree column should be uint32_t",
-              __func__);
-
-      /* Make sure right is 'uint32_t'. */
-      if(p->right_col->type!=GAL_TYPE_UINT32)
-        error(EXIT_FAILURE, 0, "%s: right kd-tree column should be uint32_t",
-              __func__);
-
-      /* Initailise left and right arrays. */
-      p->left=p->left_col->array;
-      p->right=p->right_col->array;
-    }
-  else
-    {
-      /* Allocate and initialise the kd-tree input_row. */
-      p->input_row=gal_pointer_allocate(GAL_TYPE_SIZE_T, coords_raw->size, 0,
-                                        __func__, "p->input_row");
-      for(i=0; i<coords_raw->size; ++i)	p->input_row[i]=i;
-
-      /* Allocate output and initialize them. */
-      p->left_col=gal_data_alloc(NULL, GAL_TYPE_UINT32, 1,
-                                 coords_raw->dsize, NULL, 0,
-                                 coords_raw->minmapsize,
-                                 coords_raw->quietmmap, "left",
-                                 "index",
-                                 "index of left subtree in the kd-tree");
-      p->right_col=gal_data_alloc(NULL, GAL_TYPE_UINT32, 1,
-                                  coords_raw->dsize, NULL, 0,
-                                  coords_raw->minmapsize,
-                                  coords_raw->quietmmap, "right",
-                                  "index",
-                                  "index of right subtree in the kd-tree");
-
-      /* Fill the elements of the params structure. */
-      p->left_col->next=p->right_col;
-
-      /* Initialise the left and right arrays. */
-      p->left=p->left_col->array;
-      p->right=p->right_col->array;
-      for(i=0;i<coords_raw->size;++i)
-        { p->left[i]=p->right[i]=GAL_BLANK_UINT32; }
-    }
+  /* The k-d tree is already defined, so we just need to do some sanity
+     checks. First, make sure there is more than one column. */
+  if(p->left_col->next==NULL)
+    error(EXIT_FAILURE, 0, "%s: the input kd-tree should be 2 columns",
+          __func__);
+
+  /* Set the right column and check if there aren't any
+     more columns. */
+  p->right_col=p->left_col->next;
+  if(p->right_col->next)
+    error(EXIT_FAILURE, 0, "%s: the input kd-tree shoudn't be more "
+          "than 2 columns", __func__);
+
+  /* Make sure they are the same size. */
+  if(p->left_col->size!=p->right_col->size)
+    error(EXIT_FAILURE, 0, "%s: left and right columns should have "
+          "same size", __func__);
+
+  /* Make sure left is 'uint32_t'. */
+  if(p->left_col->type!=GAL_TYPE_UINT32)
+    error(EXIT_FAILURE, 0, "%s: left kd-tree column should be uint32_t",
+          __func__);
+
+  /* Make sure right is 'uint32_t'. */
+  if(p->right_col->type!=GAL_TYPE_UINT32)
+    error(EXIT_FAILURE, 0, "%s: right kd-tree column should be uint32_t",
+          __func__);
+
+  /* Initailise left and right arrays. */
+  p->left=p->left_col->array;
+  p->right=p->right_col->array;
 }
 
 
@@ -261,7 +209,6 @@ kdtree_cleanup(struct kdtree_params *p, gal_data_t *coords_raw)
 
   /* Free memory. */
   free(p->coords);
-  free(p->input_row);
 }
 
 
@@ -286,192 +233,458 @@ kdtree_cleanup(struct kdtree_params *p, gal_data_t *coords_raw)
 /****************************************************************
  ********                Create KD-Tree                   *******
  ****************************************************************/
-/* Divide the array into two parts, values more than that of k'th node
-   and values less than k'th node.
+/* Parameters to build the tree on many threads. */
+struct kdtree_build_params
+{
+  size_t             ndim;  /* Number of dimensions.                    */
+  double            *wcrd;  /* Coordinates of points that are sorted.   */
+  size_t            *wrow;  /* Input row of points that are sorted.     */
+  double          *coords;  /* Coordinates of each node (output).       */
+  size_t            *rows;  /* Input row of each node (output).         */
+  size_t            level;  /* Depth of the nodes in this step.         */
+  size_t              *lo;  /* First point of each node's subtree.      */
+  size_t              *hi;  /* Last point (not inclusive) of subtree.   */
+  size_t          *nextlo;  /* 'lo' for the nodes of the next level.    */
+  size_t          *nexthi;  /* 'hi' for the nodes of the next level.    */
+  int            subtrees;  /* Build the full subtree of each node.     */
+};
 
-   Return: Index of the node whose value is greater than all
-           the nodes before it.
-*/
+
+
+
+
+/* Swap two points in the working arrays. */
+static void
+kdtree_build_swap(struct kdtree_build_params *p, size_t a, size_t b)
+{
+  size_t i, t;
+  double d, *ca=p->wcrd+a*p->ndim, *cb=p->wcrd+b*p->ndim;
+
+  t=p->wrow[a]; p->wrow[a]=p->wrow[b]; p->wrow[b]=t;
+  for(i=0;i<p->ndim;++i) { d=ca[i]; ca[i]=cb[i]; cb[i]=d; }
+}
+
+
+
+
+
+/* Number of nodes in the left subtree of a tree with 'n' nodes. The tree
+   is complete (all levels are full, except the last, which is filled from
+   the left), so its nodes can be kept in breadth-first order: the
+   children of node 'i' are nodes '2i+1' and '2i+2'. */
 static size_t
-kdtree_make_partition(struct kdtree_params *p, size_t node_left,
-                      size_t node_right, size_t node_k,
-                      double *coordinate)
-{
-  /* store_index is the index before which all values are smaller than
-     the value of k'th node. */
-  size_t i, store_index;
-  double k_node_value = coordinate[p->input_row[node_k]];
-
-  /* Move the k'th node to the right. */
-  kdtree_node_swap(p, node_k, node_right);
-
-  /* Move all nodes smaller than k'th node to its left and check
-     the number of elements smaller than the value present at the
-     k'th index. */
-  store_index = node_left;
-  for(i = node_left; i < node_right; ++i)
-    if(coordinate[p->input_row[i]] < k_node_value)
-      {
-        /* Move i'th node to the left side of the k'th index. */
-        kdtree_node_swap(p, store_index, i);
+kdtree_build_left_size(size_t n)
+{
+  size_t full, half, last;
+
+  /* A single node (or nothing) has no left subtree. */
+  if(n<2) return 0;
+
+  /* 'full' is the number of nodes in the complete levels (plus one) and
+     'half' is the number of nodes of the last level that can be in the
+     left subtree. */
+  for(full=1; full<=n/2; full*=2) {}
+  half=full/2;
+  last=n-(full-1);
+  return half-1 + (last<half ? last : half);
+}
 
-        /* Prepare the place of next smaller node. */
-        store_index++;
-      }
 
-  /* Place k'th node after all the nodes that have lesser value
-     than it, as it was moved to the right initially. */
-  kdtree_node_swap(p, node_right, store_index);
 
-  /* Return the store_index. */
-  return store_index;
+
+
+/* Partition the points in the range 'lo' to 'hi' (not inclusive) with
+   the given pivot (along the 'axis'): the points before '*lt' will be
+   smaller or equal to the pivot, the points from '*gt' will be larger or
+   equal to it and those in between are equal to it. Points that are equal
+   to the pivot stop both scans, so many equal coordinates are distributed
+   on both sides (and don't slow down the selection). */
+static void
+kdtree_build_partition(struct kdtree_build_params *p, size_t lo, size_t hi,
+                       size_t axis, double pivot, size_t *lt, size_t *gt)
+{
+  size_t i=lo, j=hi-1, nd=p->ndim;
+  double *c=p->wcrd+axis;
+
+  while(1)
+    {
+      while( c[i*nd]<pivot ) ++i;
+      while( pivot<c[j*nd] ) --j;
+      if(i<j) kdtree_build_swap(p, i++, j--);
+      else break;
+    }
+  *lt = i==j ? i   : j+1;
+  *gt = i==j ? i+1 : i;
+}
+
+
+
+
+
+static void
+kdtree_build_select(struct kdtree_build_params *p, size_t lo, size_t hi,
+                    size_t k, size_t axis);
+
+/* Pivot for the selection that is guaranteed to be between the 30th and
+   70th percentiles of the range (the median of the medians of each group
+   of five points). */
+static double
+kdtree_build_pivot_mom(struct kdtree_build_params *p, size_t lo,
+                       size_t hi, size_t axis)
+{
+  double *c=p->wcrd;
+  size_t i, j, k, g, n=0, nd=p->ndim;
+
+  /* Sort each group of five (with insertion sort) and move its median
+     to the start of the range. */
+  for(i=lo; i<hi; i+=5)
+    {
+      g = hi-i<5 ? hi-i : 5;
+      for(j=i+1; j<i+g; ++j)
+        for(k=j; k>i && c[(k-1)*nd+axis]>c[k*nd+axis]; --k)
+          kdtree_build_swap(p, k-1, k);
+      kdtree_build_swap(p, lo+n++, i+g/2);
+    }
+
+  /* Select the median of the medians. */
+  kdtree_build_select(p, lo, lo+n, lo+n/2, axis);
+  return c[(lo+n/2)*nd+axis];
 }
 
 
 
 
 
-/* Find the median node of the current axis. Instead of randomly
-   choosing the median node, we use `quickselect alogorithm` to
-   find median node in linear time between the left and right node.
-   This also makes the values in the current axis partially sorted.
+/* Put the 'k'th smallest point (along 'axis') of the range 'lo' to 'hi'
+   (not inclusive) in position 'k', with all smaller points before it and
+   all larger ones after it. Quick-select (with the median of three points
+   as pivot) is used first. Points with the same value are grouped
+   together in each partition, so many equal coordinates don't slow it
+   down. If quick-select doesn't converge fast enough, the median of
+   medians is used as pivot, so the time is always linear. */
+static void
+kdtree_build_select(struct kdtree_build_params *p, size_t lo, size_t hi,
+                    size_t k, size_t axis)
+{
+  size_t n, lt, gt, budget=0;
+  double a, b, c, pivot, *crd=p->wcrd;
 
-   See `https://en.wikipedia.org/wiki/Quickselect`
-   for pseudocode and more details of the algorithm.
+  /* Allowed number of quick-select iterations: twice the number of
+     halvings of the range. */
+  for(n=hi-lo; n>1; n/=2) budget+=2;
 
-   Return: Median node between the given left and right nodes.
-*/
+  /* Shrink the range until the 'k'th point is in place. */
+  while(hi-lo>1)
+    {
+      /* Find the pivot. */
+      if(budget)
+        {
+          --budget;
+          a=crd[ lo           *p->ndim+axis];
+          b=crd[(lo+(hi-lo)/2)*p->ndim+axis];
+          c=crd[(hi-1)        *p->ndim+axis];
+          pivot = ( a<b
+                    ? ( b<c ? b : (a<c ? c : a) )
+                    : ( a<c ? a : (b<c ? c : b) ) );
+        }
+      else
+        pivot=kdtree_build_pivot_mom(p, lo, hi, axis);
+
+      /* Partition the range and continue with the part containing 'k'. */
+      kdtree_build_partition(p, lo, hi, axis, pivot, &lt, &gt);
+      if(k<lt)       hi=lt;
+      else if(k>=gt) lo=gt;
+      else           break;
+    }
+}
+
+
+
+
+
+/* Find the median of the points in the range 'lo' to 'hi' (not inclusive)
+   along the axis of this depth and put it in the given node. The returned
+   value is the position of the median in the working arrays: the points
+   before it are in the node's left subtree and those after it are in its
+   right subtree. */
 static size_t
-kdtree_median_find(struct kdtree_params *p, size_t node_left,
-                   size_t node_right, double *coordinate)
+kdtree_build_node(struct kdtree_build_params *p, size_t node, size_t lo,
+                  size_t hi, size_t depth)
 {
-  size_t node_pivot, node_median;
+  size_t i, axis=depth%p->ndim;
+  size_t median=lo+kdtree_build_left_size(hi-lo);
+
+  kdtree_build_select(p, lo, hi, median, axis);
+  for(i=0;i<p->ndim;++i)
+    p->coords[node*p->ndim+i]=p->wcrd[median*p->ndim+i];
+  p->rows[node]=p->wrow[median];
+  return median;
+}
 
-  /* False state, this is a programming error. */
-  if(node_right < node_left)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us to fix "
-          "the problem! For some reason, the node_right (%zu) is "
-          "smaller than node_left (%zu)", __func__, node_right,
-          node_left);
 
-  /* If the two nodes are the same, just return the node. */
-  if(node_right == node_left)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us to fix "
-          "the problem! For some reason, the node_right (%zu) is "
-          "equal to node_left (%zu)", __func__, node_right, node_left);
 
-  /* The required median node between left and right node. */
-  node_median = node_left+(node_right-node_left)/2;
 
-  /* Loop until the median of the current axis is returned. */
-  while(1)
+
+/* Build the full subtree of the given node. */
+static void
+kdtree_build_subtree(struct kdtree_build_params *p, size_t node,
+                     size_t lo, size_t hi, size_t depth)
+{
+  size_t median;
+
+  /* The right subtree is built in the loop (not recursively). */
+  while(lo<hi)
     {
-      /* Pivot node acts as a reference for the distance from the desired
-        (here median) node. */
-      node_pivot = kdtree_make_partition(p, node_left, node_right,
-                                         node_median, coordinate);
-      /* If median is found, break the loop and return median node. */
-      if(node_median == node_pivot) break;
-
-      /* Change the left or right node based on the position of
-         the pivot node with respect to the required median node. */
-      if(node_median < node_pivot)  node_right = node_pivot - 1;
-      else                          node_left  = node_pivot + 1;
+      median=kdtree_build_node(p, node, lo, hi, depth);
+      kdtree_build_subtree(p, 2*node+1, lo, median, depth+1);
+      node=2*node+2;
+      lo=median+1;
+      ++depth;
     }
-  /* Return the median node. */
-  return node_median;
 }
 
 
 
 
 
-/* Make a kd-tree from a given set of points. For tree construction, a
-   median point is selected for each axis and the left and right branches
-   are recursively created by comparing points in that axis.
+/* Build the nodes of one level (or their full subtrees) on a thread. */
+static void *
+kdtree_build_worker(void *in_prm)
+{
+  /* Low-level definitions to be done first. */
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_build_params *p=(struct kdtree_build_params *)tprm->params;
 
-   Return : Indexes of the nodes in the kd-tree.
-*/
-static uint32_t
-kdtree_fill_subtrees(struct kdtree_params *p, size_t node_left,
-                     size_t node_right, size_t depth)
+  /* The first node of this level. */
+  size_t i, t, median, first=((size_t)1<<p->level)-1;
+
+  /* Go over the nodes (of this level) that were assigned to this
+     thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      t=tprm->indexs[i];
+      if(p->subtrees)
+        kdtree_build_subtree(p, first+t, p->lo[t], p->hi[t], p->level);
+      else
+        {
+          /* Build this node and set the ranges of its children. */
+          if(p->lo[t]<p->hi[t])
+            {
+              median=kdtree_build_node(p, first+t, p->lo[t], p->hi[t],
+                                       p->level);
+              p->nextlo[2*t]   = p->lo[t];   p->nexthi[2*t]   = median;
+              p->nextlo[2*t+1] = median+1;   p->nexthi[2*t+1] = p->hi[t];
+            }
+
+          /* On the last level, some nodes may not exist. */
+          else
+            p->nextlo[2*t] = p->nexthi[2*t]
+              = p->nextlo[2*t+1] = p->nexthi[2*t+1] = p->lo[t];
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Build a k-d tree from the given coordinates on 'numthreads' threads.
+   The points are copied into working arrays (with all the coordinates of
+   each point beside each other) and the median is found with a linear
+   time selection. The top levels of the tree are built level by level
+   (with the nodes of each level on different threads), until there are
+   enough subtrees to build them completely and independently on the
+   threads. */
+gal_kdtree_t *
+gal_kdtree_build(gal_data_t *coords_raw, size_t numthreads,
+                 size_t minmapsize, int quietmmap)
 {
-  /* Set the working axis. */
-  size_t axis=depth % p->ndim;
+  double *darr;
+  gal_kdtree_t *tree;
+  size_t *ranges, *tmp;
+  gal_data_t *ccol, *conv, *wcrd, *wrow;
+  struct kdtree_build_params p={0};
+  size_t i, d, n=coords_raw->size, dsize[2];
+
+  /* If there are no coordinates, just return NULL. */
+  if(n==0) return NULL;
+
+  /* Allocate the tree. */
+  errno=0;
+  tree=malloc(sizeof *tree);
+  if(tree==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'tree'", __func__, sizeof *tree);
+  tree->map=NULL;
+  tree->mapsize=0;
+  tree->size=n;
+  tree->ndim=p.ndim=gal_list_data_number(coords_raw);
+  dsize[0]=n;
+  dsize[1]=p.ndim;
+  tree->coords=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
+                              minmapsize, quietmmap, "coords", NULL,
+                              "Coordinates of each k-d tree node.");
+  tree->rows=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, dsize, NULL, 0,
+                            minmapsize, quietmmap, "rows", "index",
+                            "Input row of each k-d tree node.");
+  p.coords=tree->coords->array;
+  p.rows=tree->rows->array;
+
+  /* Copy the points into the working arrays. */
+  wcrd=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
+                      minmapsize, quietmmap, NULL, NULL, NULL);
+  wrow=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, dsize, NULL, 0,
+                      minmapsize, quietmmap, NULL, NULL, NULL);
+  p.wcrd=wcrd->array;
+  p.wrow=wrow->array;
+  for(i=0;i<n;++i) p.wrow[i]=i;
+  for(d=0, ccol=coords_raw; ccol!=NULL; ++d, ccol=ccol->next)
+    {
+      if(ccol->size!=n)
+        error(EXIT_FAILURE, 0, "%s: all coordinates should have the "
+              "same number of elements, but column %zu has %zu "
+              "elements (the first has %zu)", __func__, d+1,
+              ccol->size, n);
+      conv = ( ccol->type==GAL_TYPE_FLOAT64
+               ? ccol
+               : gal_data_copy_to_new_type(ccol, GAL_TYPE_FLOAT64) );
+      darr=conv->array;
+      for(i=0;i<n;++i) p.wcrd[i*p.ndim+d]=darr[i];
+      if(conv!=ccol) gal_data_free(conv);
+    }
+
+  /* Space for the ranges of the nodes in each level (while the top levels
+     are built on separate threads, there are less than '8*numthreads'
+     nodes in each level). */
+  ranges=gal_pointer_allocate(GAL_TYPE_SIZE_T, 4*8*numthreads, 0,
+                              __func__, "ranges");
+  p.lo=ranges;
+  p.hi=ranges+8*numthreads;
+  p.nextlo=ranges+2*8*numthreads;
+  p.nexthi=ranges+3*8*numthreads;
+  p.lo[0]=0;
+  p.hi[0]=n;
+
+  /* Build the top levels (one node on each thread) until there are
+     enough subtrees to distribute between the threads. */
+  if(numthreads>1)
+    while( ((size_t)1<<p.level) < 4*numthreads
+           && ((size_t)1<<p.level) <= n )
+      {
+        gal_threads_spin_off(kdtree_build_worker, &p, (size_t)1<<p.level,
+                             numthreads, minmapsize, quietmmap);
+        tmp=p.lo; p.lo=p.nextlo; p.nextlo=tmp;
+        tmp=p.hi; p.hi=p.nexthi; p.nexthi=tmp;
+        ++p.level;
+      }
 
-  /* node_median is a counter over the `input_row` array.
-     `input_row` array has the input_row(row number). */
-  size_t node_median;
+  /* Build the remaining subtrees. */
+  p.subtrees=1;
+  gal_threads_spin_off(kdtree_build_worker, &p, (size_t)1<<p.level,
+                       numthreads, minmapsize, quietmmap);
 
-  /* Recursion terminates when the left and right nodes are the
-     same. */
-  if(node_left==node_right) return p->input_row[node_left];
+  /* Clean up and return. */
+  free(ranges);
+  gal_data_free(wcrd);
+  gal_data_free(wrow);
+  return tree;
+}
 
-  /* Find the median node. */
-  node_median = kdtree_median_find(p, node_left, node_right,
-                                   p->coords[axis]->array);
 
-  /* node_median == 0 : We are in the lowest node (leaf) so no need
-     When we only have 2 nodes and the median is equal to the left,
-     its the end of the subtree.
-  */
-  if(node_median)
-    p->left[node_median] = ( (node_median == node_left)
-                             ? GAL_BLANK_UINT32
-                             : kdtree_fill_subtrees(p, node_left,
-                                                    node_median-1,
-                                                    depth+1) );
 
-  /* Right and left nodes are non-symytrical. Node left can be equal
-     to node median when there are only 2 points and at this point,
-     there can never be a single point (node left == node right).
-     But node right can never be equal to node median.
-     So we don't check for it.*/
-  p->right[node_median] = kdtree_fill_subtrees(p, node_median+1,
-                                               node_right,
-                                               depth+1);
 
-  /* All subtrees have been parsed, return the node. */
-  return p->input_row[node_median];
+
+/* Free the space that was allocated for a k-d tree. When the tree was
+   loaded from an index file, its arrays are within the mapping of the
+   file, so the file is un-mapped instead. */
+void
+gal_kdtree_free(gal_kdtree_t *tree)
+{
+  if(tree==NULL) return;
+  if(tree->map)
+    {
+      tree->coords->array=tree->rows->array=NULL;
+      errno=0;
+      if( munmap(tree->map, tree->mapsize) )
+        error(EXIT_FAILURE, errno, "%s: couldn't un-map the k-d tree "
+              "index", __func__);
+    }
+  gal_data_free(tree->coords);
+  gal_data_free(tree->rows);
+  free(tree);
 }
 
 
 
 
 
-/* High level function to construct the kd-tree. This function initilises
-   and creates the tree in top-down manner. Returns a list containing the
-   indexes of left and right subtrees. */
+/* High level function to construct the kd-tree and return it as two
+   columns (the index of the left and right subtree of each input row).
+   Returns a list containing the indexes of left and right subtrees. */
 gal_data_t *
 gal_kdtree_create(gal_data_t *coords_raw, size_t *root)
 {
-  struct kdtree_params p={0};
+  return gal_kdtree_create_parallel(coords_raw, 1, root);
+}
 
-  /* If there are no coordinates, just return NULL. */
-  if(coords_raw->size==0) return NULL;
 
-  /* Initialise the params structure. */
-  kdtree_prepare(&p, coords_raw);
 
-  /* Fill the kd-tree*/
-  *root=kdtree_fill_subtrees(&p, 0, coords_raw->size-1, 0);
 
-  /* For a check
-  size_t i;
-  for(i=0;i<coords_raw->size;++i)
-    printf("%-15zu%-15u%-15u\n", p.input_row[i], p.left[i], p.right[i]);
-  */
 
-  /* Do a reverse permutation to sort the indexes
-     back in the input order. */
-  gal_permutation_apply_inverse(p.left_col, p.input_row);
-  gal_permutation_apply_inverse(p.right_col, p.input_row);
+/* Similar to 'gal_kdtree_create', but the tree is built on 'numthreads'
+   threads. */
+gal_data_t *
+gal_kdtree_create_parallel(gal_data_t *coords_raw, size_t numthreads,
+                           size_t *root)
+{
+  gal_kdtree_t *tree;
+  gal_data_t *left_col, *right_col;
+  size_t i, n=coords_raw->size, *rows;
+  uint32_t *left, *right;
 
-  /* Free and clean up */
-  kdtree_cleanup(&p, coords_raw);
+  /* If there are no coordinates, just return NULL. */
+  if(n==0) return NULL;
+
+  /* The output columns are 32-bit integers. */
+  if(n>=GAL_BLANK_UINT32)
+    error(EXIT_FAILURE, 0, "%s: the input has %zu points, but the "
+          "left and right columns of the k-d tree can only be used for "
+          "less than %u points (use 'gal_kdtree_build' for larger "
+          "inputs)", __func__, n, GAL_BLANK_UINT32);
+
+  /* Build the tree. */
+  tree=gal_kdtree_build(coords_raw, numthreads, coords_raw->minmapsize,
+                        coords_raw->quietmmap);
+
+  /* Allocate output and initialize them. */
+  left_col=gal_data_alloc(NULL, GAL_TYPE_UINT32, 1, coords_raw->dsize,
+                          NULL, 0, coords_raw->minmapsize,
+                          coords_raw->quietmmap, "left", "index",
+                          "index of left subtree in the kd-tree");
+  right_col=gal_data_alloc(NULL, GAL_TYPE_UINT32, 1, coords_raw->dsize,
+                           NULL, 0, coords_raw->minmapsize,
+                           coords_raw->quietmmap, "right", "index",
+                           "index of right subtree in the kd-tree");
+  left_col->next=right_col;
+
+  /* The children of node 'i' are nodes '2i+1' and '2i+2'. */
+  left=left_col->array;
+  right=right_col->array;
+  rows=tree->rows->array;
+  for(i=0;i<n;++i)
+    {
+      left [ rows[i] ] = 2*i+1<n ? rows[2*i+1] : GAL_BLANK_UINT32;
+      right[ rows[i] ] = 2*i+2<n ? rows[2*i+2] : GAL_BLANK_UINT32;
+    }
+  *root=rows[0];
 
-  /* Return results. */
-  return p.left_col;
+  /* Clean up and return. */
+  gal_kdtree_free(tree);
+  return left_col;
 }
 
 
@@ -595,3 +808,847 @@ gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
   kdtree_cleanup(&p, coords_raw);
   return out_nn;
 }
+
+
+
+
+
+/* Low-level nearest-neighbour search in a tree that was built with
+   'gal_kdtree_build'. The square of the distance to the best node so far
+   is kept in 'best_d' (which initially has the square of the maximum
+   distance), so the far side of a node is only searched when the
+   splitting plane is closer than the best node. */
+static void
+kdtree_nearest(gal_kdtree_t *tree, double *coords, size_t *rows,
+               double *point, size_t node, size_t depth, size_t *best,
+               double *best_d)
+{
+  size_t d, ndim=tree->ndim;
+  double dist=0.0, diff, *nc=coords+node*ndim;
+
+  /* Distance of this node to the point (in case of equal distances, the
+     node with the smaller input row is used). */
+  for(d=0;d<ndim;++d) { diff=nc[d]-point[d]; dist+=diff*diff; }
+  if( dist<*best_d
+      || ( dist==*best_d
+           && ( *best==GAL_BLANK_SIZE_T || rows[node]<rows[*best] ) ) )
+    { *best=node; *best_d=dist; }
+
+  /* Go down the side of the point first, then the other side if the
+     splitting plane is not farther than the best node. */
+  d=depth%ndim;
+  diff=point[d]-nc[d];
+  node = diff<0 ? 2*node+1 : 2*node+2;
+  if(node<tree->size)
+    kdtree_nearest(tree, coords, rows, point, node, depth+1, best, best_d);
+  node = diff<0 ? node+1 : node-1;
+  if(node<tree->size && diff*diff<=*best_d)
+    kdtree_nearest(tree, coords, rows, point, node, depth+1, best, best_d);
+}
+
+
+
+
+
+/* Find the nearest node of 'tree' (built with 'gal_kdtree_build') to
+   'point' that is not farther than 'maxdist' (which can be 'INFINITY').
+   The returned value is the node (not the input row!) so its coordinates
+   are also available to the caller (its input row is the node's element
+   in 'tree->rows'). If no node is found, 'GAL_BLANK_SIZE_T' is returned.
+   The distance to the returned node is written in 'dist'. Since this
+   function doesn't allocate anything, it can be called on any number of
+   threads. */
+size_t
+gal_kdtree_nearest(gal_kdtree_t *tree, double *point, double maxdist,
+                   double *dist)
+{
+  size_t d, best=GAL_BLANK_SIZE_T;
+
+  /* Blank points have no neighbor. */
+  *dist=NAN;
+  if(tree==NULL || tree->size==0) return GAL_BLANK_SIZE_T;
+  for(d=0;d<tree->ndim;++d) if(isnan(point[d])) return GAL_BLANK_SIZE_T;
+
+  /* Find the nearest node and return it. */
+  *dist=maxdist*maxdist;
+  kdtree_nearest(tree, tree->coords->array, tree->rows->array, point, 0,
+                 0, &best, dist);
+  *dist = best==GAL_BLANK_SIZE_T ? NAN : sqrt(*dist);
+  return best;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********                 Batched queries                 *******
+ ****************************************************************/
+/* Number of query points in each job that is given to a thread. */
+#define KDTREE_QUERY_BLOCKSIZE 4096
+
+
+
+
+
+/* A point that is found within the radius of a query. */
+struct kdtree_found
+{
+  double                dist;  /* Squared distance to the query point.   */
+  size_t                 row;  /* Row of the point in the tree's input.  */
+};
+
+
+
+
+
+/* Parameters of the batched queries. */
+struct kdtree_query_params
+{
+  size_t                ndim;  /* Number of dimensions.                  */
+  size_t                size;  /* Number of nodes in the tree.           */
+  double             *coords;  /* Coordinates of the tree's nodes.       */
+  size_t               *rows;  /* Input row of the tree's nodes.         */
+  double            **points;  /* Coordinates of the query points.       */
+  gal_data_t      *converted;  /* Query coordinates converted to double. */
+  size_t             npoints;  /* Number of query points.                */
+
+  size_t                   k;  /* Number of neighbors (k-NN query).      */
+  uint8_t             metric;  /* Distance metric (k-NN query).          */
+  size_t             *indexs;  /* Rows of the neighbors (k-NN query).    */
+  double              *dists;  /* Distance to neighbors (k-NN query).    */
+
+  double             radius2;  /* Squared radius (radius query).         */
+  size_t              *start;  /* Number of points found for each query. */
+  struct kdtree_found **found; /* Points found in each block of queries. */
+  size_t           *numfound;  /* Number of points found in each block.  */
+};
+
+
+
+
+
+/* The state of the search on each thread. */
+struct kdtree_search
+{
+  double              *point;  /* Coordinates of the query point.        */
+  double                *off;  /* Offset of the region in each dim.      */
+  double              *hdist;  /* Squared distances in heap (k-NN).      */
+  size_t              *hnode;  /* Nodes in the heap (k-NN).              */
+  size_t                   n;  /* Number of points in heap (or found).   */
+  size_t              nalloc;  /* Allocated size of 'found'.             */
+  struct kdtree_found *found;  /* Points found within the radius.        */
+};
+
+
+
+
+
+/* Return 1 if element 'a' of the heap is farther than element 'b'. When
+   the distances are equal, the point with a larger row is farther. */
+static int
+kdtree_query_farther(struct kdtree_query_params *p, struct kdtree_search *s,
+                     size_t a, size_t b)
+{
+  return ( s->hdist[a]>s->hdist[b]
+           || ( s->hdist[a]==s->hdist[b]
+                && p->rows[s->hnode[a]]>p->rows[s->hnode[b]] ) );
+}
+
+
+
+
+
+/* Swap two elements of the heap. */
+static void
+kdtree_query_heap_swap(struct kdtree_search *s, size_t a, size_t b)
+{
+  size_t t=s->hnode[a];
+  double d=s->hdist[a];
+  s->hnode[a]=s->hnode[b]; s->hnode[b]=t;
+  s->hdist[a]=s->hdist[b]; s->hdist[b]=d;
+}
+
+
+
+
+
+/* Move element 'i' of the heap down (until its children are nearer). The
+   heap has 'n' elements. */
+static void
+kdtree_query_heap_down(struct kdtree_query_params *p,
+                       struct kdtree_search *s, size_t i, size_t n)
+{
+  size_t c;
+  while( (c=2*i+1)<n )
+    {
+      if( c+1<n && kdtree_query_farther(p, s, c+1, c) ) ++c;
+      if( !kdtree_query_farther(p, s, c, i) ) break;
+      kdtree_query_heap_swap(s, i, c);
+      i=c;
+    }
+}
+
+
+
+
+
+/* Add a node of the tree to the points that are found for the query. For
+   a k-NN query, the points are kept in a max-heap of 'k' elements (the
+   farthest point that has been found is on top). */
+static void
+kdtree_query_add(struct kdtree_query_params *p, struct kdtree_search *s,
+                 size_t node, double dist)
+{
+  size_t i, pa;
+
+  /* Radius query. */
+  if(p->k==0)
+    {
+      if(dist>p->radius2) return;
+      if(s->n==s->nalloc)
+        {
+          s->nalloc = s->nalloc ? 2*s->nalloc : 64;
+          errno=0;
+          s->found=realloc(s->found, s->nalloc*sizeof *s->found);
+          if(s->found==NULL)
+            error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes "
+                  "for 'found'", __func__, s->nalloc*sizeof *s->found);
+        }
+      s->found[s->n].dist=dist;
+      s->found[s->n].row=p->rows[node];
+      ++s->n;
+    }
+
+  /* k-NN query when the heap isn't full: add the point to the end and
+     move it up. */
+  else if(s->n<p->k)
+    {
+      i=s->n++;
+      s->hdist[i]=dist;
+      s->hnode[i]=node;
+      while(i)
+        {
+          pa=(i-1)/2;
+          if( !kdtree_query_farther(p, s, i, pa) ) break;
+          kdtree_query_heap_swap(s, i, pa);
+          i=pa;
+        }
+    }
+
+  /* When the heap is full, replace the farthest point if this is
+     nearer. */
+  else if( dist<s->hdist[0]
+           || (dist==s->hdist[0] && p->rows[node]<p->rows[s->hnode[0]]) )
+    {
+      s->hdist[0]=dist;
+      s->hnode[0]=node;
+      kdtree_query_heap_down(p, s, 0, p->k);
+    }
+}
+
+
+
+
+
+/* Distance between the points 'a' and 'b' (or the length of 'a' when
+   'b==NULL'). With the Euclidean metric, the squared distance is
+   returned. */
+static double
+kdtree_query_distance(struct kdtree_query_params *p, double *a, double *b)
+{
+  size_t i;
+  double d, out=0.0;
+  for(i=0;i<p->ndim;++i)
+    {
+      d = b ? a[i]-b[i] : a[i];
+      out += p->metric==GAL_KDTREE_METRIC_MANHATTAN ? fabs(d) : d*d;
+    }
+  return out;
+}
+
+
+
+
+
+/* Search the subtree of 'node' (at 'depth'). 'rd' is the distance (see
+   'kdtree_query_distance') of the query point to the region of this
+   subtree and 's->off' is the offset of the query point from that region
+   along each dimension. */
+static void
+kdtree_query_search(struct kdtree_query_params *p, struct kdtree_search *s,
+                    size_t node, size_t depth, double rd)
+{
+  double *c, diff, old;
+  size_t axis, near, far;
+
+  /* If the subtree doesn't exist, or its region is farther than the
+     points that are desired, there is nothing to do. */
+  if( node>=p->size ) return;
+  if( p->k ? (s->n==p->k && rd>s->hdist[0]) : rd>p->radius2 ) return;
+
+  /* Check this node. */
+  c=p->coords+node*p->ndim;
+  kdtree_query_add(p, s, node, kdtree_query_distance(p, s->point, c));
+
+  /* Search the side of the splitting plane that contains the query point
+     first. */
+  axis=depth%p->ndim;
+  diff=s->point[axis]-c[axis];
+  near = diff<0 ? 2*node+1 : 2*node+2;
+  far  = diff<0 ? 2*node+2 : 2*node+1;
+  kdtree_query_search(p, s, near, depth+1, rd);
+
+  /* On the other side, the offset along this axis is the distance to the
+     splitting plane. */
+  old=s->off[axis];
+  s->off[axis]=diff;
+  rd=kdtree_query_distance(p, s->off, NULL);
+  kdtree_query_search(p, s, far, depth+1, rd);
+  s->off[axis]=old;
+}
+
+
+
+
+
+/* For sorting the points found within the radius (by distance and row). */
+static int
+kdtree_query_found_cmp(const void *a, const void *b)
+{
+  const struct kdtree_found *fa=a, *fb=b;
+  return ( fa->dist<fb->dist ? -1
+           : ( fa->dist>fb->dist ? 1
+               : ( fa->row<fb->row ? -1 : (fa->row>fb->row) ) ) );
+}
+
+
+
+
+
+/* Answer the queries in the blocks that are given to this thread. */
+static void *
+kdtree_query_worker(void *in_prm)
+{
+  /* Low-level definitions to be done first. */
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_query_params *p=(struct kdtree_query_params *)tprm->params;
+
+  /* High level definitions. */
+  int isblank;
+  struct kdtree_search s={0};
+  size_t i, j, b, q, qfirst, qlast, qn;
+  double *ws=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*p->ndim+p->k, 0,
+                                  __func__, "ws");
+
+  /* Set the per-thread workspace. */
+  s.point=ws;
+  s.off=ws+p->ndim;
+  s.hdist=ws+2*p->ndim;
+  if(p->k)
+    s.hnode=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->k, 0, __func__,
+                                 "s.hnode");
+
+  /* Go over the blocks of queries that are assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Range of the queries in this block. */
+      b=tprm->indexs[i];
+      qfirst=b*KDTREE_QUERY_BLOCKSIZE;
+      qlast=qfirst+KDTREE_QUERY_BLOCKSIZE;
+      if(qlast>p->npoints) qlast=p->npoints;
+
+      /* Each block has its own array of found points. */
+      s.n=s.nalloc=0;
+      s.found=NULL;
+
+      /* Go over the queries. */
+      for(q=qfirst; q<qlast; ++q)
+        {
+          /* Set the query point (a blank coordinate has no neighbor). */
+          isblank=0;
+          for(j=0;j<p->ndim;++j)
+            {
+              s.off[j]=0.0;
+              s.point[j]=p->points[j][q];
+              if(isnan(s.point[j])) isblank=1;
+            }
+
+          /* k-NN query: do the search and sort the heap (the farthest
+             point goes to the end of the heap in every step). */
+          if(p->k)
+            {
+              s.n=0;
+              if(!isblank) kdtree_query_search(p, &s, 0, 0, 0.0);
+              for(qn=s.n; qn>1; --qn)
+                {
+                  kdtree_query_heap_swap(&s, 0, qn-1);
+                  kdtree_query_heap_down(p, &s, 0, qn-1);
+                }
+              if(p->metric!=GAL_KDTREE_METRIC_MANHATTAN)
+                for(j=0;j<s.n;++j) s.hdist[j]=sqrt(s.hdist[j]);
+              for(j=0;j<p->k;++j)
+                {
+                  p->indexs[q*p->k+j] = ( j<s.n
+                                          ? p->rows[s.hnode[j]]
+                                          : GAL_BLANK_SIZE_T );
+                  p->dists[q*p->k+j]  = j<s.n ? s.hdist[j] : NAN;
+                }
+            }
+
+          /* Radius query: sort the points that were found for this
+             query and keep their number. */
+          else
+            {
+              qn=s.n;
+              if(!isblank) kdtree_query_search(p, &s, 0, 0, 0.0);
+              if(s.n>qn)
+                qsort(s.found+qn, s.n-qn, sizeof *s.found,
+                      kdtree_query_found_cmp);
+              for(j=qn;j<s.n;++j) s.found[j].dist=sqrt(s.found[j].dist);
+              p->start[q+1]=s.n-qn;
+            }
+        }
+
+      /* Keep the points that were found in this block. */
+      if(p->k==0)
+        {
+          p->found[b]=s.found;
+          p->numfound[b]=s.n;
+        }
+    }
+
+  /* Clean up. */
+  free(ws);
+  if(p->k) free(s.hnode);
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Prepare the query points and spin-off the threads. */
+static void
+kdtree_query(struct kdtree_query_params *p, gal_kdtree_t *tree,
+             gal_data_t *points, size_t numthreads, size_t minmapsize,
+             int quietmmap)
+{
+  size_t i;
+  gal_data_t *tmp, *conv;
+
+  /* Sanity checks. */
+  p->ndim=tree->ndim;
+  p->size=tree->size;
+  p->npoints=points->size;
+  if( gal_list_data_number(points)!=tree->ndim )
+    error(EXIT_FAILURE, 0, "%s: the query points have %zu dimensions "
+          "(columns), but the k-d tree has %zu dimensions", __func__,
+          gal_list_data_number(points), tree->ndim);
+  for(tmp=points; tmp!=NULL; tmp=tmp->next)
+    if(tmp->size!=points->size)
+      error(EXIT_FAILURE, 0, "%s: all the coordinates of the query "
+            "points should have the same number of elements", __func__);
+
+  /* Pointers to the tree. */
+  p->coords=tree->coords->array;
+  p->rows=tree->rows->array;
+
+  /* Pointers to the query points (converted to double if necessary). */
+  errno=0;
+  p->points=malloc(p->ndim*sizeof *p->points);
+  if(p->points==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'p->points'", __func__, p->ndim*sizeof *p->points);
+  for(i=0, tmp=points; tmp!=NULL; ++i, tmp=tmp->next)
+    if(tmp->type==GAL_TYPE_FLOAT64)
+      p->points[i]=tmp->array;
+    else
+      {
+        conv=gal_data_copy_to_new_type(tmp, GAL_TYPE_FLOAT64);
+        gal_list_data_add(&p->converted, conv);
+        p->points[i]=conv->array;
+      }
+
+  /* Do the queries. */
+  gal_threads_spin_off(kdtree_query_worker, p,
+                       (p->npoints-1)/KDTREE_QUERY_BLOCKSIZE+1,
+                       numthreads, minmapsize, quietmmap);
+
+  /* Clean up. */
+  free(p->points);
+  gal_list_data_free(p->converted);
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbors of each query point (with the Euclidean
+   metric). */
+gal_data_t *
+gal_kdtree_knn(gal_kdtree_t *tree, gal_data_t *points, size_t k,
+               size_t numthreads, size_t minmapsize, int quietmmap)
+{
+  return gal_kdtree_knn_metric(tree, points, k, GAL_KDTREE_METRIC_EUCLIDEAN,
+                               numthreads, minmapsize, quietmmap);
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbors of each query point with the given
+   metric. */
+gal_data_t *
+gal_kdtree_knn_metric(gal_kdtree_t *tree, gal_data_t *points, size_t k,
+                      uint8_t metric, size_t numthreads, size_t minmapsize,
+                      int quietmmap)
+{
+  size_t dsize[2];
+  gal_data_t *out;
+  struct kdtree_query_params p={0};
+
+  /* If there are no query points, just return NULL. */
+  if(points==NULL || points->size==0) return NULL;
+  if(k==0)
+    error(EXIT_FAILURE, 0, "%s: the number of neighbors ('k') should "
+          "be larger than zero", __func__);
+  if( metric!=GAL_KDTREE_METRIC_EUCLIDEAN
+      && metric!=GAL_KDTREE_METRIC_MANHATTAN )
+    error(EXIT_FAILURE, 0, "%s: %u is not a recognized metric, please "
+          "use one of the 'GAL_KDTREE_METRIC_*' macros", __func__, metric);
+  if(tree==NULL)
+    error(EXIT_FAILURE, 0, "%s: no k-d tree given", __func__);
+
+  /* Allocate the outputs. */
+  dsize[0]=points->size;
+  dsize[1]=k;
+  out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 2, dsize, NULL, 0, minmapsize,
+                     quietmmap, "index", "index",
+                     "Input row of the neighbors (nearest first).");
+  out->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
+                           minmapsize, quietmmap, "distance", NULL,
+                           "Distance to the neighbors.");
+
+  /* Do the queries. */
+  p.k=k;
+  p.metric=metric;
+  p.indexs=out->array;
+  p.dists=out->next->array;
+  kdtree_query(&p, tree, points, numthreads, minmapsize, quietmmap);
+  return out;
+}
+
+
+
+
+
+/* Find all the points within 'radius' of each query point. */
+gal_data_t *
+gal_kdtree_radius(gal_kdtree_t *tree, gal_data_t *points, double radius,
+                  size_t numthreads, size_t minmapsize, int quietmmap)
+{
+  size_t i, b, o, nb, dsize;
+  gal_data_t *out, *ind, *dist;
+  struct kdtree_query_params p={0};
+
+  /* If there are no query points, just return NULL. */
+  if(points==NULL || points->size==0) return NULL;
+  if( !(radius>=0.0) )
+    error(EXIT_FAILURE, 0, "%s: the radius should be positive, but it "
+          "is %g", __func__, radius);
+  if(tree==NULL)
+    error(EXIT_FAILURE, 0, "%s: no k-d tree given", __func__);
+
+  /* The start of the points of each query in the output. */
+  dsize=points->size+1;
+  out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &dsize, NULL, 0,
+                     minmapsize, quietmmap, "start", "index",
+                     "Index of first neighbor of each query.");
+
+  /* Space to keep the points that are found in each block of queries. */
+  nb=(points->size-1)/KDTREE_QUERY_BLOCKSIZE+1;
+  errno=0;
+  p.found=calloc(nb, sizeof *p.found);
+  if(p.found==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'p.found'", __func__, nb*sizeof *p.found);
+  p.numfound=gal_pointer_allocate(GAL_TYPE_SIZE_T, nb, 1, __func__,
+                                  "p.numfound");
+
+  /* Do the queries. */
+  p.radius2=radius*radius;
+  p.start=out->array;
+  kdtree_query(&p, tree, points, numthreads, minmapsize, quietmmap);
+
+  /* Convert the number of points found for each query into the start of
+     its points in the output. */
+  p.start[0]=0;
+  for(i=0;i<points->size;++i) p.start[i+1]+=p.start[i];
+
+  /* Allocate the output arrays and copy the points of each block (the
+     queries of each block are contiguous). */
+  dsize=p.start[points->size];
+  ind=out->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &dsize, NULL, 0,
+                               minmapsize, quietmmap, "index", "index",
+                               "Input row of the neighbors.");
+  dist=ind->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &dsize, NULL,
+                                0, minmapsize, quietmmap, "distance",
+                                NULL, "Distance to the neighbors.");
+  for(b=0;b<nb;++b)
+    {
+      o=p.start[b*KDTREE_QUERY_BLOCKSIZE];
+      for(i=0;i<p.numfound[b];++i)
+        {
+          ((size_t *)(ind->array))[o+i]  = p.found[b][i].row;
+          ((double *)(dist->array))[o+i] = p.found[b][i].dist;
+        }
+      free(p.found[b]);
+    }
+
+  /* Clean up and return. */
+  free(p.found);
+  free(p.numfound);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********                   Index files                   *******
+ ****************************************************************/
+/* An index file keeps a tree that was built with 'gal_kdtree_build' so
+   it can be used directly (without reading the coordinates or building
+   the tree) by mapping it into memory. It starts with the header below
+   that is followed by the coordinates of the nodes ('size x ndim'
+   doubles) and the input row of each node ('size' size_t values). The
+   header is a multiple of 8 bytes, so both arrays are aligned. All the
+   values are in the native byte order of the writing system, so the
+   header keeps a known number (which will not be read as the same number
+   in another byte order) and the size of 'size_t'. If the format is
+   changed in the future, 'KDTREE_INDEX_VERSION' should be incremented,
+   so old index files are not mis-read. */
+#define KDTREE_INDEX_MAGIC   "GALKDTI"
+#define KDTREE_INDEX_ENDIAN  0x0102030405060708
+#define KDTREE_INDEX_VERSION 1
+
+struct kdtree_index_header
+{
+  char          magic[8];  /* 'KDTREE_INDEX_MAGIC' (with its '\0').    */
+  uint64_t        endian;  /* 'KDTREE_INDEX_ENDIAN' in native order.   */
+  uint64_t       version;  /* Version of the format.                   */
+  uint64_t   sizeofsizet;  /* Size of 'size_t' on the writing system.  */
+  uint64_t          ndim;  /* Number of dimensions.                    */
+  uint64_t          size;  /* Number of nodes.                         */
+};
+
+
+
+
+
+/* Return 1 if the given name has the suffix of k-d tree index files. */
+int
+gal_kdtree_name_is_index(char *name)
+{
+  size_t len, slen=strlen(GAL_KDTREE_INDEX_SUFFIX);
+
+  if(name==NULL) return 0;
+  len=strlen(name);
+  return ( len>slen
+           && name[len-slen-1]=='.'
+           && !strcmp(&name[len-slen], GAL_KDTREE_INDEX_SUFFIX) );
+}
+
+
+
+
+
+/* Write 'size' bytes of 'ptr' into the index file. */
+static void
+kdtree_index_fwrite(FILE *fp, void *ptr, size_t size, char *name)
+{
+  errno=0;
+  if( size && fwrite(ptr, 1, size, fp)!=size )
+    error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes", name, size);
+}
+
+
+
+
+
+/* Write the tree into an index file. To avoid using a partially written
+   index (for example if this program is killed or another program reads
+   the index at the same time), it is first written into a temporary file
+   and then renamed. */
+void
+gal_kdtree_save(gal_kdtree_t *tree, char *filename)
+{
+  FILE *fp;
+  char *tmpname;
+  struct kdtree_index_header h;
+
+  /* An empty tree can't be saved (its dimensions are not known). */
+  if(tree==NULL)
+    error(EXIT_FAILURE, 0, "%s: no tree to save in '%s' (the tree is "
+          "empty)", __func__, filename);
+
+  /* Fill the header. */
+  memset(&h, 0, sizeof h);
+  strcpy(h.magic, KDTREE_INDEX_MAGIC);
+  h.endian=KDTREE_INDEX_ENDIAN;
+  h.version=KDTREE_INDEX_VERSION;
+  h.sizeofsizet=sizeof(size_t);
+  h.ndim=tree->ndim;
+  h.size=tree->size;
+
+  /* Open the temporary file. */
+  if( asprintf(&tmpname, "%s.tmp", filename)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  errno=0;
+  fp=fopen(tmpname, "wb");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to write the k-d "
+          "tree index", tmpname);
+
+  /* Write the header and the two arrays. */
+  kdtree_index_fwrite(fp, &h, sizeof h, tmpname);
+  kdtree_index_fwrite(fp, tree->coords->array,
+                      tree->size*tree->ndim*sizeof(double), tmpname);
+  kdtree_index_fwrite(fp, tree->rows->array,
+                      tree->size*sizeof(size_t), tmpname);
+
+  /* Close the file and rename it to the final name. */
+  errno=0;
+  if(fclose(fp))
+    error(EXIT_FAILURE, errno, "%s: couldn't close file after writing "
+          "the k-d tree index", tmpname);
+  errno=0;
+  if( rename(tmpname, filename) )
+    error(EXIT_FAILURE, errno, "%s: couldn't rename to '%s'", tmpname,
+          filename);
+
+  /* Clean up. */
+  free(tmpname);
+}
+
+
+
+
+
+/* Map an index file (written by 'gal_kdtree_save') into memory and
+   return it as a tree. The arrays of the returned tree are within the
+   read-only mapping: the file is only read (by the operating system)
+   when its pages are needed and its pages can be shared between all the
+   programs that use it. The returned tree should be freed with
+   'gal_kdtree_free'. */
+gal_kdtree_t *
+gal_kdtree_load(char *filename)
+{
+  int fd;
+  struct stat st;
+  gal_kdtree_t *tree;
+  size_t dsize[2], size, need;
+  struct kdtree_index_header *h;
+
+  /* Open the file and find its size. */
+  errno=0;
+  fd=open(filename, O_RDONLY);
+  if(fd==-1 || fstat(fd, &st))
+    error(EXIT_FAILURE, errno, "%s: couldn't open the k-d tree index",
+          filename);
+  size=st.st_size;
+  if(size<sizeof *h)
+    error(EXIT_FAILURE, 0, "%s: not a k-d tree index (too small)",
+          filename);
+
+  /* Allocate the tree and map the file into memory. */
+  errno=0;
+  tree=malloc(sizeof *tree);
+  if(tree==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'tree'", __func__, sizeof *tree);
+  tree->mapsize=size;
+  errno=0;
+  tree->map=mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(tree->map==MAP_FAILED)
+    error(EXIT_FAILURE, errno, "%s: couldn't map the k-d tree index "
+          "into memory", filename);
+  close(fd);
+
+  /* Check the header. */
+  h=tree->map;
+  if( memcmp(h->magic, KDTREE_INDEX_MAGIC, sizeof h->magic) )
+    error(EXIT_FAILURE, 0, "%s: not a k-d tree index", filename);
+  if( h->endian!=KDTREE_INDEX_ENDIAN || h->sizeofsizet!=sizeof(size_t) )
+    error(EXIT_FAILURE, 0, "%s: the k-d tree index was written on a "
+          "system with a different byte order or integer size. Please "
+          "build it again on this system", filename);
+  if( h->version!=KDTREE_INDEX_VERSION )
+    error(EXIT_FAILURE, 0, "%s: the k-d tree index has version %"PRIu64
+          ", but this version of Gnuastro can only read version %d. "
+          "Please build it again", filename, h->version,
+          KDTREE_INDEX_VERSION);
+  if( h->ndim==0 || h->size==0
+      || h->ndim > (SIZE_MAX-sizeof(size_t))/sizeof(double)
+      || h->size > (size-sizeof *h)/(h->ndim*sizeof(double)
+                                     +sizeof(size_t)) )
+    error(EXIT_FAILURE, 0, "%s: the k-d tree index is corrupted "
+          "(possibly truncated). Please build it again", filename);
+  need = sizeof *h + h->size*(h->ndim*sizeof(double)+sizeof(size_t));
+  if(need!=size)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree index has %zu bytes, but "
+          "should have %zu bytes. Please build it again", filename,
+          size, need);
+
+  /* Set the arrays within the mapping. */
+  tree->ndim=h->ndim;
+  tree->size=h->size;
+  dsize[0]=tree->size;
+  dsize[1]=tree->ndim;
+  tree->coords=gal_data_alloc((char *)tree->map + sizeof *h,
+                              GAL_TYPE_FLOAT64, 2, dsize, NULL, 0, -1, 1,
+                              "coords", NULL,
+                              "Coordinates of each k-d tree node.");
+  tree->rows=gal_data_alloc((char *)tree->map + sizeof *h
+                            + tree->size*tree->ndim*sizeof(double),
+                            GAL_TYPE_SIZE_T, 1, dsize, NULL, 0, -1, 1,
+                            "rows", "index",
+                            "Input row of each k-d tree node.");
+  return tree;
+}
@@ -22,6 +22,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
@@ -29,7 +30,6 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 
 #include <gnuastro/list.h>
-#include <gnuastro/qsort.h>
 #include <gnuastro/label.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/dimension.h>
@@ -63,6 +63,88 @@ label_check_type(gal_data_t *in, uint8_t needed_type, char *variable,
 
 
 
+/* Sort the indexs by the 32-bit floating point values they point to (in
+   decreasing order when 'min0_max1==1'). NaN values are placed at the
+   end in both cases, similar to 'gal_qsort_index_single_float32_d'.
+
+   This is a stable (so equal values stay in the order of their index)
+   least-significant-digit radix sort on the bits of each float (the sign
+   is flipped so the unsigned integers have the same order as the
+   floats). Unlike 'qsort' with 'gal_qsort_index_single', it doesn't need
+   any global variable, so it can be called on many threads at the same
+   time. The four byte histograms are found in one pass and any byte that
+   is the same in all the values is not sorted. */
+static void
+label_sort_index_float32(float *values, size_t *indexs, size_t size,
+                         int min0_max1)
+{
+  float v;
+  uint8_t byte;
+  size_t i, b, c, sum, count[4][256]={{0}};
+  uint32_t u, *key, *tkey, *tmpk, *kbuf;
+  size_t *ind=indexs, *tind, *tmpi, *ibuf;
+
+  /* Allocate the necessary space. */
+  kbuf=gal_pointer_allocate(GAL_TYPE_UINT32, 2*size, 0, __func__, "kbuf");
+  ibuf=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__, "ibuf");
+  key=kbuf;
+  tkey=kbuf+size;
+  tind=ibuf;
+
+
+  /* Convert the values to sortable unsigned integers and find the
+     histogram of each byte. */
+  for(i=0;i<size;++i)
+    {
+      v=values[indexs[i]];
+      if(isnan(v)) u=UINT32_MAX;
+      else
+        {
+          if(v==0.0f) v=0.0f;   /* So '-0' and '+0' are equal. */
+          memcpy(&u, &v, sizeof u);
+          u = u & 0x80000000 ? ~u : u | 0x80000000;
+          if(min0_max1) u=~u;
+          if(u==UINT32_MAX) u=UINT32_MAX-1; /* Only NaN is the largest. */
+        }
+      key[i]=u;
+      for(b=0;b<4;++b) ++count[b][ (u>>(8*b)) & 0xff ];
+    }
+
+
+  /* Sort over each byte (from the least significant). */
+  for(b=0;b<4;++b)
+    {
+      /* If all the values have the same byte, there is nothing to do. */
+      if( count[b][ (key[0]>>(8*b)) & 0xff ]==size ) continue;
+
+      /* Starting position of each byte value. */
+      for(sum=c=0;c<256;++c) { i=count[b][c]; count[b][c]=sum; sum+=i; }
+
+      /* Put the elements in their place. */
+      for(i=0;i<size;++i)
+        {
+          byte=(key[i]>>(8*b)) & 0xff;
+          tkey[ count[b][byte] ]   = key[i];
+          tind[ count[b][byte]++ ] = ind[i];
+        }
+
+      /* Swap the arrays for the next byte. */
+      tmpk=key; key=tkey; tkey=tmpk;
+      tmpi=ind; ind=tind; tind=tmpi;
+    }
+
+
+  /* If the final order is in the temporary array, copy it into the
+     input, then clean up. */
+  if(ind!=indexs) memcpy(indexs, ind, size*sizeof *indexs);
+  free(kbuf);
+  free(ibuf);
+}
+
+
+
+
+
 
 
 
@@ -187,7 +269,7 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
 
   int hasblank;
   float *arr=values->array;
-  gal_list_sizet_t *Q=NULL, *cleanup=NULL;
+  size_t nq, nc, *Q=NULL, *cleanup=NULL;
   size_t *a, *af, ind, *dsize=values->dsize;
   size_t *dinc=gal_dimension_increment(ndim, dsize);
   int32_t n1, nlab, rlab, curlab=1, *labs=labels->array;
@@ -239,19 +321,13 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
 
 
   /* If the indexs aren't already sorted (by the value they correspond to),
-     sort them given indexs based on their flux ('gal_qsort_index_arr' is
-     defined as static in 'gnuastro/qsort.h') */
+     sort them given indexs based on their flux. The sort doesn't use any
+     global variable, so this function can be called on many threads. */
   if( !( (indexs->flag & GAL_DATA_FLAG_SORT_CH)
         && ( indexs->flag
              & (GAL_DATA_FLAG_SORTED_I
                 | GAL_DATA_FLAG_SORTED_D) ) ) )
-    {
-      gal_qsort_index_single=values->array;
-      qsort(indexs->array, indexs->size, sizeof(size_t),
-            ( min0_max1
-              ? gal_qsort_index_single_float32_d
-              : gal_qsort_index_single_float32_i) );
-    }
+    label_sort_index_float32(arr, indexs->array, indexs->size, min0_max1);
 
 
   /* Initialize the region we want to over-segment. */
@@ -285,24 +361,29 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
             /* Label of first neighbor found. */
             n1=0;
 
-            /* A small sanity check. */
-            if(Q!=NULL || cleanup!=NULL)
-              error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so "
-                    "we can fix this problem. 'Q' and 'cleanup' should be "
-                    "NULL but while checking the equal flux regions they "
-                    "aren't", __func__, PACKAGE_BUGREPORT);
+            /* The queue (used as a stack, last in first out) and the
+               list of pixels to clean up are only allocated once (when
+               the first equal-flux region is found). Every pixel can only
+               be added to them once (after being set to
+               'GAL_LABEL_TMPCHECK') so the number of indexs is enough. */
+            if(Q==NULL)
+              {
+                Q=gal_pointer_allocate(GAL_TYPE_SIZE_T, 2*indexs->size,
+                                       0, __func__, "Q");
+                cleanup=Q+indexs->size;
+              }
 
             /* Add this pixel to a queue. */
-            gal_list_sizet_add(&Q, *a);
-            gal_list_sizet_add(&cleanup, *a);
+            nq=nc=0;
+            Q[nq++]=cleanup[nc++]=*a;
             labs[*a] = GAL_LABEL_TMPCHECK;
 
             /* Find all the pixels that have the same flux and are
                connected. */
-            while(Q!=NULL)
+            while(nq)
               {
                 /* Pop an element from the queue. */
-                ind=gal_list_sizet_pop(&Q);
+                ind=Q[--nq];
 
                 /* Look at the neighbors and see if we already have a
                    label. */
@@ -324,8 +405,7 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
                              if( nlab==GAL_LABEL_INIT && arr[nind]==arr[*a] )
                                {
                                  labs[nind]=GAL_LABEL_TMPCHECK;
-                                 gal_list_sizet_add(&Q, nind);
-                                 gal_list_sizet_add(&cleanup, nind);
+                                 Q[nq++]=cleanup[nc++]=nind;
                                }
                              else
                                n1=( nlab>0
@@ -384,9 +464,9 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
             /* Give the same label to the whole connected equal flux
                region, except those that might have been on the side of
                the image and were a river pixel. */
-            while(cleanup!=NULL)
+            while(nc)
               {
-                ind=gal_list_sizet_pop(&cleanup);
+                ind=cleanup[--nc];
                 /* If it was on the sides of the image, it has been
                    changed to a river pixel. */
                 if( labs[ ind ]==GAL_LABEL_TMPCHECK ) labs[ ind ]=rlab;
@@ -502,6 +582,7 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
 
   /* Clean up. */
   free(dinc);
+  if(Q) free(Q);
 
   /* Return the total number of clumps. */
   return curlab-1;
@@ -44,6 +44,169 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/****************************************************************
+ *****************     Arena of list nodes   ********************
+ ****************************************************************/
+/* When many nodes are added and removed (for example in a breadth-first
+   search over the pixels of an image), allocating and freeing each node
+   independently can take a large fraction of the processing time. An
+   arena allocates the nodes in blocks of 'blocksize' nodes, removed nodes
+   are kept in a 'freelist' to be used again and all the nodes are freed
+   together with 'gal_list_arena_free'. The first pointer in each block
+   points to the previous block and the nodes come after it. An arena
+   should only be used by one thread. */
+gal_list_arena_t *
+gal_list_arena_alloc(size_t nodesize, size_t blocksize)
+{
+  gal_list_arena_t *arena;
+
+  /* Allocate the arena. */
+  errno=0;
+  arena=malloc(sizeof *arena);
+  if(arena==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'arena'",
+          __func__, sizeof *arena);
+
+  /* Each node should be able to keep a pointer (when it is in the free
+     list) and the nodes should be aligned to pointers. */
+  if(nodesize<sizeof(void *)) nodesize=sizeof(void *);
+  nodesize = (nodesize+sizeof(void *)-1)/sizeof(void *)*sizeof(void *);
+
+  /* Initialize the arena (no block is allocated until the first node is
+     requested). */
+  arena->nodesize=nodesize;
+  arena->blocksize = blocksize ? blocksize : GAL_LIST_ARENA_BLOCKSIZE;
+  arena->used=arena->blocksize;
+  arena->current=arena->freelist=arena->blocks=NULL;
+  return arena;
+}
+
+
+
+
+
+/* Return a node from the arena (its contents are not initialized). */
+void *
+gal_list_arena_node(gal_list_arena_t *arena)
+{
+  void *node, **block;
+
+  /* If a node has been returned to the arena, use it. */
+  if(arena->freelist)
+    {
+      node=arena->freelist;
+      arena->freelist=*(void **)node;
+      return node;
+    }
+
+  /* If the newest block is full, allocate a new one. */
+  if(arena->used==arena->blocksize)
+    {
+      errno=0;
+      block=malloc( sizeof *block + arena->nodesize*arena->blocksize );
+      if(block==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating a block of %zu nodes",
+              __func__, arena->blocksize);
+      *block=arena->blocks;
+      arena->blocks=block;
+      arena->current=block+1;
+      arena->used=0;
+    }
+
+  /* Return the next node in the newest block. */
+  return (char *)(arena->current) + arena->nodesize * arena->used++;
+}
+
+
+
+
+
+/* Put a node back into the arena (so it can be used again). */
+void
+gal_list_arena_return(gal_list_arena_t *arena, void *node)
+{
+  *(void **)node=arena->freelist;
+  arena->freelist=node;
+}
+
+
+
+
+
+/* Free all the nodes that were taken from the arena and the arena
+   itself. */
+void
+gal_list_arena_free(gal_list_arena_t *arena)
+{
+  void **block, *prev;
+
+  if(arena==NULL) return;
+  for(block=arena->blocks; block!=NULL; block=prev)
+    {
+      prev=*block;
+      free(block);
+    }
+  free(arena);
+}
+
+
+
+
+
+/* Allocate a new node for the list functions: from the arena if it is
+   given, otherwise with 'malloc'. */
+static void *
+list_node_alloc(gal_list_arena_t *arena, size_t size, const char *func)
+{
+  void *node;
+
+  /* Take the node from the arena. */
+  if(arena)
+    {
+      if(arena->nodesize<size)
+        error(EXIT_FAILURE, 0, "%s: the arena's nodes are %zu bytes, but "
+              "%zu bytes are necessary", func, arena->nodesize, size);
+      return gal_list_arena_node(arena);
+    }
+
+  /* Allocate the node. */
+  errno=0;
+  node=malloc(size);
+  if(node==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating new node", func);
+  return node;
+}
+
+
+
+
+
+static void
+list_node_free(gal_list_arena_t *arena, void *node)
+{
+  if(arena) gal_list_arena_return(arena, node);
+  else      free(node);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /****************************************************************
  *****************           String          ********************
  ****************************************************************/
@@ -450,13 +613,23 @@ gal_list_i32_free(gal_list_i32_t *list)
  ****************************************************************/
 void
 gal_list_sizet_add(gal_list_sizet_t **list, size_t value)
+{
+  gal_list_sizet_add_arena(list, value, NULL);
+}
+
+
+
+
+
+/* Similar to 'gal_list_sizet_add', but take the node from 'arena' (when
+   it isn't NULL). */
+void
+gal_list_sizet_add_arena(gal_list_sizet_t **list, size_t value,
+                         gal_list_arena_t *arena)
 {
   gal_list_sizet_t *newnode;
 
-  errno=0;
-  newnode=malloc(sizeof *newnode);
-  if(newnode==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating new node", __func__);
+  newnode=list_node_alloc(arena, sizeof *newnode, __func__);
 
   newnode->v=value;
   newnode->next=*list;
@@ -469,6 +642,16 @@ gal_list_sizet_add(gal_list_sizet_t **list, size_t value)
 
 size_t
 gal_list_sizet_pop(gal_list_sizet_t **list)
+{
+  return gal_list_sizet_pop_arena(list, NULL);
+}
+
+
+
+
+
+size_t
+gal_list_sizet_pop_arena(gal_list_sizet_t **list, gal_list_arena_t *arena)
 {
   gal_list_sizet_t *tmp;
   size_t out=GAL_BLANK_SIZE_T;
@@ -478,7 +661,7 @@ gal_list_sizet_pop(gal_list_sizet_t **list)
       tmp=*list;
       out=tmp->v;
       *list=tmp->next;
-      free(tmp);
+      list_node_free(arena, tmp);
     }
   return out;
 }
@@ -995,13 +1178,21 @@ gal_list_f64_free(gal_list_f64_t *list)
  ****************************************************************/
 void
 gal_list_void_add(gal_list_void_t **list, void *value)
+{
+  gal_list_void_add_arena(list, value, NULL);
+}
+
+
+
+
+
+void
+gal_list_void_add_arena(gal_list_void_t **list, void *value,
+                        gal_list_arena_t *arena)
 {
   gal_list_void_t *newnode;
 
-  errno=0;
-  newnode=malloc(sizeof *newnode);
-  if(newnode==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating new node", __func__);
+  newnode=list_node_alloc(arena, sizeof *newnode, __func__);
 
   newnode->v=value;
   newnode->next=*list;
@@ -1014,6 +1205,16 @@ gal_list_void_add(gal_list_void_t **list, void *value)
 
 void *
 gal_list_void_pop(gal_list_void_t **list)
+{
+  return gal_list_void_pop_arena(list, NULL);
+}
+
+
+
+
+
+void *
+gal_list_void_pop_arena(gal_list_void_t **list, gal_list_arena_t *arena)
 {
   void *out=NULL;
   gal_list_void_t *tmp;
@@ -1023,7 +1224,7 @@ gal_list_void_pop(gal_list_void_t **list)
       tmp=*list;
       out=tmp->v;
       *list=tmp->next;
-      free(tmp);
+      list_node_free(arena, tmp);
     }
   return out;
 }
@@ -1122,13 +1323,21 @@ each node. The top element should always have the smallest radius. */
 void
 gal_list_osizet_add(gal_list_osizet_t **list,
                     size_t value, float tosort)
+{
+  gal_list_osizet_add_arena(list, value, tosort, NULL);
+}
+
+
+
+
+
+void
+gal_list_osizet_add_arena(gal_list_osizet_t **list, size_t value,
+                          float tosort, gal_list_arena_t *arena)
 {
   gal_list_osizet_t *newnode, *tmp=*list, *prev=NULL;
 
-  errno=0;
-  newnode=malloc(sizeof *newnode);
-  if(newnode==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating new node", __func__);
+  newnode=list_node_alloc(arena, sizeof *newnode, __func__);
 
   newnode->v=value;
   newnode->s=tosort;
@@ -1164,6 +1373,17 @@ gal_list_osizet_add(gal_list_osizet_t **list,
 /* Note that the popped element is the smallest! */
 size_t
 gal_list_osizet_pop(gal_list_osizet_t **list, float *sortvalue)
+{
+  return gal_list_osizet_pop_arena(list, sortvalue, NULL);
+}
+
+
+
+
+
+size_t
+gal_list_osizet_pop_arena(gal_list_osizet_t **list, float *sortvalue,
+                          gal_list_arena_t *arena)
 {
   size_t value;
   gal_list_osizet_t *tmp=*list;
@@ -1173,7 +1393,7 @@ gal_list_osizet_pop(gal_list_osizet_t **list, float *sortvalue)
       value=tmp->v;
       *sortvalue=tmp->s;
       *list=tmp->next;
-      free(tmp);
+      list_node_free(arena, tmp);
     }
   else
     {
@@ -1240,13 +1460,22 @@ gal_list_osizet_to_sizet_free(gal_list_osizet_t *in,
 void
 gal_list_dosizet_add(gal_list_dosizet_t **largest,
                      gal_list_dosizet_t **smallest, size_t value, float tosort)
+{
+  gal_list_dosizet_add_arena(largest, smallest, value, tosort, NULL);
+}
+
+
+
+
+
+void
+gal_list_dosizet_add_arena(gal_list_dosizet_t **largest,
+                           gal_list_dosizet_t **smallest, size_t value,
+                           float tosort, gal_list_arena_t *arena)
 {
   gal_list_dosizet_t *newnode, *tmp=*largest;
 
-  errno=0;
-  newnode=malloc(sizeof *newnode);
-  if(newnode==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating new node", __func__);
+  newnode=list_node_alloc(arena, sizeof *newnode, __func__);
 
   newnode->v=value;
   newnode->s=tosort;
@@ -1294,6 +1523,19 @@ gal_list_dosizet_add(gal_list_dosizet_t **largest,
 size_t
 gal_list_dosizet_pop_smallest(gal_list_dosizet_t **largest,
                               gal_list_dosizet_t **smallest, float *tosort)
+{
+  return gal_list_dosizet_pop_smallest_arena(largest, smallest, tosort,
+                                             NULL);
+}
+
+
+
+
+
+size_t
+gal_list_dosizet_pop_smallest_arena(gal_list_dosizet_t **largest,
+                                    gal_list_dosizet_t **smallest,
+                                    float *tosort, gal_list_arena_t *arena)
 {
   size_t value;
   gal_list_dosizet_t *tmp=*smallest;
@@ -1304,7 +1546,7 @@ gal_list_dosizet_pop_smallest(gal_list_dosizet_t **largest,
       *tosort=tmp->s;
 
       *smallest=tmp->prev;
-      free(tmp);
+      list_node_free(arena, tmp);
       if(*smallest)
         (*smallest)->next=NULL;
       else
@@ -1380,3 +1380,161 @@ gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
   gal_list_data_free(p.Aexist);
   return out;
 }
+
+
+
+
+
+/* Parameters of matching with a tree that is already built. */
+struct match_prebuilt_params
+{
+  gal_kdtree_t        *tree;  /* k-d tree of the first coordinates.   */
+  gal_data_t             *B;  /* 2nd coordinate list of 'gal_data_t's */
+  size_t               ndim;  /* The number of dimensions.            */
+  double          *aperture;  /* Acceptable aperture for match.       */
+  int              iscircle;  /* If the aperture is circular.         */
+  double               c[3];  /* Fixed cos(), for elliptical dist.    */
+  double               s[3];  /* Fixed sin(), for elliptical dist.    */
+  double              *b[3];  /* Direct pointers to column arrays.    */
+  size_t              *ainb;  /* Matched first row of each second row.*/
+  float                  *r;  /* Distance of each match.              */
+};
+
+
+
+
+
+/* Find the match of each row of the second catalog. Since the search for
+   the nearest node is bounded by the aperture's largest axis (no point
+   within the aperture can be farther), a non-match is also found quickly,
+   so unlike 'match_kdtree_worker', the coverage of the first catalog
+   isn't needed. */
+static void *
+match_kdtree_prebuilt_worker(void *in_prm)
+{
+  /* Low-level definitions to be done first. */
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_prebuilt_params *p;
+
+  /* High level definitions. */
+  size_t i, j, bi, node, *rows;
+  double r, dist, delta[3], point[3], *nc, *coords;
+
+  /* Set the parameters. */
+  p=(struct match_prebuilt_params *)tprm->params;
+  rows=p->tree->rows->array;
+  coords=p->tree->coords->array;
+
+  /* Go over all the rows in the second catalog that were assigned to this
+     thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      bi = tprm->indexs[i];
+      p->ainb[bi]=GAL_BLANK_SIZE_T;
+
+      /* Find the nearest node of the tree to this point. */
+      for(j=0;j<p->ndim;++j) point[j]=p->b[j][bi];
+      node=gal_kdtree_nearest(p->tree, point, p->aperture[0], &dist);
+
+      /* Make sure the matched point is within the given aperture (which
+         may be elliptical). */
+      if(node!=GAL_BLANK_SIZE_T)
+        {
+          nc=coords+node*p->ndim;
+          for(j=0;j<p->ndim;++j) delta[j]=point[j]-nc[j];
+          r=match_distance(delta, p->iscircle, p->ndim, p->aperture,
+                           p->c, p->s);
+          if(r<p->aperture[0]) { p->ainb[bi]=rows[node]; p->r[bi]=r; }
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Match 'coord2' with a k-d tree of the first catalog that is already
+   built with 'gal_kdtree_build' (or loaded from an index file with
+   'gal_kdtree_load'). The coordinates of the first catalog are taken
+   from the tree, so they don't need to be read. The output has the same
+   format as 'gal_match_kdtree'. */
+gal_data_t *
+gal_match_kdtree_prebuilt(gal_kdtree_t *tree, gal_data_t *coord2,
+                          double *aperture, size_t numthreads,
+                          size_t minmapsize, int quietmmap,
+                          size_t *nummatched)
+{
+  gal_data_t *tmp, *out=NULL;
+  struct match_sfll **bina;
+  struct match_prebuilt_params p;
+  double *a[3], dist[3]; /* Place-holders in 'aperture_prepare'. */
+  size_t bi;
+
+  /* In case the 'k-d' tree is empty, just return a NULL pointer and the
+     number of matches to zero. */
+  if(tree==NULL) { *nummatched=0; return NULL; }
+
+  /* Basic sanity checks. */
+  p.ndim=gal_list_data_number(coord2);
+  if(p.ndim!=tree->ndim)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree has %zu dimensions, but "
+          "'coord2' has %zu nodes/columns (elements in a simply linked "
+          "list)", __func__, tree->ndim, p.ndim);
+  if(p.ndim>3)
+    error(EXIT_FAILURE, 0, "%s: %zu dimensional matches are not "
+          "currently supported (maximum is 3 dimensions)", __func__,
+          p.ndim);
+  for(tmp=coord2; tmp!=NULL; tmp=tmp->next)
+    if( tmp->type!=GAL_TYPE_FLOAT64 )
+      error(EXIT_FAILURE, 0, "%s: the type of all columns in 'coord2' "
+            "should be 'double', but at least one of them is '%s'",
+            __func__, gal_type_name(tmp->type, 1));
+
+  /* Prepare the aperture-related checks (the first coordinates are in
+     the tree, so the second are also given in place of the first). */
+  p.tree=tree;
+  p.B=coord2;
+  p.aperture=aperture;
+  match_aperture_prepare(coord2, coord2, aperture, p.ndim, a, p.b, dist,
+                         p.c, p.s, &p.iscircle);
+
+  /* Find the match of every row of the second catalog. */
+  p.ainb=gal_pointer_allocate(GAL_TYPE_SIZE_T, coord2->size, 0, __func__,
+                              "p.ainb");
+  p.r=gal_pointer_allocate(GAL_TYPE_FLOAT32, coord2->size, 0, __func__,
+                           "p.r");
+  gal_threads_spin_off(match_kdtree_prebuilt_worker, &p, coord2->size,
+                       numthreads, minmapsize, quietmmap);
+
+  /* Put the matches in the array of lists (one element for each row of
+     the first catalog), this is done after the threads to avoid them
+     writing into the same list. */
+  errno=0;
+  bina=calloc(tree->size, sizeof *bina);
+  if(bina==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'bina'",
+          __func__, tree->size*sizeof *bina);
+  for(bi=0;bi<coord2->size;++bi)
+    if(p.ainb[bi]!=GAL_BLANK_SIZE_T)
+      match_add_to_sfll(&bina[p.ainb[bi]], bi, p.r[bi]);
+
+  /* Find the best match for each item (from possibly multiple matches)
+     and write the output ('tree->rows' has one element for each row of
+     the first catalog). */
+  match_rearrange(tree->rows, coord2, bina);
+  out=match_output(tree->rows, coord2, NULL, NULL, bina, minmapsize,
+                   quietmmap);
+
+  /* Set 'nummatched' and return output. */
+  *nummatched = out ?  out->next->next->size : 0;
+
+  /* Clean up and return. */
+  free(bina);
+  free(p.r);
+  free(p.ainb);
+  return out;
+}
@@ -28,6 +28,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <regex.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <gnuastro/git.h>
 #include <gnuastro/txt.h>
@@ -37,6 +38,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/checkset.h>
+#include <gnuastro-internal/tablecache.h>
 #include <gnuastro-internal/tableintern.h>
 
 
@@ -100,9 +102,9 @@ gal_table_displayflt_to_str(uint8_t fmt)
 
    See the DESCRIPTION OF THIS FUNCTION IN THE BOOK FOR a detailed listing
    of the output's elements. */
-gal_data_t *
-gal_table_info(char *filename, char *hdu, gal_list_str_t *lines,
-               size_t *numcols, size_t *numrows, int *tableformat)
+static gal_data_t *
+table_info_nocache(char *filename, char *hdu, gal_list_str_t *lines,
+                   size_t *numcols, size_t *numrows, int *tableformat)
 {
   /* Get the table format and size (number of columns and rows). */
   if(filename && gal_fits_file_recognized(filename))
@@ -124,6 +126,55 @@ gal_table_info(char *filename, char *hdu, gal_list_str_t *lines,
 
 
 
+/* If the table is a file with a usable cache (see
+   'gal_table_cache_write'), return the name of the cache (which should be
+   freed), otherwise return NULL. */
+static char *
+table_cache_name(char *filename, char *hdu, gal_list_str_t *lines)
+{
+  return ( filename && lines==NULL
+           ? gal_tablecache_usable(filename, hdu)
+           : NULL );
+}
+
+
+
+
+
+/* Get the column information (from the cache if 'cachename!=NULL'). */
+static gal_data_t *
+table_info_cache(char *cachename, char *filename, char *hdu,
+                 gal_list_str_t *lines, size_t *numcols, size_t *numrows,
+                 int *tableformat)
+{
+  return ( cachename
+           ? gal_tablecache_info(cachename, numcols, numrows, tableformat)
+           : table_info_nocache(filename, hdu, lines, numcols, numrows,
+                                tableformat) );
+}
+
+
+
+
+
+gal_data_t *
+gal_table_info(char *filename, char *hdu, gal_list_str_t *lines,
+               size_t *numcols, size_t *numrows, int *tableformat)
+{
+  gal_data_t *out;
+  char *cachename=table_cache_name(filename, hdu, lines);
+
+  /* Read the information and return. */
+  out=table_info_cache(cachename, filename, hdu, lines, numcols, numrows,
+                       tableformat);
+  free(cachename);
+  return out;
+}
+
+
+
+
+
 void
 gal_table_print_info(gal_data_t *allcols, size_t numcols, size_t numrows)
 {
@@ -489,13 +540,14 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
   gal_list_sizet_t *indexll;
   size_t i, numcols, numrows;
   gal_data_t *allcols, *out=NULL;
+  char *cachename=table_cache_name(filename, hdu, lines);
 
   /* First get the information of all the columns. */
-  allcols=gal_table_info(filename, hdu, lines, &numcols, &numrows,
-                         &tableformat);
+  allcols=table_info_cache(cachename, filename, hdu, lines, &numcols,
+                           &numrows, &tableformat);
 
   /* If there was no actual data in the file, then return NULL. */
-  if(allcols==NULL) return NULL;
+  if(allcols==NULL) { free(cachename); return NULL; }
 
   /* Get the list of indexs in the same order as the input list. */
   indexll=gal_table_list_of_indexs(cols, allcols, numcols, searchin,
@@ -503,12 +555,17 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
 
   /* Depending on the table format, read the columns into the output
      structure. Also note that after these functions, the 'indexll' will be
-     all freed (each popped element is actually freed).*/
-  switch(tableformat)
+     all freed (each popped element is actually freed). When a cache
+     exists, the format of the original table is irrelevant.*/
+  if(cachename)
+    out=gal_tablecache_read(cachename, indexll, 0, numrows, NULL,
+                            minmapsize, quietmmap);
+  else switch(tableformat)
     {
     case GAL_TABLE_FORMAT_TXT:
-      out=gal_txt_table_read(filename, lines, numrows, allcols, indexll,
-                             minmapsize, quietmmap);
+      out=gal_txt_table_read_parallel(filename, lines, numrows, allcols,
+                                      indexll, numthreads, minmapsize,
+                                      quietmmap);
       break;
 
     case GAL_TABLE_FORMAT_AFITS:
@@ -526,6 +583,7 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
   for(i=0;i<numcols;++i)
     gal_data_free_contents(&allcols[i]);
   free(allcols);
+  free(cachename);
   gal_list_sizet_free(indexll);
 
   /* Return the final linked list. */
@@ -536,6 +594,221 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *lines,
 
 
 
+/* Similar to 'gal_table_read', but only read 'numrows' rows, starting from
+   row 'rowstart' (counting from 0). If the table has less rows than
+   'rowstart+numrows', only the available rows will be read. This is only
+   implemented for FITS tables (where CFITSIO can directly jump to the
+   desired row) or tables with a cache (see 'gal_table_cache_write'), so
+   large tables can be read (and processed) in separate chunks. */
+gal_data_t *
+gal_table_read_rows(char *filename, char *hdu, gal_list_str_t *cols,
+                    size_t rowstart, size_t numrows, int searchin,
+                    int ignorecase, size_t numthreads, size_t minmapsize,
+                    int quietmmap, size_t *colmatch)
+{
+  int tableformat;
+  gal_data_t *allcols, *out;
+  gal_list_sizet_t *indexll;
+  size_t i, numcols, tabrows;
+  char *cachename=table_cache_name(filename, hdu, NULL);
+
+  /* First get the information of all the columns. */
+  allcols=table_info_cache(cachename, filename, hdu, NULL, &numcols,
+                           &tabrows, &tableformat);
+  if(allcols==NULL) { free(cachename); return NULL; }
+
+  /* Reading a range of rows is currently only possible in FITS tables
+     (or tables with a cache). */
+  if(cachename==NULL
+     && tableformat!=GAL_TABLE_FORMAT_AFITS
+     && tableformat!=GAL_TABLE_FORMAT_BFITS)
+    error(EXIT_FAILURE, 0, "%s: %s: reading a range of rows is currently "
+          "only possible for FITS tables (or tables with a cache, see "
+          "'gal_table_cache_write')", __func__, filename);
+
+  /* Correct the number of rows to read (if necessary). */
+  if(rowstart>=tabrows) numrows=0;
+  else if(rowstart+numrows>tabrows) numrows=tabrows-rowstart;
+
+  /* Get the list of indexs in the same order as the input list and read
+     the desired rows. */
+  indexll=gal_table_list_of_indexs(cols, allcols, numcols, searchin,
+                                   ignorecase, filename, hdu, colmatch);
+  out = ( cachename
+          ? gal_tablecache_read(cachename, indexll, numrows ? rowstart : 0,
+                                numrows, NULL, minmapsize, quietmmap)
+          : gal_fits_tab_read_rows(filename, hdu, numrows ? rowstart : 0,
+                                   numrows, allcols, indexll, numthreads,
+                                   minmapsize, quietmmap) );
+
+  /* Clean up and return. */
+  for(i=0;i<numcols;++i)
+    gal_data_free_contents(&allcols[i]);
+  free(allcols);
+  free(cachename);
+  gal_list_sizet_free(indexll);
+  return out;
+}
+
+
+
+
+
+/* Only read the given rows ('rowids' is a sorted 'size_t' dataset, with
+   row IDs counting from 0) of the requested columns. */
+gal_data_t *
+gal_table_read_rowids(char *filename, char *hdu, gal_list_str_t *cols,
+                      gal_data_t *rowids, int searchin, int ignorecase,
+                      size_t numthreads, size_t minmapsize, int quietmmap,
+                      size_t *colmatch)
+{
+  int tableformat;
+  gal_data_t *allcols, *out;
+  gal_list_sizet_t *indexll;
+  size_t i, numcols, tabrows, *ids=rowids->array;
+  char *cachename=table_cache_name(filename, hdu, NULL);
+
+  /* First get the information of all the columns. */
+  allcols=table_info_cache(cachename, filename, hdu, NULL, &numcols,
+                           &tabrows, &tableformat);
+  if(allcols==NULL) { free(cachename); return NULL; }
+
+  /* Reading specific rows is currently only possible in FITS tables (or
+     tables with a cache). */
+  if(cachename==NULL
+     && tableformat!=GAL_TABLE_FORMAT_AFITS
+     && tableformat!=GAL_TABLE_FORMAT_BFITS)
+    error(EXIT_FAILURE, 0, "%s: %s: reading specific rows is currently "
+          "only possible for FITS tables (or tables with a cache, see "
+          "'gal_table_cache_write')", __func__, filename);
+
+  /* Make sure the row IDs are sorted and within the table. */
+  if(rowids->type!=GAL_TYPE_SIZE_T)
+    error(EXIT_FAILURE, 0, "%s: the 'rowids' dataset should have a "
+          "'size_t' type", __func__);
+  for(i=0;i<rowids->size;++i)
+    if( ids[i]>=tabrows || (i && ids[i]<=ids[i-1]) )
+      error(EXIT_FAILURE, 0, "%s: the row IDs should be unique, sorted "
+            "in increasing order and less than the number of rows in "
+            "the table (%zu)", __func__, tabrows);
+
+  /* Get the list of indexs in the same order as the input list and read
+     the desired rows. */
+  indexll=gal_table_list_of_indexs(cols, allcols, numcols, searchin,
+                                   ignorecase, filename, hdu, colmatch);
+  out = ( cachename
+          ? gal_tablecache_read(cachename, indexll, 0, rowids->size, ids,
+                                minmapsize, quietmmap)
+          : gal_fits_tab_read_rowids(filename, hdu, rowids, allcols,
+                                     indexll, numthreads, minmapsize,
+                                     quietmmap) );
+
+  /* Clean up and return. */
+  for(i=0;i<numcols;++i)
+    gal_data_free_contents(&allcols[i]);
+  free(allcols);
+  free(cachename);
+  gal_list_sizet_free(indexll);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/************************************************************************/
+/***************               Table cache                ***************/
+/************************************************************************/
+/* Write (or over-write) a columnar binary cache of the given table beside
+   it (with a '.gtc' suffix). Once the cache exists (and is newer than the
+   table), it will be used in all the reading functions above: the columns
+   are read directly from the memory-mapped cache without any parsing. It
+   also keeps the minimum and maximum of each block of rows in numeric
+   columns, to skip full blocks in a range selection. */
+void
+gal_table_cache_write(char *filename, char *hdu, size_t numthreads,
+                      size_t minmapsize, int quietmmap)
+{
+  int tableformat;
+  char *cachename;
+  struct stat source;
+  size_t i, numcols, numrows;
+  gal_list_sizet_t *indexll=NULL;
+  gal_data_t *allcols, *cols=NULL;
+
+  /* A cache is only relevant for files. */
+  if(filename==NULL)
+    error(EXIT_FAILURE, 0, "%s: a cache can only be written for tables "
+          "in a file", __func__);
+
+  /* The size and modification time of the table are necessary to check
+     if the cache is usable later. They are found before reading the
+     table, so a change during the reading will make the cache unusable.
+  */
+  errno=0;
+  if( stat(filename, &source) )
+    error(EXIT_FAILURE, errno, "%s", filename);
+
+  /* Get the information of the original table (the cache may be out of
+     date). If the table has no columns, there is nothing to cache. */
+  allcols=table_info_nocache(filename, hdu, NULL, &numcols, &numrows,
+                             &tableformat);
+  if(allcols==NULL) return;
+
+  /* Read all the columns of the original table. */
+  for(i=numcols;i>0;--i) gal_list_sizet_add(&indexll, i-1);
+  switch(tableformat)
+    {
+    case GAL_TABLE_FORMAT_TXT:
+      cols=gal_txt_table_read_parallel(filename, NULL, numrows, allcols,
+                                       indexll, numthreads, minmapsize,
+                                       quietmmap);
+      break;
+
+    case GAL_TABLE_FORMAT_AFITS:
+    case GAL_TABLE_FORMAT_BFITS:
+      cols=gal_fits_tab_read(filename, hdu, numrows, allcols, indexll,
+                             numthreads, minmapsize, quietmmap);
+      break;
+
+    default:
+      error(EXIT_FAILURE, 0, "%s: table format code %d not recognized for "
+            "'tableformat'", __func__, tableformat);
+    }
+
+  /* Write the cache. */
+  cachename=gal_tablecache_name(filename, hdu);
+  gal_tablecache_write(cachename, &source, allcols, numcols, numrows,
+                       tableformat, cols);
+
+  /* Clean up. */
+  for(i=0;i<numcols;++i)
+    gal_data_free_contents(&allcols[i]);
+  free(allcols);
+  free(cachename);
+  gal_list_data_free(cols);
+  gal_list_sizet_free(indexll);
+}
+
+
+
+
+
 
 
 
@@ -595,6 +868,22 @@ void
 gal_table_write(gal_data_t *cols, struct gal_fits_list_key_t **keylist,
                 gal_list_str_t *comments, int tableformat, char *filename,
                 char *extname, uint8_t colinfoinstdout)
+{
+  gal_table_write_parallel(cols, keylist, comments, tableformat, filename,
+                           extname, colinfoinstdout, 1);
+}
+
+
+
+
+
+/* Similar to 'gal_table_write', but on 'numthreads' threads. */
+void
+gal_table_write_parallel(gal_data_t *cols,
+                         struct gal_fits_list_key_t **keylist,
+                         gal_list_str_t *comments, int tableformat,
+                         char *filename, char *extname,
+                         uint8_t colinfoinstdout, size_t numthreads)
 {
   /* If a filename was given, then the tableformat is relevant and must be
      used. When the filename is empty, a text table must be printed on the
@@ -605,12 +894,30 @@ gal_table_write(gal_data_t *cols, struct gal_fits_list_key_t **keylist,
         gal_fits_tab_write(cols, comments, tableformat, filename, extname,
                            keylist);
       else
-        gal_txt_write(cols, keylist, comments, filename,
-                      colinfoinstdout, 0);
+        gal_txt_write_parallel(cols, keylist, comments, filename,
+                               colinfoinstdout, 0, numthreads);
     }
   else
     /* Write to standard output. */
-    gal_txt_write(cols, keylist, comments, filename, colinfoinstdout, 0);
+    gal_txt_write_parallel(cols, keylist, comments, filename,
+                           colinfoinstdout, 0, numthreads);
+}
+
+
+
+
+
+/* Append the rows of 'cols' to the end of the table that was previously
+   written into 'filename' with 'gal_table_write' (in a FITS file, the last
+   HDU is used). When 'filename==NULL', the rows are printed on the
+   standard output without any metadata. */
+void
+gal_table_write_append(gal_data_t *cols, char *filename)
+{
+  if(filename && gal_fits_name_is_fits(filename))
+    gal_fits_tab_write_append(cols, filename, NULL);
+  else
+    gal_txt_write_append(cols, filename);
 }
 
 
@@ -0,0 +1,775 @@
+/*********************************************************************
+tablecache -- Columnar binary cache of tables.
+This is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stat-time.h>
+
+#include <gnuastro/data.h>
+#include <gnuastro/fits.h>
+#include <gnuastro/blank.h>
+#include <gnuastro/pointer.h>
+
+#include <gnuastro-internal/checkset.h>
+#include <gnuastro-internal/tablecache.h>
+
+
+
+
+
+/* The cache file is a native-endian binary file that is designed to be
+   memory-mapped. All the elements (and the start of each section) are
+   aligned to 8 bytes:
+
+     1. The header ('struct tablecache_header').
+     2. One fixed-size descriptor for each column ('struct
+        tablecache_col').
+     3. The name, unit and comment of each column (each terminated by a
+        '\0').
+     4. The contents of each column, contiguous in memory: for numeric
+        columns this is the raw array. For string columns, it is an array
+        of 'uint64_t' offsets (one for each row) followed by the strings
+        (each terminated by a '\0').
+     5. For one-dimensional numeric columns, the minimum and maximum
+        (as 'double') of every 'blocksize' rows (blank values are
+        ignored). These allow skipping full blocks of rows in a range
+        selection.
+
+   The 'endian' element of the header is used to reject caches that were
+   written on a machine with a different byte order. The size and
+   modification time (with nanoseconds) of the original table when it was
+   read are also kept in the header: the cache is only used when they are
+   exactly equal to those of the table. */
+#define TABLECACHE_MAGIC   "GALTBLC"
+#define TABLECACHE_ENDIAN  0x0102030405060708
+#define TABLECACHE_VERSION 2
+
+struct tablecache_header
+{
+  char          magic[8];  /* 'TABLECACHE_MAGIC' (with its '\0').      */
+  uint64_t        endian;  /* 'TABLECACHE_ENDIAN' in native order.     */
+  uint64_t       version;  /* Version of the format.                   */
+  uint64_t   tableformat;  /* Format of the original table.            */
+  uint64_t       numcols;  /* Number of columns.                       */
+  uint64_t       numrows;  /* Number of rows.                          */
+  uint64_t     blocksize;  /* Number of rows in each statistics block. */
+  uint64_t       nblocks;  /* Number of statistics blocks.             */
+  uint64_t       srcsize;  /* Size of original table (in bytes).       */
+  int64_t       srcmtime;  /* Modification time of table (seconds).    */
+  int64_t      srcmtimen;  /* Nanoseconds of modification time.        */
+};
+
+struct tablecache_col
+{
+  uint64_t          type;  /* Gnuastro type of the column.             */
+  uint64_t        repeat;  /* Repeat (the 'minmapsize' of info).       */
+  uint64_t          ndim;  /* Number of dimensions when read.          */
+  uint64_t          flag;  /* Flags of the column information.         */
+  int64_t        infofmt;  /* 'disp_fmt' of column information.        */
+  int64_t      infowidth;  /* 'disp_width' of column information.      */
+  int64_t       infoprec;  /* 'disp_precision' of column information.  */
+  int64_t        readfmt;  /* 'disp_fmt' of read column.               */
+  int64_t      readwidth;  /* 'disp_width' of read column.             */
+  int64_t       readprec;  /* 'disp_precision' of read column.         */
+  uint64_t     stroffset;  /* Offset to name, unit and comment.        */
+  uint64_t       namelen;  /* Length of name (with '\0', 0 if NULL).   */
+  uint64_t       unitlen;  /* Length of unit (with '\0', 0 if NULL).   */
+  uint64_t    commentlen;  /* Length of comment (with '\0', or 0).     */
+  uint64_t    dataoffset;  /* Offset to the column's contents.         */
+  uint64_t      datasize;  /* Number of bytes in the contents.         */
+  uint64_t   statsoffset;  /* Offset to block statistics (or 0).       */
+};
+
+/* A memory-mapped cache file. */
+struct tablecache_map
+{
+  char                      *name;  /* Name of cache file.             */
+  char                      *base;  /* Start of the mapped file.       */
+  size_t                     size;  /* Size of the mapped file.        */
+  struct tablecache_header *head;   /* Header of the file.             */
+  struct tablecache_col    *cols;   /* Column descriptors.             */
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***********************************************************************/
+/**************             Basic operations            ****************/
+/***********************************************************************/
+/* Name of the cache file of the given table. For FITS files, the HDU is
+   also necessary (each HDU can have its own cache). The output should be
+   freed by the caller. */
+char *
+gal_tablecache_name(char *filename, char *hdu)
+{
+  char *out;
+  int r = ( hdu && gal_fits_file_recognized(filename)
+            ? asprintf(&out, "%s.%s.%s", filename, hdu,
+                       GAL_TABLECACHE_SUFFIX)
+            : asprintf(&out, "%s.%s", filename, GAL_TABLECACHE_SUFFIX) );
+  if(r<0) error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  return out;
+}
+
+
+
+
+
+/* Round the given value up to a multiple of 8. */
+static size_t
+tablecache_align(size_t in)
+{
+  return (in+7) / 8 * 8;
+}
+
+
+
+
+
+/* Check the header of a cache (that is already in memory). */
+static int
+tablecache_header_is_good(struct tablecache_header *h, size_t size)
+{
+  return ( size >= sizeof *h
+           && !strcmp(h->magic, TABLECACHE_MAGIC)
+           && h->endian==TABLECACHE_ENDIAN
+           && h->version==TABLECACHE_VERSION
+           && size >= sizeof *h + h->numcols*sizeof(struct tablecache_col) );
+}
+
+
+
+
+
+/* If a usable cache exists for the table, return its name (which should
+   be freed), otherwise return NULL. A cache is only usable if it has a
+   correct header (for example it was written on a machine with the same
+   byte order) and the size and modification time of the table are
+   exactly the same as when the cache was written. */
+char *
+gal_tablecache_usable(char *filename, char *hdu)
+{
+  FILE *fp;
+  char *name;
+  struct stat ts, cs;
+  struct timespec mtime;
+  struct tablecache_header h;
+
+  /* Only files can have a cache. */
+  if(filename==NULL || stat(filename, &ts)) return NULL;
+
+  /* See if the cache exists. */
+  name=gal_tablecache_name(filename, hdu);
+  if( stat(name, &cs) ) { free(name); return NULL; }
+
+  /* Check the header and the table's size and modification time. */
+  mtime=get_stat_mtime(&ts);
+  fp=fopen(name, "r");
+  if( fp==NULL
+      || fread(&h, sizeof h, 1, fp)!=1
+      || !tablecache_header_is_good(&h, cs.st_size)
+      || h.srcsize!=(uint64_t)ts.st_size
+      || h.srcmtime!=(int64_t)mtime.tv_sec
+      || h.srcmtimen!=(int64_t)mtime.tv_nsec )
+    { if(fp) fclose(fp); free(name); return NULL; }
+  fclose(fp);
+  return name;
+}
+
+
+
+
+
+/* Map the full cache file into memory (read-only). */
+static void
+tablecache_map(char *cachename, struct tablecache_map *map)
+{
+  int fd;
+  struct stat st;
+  size_t i, end;
+  struct tablecache_col *c;
+
+  /* Open the file and find its size. */
+  errno=0;
+  fd=open(cachename, O_RDONLY);
+  if(fd==-1 || fstat(fd, &st))
+    error(EXIT_FAILURE, errno, "%s: couldn't open the table cache",
+          cachename);
+
+  /* Map it into memory. */
+  map->name=cachename;
+  map->size=st.st_size;
+  errno=0;
+  map->base=mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map->base==MAP_FAILED)
+    error(EXIT_FAILURE, errno, "%s: couldn't map the table cache into "
+          "memory", cachename);
+  close(fd);
+
+  /* Set the pointers and check the file. */
+  map->head=(struct tablecache_header *)map->base;
+  map->cols=(struct tablecache_col *)(map->base + sizeof *map->head);
+  if( !tablecache_header_is_good(map->head, map->size) )
+    error(EXIT_FAILURE, 0, "%s: not a usable table cache", cachename);
+  for(i=0;i<map->head->numcols;++i)
+    {
+      c=&map->cols[i];
+      end = ( c->statsoffset
+              ? c->statsoffset + 2*map->head->nblocks*sizeof(double)
+              : c->dataoffset + c->datasize );
+      if( end > map->size
+          || c->stroffset+c->namelen+c->unitlen+c->commentlen > map->size )
+        error(EXIT_FAILURE, 0, "%s: the table cache is corrupted "
+              "(possibly truncated). Please delete it", cachename);
+    }
+}
+
+
+
+
+
+static void
+tablecache_unmap(struct tablecache_map *map)
+{
+  errno=0;
+  if( munmap(map->base, map->size) )
+    error(EXIT_FAILURE, errno, "%s: couldn't un-map the table cache",
+          map->name);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***********************************************************************/
+/**************                 Reading                 ****************/
+/***********************************************************************/
+/* Return a copy of the string at the given offset of the cache (or NULL
+   if its length is zero). */
+static char *
+tablecache_string(struct tablecache_map *map, size_t offset, size_t len)
+{
+  char *out=NULL;
+  if(len) gal_checkset_allocate_copy(map->base+offset, &out);
+  return out;
+}
+
+
+
+
+
+/* Return the column information (similar to 'gal_table_info'). */
+gal_data_t *
+gal_tablecache_info(char *cachename, size_t *numcols, size_t *numrows,
+                    int *tableformat)
+{
+  size_t i, o;
+  gal_data_t *allcols;
+  struct tablecache_col *c;
+  struct tablecache_map map;
+
+  /* Map the cache and set the basic information. */
+  tablecache_map(cachename, &map);
+  *numcols=map.head->numcols;
+  *numrows=map.head->numrows;
+  *tableformat=map.head->tableformat;
+
+  /* Fill in the information of each column. */
+  allcols=gal_data_array_calloc(*numcols);
+  for(i=0;i<*numcols;++i)
+    {
+      c=&map.cols[i];
+      o=c->stroffset;
+      allcols[i].type           = c->type;
+      allcols[i].flag           = c->flag;
+      allcols[i].minmapsize     = c->repeat;
+      allcols[i].disp_fmt       = c->infofmt;
+      allcols[i].disp_width     = c->infowidth;
+      allcols[i].disp_precision = c->infoprec;
+      allcols[i].name    = tablecache_string(&map, o, c->namelen);
+      allcols[i].unit    = tablecache_string(&map, o+c->namelen,
+                                             c->unitlen);
+      allcols[i].comment = tablecache_string(&map, o+c->namelen+c->unitlen,
+                                             c->commentlen);
+    }
+
+  /* Clean up and return. */
+  tablecache_unmap(&map);
+  return allcols;
+}
+
+
+
+
+
+/* Copy 'nrows' rows of the column (starting from row 'rowstart') into the
+   output column (starting from its row 'outstart'). */
+static void
+tablecache_copy_rows(struct tablecache_map *map, struct tablecache_col *c,
+                     gal_data_t *out, size_t rowstart, size_t nrows,
+                     size_t outstart)
+{
+  size_t i, nelem;
+  char **strarr=out->array;
+  uint64_t *offsets=(uint64_t *)(map->base+c->dataoffset);
+  char *chars=map->base + c->dataoffset + map->head->numrows*sizeof *offsets;
+
+  /* Strings need to be allocated separately. */
+  if(out->type==GAL_TYPE_STRING)
+    for(i=0;i<nrows;++i)
+      gal_checkset_allocate_copy(chars+offsets[rowstart+i],
+                                 &strarr[outstart+i]);
+
+  /* Numeric columns are contiguous. */
+  else
+    {
+      nelem=out->size/out->dsize[0];
+      memcpy(gal_pointer_increment(out->array, outstart*nelem, out->type),
+             map->base + c->dataoffset
+             + rowstart*nelem*gal_type_sizeof(out->type),
+             nrows*nelem*gal_type_sizeof(out->type));
+    }
+}
+
+
+
+
+
+/* Read the columns given in 'indexll' (in the same order). When 'rowids'
+   is NULL, 'numrows' rows will be read, starting from 'rowstart'.
+   Otherwise, 'rowids' is a sorted array of 'numrows' row IDs (counting
+   from 0) to read. Both should be within the table (this is not
+   checked here). */
+gal_data_t *
+gal_tablecache_read(char *cachename, gal_list_sizet_t *indexll,
+                    size_t rowstart, size_t numrows, size_t *rowids,
+                    size_t minmapsize, int quietmmap)
+{
+  size_t j, k, dsize[2];
+  gal_list_sizet_t *ind;
+  struct tablecache_col *c;
+  struct tablecache_map map;
+  gal_data_t *col, *out=NULL;
+
+  /* Map the cache into memory. */
+  tablecache_map(cachename, &map);
+
+  /* Read each column. */
+  for(ind=indexll; ind!=NULL; ind=ind->next)
+    {
+      /* Allocate the output column (when there are no rows, a one-row
+         column is allocated and corrected afterwards, similar to the
+         FITS and plain-text readers). */
+      c=&map.cols[ind->v];
+      dsize[0] = numrows ? numrows : 1;
+      dsize[1] = c->repeat;
+      col=gal_data_alloc(NULL, c->type, c->ndim, dsize, NULL, 0,
+                         minmapsize, quietmmap, NULL, NULL, NULL);
+      col->name    = tablecache_string(&map, c->stroffset, c->namelen);
+      col->unit    = tablecache_string(&map, c->stroffset+c->namelen,
+                                       c->unitlen);
+      col->comment = tablecache_string(&map, c->stroffset+c->namelen
+                                       +c->unitlen, c->commentlen);
+      col->disp_fmt       = c->readfmt;
+      col->disp_width     = c->readwidth;
+      col->disp_precision = c->readprec;
+
+      /* Copy the desired rows: with row IDs, each run of contiguous rows
+         is copied at once. */
+      if(numrows==0)
+        {
+          free(col->array);
+          col->size=0;
+          col->array=NULL;
+          col->dsize[0]=0;
+        }
+      else if(rowids)
+        for(j=0;j<numrows;j=k)
+          {
+            for(k=j+1; k<numrows && rowids[k]==rowids[k-1]+1; ++k) {}
+            tablecache_copy_rows(&map, c, col, rowids[j], k-j, j);
+          }
+      else
+        tablecache_copy_rows(&map, c, col, rowstart, numrows, 0);
+
+      /* Add the column to the output list. */
+      gal_list_data_add(&out, col);
+    }
+
+  /* Clean up and return (in the same order as 'indexll'). */
+  tablecache_unmap(&map);
+  gal_list_data_reverse(&out);
+  return out;
+}
+
+
+
+
+
+/* Return an array with one element for every block of rows in the given
+   column: it will be 1 if the block may contain values within the given
+   range (larger or equal to 'min' and smaller than 'max') and 0 if it
+   doesn't. If the column has no block statistics (for example it is a
+   string or vector column), NULL is returned. */
+uint8_t *
+gal_tablecache_blocks_in_range(char *cachename, size_t colind, double min,
+                               double max, size_t *nblocks,
+                               size_t *blocksize, size_t *numrows)
+{
+  size_t i;
+  double *stats;
+  uint8_t *out=NULL;
+  struct tablecache_col *c;
+  struct tablecache_map map;
+
+  /* Map the cache and check the column. */
+  tablecache_map(cachename, &map);
+  if(colind>=map.head->numcols)
+    error(EXIT_FAILURE, 0, "%s: %s has %zu columns, but column %zu "
+          "(counting from 0) was requested", __func__, cachename,
+          (size_t)(map.head->numcols), colind);
+  c=&map.cols[colind];
+
+  /* Check each block (since NaN fails on any condition, blocks with no
+     usable value are also flagged as 0). */
+  if(c->statsoffset)
+    {
+      *nblocks=map.head->nblocks;
+      *numrows=map.head->numrows;
+      *blocksize=map.head->blocksize;
+      stats=(double *)(map.base+c->statsoffset);
+      out=gal_pointer_allocate(GAL_TYPE_UINT8, *nblocks, 0, __func__,
+                               "out");
+      for(i=0;i<*nblocks;++i)
+        out[i] = stats[i*2+1]>=min && stats[i*2]<max;
+    }
+
+  /* Clean up and return. */
+  tablecache_unmap(&map);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***********************************************************************/
+/**************                 Writing                 ****************/
+/***********************************************************************/
+/* Return the given element of a numeric array as a double (or NaN if it
+   is blank). */
+static double
+tablecache_as_double(gal_data_t *col, size_t i)
+{
+  void *a=col->array;
+  void *p=gal_pointer_increment(a, i, col->type);
+
+  if( gal_blank_is(p, col->type) ) return NAN;
+  switch(col->type)
+    {
+    case GAL_TYPE_UINT8:   return (( uint8_t  *)a)[i];
+    case GAL_TYPE_INT8:    return (( int8_t   *)a)[i];
+    case GAL_TYPE_UINT16:  return (( uint16_t *)a)[i];
+    case GAL_TYPE_INT16:   return (( int16_t  *)a)[i];
+    case GAL_TYPE_UINT32:  return (( uint32_t *)a)[i];
+    case GAL_TYPE_INT32:   return (( int32_t  *)a)[i];
+    case GAL_TYPE_UINT64:  return (( uint64_t *)a)[i];
+    case GAL_TYPE_INT64:   return (( int64_t  *)a)[i];
+    case GAL_TYPE_FLOAT32: return (( float    *)a)[i];
+    case GAL_TYPE_FLOAT64: return (( double   *)a)[i];
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, col->type);
+    }
+
+  /* Control should not reach here. */
+  return NAN;
+}
+
+
+
+
+
+/* Write zero-valued bytes after a section of 'size' bytes, so the next
+   section starts at a multiple of 8 bytes. */
+static void
+tablecache_pad(FILE *fp, size_t size, char *name)
+{
+  uint64_t zero=0;
+  size_t pad=tablecache_align(size)-size;
+  errno=0;
+  if( pad && fwrite(&zero, 1, pad, fp)!=pad )
+    error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes", name, pad);
+}
+
+
+
+
+
+/* Write 'size' bytes, and when 'pad' is non-zero, also the padding after
+   them. */
+static void
+tablecache_fwrite(FILE *fp, void *ptr, size_t size, char *name, int pad)
+{
+  errno=0;
+  if( size && fwrite(ptr, 1, size, fp)!=size )
+    error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes", name, size);
+  if(pad) tablecache_pad(fp, size, name);
+}
+
+
+
+
+
+/* Write the given columns ('cols', containing all the columns of the
+   table in the same order as 'allcols', that is the output of
+   'gal_table_info') into the cache file. To avoid using a partially
+   written cache (for example if this program is killed or another
+   program reads the table at the same time), the cache is first written
+   into a temporary file and then renamed. 'source' is the 'stat' of the
+   original table before it was read (its size and modification time are
+   kept to check if the cache is still usable later). */
+void
+gal_tablecache_write(char *cachename, struct stat *source,
+                     gal_data_t *allcols, size_t numcols, size_t numrows,
+                     int tableformat, gal_data_t *cols)
+{
+  FILE *fp;
+  char *tmpname;
+  double v, *stats;
+  gal_data_t *col;
+  char **strarr=NULL;
+  struct timespec mtime;
+  struct tablecache_col *cc;
+  struct tablecache_header h;
+  uint64_t i, b, r, off, *offsets;
+  size_t offset, nblocks, nelem;
+
+  /* Fill the header. */
+  memset(&h, 0, sizeof h);
+  strcpy(h.magic, TABLECACHE_MAGIC);
+  h.endian=TABLECACHE_ENDIAN;
+  h.version=TABLECACHE_VERSION;
+  h.tableformat=tableformat;
+  h.numcols=numcols;
+  h.numrows=numrows;
+  h.blocksize=GAL_TABLECACHE_BLOCKSIZE;
+  h.nblocks=nblocks=(numrows+h.blocksize-1)/h.blocksize;
+  mtime=get_stat_mtime(source);
+  h.srcsize=source->st_size;
+  h.srcmtime=mtime.tv_sec;
+  h.srcmtimen=mtime.tv_nsec;
+
+  /* Fill the column descriptors and find the offset of every section. */
+  cc=gal_pointer_allocate(GAL_TYPE_UINT8, numcols*sizeof *cc, 1,
+                          __func__, "cc");
+  offset=sizeof h + numcols*sizeof *cc;
+  for(i=0, col=cols; i<numcols; ++i, col=col->next)
+    {
+      if(col==NULL)
+        error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at '%s' to "
+              "fix the problem. The number of columns (%zu) is less than "
+              "'numcols' (%zu)", __func__, PACKAGE_BUGREPORT, (size_t)i,
+              numcols);
+      cc[i].type      = col->type;
+      cc[i].ndim      = col->ndim;
+      cc[i].flag      = allcols[i].flag;
+      cc[i].repeat    = allcols[i].minmapsize;
+      cc[i].infofmt   = allcols[i].disp_fmt;
+      cc[i].infowidth = allcols[i].disp_width;
+      cc[i].infoprec  = allcols[i].disp_precision;
+      cc[i].readfmt   = col->disp_fmt;
+      cc[i].readwidth = col->disp_width;
+      cc[i].readprec  = col->disp_precision;
+      cc[i].namelen    = col->name    ? strlen(col->name)+1    : 0;
+      cc[i].unitlen    = col->unit    ? strlen(col->unit)+1    : 0;
+      cc[i].commentlen = col->comment ? strlen(col->comment)+1 : 0;
+      cc[i].stroffset  = offset;
+      offset=tablecache_align(offset + cc[i].namelen + cc[i].unitlen
+                              + cc[i].commentlen);
+    }
+  for(i=0, col=cols; i<numcols; ++i, col=col->next)
+    {
+      /* Size of the contents. */
+      if(col->type==GAL_TYPE_STRING)
+        {
+          strarr=col->array;
+          cc[i].datasize=numrows*sizeof *offsets;
+          for(r=0;r<numrows;++r) cc[i].datasize+=strlen(strarr[r])+1;
+        }
+      else
+        cc[i].datasize=col->size*gal_type_sizeof(col->type);
+      cc[i].dataoffset=offset;
+      offset=tablecache_align(offset+cc[i].datasize);
+
+      /* Block statistics are only for 1D numeric columns. */
+      if(col->type!=GAL_TYPE_STRING && col->ndim==1 && numrows)
+        {
+          cc[i].statsoffset=offset;
+          offset+=2*nblocks*sizeof *stats;
+        }
+    }
+
+  /* Open the temporary file. */
+  if( asprintf(&tmpname, "%s.tmp", cachename)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+  errno=0;
+  fp=fopen(tmpname, "w");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to write table cache",
+          tmpname);
+
+  /* Write the header, the column descriptors and the strings. */
+  tablecache_fwrite(fp, &h, sizeof h, tmpname, 1);
+  tablecache_fwrite(fp, cc, numcols*sizeof *cc, tmpname, 1);
+  for(i=0, col=cols; i<numcols; ++i, col=col->next)
+    {
+      tablecache_fwrite(fp, col->name, cc[i].namelen, tmpname, 0);
+      tablecache_fwrite(fp, col->unit, cc[i].unitlen, tmpname, 0);
+      tablecache_fwrite(fp, col->comment, cc[i].commentlen, tmpname,
+                        0);
+      tablecache_pad(fp, cc[i].namelen+cc[i].unitlen+cc[i].commentlen,
+                     tmpname);
+    }
+
+  /* Write the contents (and block statistics) of each column. */
+  for(i=0, col=cols; i<numcols; ++i, col=col->next)
+    {
+      if(col->type==GAL_TYPE_STRING)
+        {
+          /* The offset of each string, then the strings. */
+          strarr=col->array;
+          offsets=gal_pointer_allocate(GAL_TYPE_UINT64,
+                                       numrows ? numrows : 1, 0,
+                                       __func__, "offsets");
+          for(off=r=0;r<numrows;++r)
+            { offsets[r]=off; off+=strlen(strarr[r])+1; }
+          tablecache_fwrite(fp, offsets, numrows*sizeof *offsets,
+                            tmpname, 0);
+          for(r=0;r<numrows;++r)
+            tablecache_fwrite(fp, strarr[r], strlen(strarr[r])+1,
+                              tmpname, 0);
+          tablecache_pad(fp, cc[i].datasize, tmpname);
+          free(offsets);
+        }
+      else
+        tablecache_fwrite(fp, col->array, cc[i].datasize, tmpname, 1);
+
+      /* Block statistics. */
+      if(cc[i].statsoffset)
+        {
+          stats=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*nblocks, 0,
+                                     __func__, "stats");
+          for(b=0;b<nblocks;++b)
+            {
+              stats[b*2]=stats[b*2+1]=NAN;
+              nelem = ( (b+1)*h.blocksize > numrows
+                        ? numrows : (b+1)*h.blocksize );
+              for(r=b*h.blocksize; r<nelem; ++r)
+                {
+                  v=tablecache_as_double(col, r);
+                  if( !isnan(v) )
+                    {
+                      if( isnan(stats[b*2]) || v<stats[b*2] )
+                        stats[b*2]=v;
+                      if( isnan(stats[b*2+1]) || v>stats[b*2+1] )
+                        stats[b*2+1]=v;
+                    }
+                }
+            }
+          tablecache_fwrite(fp, stats, 2*nblocks*sizeof *stats,
+                            tmpname, 1);
+          free(stats);
+        }
+    }
+
+  /* Close the file and rename it to the final name. */
+  errno=0;
+  if(fclose(fp))
+    error(EXIT_FAILURE, errno, "%s: couldn't close file after writing "
+          "the table cache", tmpname);
+  errno=0;
+  if( rename(tmpname, cachename) )
+    error(EXIT_FAILURE, errno, "%s: couldn't rename to '%s'", tmpname,
+          cachename);
+
+  /* Clean up. */
+  free(cc);
+  free(tmpname);
+}
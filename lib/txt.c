@@ -37,6 +37,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/blank.h>
 #include <gnuastro/table.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/statistics.h>
 
 #include <gnuastro-internal/checkset.h>
@@ -1412,10 +1413,215 @@ txt_read_prepare(gal_data_t *info, size_t *indsize,
 
 
 
+/* Parameters for parsing the data rows of a file in parallel. The file
+   is read in chunks of (at least) 'TXT_READ_CHUNK_BYTES' bytes. */
+#define TXT_READ_CHUNK_BYTES 67108864
+struct txt_read_params
+{
+  char              *filename;  /* Name of input file.                  */
+  char                   *buf;  /* Contents of the current chunk.       */
+  size_t              *starts;  /* Start of each data row within 'buf'. */
+  size_t             *linenos;  /* Line number of each data row.        */
+  size_t             firstrow;  /* Output row of first row in chunk.    */
+  size_t           ntokforout;  /* Last necessary token of each line.   */
+  size_t         *tokenvecind;  /* Index of each token within vector.   */
+  gal_data_t     **tokeninout;  /* Output dataset(s) of each token.     */
+  gal_data_t    **tokenininfo;  /* Information of each token.           */
+  int                  format;  /* Format of the file (table or image). */
+};
+
+
+
+
+
+static void *
+txt_read_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_read_params *p=(struct txt_read_params *)tprm->params;
+
+  size_t i, ind;
+
+  /* Parse all the rows that were assigned to this thread. Each row's
+     line has already been terminated with a '\0', so it can be parsed
+     in place. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      txt_fill(p->buf+p->starts[ind], p->tokeninout, p->ntokforout,
+               p->tokenininfo, p->tokenvecind, p->firstrow+ind,
+               p->filename, p->linenos[ind], 1, p->format);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find the start of each data row within the complete lines of the
+   current chunk ('p->buf' until 'end') and terminate all the lines (the
+   new-line character, and a possible carriage return before it, are
+   replaced by '\0'). Note that 'gal_txt_line_stat' checks the line until
+   its new-line character, so it should be called before the line is
+   terminated. The returned value is the number of data rows. */
+static size_t
+txt_read_chunk_rows(struct txt_read_params *p, char *end, size_t maxrows,
+                    size_t *lineno, size_t *nalloc)
+{
+  char *c, *nl;
+  size_t nrows=0;
+
+  for(c=p->buf; c<end; c=nl+1)
+    {
+      ++*lineno;
+      nl=memchr(c, '\n', end-c);
+      if( nrows<maxrows
+          && gal_txt_line_stat(c) == GAL_TXT_LINESTAT_DATAROW )
+        {
+          /* Allocate more space if necessary. */
+          if(nrows==*nalloc)
+            {
+              *nalloc = *nalloc ? 2 * *nalloc : 1024;
+              errno=0;
+              p->starts=realloc(p->starts, *nalloc * sizeof *p->starts);
+              p->linenos=realloc(p->linenos, *nalloc * sizeof *p->linenos);
+              if(p->starts==NULL || p->linenos==NULL)
+                error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu "
+                      "elements", __func__, *nalloc);
+            }
+          p->starts[nrows]=c-p->buf;
+          p->linenos[nrows++]=*lineno;
+        }
+      *nl='\0';
+      if(nl>c && *(nl-1)==13) *(nl-1)='\0';
+    }
+  return nrows;
+}
+
+
+
+
+
+/* Read the file in chunks of (at least) 'TXT_READ_CHUNK_BYTES' bytes
+   (with one call to 'fread'), find the start of each data row in the
+   complete lines of each chunk (with 'memchr', which is much faster than
+   'getline' on each line) and parse those rows in parallel. Since each
+   data row's position in the output is already known (from its counter),
+   the rows can be parsed independently. The incomplete last line of each
+   chunk is moved to the start of the buffer to be completed by the next
+   chunk. So the memory necessary for reading is independent of the size
+   of the file (the buffer is only enlarged when a single line is longer
+   than it). */
+static void
+txt_read_file_threaded(char *filename, size_t numrows,
+                       gal_data_t **tokeninout, size_t ntokforout,
+                       gal_data_t **tokenininfo, size_t *tokenvecind,
+                       int format, size_t numthreads, size_t minmapsize,
+                       int quietmmap)
+{
+  FILE *fp;
+  int eof=0;
+  char *end;
+  struct txt_read_params p;
+  size_t bufsize=TXT_READ_CHUNK_BYTES, used=0, nread, nrows;
+  size_t nalloc=0, lineno=0;
+
+  /* Open the file. */
+  errno=0;
+  fp=fopen(filename, "r");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to read as a text "
+          "table in %s", filename, __func__);
+
+  /* Allocate the buffer. The extra byte is necessary to add a new-line
+     character if the file doesn't end with one. */
+  p.buf=gal_pointer_allocate(GAL_TYPE_UINT8, bufsize+1, 0, __func__,
+                             "p.buf");
+  p.starts=p.linenos=NULL;
+  p.firstrow=0;
+  p.format=format;
+  p.filename=filename;
+  p.tokeninout=tokeninout;
+  p.ntokforout=ntokforout;
+  p.tokenininfo=tokenininfo;
+  p.tokenvecind=tokenvecind;
+
+  /* Read and parse each chunk. */
+  while(eof==0 && p.firstrow<numrows)
+    {
+      /* Fill the rest of the buffer. */
+      errno=0;
+      nread=fread(p.buf+used, 1, bufsize-used, fp);
+      if(nread<bufsize-used)
+        {
+          if(ferror(fp))
+            error(EXIT_FAILURE, errno, "%s: couldn't read the file in %s",
+                  filename, __func__);
+          eof=1;
+        }
+      used+=nread;
+
+      /* Find the end of the last complete line in the buffer. At the end
+         of the file, the last line is complete (even if it doesn't have
+         a new-line character). */
+      if(eof)
+        {
+          if(used && p.buf[used-1]!='\n') p.buf[used++]='\n';
+          end=p.buf+used;
+        }
+      else
+        {
+          for(end=p.buf+used; end>p.buf && *(end-1)!='\n'; --end);
+
+          /* A single line is longer than the buffer: enlarge it and read
+             the rest of the line. */
+          if(end==p.buf)
+            {
+              bufsize*=2;
+              errno=0;
+              p.buf=realloc(p.buf, bufsize+1);
+              if(p.buf==NULL)
+                error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu "
+                      "bytes for 'p.buf'", __func__, bufsize+1);
+              continue;
+            }
+        }
+
+      /* Parse the data rows of this chunk in parallel. */
+      nrows=txt_read_chunk_rows(&p, end, numrows-p.firstrow, &lineno,
+                                &nalloc);
+      if(nrows)
+        gal_threads_spin_off(txt_read_worker, &p, nrows, numthreads,
+                             minmapsize, quietmmap);
+      p.firstrow+=nrows;
+
+      /* Move the incomplete last line to the start of the buffer. */
+      used-=end-p.buf;
+      if(used) memmove(p.buf, end, used);
+    }
+
+  /* Clean up. */
+  errno=0;
+  if(fclose(fp))
+    error(EXIT_FAILURE, errno, "%s: couldn't close file after reading "
+          "ASCII table information in %s", filename, __func__);
+  free(p.buf);
+  free(p.starts);
+  free(p.linenos);
+}
+
+
+
+
+
 static gal_data_t *
 txt_read(char *filename, gal_list_str_t *lines, size_t *indsize,
-         gal_data_t *info, gal_list_sizet_t *indexll, size_t minmapsize,
-         int quietmmap, int format)
+         gal_data_t *info, gal_list_sizet_t *indexll, size_t numthreads,
+         size_t minmapsize, int quietmmap, int format)
 {
   FILE *fp;
   int test;
@@ -1437,8 +1643,15 @@ txt_read(char *filename, gal_list_str_t *lines, size_t *indsize,
                        format, &line, linelen, &tokeninout, &ntokforout,
                        &tokenininfo, &tokenvecind);
 
+  /* When more than one thread is requested (and there is more than one
+     row), read the full file and parse its rows in parallel. */
+  if(filename && numthreads>1 && indsize[0]>1)
+    txt_read_file_threaded(filename, indsize[0], tokeninout, ntokforout,
+                           tokenininfo, tokenvecind, format, numthreads,
+                           minmapsize, quietmmap);
+
   /* Read the input line by line. */
-  if(filename) /* Input from a file. */
+  else if(filename) /* Input from a file. */
     {
       /* Open the file. */
       errno=0;
@@ -1498,8 +1711,23 @@ gal_txt_table_read(char *filename, gal_list_str_t *lines, size_t numrows,
                    gal_data_t *colinfo, gal_list_sizet_t *indexll,
                    size_t minmapsize, int quietmmap)
 {
-  return txt_read(filename, lines, &numrows, colinfo, indexll, minmapsize,
-                  quietmmap, TXT_FORMAT_TABLE);
+  return gal_txt_table_read_parallel(filename, lines, numrows, colinfo,
+                                     indexll, 1, minmapsize, quietmmap);
+}
+
+
+
+
+
+/* Similar to 'gal_txt_table_read', but on 'numthreads' threads. */
+gal_data_t *
+gal_txt_table_read_parallel(char *filename, gal_list_str_t *lines,
+                            size_t numrows, gal_data_t *colinfo,
+                            gal_list_sizet_t *indexll, size_t numthreads,
+                            size_t minmapsize, int quietmmap)
+{
+  return txt_read(filename, lines, &numrows, colinfo, indexll, numthreads,
+                  minmapsize, quietmmap, TXT_FORMAT_TABLE);
 }
 
 
@@ -1518,7 +1746,7 @@ gal_txt_image_read(char *filename, gal_list_str_t *lines,
   imginfo=gal_txt_image_info(filename, lines, &numimg, dsize);
 
   /* Read the table. */
-  img=txt_read(filename, lines, dsize, imginfo, indexll, minmapsize,
+  img=txt_read(filename, lines, dsize, imginfo, indexll, 1, minmapsize,
                quietmmap, TXT_FORMAT_IMAGE);
 
   /* Clean up and return. */
@@ -1992,15 +2220,189 @@ txt_write_keys(FILE *fp, struct gal_fits_list_key_t **keylist)
 
 
 
+/* Print the values of rows 'first' to 'last' (not inclusive) of the
+   given dataset(s) row-by-row. */
+static void
+txt_write_rows_range(FILE *fp, gal_data_t *input, char **fmts,
+                     int tab0_img1, size_t first, size_t last)
+{
+  size_t i, j, k, d1;
+  gal_data_t *data;
+
+  /* Print row-by-row (if we actually have data to print! */
+  if(input->array)
+    {
+      if(tab0_img1) /* Image. */
+        for(i=first;i<last;++i)
+          {
+            d1=input->dsize[1];
+            for(j=0;j<d1;++j)
+              txt_print_value(fp, input, i*d1+j, fmts[j==d1-1 ? 3 : 0]);
+            fprintf(fp, "\n");
+          }
+      else /* Table. */
+        {
+          for(i=first;i<last;++i)                         /* Row.    */
+            {
+              k=0; /* Column counter. */
+              for(data=input;data!=NULL;data=data->next)  /* Column. */
+                {
+                  if(data->ndim>1)  /* Vector column. */
+                    {
+                      d1=data->dsize[1];
+                      for(j=0;j<d1;++j)
+                        txt_print_value(fp, data, i*d1+j,
+                          fmts[ k * FMTS_COLS
+                      /* Last of vector column has a different format. */
+                                + (j==d1-1 && data->next==NULL ? 3 : 0) ]);
+                    }
+                  else /* Non-vector column: simple! */
+                    txt_print_value(fp, data, i, fmts[k * FMTS_COLS]);
+                  ++k;
+                }
+              fprintf(fp, "\n");
+            }
+        }
+    }
+}
+
+
+
+
+
+/* Parameters to format blocks of rows in parallel. */
+#define TXT_WRITE_ROWS_IN_BLOCK 10000
+struct txt_write_params
+{
+  gal_data_t            *input;  /* Input dataset(s).                    */
+  char                  **fmts;  /* Format of each column.               */
+  int                tab0_img1;  /* If the input is a table or image.    */
+  size_t            firstblock;  /* Index of first block in this batch.  */
+  char                  **bufs;  /* Formatted rows of each block.        */
+  size_t             *bufsizes;  /* Size of the formatted rows.          */
+};
+
+
+
+
+
+static void *
+txt_write_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_write_params *p=(struct txt_write_params *)tprm->params;
+
+  FILE *fp;
+  size_t i, ind, first, last, nrows=p->input->dsize[0];
+
+  /* Format the rows of each block into its own in-memory stream. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      first=(p->firstblock+ind)*TXT_WRITE_ROWS_IN_BLOCK;
+      last = ( first+TXT_WRITE_ROWS_IN_BLOCK > nrows
+               ? nrows : first+TXT_WRITE_ROWS_IN_BLOCK );
+      errno=0;
+      fp=open_memstream(&p->bufs[ind], &p->bufsizes[ind]);
+      if(fp==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't open a memory stream",
+              __func__);
+      txt_write_rows_range(fp, p->input, p->fmts, p->tab0_img1, first,
+                           last);
+      errno=0;
+      if(fclose(fp))
+        error(EXIT_FAILURE, errno, "%s: couldn't close the memory stream",
+              __func__);
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Print the values of the given dataset(s) row-by-row. When more than one
+   thread is requested, blocks of rows are formatted in parallel (each
+   into its own buffer in memory) and the buffers are written in order
+   (with one call to 'fwrite' for each block). To keep the memory usage
+   limited, only one block is formatted by each thread at every step. */
+static void
+txt_write_rows(FILE *fp, gal_data_t *input, char **fmts, int tab0_img1,
+               size_t numthreads)
+{
+  size_t i, nblocks, nbatch;
+  struct txt_write_params p;
+  size_t nrows = input->array ? input->dsize[0] : 0;
+
+  /* If there aren't enough rows, just print them on this thread. */
+  if(numthreads<2 || nrows<=TXT_WRITE_ROWS_IN_BLOCK)
+    { txt_write_rows_range(fp, input, fmts, tab0_img1, 0, nrows); return; }
+
+  /* Prepare the parameters. */
+  p.fmts=fmts;
+  p.input=input;
+  p.tab0_img1=tab0_img1;
+  nblocks=(nrows+TXT_WRITE_ROWS_IN_BLOCK-1)/TXT_WRITE_ROWS_IN_BLOCK;
+  p.bufs=gal_pointer_allocate(GAL_TYPE_STRING, numthreads, 1, __func__,
+                              "p.bufs");
+  p.bufsizes=gal_pointer_allocate(GAL_TYPE_SIZE_T, numthreads, 1,
+                                  __func__, "p.bufsizes");
+
+  /* Format and write the blocks in batches of 'numthreads'. */
+  for(p.firstblock=0; p.firstblock<nblocks; p.firstblock+=numthreads)
+    {
+      nbatch = ( p.firstblock+numthreads > nblocks
+                 ? nblocks-p.firstblock : numthreads );
+      gal_threads_spin_off(txt_write_worker, &p, nbatch, numthreads,
+                           -1, 1);
+      for(i=0;i<nbatch;++i)
+        {
+          errno=0;
+          if( fwrite(p.bufs[i], 1, p.bufsizes[i], fp)!=p.bufsizes[i] )
+            error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes",
+                  __func__, p.bufsizes[i]);
+          free(p.bufs[i]);
+          p.bufs[i]=NULL;
+        }
+    }
+
+  /* Clean up. */
+  free(p.bufs);
+  free(p.bufsizes);
+}
+
+
+
+
+
 void
 gal_txt_write(gal_data_t *input, struct gal_fits_list_key_t **keylist,
               gal_list_str_t *comment, char *filename,
               uint8_t colinfoinstdout, int tab0_img1)
+{
+  gal_txt_write_parallel(input, keylist, comment, filename,
+                         colinfoinstdout, tab0_img1, 1);
+}
+
+
+
+
+
+/* Similar to 'gal_txt_write', but on 'numthreads' threads. */
+void
+gal_txt_write_parallel(gal_data_t *input,
+                       struct gal_fits_list_key_t **keylist,
+                       gal_list_str_t *comment, char *filename,
+                       uint8_t colinfoinstdout, int tab0_img1,
+                       size_t numthreads)
 {
   FILE *fp;
   char **fmts;
   gal_list_str_t *strt;
-  size_t i, j, k, num=0, d1;
+  size_t i, num=0;
   gal_data_t *data, *nextimg=NULL;
 
   /* Make sure input is valid. */
@@ -2084,40 +2486,7 @@ gal_txt_write(gal_data_t *input, struct gal_fits_list_key_t **keylist,
 
 
   /* Print row-by-row (if we actually have data to print! */
-  if(input->array)
-    {
-      if(tab0_img1) /* Image. */
-        for(i=0;i<input->dsize[0];++i)
-          {
-            d1=input->dsize[1];
-            for(j=0;j<d1;++j)
-              txt_print_value(fp, input, i*d1+j, fmts[j==d1-1 ? 3 : 0]);
-            fprintf(fp, "\n");
-          }
-      else /* Table. */
-        {
-          for(i=0;i<input->dsize[0];++i)                  /* Row.    */
-            {
-              k=0; /* Column counter. */
-              for(data=input;data!=NULL;data=data->next)  /* Column. */
-                {
-                  if(data->ndim>1)  /* Vector column. */
-                    {
-                      d1=data->dsize[1];
-                      for(j=0;j<d1;++j)
-                        txt_print_value(fp, data, i*d1+j,
-                          fmts[ k * FMTS_COLS
-                      /* Last of vector column has a different format. */
-                                + (j==d1-1 && data->next==NULL ? 3 : 0) ]);
-                    }
-                  else /* Non-vector column: simple! */
-                    txt_print_value(fp, data, i, fmts[k * FMTS_COLS]);
-                  ++k;
-                }
-              fprintf(fp, "\n");
-            }
-        }
-    }
+  txt_write_rows(fp, input, fmts, tab0_img1, numthreads);
 
 
   /* Clean up. */
@@ -2143,3 +2512,73 @@ gal_txt_write(gal_data_t *input, struct gal_fits_list_key_t **keylist,
   /* Restore the next pointer for an image. */
   if(nextimg) input->next=nextimg;
 }
+
+
+
+
+
+/* Append the rows of the given table columns to the end of an existing
+   plain text table ('filename'), or print them on the standard output
+   (when 'filename==NULL'). No metadata is written, so the columns have to
+   be in the same order (and of the same types) as the original table,
+   for example when the table was created by 'gal_txt_write' with the
+   first set of rows. */
+void
+gal_txt_write_append(gal_data_t *cols, char *filename)
+{
+  FILE *fp;
+  char **fmts;
+  gal_data_t *data;
+  size_t i, num=0;
+
+  /* Make sure input is valid. */
+  if(cols==NULL) error(EXIT_FAILURE, 0, "%s: input is NULL", __func__);
+
+  /* Find the number of columns and check their sizes. */
+  for(data=cols;data!=NULL;data=data->next)
+    {
+      ++num;
+      if( cols!=data && cols->dsize && data->dsize
+          && cols->dsize[0]!=data->dsize[0] )
+        error(EXIT_FAILURE, 0, "%s: the input list of datasets must "
+              "have the same sizes (dimensions and length along each "
+              "dimension)", __func__);
+    }
+
+  /* Prepare the formats of each column. */
+  fmts=txt_fmts_for_printf(cols, 1, 0);
+
+  /* Open the output file for appending (or use the standard output). */
+  if(filename)
+    {
+      errno=0;
+      fp=fopen(filename, "a");
+      if(fp==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't be open to append text "
+              "table by %s", filename, __func__);
+    }
+  else
+    fp=stdout;
+
+  /* Print the rows. */
+  txt_write_rows(fp, cols, fmts, 0, 1);
+
+  /* Clean up. */
+  for(i=0;i<num;++i)
+    {
+      free(fmts[i*FMTS_COLS]);
+      free(fmts[i*FMTS_COLS+1]);
+      free(fmts[i*FMTS_COLS+2]);
+      free(fmts[i*FMTS_COLS+3]);
+    }
+  free(fmts);
+
+  /* Close the output file. */
+  if(filename)
+    {
+      errno=0;
+      if(fclose(fp))
+        error(EXIT_FAILURE, errno, "%s: couldn't close file after "
+              "appending to text table in %s", filename, __func__);
+    }
+}
@@ -48,7 +48,7 @@ gal_units_extract_decimal(char *convert, const char *delimiter,
                           double *args, size_t n)
 {
   size_t i = 0;
-  char *copy, *token, *end;
+  char *copy, *token, *end, *saveptr;
 
   /* Create a copy of the string to be parsed and parse it. This is because
      it will be modified during the parsing. */
@@ -64,8 +64,10 @@ gal_units_extract_decimal(char *convert, const char *delimiter,
           return 0;
         }
 
-      /* Extract the substring till the next delimiter */
-      token=strtok(i==0?copy:NULL, delimiter);
+      /* Extract the substring till the next delimiter ('strtok_r' is
+         used because this function may be called in parallel, for
+         example when reading plain-text tables). */
+      token=strtok_r(i==0?copy:NULL, delimiter, &saveptr);
       if(token)
         {
           /* Parse extracted string as a number, and check if it worked. */
@@ -23,9 +23,13 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <errno.h>
 #include <error.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <gsl/gsl_math.h>
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/type.h>
@@ -618,6 +622,7 @@ warp_check_basic_params(gal_warp_wcsalign_t *wa, const char *func)
     wa->numthreads=gal_threads_number();
 
   /* Initialize the internal parameters */
+  wa->centers=NULL;
   wa->vertices=NULL;
   wa->isccw=GAL_BLANK_INT;
   wa->v0=GAL_BLANK_SIZE_T;
@@ -646,8 +651,9 @@ warp_wcsalign_init_internals(gal_warp_wcsalign_t *wa)
 
   /* Determine the output image rotation direction so we can sort the
      indices in counter clockwise order. This is necessary for the
-     'gal_polygon_clip' function to work. */
-  warp_check_output_orientation(wa);
+     'gal_polygon_clip' function to work (the vertices are only used in
+     pixel mixing). */
+  if(wa->vertices) warp_check_output_orientation(wa);
 }
 
 
@@ -670,6 +676,23 @@ warp_wcsalign_init_params(gal_warp_wcsalign_t *wa, const char *func)
           "value less than or equal to 1.0, but it is given a value "
           "of %f", func, wa->coveredfrac);
 
+  /* Check 'maxinterperr' (a blank value or zero means exact conversion
+     of all vertices). */
+  if(wa->maxinterperr<0.0f)
+    error(EXIT_FAILURE, 0, "%s: maxinterperr (maximum error of the "
+          "interpolated vertices in units of input pixels) cannot be "
+          "negative, but it is given a value of %g", func,
+          wa->maxinterperr);
+
+  /* Check the kernel. */
+  if(wa->kernel>GAL_WARP_KERNEL_LANCZOS3)
+    error(EXIT_FAILURE, 0, "%s: kernel code %u isn't recognized, please "
+          "use one of the 'GAL_WARP_KERNEL_*' macros", func, wa->kernel);
+  if(wa->kernel!=GAL_WARP_KERNEL_AREA && wa->checkmaxfrac)
+    error(EXIT_FAILURE, 0, "%s: the maximum fraction check ('checkmaxfrac') "
+          "is only relevant to the area kernel (pixel mixing), it can't "
+          "be used with an interpolation kernel", func);
+
   /* If a target WCS is given ignore other variables and initialize the
      output image. */
   if(wa->twcs)
@@ -723,20 +746,28 @@ warp_wcsalign_init_params(gal_warp_wcsalign_t *wa, const char *func)
 
 
 /* Convert the necessary vertice coordinates. */
+struct warp_wcsalign_convert_params
+{
+  gal_warp_wcsalign_t     *wa;  /* Main warp parameters.               */
+  gal_data_t          *coords;  /* X and Y output coords (two columns). */
+};
+
 static void *
 warp_wcsalign_init_convert(void *in_prm)
 {
   /* Low-level definitions to be done first. */
   struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
-  gal_warp_wcsalign_t *wa = (gal_warp_wcsalign_t *)tprm->params;
+  struct warp_wcsalign_convert_params *cprm=
+    (struct warp_wcsalign_convert_params *)tprm->params;
+  gal_warp_wcsalign_t *wa=cprm->wa;
 
   /* Higher-level variables. */
   gal_data_t *vertices=NULL;
-  double *xarr=wa->vertices->array;
-  int quietmmap=wa->vertices->quietmmap;
-  double *yarr=wa->vertices->next->array;
-  size_t minmapsize=wa->vertices->minmapsize;
-  size_t first, size, nt=wa->numthreads, vsize=wa->vertices->size;
+  double *xarr=cprm->coords->array;
+  int quietmmap=cprm->coords->quietmmap;
+  double *yarr=cprm->coords->next->array;
+  size_t minmapsize=cprm->coords->minmapsize;
+  size_t first, size, nt=wa->numthreads, vsize=cprm->coords->size;
 
   /* WCSLIB's conversion functions write intermediate processing steps in
      the 'wcsprm', so each thread should use its own copy. */
@@ -754,24 +785,29 @@ warp_wcsalign_init_convert(void *in_prm)
          tprm->id, first, size);
   */
 
-  /* Allocate the non-allocated vertices table for this thread. */
-  gal_list_data_add_alloc(&vertices, xarr+first, GAL_TYPE_FLOAT64,
-                          1, &size, NULL, 0, minmapsize, quietmmap,
-                          NULL, NULL, NULL);
-  gal_list_data_add_alloc(&vertices, yarr+first, GAL_TYPE_FLOAT64,
-                          1, &size, NULL, 0, minmapsize, quietmmap,
-                          NULL, NULL, NULL);
-  gal_list_data_reverse(&vertices); /* '_add' is last-in-first-out. */
-
-  /* Convert the coordinates. */
-  gal_wcs_img_to_world(vertices, owcs, 1);
-  gal_wcs_world_to_img(vertices, iwcs,  1);
-
-  /* Clean up: since the 'array' pointer is within a larger allocated
-     array, we shouldn't free it when freeing the table, so we'll set it to
-     NULL. */
-  vertices->array=vertices->next->array=NULL;
-  gal_list_data_free(vertices);
+  /* When there are fewer coordinates than threads, some threads have
+     nothing to do. */
+  if(size)
+    {
+      /* Allocate the non-allocated vertices table for this thread. */
+      gal_list_data_add_alloc(&vertices, xarr+first, GAL_TYPE_FLOAT64,
+                              1, &size, NULL, 0, minmapsize, quietmmap,
+                              NULL, NULL, NULL);
+      gal_list_data_add_alloc(&vertices, yarr+first, GAL_TYPE_FLOAT64,
+                              1, &size, NULL, 0, minmapsize, quietmmap,
+                              NULL, NULL, NULL);
+      gal_list_data_reverse(&vertices); /* '_add' is last-in-first-out. */
+
+      /* Convert the coordinates. */
+      gal_wcs_img_to_world(vertices, owcs, 1);
+      gal_wcs_world_to_img(vertices, iwcs,  1);
+
+      /* Clean up: since the 'array' pointer is within a larger allocated
+         array, we shouldn't free it when freeing the table, so we'll set
+         it to NULL. */
+      vertices->array=vertices->next->array=NULL;
+      gal_list_data_free(vertices);
+    }
   gal_wcs_free(iwcs);
   gal_wcs_free(owcs);
 
@@ -784,6 +820,314 @@ warp_wcsalign_init_convert(void *in_prm)
 
 
 
+/* Convert the given output pixel coordinates (two columns of a list) to
+   input pixel coordinates in place. We only want one job per thread, so
+   the number of jobs and the number of threads are the same. */
+static void
+warp_wcsalign_convert(gal_warp_wcsalign_t *wa, gal_data_t *coords)
+{
+  struct warp_wcsalign_convert_params cprm={wa, coords};
+  gal_threads_spin_off(warp_wcsalign_init_convert, &cprm, wa->numthreads,
+                       wa->numthreads, wa->input->minmapsize,
+                       wa->input->quietmmap);
+}
+
+
+
+
+
+/* When 'maxinterperr' is given, the exact WCS conversion (output pixel ->
+   world -> input pixel) is only done on the nodes of a coarse grid over
+   the output, with a separation of 'WARP_WCSALIGN_INTERP_STEP' output
+   pixels. The vertices within each cell of this grid are found with
+   bicubic (Catmull-Rom) interpolation over the 4x4 nodes around the
+   cell. To have a verified error, the exact conversion is also done on
+   the center and the middle of the four sides of each cell and compared
+   with the interpolated value. Any cell where the difference is larger
+   than 'maxinterperr' (in input pixels, or is not a number) is flagged
+   and all the vertices within it are converted exactly.
+
+   Node 'k' of the grid (along each axis) is at '0.5+(k-1)*step', so
+   there is one extra node before the first and two after the last cell
+   (for the 4x4 neighborhood of the cells on the edge). */
+#define WARP_WCSALIGN_INTERP_STEP   16
+#define WARP_WCSALIGN_INTERP_NTEST  5
+
+struct warp_wcsalign_interp_params
+{
+  gal_warp_wcsalign_t     *wa;  /* Main warp parameters.               */
+  size_t                  ncx;  /* Number of cells along horizontal.   */
+  size_t                  ncy;  /* Number of cells along vertical.     */
+  size_t                  nnx;  /* Number of nodes along horizontal.   */
+  double                *nodx;  /* Input X of each node.               */
+  double                *nody;  /* Input Y of each node.               */
+  uint8_t              *exact;  /* Flag of cells that must be exact.   */
+};
+
+
+
+
+
+/* Catmull-Rom weights of the four nodes around a position that is at a
+   fraction of 't' within its cell. */
+static void
+warp_wcsalign_interp_weights(double t, double *w)
+{
+  double t2=t*t, t3=t2*t;
+  w[0] = 0.5f * ( -t3 + 2*t2 - t     );
+  w[1] = 0.5f * ( 3*t3 - 5*t2 + 2    );
+  w[2] = 0.5f * ( -3*t3 + 4*t2 + t   );
+  w[3] = 0.5f * ( t3 - t2            );
+}
+
+
+
+
+
+/* Find the cell of a position (along one axis) and the weights of its
+   four nodes. */
+static size_t
+warp_wcsalign_interp_cell(double pos, size_t nc, double *w)
+{
+  size_t c;
+  double f=(pos-0.5f)/WARP_WCSALIGN_INTERP_STEP;
+
+  c = f<0 ? 0 : (size_t)f;
+  if(c>=nc) c=nc-1;
+  warp_wcsalign_interp_weights(f-c, w);
+  return c;
+}
+
+
+
+
+
+/* Interpolate the node values around a cell. */
+static double
+warp_wcsalign_interp_value(double *nodes, size_t nnx, size_t cx,
+                           size_t cy, double *wx, double *wy)
+{
+  size_t i, j;
+  double *row, sum=0.0f;
+
+  for(j=0;j<4;++j)
+    {
+      row=nodes+(cy+j)*nnx+cx;
+      for(i=0;i<4;++i) sum += wy[j] * wx[i] * row[i];
+    }
+  return sum;
+}
+
+
+
+
+
+/* Interpolate the vertices that are in verified cells, and convert the
+   rest exactly. Similar to 'warp_wcsalign_init_convert', each thread
+   works on a contiguous range of vertices. */
+static void *
+warp_wcsalign_interp_onthread(void *in_prm)
+{
+  /* Low-level definitions to be done first. */
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct warp_wcsalign_interp_params *iprm=
+    (struct warp_wcsalign_interp_params *)tprm->params;
+  gal_warp_wcsalign_t *wa=iprm->wa;
+
+  /* Higher-level variables. */
+  double wx[4], wy[4], *ex, *ey;
+  gal_data_t *ecoords;
+  struct wcsprm *iwcs, *owcs;
+  double *xarr=wa->vertices->array;
+  double *yarr=wa->vertices->next->array;
+  size_t i, cx, cy, nexact=0, *eind=NULL;
+  size_t first, size, nt=wa->numthreads, vsize=wa->vertices->size;
+
+  /* This thread's range of vertices. */
+  size  = vsize/nt;
+  first = vsize/nt*tprm->id;
+  if(tprm->id==nt-1 && nt>1) size=vsize-(nt-1)*size;
+
+  /* Interpolate the vertices in verified cells and keep the index of
+     those in flagged cells. */
+  if(size)
+    {
+      eind=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__,
+                                "eind");
+      for(i=first; i<first+size; ++i)
+        {
+          cx=warp_wcsalign_interp_cell(xarr[i], iprm->ncx, wx);
+          cy=warp_wcsalign_interp_cell(yarr[i], iprm->ncy, wy);
+          if( iprm->exact[cy*iprm->ncx+cx] ) eind[nexact++]=i;
+          else
+            {
+              xarr[i]=warp_wcsalign_interp_value(iprm->nodx, iprm->nnx,
+                                                 cx, cy, wx, wy);
+              yarr[i]=warp_wcsalign_interp_value(iprm->nody, iprm->nnx,
+                                                 cx, cy, wx, wy);
+            }
+        }
+    }
+
+  /* Convert the vertices of the flagged cells exactly. */
+  if(nexact)
+    {
+      /* Copy the output pixel coordinates into a contiguous table. */
+      ecoords=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &nexact, NULL, 0,
+                             -1, 1, NULL, NULL, NULL);
+      ecoords->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &nexact,
+                                   NULL, 0, -1, 1, NULL, NULL, NULL);
+      ex=ecoords->array;
+      ey=ecoords->next->array;
+      for(i=0;i<nexact;++i) { ex[i]=xarr[eind[i]]; ey[i]=yarr[eind[i]]; }
+
+      /* Convert them with this thread's own copy of the WCSs. */
+      iwcs=gal_wcs_copy(wa->input->wcs);
+      owcs=gal_wcs_copy(wa->output->wcs);
+      gal_wcs_img_to_world(ecoords, owcs, 1);
+      gal_wcs_world_to_img(ecoords, iwcs, 1);
+      gal_wcs_free(iwcs);
+      gal_wcs_free(owcs);
+
+      /* Put them back in their place. */
+      for(i=0;i<nexact;++i) { xarr[eind[i]]=ex[i]; yarr[eind[i]]=ey[i]; }
+      gal_list_data_free(ecoords);
+    }
+
+  /* Clean up, wait for all the other threads to finish, then return. */
+  free(eind);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find the input pixel coordinates of all the vertices through the
+   interpolated grid (see the comments at the top of this section). */
+static void
+warp_wcsalign_interp(gal_warp_wcsalign_t *wa)
+{
+  struct warp_wcsalign_interp_params iprm;
+  size_t os0=wa->output->dsize[0], os1=wa->output->dsize[1];
+  size_t step=WARP_WCSALIGN_INTERP_STEP, ntest=WARP_WCSALIGN_INTERP_NTEST;
+
+  gal_data_t *coords=NULL;
+  double *x, *y, ix, iy, wx[4], wy[4], err;
+  size_t i, j, c, nn, ncells, nnx, nny, ncx, ncy, ncoords;
+  const double tx[WARP_WCSALIGN_INTERP_NTEST]={0.5f, 0.5f, 0.0f, 1.0f, 0.5f};
+  const double ty[WARP_WCSALIGN_INTERP_NTEST]={0.5f, 0.0f, 0.5f, 0.5f, 1.0f};
+
+  /* Grid sizes. */
+  ncx = os1/step + (os1%step ? 1 : 0);
+  ncy = os0/step + (os0%step ? 1 : 0);
+  nnx = ncx+3;
+  nny = ncy+3;
+  nn  = nnx*nny;
+  ncells  = ncx*ncy;
+  ncoords = nn + ncells*ntest;
+
+  /* Allocate the coordinates of the nodes (first 'nn' elements) and the
+     test positions (after them). */
+  coords=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &ncoords, NULL, 0,
+                        wa->input->minmapsize, wa->input->quietmmap,
+                        NULL, NULL, NULL);
+  coords->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &ncoords, NULL,
+                              0, wa->input->minmapsize,
+                              wa->input->quietmmap, NULL, NULL, NULL);
+  x=coords->array;
+  y=coords->next->array;
+  for(j=0;j<nny;++j)
+    for(i=0;i<nnx;++i)
+      {
+        x[j*nnx+i] = 0.5f + ((double)i-1.0f)*step;
+        y[j*nnx+i] = 0.5f + ((double)j-1.0f)*step;
+      }
+  for(c=0;c<ncells;++c)
+    for(i=0;i<ntest;++i)
+      {
+        x[nn+c*ntest+i] = 0.5f + (c%ncx + tx[i])*step;
+        y[nn+c*ntest+i] = 0.5f + (c/ncx + ty[i])*step;
+      }
+
+  /* Convert them all exactly. */
+  warp_wcsalign_convert(wa, coords);
+
+  /* Flag the cells where the interpolation error is too large. The
+     interpolated value at each test point is compared with its exact
+     value. Note that 'NaN' values will also be flagged. */
+  iprm.wa=wa;
+  iprm.ncx=ncx;
+  iprm.ncy=ncy;
+  iprm.nnx=nnx;
+  iprm.nodx=x;
+  iprm.nody=y;
+  iprm.exact=gal_pointer_allocate(GAL_TYPE_UINT8, ncells, 1, __func__,
+                                  "iprm.exact");
+  for(c=0;c<ncells;++c)
+    for(i=0;i<ntest;++i)
+      {
+        warp_wcsalign_interp_weights(tx[i], wx);
+        warp_wcsalign_interp_weights(ty[i], wy);
+        ix=warp_wcsalign_interp_value(x, nnx, c%ncx, c/ncx, wx, wy);
+        iy=warp_wcsalign_interp_value(y, nnx, c%ncx, c/ncx, wx, wy);
+        err=sqrt( (ix-x[nn+c*ntest+i])*(ix-x[nn+c*ntest+i])
+                  + (iy-y[nn+c*ntest+i])*(iy-y[nn+c*ntest+i]) );
+        if( !(err<=wa->maxinterperr) ) { iprm.exact[c]=1; break; }
+      }
+
+  /* For a check:
+  {
+    size_t nexact=0;
+    for(c=0;c<ncells;++c) nexact+=iprm.exact[c];
+    printf("%s: %zu of %zu cells need exact conversion\n", __func__,
+           nexact, ncells);
+  }
+  */
+
+  /* Interpolate (or convert) all the vertices. */
+  gal_threads_spin_off(warp_wcsalign_interp_onthread, &iprm,
+                       wa->numthreads, wa->numthreads,
+                       wa->input->minmapsize, wa->input->quietmmap);
+
+  /* Clean up. */
+  free(iprm.exact);
+  gal_list_data_free(coords);
+}
+
+
+
+
+
+/* Input pixel coordinates of the output pixel centers (only used by the
+   interpolation kernels). */
+static void
+warp_wcsalign_init_centers(gal_warp_wcsalign_t *wa)
+{
+  double *x, *y;
+  size_t ind, os1=wa->output->dsize[1], size=wa->output->size;
+
+  /* Allocate the two coordinate columns. */
+  wa->centers=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &size, NULL, 0,
+                             wa->input->minmapsize, wa->input->quietmmap,
+                             "CenterX", NULL, NULL);
+  wa->centers->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &size, NULL,
+                                   0, wa->input->minmapsize,
+                                   wa->input->quietmmap, "CenterY", NULL,
+                                   NULL);
+
+  /* Fill them with the output pixel coordinates and convert them. */
+  x=wa->centers->array;
+  y=wa->centers->next->array;
+  for(ind=0;ind<size;++ind) { x[ind]=ind%os1+1; y[ind]=ind/os1+1; }
+  warp_wcsalign_convert(wa, wa->centers);
+}
+
+
+
+
+
 /* Determine the final image size and allocate the output array
    accordingly.
 
@@ -872,15 +1216,24 @@ gal_warp_wcsalign_init(gal_warp_wcsalign_t *wa)
                                 0, minmapsize, quietmmap,
                                 GAL_WARP_OUTPUT_NAME_MAXFRAC, NULL, NULL);
 
-  /* Set up the output image corners in pixel coords */
-  warp_wcsalign_init_vertices(wa);
+  /* With the interpolation kernels, only the center of each output
+     pixel over the input is necessary (pixel centers are on integers):
+     the area of each output pixel is found from the centers of its
+     neighbors (see 'warp_kernel_area'). */
+  if(wa->kernel!=GAL_WARP_KERNEL_AREA)
+    warp_wcsalign_init_centers(wa);
 
-  /* Project the output image corners to the input image pixel coords. We
-     only want one job per thread, so the number of jobs and the number of
-     threads are the same. */
-  gal_threads_spin_off(warp_wcsalign_init_convert, wa, wa->output->size,
-                       wa->numthreads, wa->input->minmapsize,
-                       wa->input->quietmmap);
+  /* For pixel mixing, project the output image corners to the input
+     image pixel coords: either exactly for every vertice, or through an
+     interpolated grid with a verified maximum error. */
+  else
+    {
+      warp_wcsalign_init_vertices(wa);
+      if( isnan(wa->maxinterperr) || wa->maxinterperr==0.0f )
+        warp_wcsalign_convert(wa, wa->vertices);
+      else
+        warp_wcsalign_interp(wa);
+    }
 
   /* Now that the output image is ready, initialize the helper internal
      variables for future processing. */
@@ -891,6 +1244,207 @@ gal_warp_wcsalign_init(gal_warp_wcsalign_t *wa)
 
 
 
+/* Maximum number of input pixels along each axis that are used by the
+   interpolation kernels (Lanczos-3 has the widest support). */
+#define WARP_KERNEL_MAXWIDTH 6
+
+/* Value of the one-dimensional kernel at a distance of 't' pixels. */
+static double
+warp_kernel_value(uint8_t kernel, double t)
+{
+  double at=fabs(t), pt;
+
+  switch(kernel)
+    {
+    case GAL_WARP_KERNEL_BILINEAR:
+      return at<1.0f ? 1.0f-at : 0.0f;
+
+    /* Keys (1981) cubic convolution kernel with a=-0.5. */
+    case GAL_WARP_KERNEL_BICUBIC:
+      if(at<=1.0f) return (1.5f*at - 2.5f)*at*at + 1.0f;
+      if(at< 2.0f) return ((-0.5f*at + 2.5f)*at - 4.0f)*at + 2.0f;
+      return 0.0f;
+
+    case GAL_WARP_KERNEL_LANCZOS3:
+      if(at<1e-8)  return 1.0f;
+      if(at>=3.0f) return 0.0f;
+      pt=M_PI*t;
+      return 3.0f * sin(pt) * sin(pt/3.0f) / (pt*pt);
+
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at '%s' to "
+            "fix the problem. The kernel code %u isn't recognized",
+            __func__, PACKAGE_BUGREPORT, kernel);
+    }
+
+  /* Control should not reach here. */
+  return NAN;
+}
+
+
+
+
+
+/* Find the first input pixel (in FITS coordinates: pixel centers are on
+   integers) that is used for an interpolation at 'pos' along one axis,
+   and the kernel weights of the pixels after it. The kernels are
+   separable: for each output pixel, the weights are calculated along
+   each axis ('width' values on each), and the weight of every input
+   pixel in its window is the product of the two. */
+static size_t
+warp_kernel_weights(uint8_t kernel, double pos, long *first, double *w)
+{
+  size_t i, width=0;
+
+  /* The nearest neighbor only uses one pixel. */
+  if(kernel==GAL_WARP_KERNEL_NEAREST)
+    {
+      w[0]=1.0f;
+      *first=GAL_DIMENSION_NEARESTINT_HALFHIGHER(pos);
+      return 1;
+    }
+
+  /* The other kernels have a support of 'width' pixels. */
+  switch(kernel)
+    {
+    case GAL_WARP_KERNEL_BILINEAR: width=2; break;
+    case GAL_WARP_KERNEL_BICUBIC:  width=4; break;
+    case GAL_WARP_KERNEL_LANCZOS3: width=6; break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at '%s' to "
+            "fix the problem. The kernel code %u isn't recognized",
+            __func__, PACKAGE_BUGREPORT, kernel);
+    }
+  *first=(long)floor(pos) - (long)(width/2) + 1;
+  for(i=0;i<width;++i) w[i]=warp_kernel_value(kernel, pos-(*first+i));
+  return width;
+}
+
+
+
+
+
+/* Derivative of the input coordinates of the output pixel centers along
+   one axis of the output, at the output pixel 'ind' ('pos' is its
+   position along that axis, which has 'n' pixels that are 'step'
+   elements apart in memory). Central differences are used when both
+   neighbors have usable centers, otherwise a one-sided difference is
+   used. If neither neighbor is usable, 0 is returned. */
+static int
+warp_kernel_derivative(double *cx, double *cy, size_t ind, size_t pos,
+                       size_t n, size_t step, double *dx, double *dy)
+{
+  size_t lo=ind, hi=ind;
+
+  if( pos>0   && !isnan(cx[ind-step]) && !isnan(cy[ind-step]) ) lo-=step;
+  if( pos+1<n && !isnan(cx[ind+step]) && !isnan(cy[ind+step]) ) hi+=step;
+  if(lo==hi) return 0;
+  *dx = (cx[hi]-cx[lo]) / ((hi-lo)/step);
+  *dy = (cy[hi]-cy[lo]) / ((hi-lo)/step);
+  return 1;
+}
+
+
+
+
+
+/* Area of an output pixel over the input (in units of input pixels) for
+   the interpolation kernels. It is the determinant of the local Jacobian
+   of the output-to-input transformation, found from the input
+   coordinates of the neighboring output pixel centers (that are already
+   in 'wa->centers'). So the vertices of each output pixel are not
+   necessary. When the derivative along one axis can't be found (for
+   example an output that is only one pixel wide), the pixel is assumed
+   to be square. */
+static double
+warp_kernel_area(gal_warp_wcsalign_t *wa, size_t ind)
+{
+  int hasi, hasj;
+  double dxdi, dydi, dxdj, dydj;
+  double *cx=wa->centers->array, *cy=wa->centers->next->array;
+  size_t os0=wa->output->dsize[0], os1=wa->output->dsize[1];
+
+  hasi=warp_kernel_derivative(cx, cy, ind, ind%os1, os1, 1,   &dxdi,
+                              &dydi);
+  hasj=warp_kernel_derivative(cx, cy, ind, ind/os1, os0, os1, &dxdj,
+                              &dydj);
+  if(hasi && hasj) return fabs(dxdi*dydj - dxdj*dydi);
+  else if(hasi)    return dxdi*dxdi + dydi*dydi;
+  else if(hasj)    return dxdj*dxdj + dydj*dydj;
+  else             return NAN;
+}
+
+
+
+
+
+/* Fill one output pixel with the interpolation kernels (not the default
+   flux-conserving pixel mixing). The pixel's center over the input is
+   already in 'wa->centers'. Similar to the pixel mixing, input pixels
+   that are blank or outside the input don't contribute, and if the sum
+   of the weights of the used pixels is less than 'coveredfrac' of the
+   full kernel, the output is blank. To have the same units as the pixel
+   mixing (sum of input pixel values), the interpolated value is
+   multiplied by the area of the output pixel over the input (see
+   'warp_kernel_area'). */
+static void
+warp_wcsalign_onpix_kernel(gal_warp_wcsalign_t *wa, size_t ind)
+{
+  gal_data_t *input=wa->input;
+  double *outputarr=wa->output->array;
+  double *cx=wa->centers->array, *cy=wa->centers->next->array;
+  double *inputarr=input->array, *row, v, w, rsum, rwsum;
+  long x0, y0, x, y, is0=input->dsize[0], is1=input->dsize[1];
+  double wx[WARP_KERNEL_MAXWIDTH], wy[WARP_KERNEL_MAXWIDTH];
+  double sum=0.0f, wsum=0.0f, wall=0.0f, wxall=0.0f;
+  size_t i, j, nx, ny;
+
+  /* If the center couldn't be converted, this pixel is blank. */
+  if( isnan(cx[ind]) || isnan(cy[ind]) ) { outputarr[ind]=NAN; return; }
+
+  /* Weights along each axis. */
+  nx=warp_kernel_weights(wa->kernel, cx[ind], &x0, wx);
+  ny=warp_kernel_weights(wa->kernel, cy[ind], &y0, wy);
+  for(i=0;i<nx;++i) wxall+=wx[i];
+
+  /* Go over the rows of the kernel's window. */
+  for(j=0;j<ny;++j)
+    {
+      /* Total weight (of the full kernel). */
+      wall += wy[j]*wxall;
+
+      /* If the row isn't in the input, go to the next. */
+      y=y0+j;
+      if( y<1 || y>is0 ) continue;
+
+      /* Sum over the pixels of this row with the horizontal weights. */
+      rsum=rwsum=0.0f;
+      row=inputarr+(y-1)*is1-1;
+      for(i=0;i<nx;++i)
+        {
+          x=x0+i;
+          if( x<1 || x>is1 ) continue;
+          v=row[x];
+          if( !isnan(v) ) { w=wx[i]; rsum+=w*v; rwsum+=w; }
+        }
+
+      /* Add this row with its vertical weight. */
+      sum  += wy[j]*rsum;
+      wsum += wy[j]*rwsum;
+    }
+
+  /* Write the final value (see if the pixel should be blank because of
+     not enough coverage). */
+  if( wsum==0.0f || wsum/wall < wa->coveredfrac-1e-5 )
+    outputarr[ind]=NAN;
+  else
+    outputarr[ind] = sum/wsum * warp_kernel_area(wa, ind);
+}
+
+
+
+
+
 void
 gal_warp_wcsalign_onpix(gal_warp_wcsalign_t *wa, size_t ind)
 {
@@ -910,6 +1464,10 @@ gal_warp_wcsalign_onpix(gal_warp_wcsalign_t *wa, size_t ind)
   double ccrn[GAL_POLYGON_MAX_CORNERS], area;
   double *maxfrac=output->next ? output->next->array : NULL;
 
+  /* The interpolation kernels are done in a separate function. */
+  if(wa->kernel!=GAL_WARP_KERNEL_AREA)
+    { warp_wcsalign_onpix_kernel(wa, ind); return; }
+
   /* Initialize if asked for each pixel's maximum coverage fraction. */
   if(maxfrac) maxfrac[ind]=-DBL_MAX;
 
@@ -1055,10 +1613,12 @@ gal_warp_wcsalign_template()
   wa.center=NULL;
   wa.output=NULL;
   wa.vertices=NULL;
+  wa.centers=NULL;
   wa.widthinpix=NULL;
 
   /* Initialize values. */
   wa.checkmaxfrac=0;
+  wa.kernel=GAL_WARP_KERNEL_AREA;
   wa.isccw=GAL_BLANK_INT;
   wa.v0=GAL_BLANK_SIZE_T;
   wa.gcrn=GAL_BLANK_SIZE_T;
@@ -1067,6 +1627,7 @@ gal_warp_wcsalign_template()
   wa.numthreads=GAL_BLANK_SIZE_T;
   wa.coveredfrac=GAL_BLANK_FLOAT64;
   wa.edgesampling=GAL_BLANK_SIZE_T;
+  wa.maxinterperr=GAL_BLANK_FLOAT64;
 
   return wa;
 }
@@ -1081,6 +1642,8 @@ gal_warp_wcsalign_free(gal_warp_wcsalign_t *wa)
 {
   gal_list_data_free(wa->vertices);
   wa->vertices=NULL;
+  gal_list_data_free(wa->centers);
+  wa->centers=NULL;
 }
 
 
@@ -1185,3 +1748,470 @@ gal_warp_pixelarea(gal_warp_wcsalign_t *wa)
   /* Clean up. */
   gal_warp_wcsalign_free(wa);
 }
+
+
+
+
+
+/* Parameters to build the plan on threads: each thread works on a
+   contiguous range of output pixels and keeps its own growing list of
+   the non-zero elements (which are later merged in order). */
+struct warp_plan_build_params
+{
+  gal_warp_wcsalign_t      *wa;  /* The initialized alignment.          */
+  gal_warp_plan_t        *plan;  /* Plan (only 'rowptr' and 'total').   */
+  size_t               *tfirst;  /* First output pixel of each thread.  */
+  size_t               *tsize;  /* Number of output pixels per thread. */
+  size_t                 *tnum;  /* Number of elements in each thread.  */
+  size_t               **tcols;  /* Input pixel of elements per thread. */
+  double             **tweight;  /* Weight of elements per thread.      */
+};
+
+
+
+
+
+/* Add one element to the growing arrays of one thread. */
+static void
+warp_plan_add(size_t **cols, double **weight, size_t *num, size_t *alloc,
+              size_t col, double w)
+{
+  /* Allocate more space if necessary. */
+  if(*num==*alloc)
+    {
+      *alloc = *alloc ? 2 * *alloc : 1024;
+      errno=0;
+      *cols=realloc(*cols, *alloc * sizeof **cols);
+      *weight=realloc(*weight, *alloc * sizeof **weight);
+      if(*cols==NULL || *weight==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu elements",
+              __func__, *alloc);
+    }
+
+  /* Add the element. */
+  (*cols)[*num]=col;
+  (*weight)[*num]=w;
+  ++*num;
+}
+
+
+
+
+
+/* Find the elements of one output pixel (row of the sparse matrix). This
+   is the same as 'gal_warp_wcsalign_onpix' (for the area kernel) and
+   'warp_wcsalign_onpix_kernel' (for the others), but the input pixel
+   values are not used: only the input pixels and their weights are
+   kept. */
+static void
+warp_plan_pixel(gal_warp_wcsalign_t *wa, size_t ind, size_t **cols,
+                double **weight, size_t *num, size_t *alloc, double *total,
+                double *scale)
+{
+  size_t i, j, ic, nx, ny;
+  double wx[WARP_KERNEL_MAXWIDTH], wy[WARP_KERNEL_MAXWIDTH], wxall=0.0f;
+  long is0=wa->input->dsize[0], is1=wa->input->dsize[1];
+  double ccrn[GAL_POLYGON_MAX_CORNERS], pcrn[8], *ocrn;
+  long xstart, ystart, xend, yend, x, y, x0, y0;
+  double xmin, xmax, ymin, ymax, *cx, *cy;
+  size_t numcrn, ncrn=wa->ncrn;
+
+  /* Interpolation kernels. */
+  if(wa->kernel!=GAL_WARP_KERNEL_AREA)
+    {
+      *total=0.0f;
+      *scale=warp_kernel_area(wa, ind);
+      cx=wa->centers->array;
+      cy=wa->centers->next->array;
+      if( !isnan(cx[ind]) && !isnan(cy[ind]) )
+        {
+          nx=warp_kernel_weights(wa->kernel, cx[ind], &x0, wx);
+          ny=warp_kernel_weights(wa->kernel, cy[ind], &y0, wy);
+          for(i=0;i<nx;++i) wxall+=wx[i];
+          for(j=0;j<ny;++j)
+            {
+              *total += wy[j]*wxall;
+              y=y0+j;
+              if( y<1 || y>is0 ) continue;
+              for(i=0;i<nx;++i)
+                {
+                  x=x0+i;
+                  if( x<1 || x>is1 ) continue;
+                  warp_plan_add(cols, weight, num, alloc, (y-1)*is1+x-1,
+                                wy[j]*wx[i]);
+                }
+            }
+        }
+      return;
+    }
+
+  /* Pixel mixing: vertices of the output pixel over the input and the
+     range of input pixels that may overlap. */
+  ocrn = ( wa->isccw==1
+           ? warp_pixel_perimeter_cw(wa, ind)
+           : warp_pixel_perimeter_ccw(wa, ind) );
+  xmin =  DBL_MAX; ymin =  DBL_MAX;
+  xmax = -DBL_MAX; ymax = -DBL_MAX;
+  for(ic=ncrn; ic--;)
+    {
+      if(xmin > ocrn[ ic*2   ]) xmin = ocrn[ ic*2   ];
+      if(xmax < ocrn[ ic*2   ]) xmax = ocrn[ ic*2   ];
+      if(ymin > ocrn[ ic*2+1 ]) ymin = ocrn[ ic*2+1 ];
+      if(ymax < ocrn[ ic*2+1 ]) ymax = ocrn[ ic*2+1 ];
+    }
+  xstart = GAL_DIMENSION_NEARESTINT_HALFHIGHER( xmin );
+  ystart = GAL_DIMENSION_NEARESTINT_HALFHIGHER( ymin );
+  xend   = GAL_DIMENSION_NEARESTINT_HALFLOWER(  xmax ) + 1;
+  yend   = GAL_DIMENSION_NEARESTINT_HALFLOWER(  ymax ) + 1;
+
+  /* Overlap with each input pixel. */
+  for(y=ystart;y<yend;++y)
+    {
+      if( y<1 || y>is0 ) continue;
+      pcrn[1]=y-0.5f; pcrn[3]=y-0.5f;
+      pcrn[5]=y+0.5f; pcrn[7]=y+0.5f;
+      for(x=xstart;x<xend;++x)
+        {
+          if( x<1 || x>is1 ) continue;
+          pcrn[0]=x-0.5f; pcrn[2]=x+0.5f;
+          pcrn[4]=x+0.5f; pcrn[6]=x-0.5f;
+          numcrn=0;
+          gal_polygon_clip(ocrn, ncrn, pcrn, 4, ccrn, &numcrn);
+          warp_plan_add(cols, weight, num, alloc, (y-1)*is1+x-1,
+                        gal_polygon_area(ccrn, numcrn));
+        }
+    }
+
+  /* The total is the area of the output pixel. */
+  *scale=1.0f;
+  *total=gal_polygon_area(ocrn, ncrn);
+  free(ocrn);
+}
+
+
+
+
+
+/* Build the plan of a range of output pixels on one thread. */
+static void *
+warp_plan_build_onthread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct warp_plan_build_params *bprm=
+    (struct warp_plan_build_params *)tprm->params;
+  gal_warp_wcsalign_t *wa=bprm->wa;
+  gal_warp_plan_t *plan=bprm->plan;
+
+  size_t nt=wa->numthreads, osize=wa->output->size;
+  size_t ind, first, size, num=0, alloc=0, *cols=NULL;
+  double *weight=NULL;
+
+  /* This thread's range of output pixels. */
+  size  = osize/nt;
+  first = osize/nt*tprm->id;
+  if(tprm->id==nt-1 && nt>1) size=osize-(nt-1)*size;
+
+  /* Find the elements of each output pixel. The 'rowptr' of each pixel
+     is the number of elements before it in this thread for now (it is
+     corrected after all threads are finished). */
+  for(ind=first; ind<first+size; ++ind)
+    {
+      plan->rowptr[ind]=num;
+      warp_plan_pixel(wa, ind, &cols, &weight, &num, &alloc,
+                      &plan->total[ind], &plan->scale[ind]);
+    }
+
+  /* Keep this thread's elements. */
+  bprm->tsize[tprm->id]=size;
+  bprm->tfirst[tprm->id]=first;
+  bprm->tnum[tprm->id]=num;
+  bprm->tcols[tprm->id]=cols;
+  bprm->tweight[tprm->id]=weight;
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Apply the plan on one input over a range of output pixels. */
+struct warp_plan_apply_params
+{
+  gal_warp_plan_t        *plan;  /* The plan.                           */
+  gal_data_t            *input;  /* Input image.                        */
+  gal_data_t           *output;  /* Output image.                       */
+};
+
+static void *
+warp_plan_apply_onthread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct warp_plan_apply_params *aprm=
+    (struct warp_plan_apply_params *)tprm->params;
+  gal_warp_plan_t *plan=aprm->plan;
+
+  size_t i, e, ind, numinput;
+  double *in=aprm->input->array, *out=aprm->output->array;
+  double v, sum, wsum, *weight=plan->weight, *total=plan->total;
+  size_t *rowptr=plan->rowptr, *colind=plan->colind;
+
+  /* Go over the output pixels of this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Sum the non-blank input pixels with their weights. */
+      ind=tprm->indexs[i];
+      numinput=0;
+      sum=wsum=0.0f;
+      for(e=rowptr[ind]; e<rowptr[ind+1]; ++e)
+        {
+          v=in[ colind[e] ];
+          if( !isnan(v) )
+            { ++numinput; sum+=weight[e]*v; wsum+=weight[e]; }
+        }
+
+      /* Write the output value (similar to 'gal_warp_wcsalign_onpix'
+         and 'warp_wcsalign_onpix_kernel'). */
+      if(plan->kernel==GAL_WARP_KERNEL_AREA)
+        out[ind] = ( numinput==0
+                     || wsum/total[ind] < plan->coveredfrac-1e-5
+                     ? NAN : sum );
+      else
+        out[ind] = ( wsum==0.0f
+                     || wsum/total[ind] < plan->coveredfrac-1e-5
+                     ? NAN : sum/wsum*plan->scale[ind] );
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Build a plan from the given alignment parameters: all the output pixels
+   and their overlaps (weights) with the input pixels are kept in a sparse
+   matrix. Any other input that has the same size and WCS (see
+   'gal_warp_plan_usable') can then be aligned to the same output grid
+   with 'gal_warp_plan_apply' (which is just a sparse matrix-vector
+   product). Like 'gal_warp_wcsalign', 'wa->output' will contain the
+   aligned 'wa->input' and the internal variables of 'wa' will be
+   freed. */
+gal_warp_plan_t *
+gal_warp_plan_make(gal_warp_wcsalign_t *wa)
+{
+  gal_warp_plan_t *plan;
+  gal_data_t *out, *input;
+  struct warp_plan_build_params bprm;
+  size_t t, e, nt, osize, nelem=0, *offsets;
+
+  /* The maximum fraction check is only done with each pixel. */
+  if(wa->checkmaxfrac)
+    error(EXIT_FAILURE, 0, "%s: 'checkmaxfrac' can't be used with a "
+          "plan", __func__);
+
+  /* Calculate and allocate the output image size and WCS. */
+  gal_warp_wcsalign_init(wa);
+  nt=wa->numthreads;
+  input=wa->input;
+  out=wa->output;
+  osize=out->size;
+
+  /* Allocate the plan. */
+  errno=0;
+  plan=malloc(sizeof *plan);
+  if(plan==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'plan'",
+          __func__, sizeof *plan);
+  plan->kernel=wa->kernel;
+  plan->numthreads=nt;
+  plan->coveredfrac=wa->coveredfrac;
+  plan->insize[0]=input->dsize[0];
+  plan->insize[1]=input->dsize[1];
+  plan->outsize[0]=out->dsize[0];
+  plan->outsize[1]=out->dsize[1];
+  plan->iwcs=gal_wcs_copy(input->wcs);
+  plan->owcs=gal_wcs_copy(out->wcs);
+  plan->rowptr=gal_pointer_allocate(GAL_TYPE_SIZE_T, osize+1, 0,
+                                    __func__, "plan->rowptr");
+  plan->total=gal_pointer_allocate(GAL_TYPE_FLOAT64, osize, 0, __func__,
+                                   "plan->total");
+  plan->scale=gal_pointer_allocate(GAL_TYPE_FLOAT64, osize, 0, __func__,
+                                   "plan->scale");
+
+  /* Find the elements of all output pixels (one job per thread). */
+  bprm.wa=wa;
+  bprm.plan=plan;
+  bprm.tnum=gal_pointer_allocate(GAL_TYPE_SIZE_T, nt, 1, __func__,
+                                 "bprm.tnum");
+  bprm.tsize=gal_pointer_allocate(GAL_TYPE_SIZE_T, nt, 1, __func__,
+                                  "bprm.tsize");
+  bprm.tfirst=gal_pointer_allocate(GAL_TYPE_SIZE_T, nt, 1, __func__,
+                                   "bprm.tfirst");
+  offsets=gal_pointer_allocate(GAL_TYPE_SIZE_T, nt, 1, __func__,
+                               "offsets");
+  errno=0;
+  bprm.tcols=calloc(nt, sizeof *bprm.tcols);
+  bprm.tweight=calloc(nt, sizeof *bprm.tweight);
+  if(bprm.tcols==NULL || bprm.tweight==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating thread arrays", __func__);
+  gal_threads_spin_off(warp_plan_build_onthread, &bprm, nt, nt,
+                       input->minmapsize, input->quietmmap);
+
+  /* Merge the elements of all threads into the compressed rows. */
+  for(t=0;t<nt;++t) { offsets[t]=nelem; nelem+=bprm.tnum[t]; }
+  plan->nelem=nelem;
+  plan->colind=gal_pointer_allocate(GAL_TYPE_SIZE_T, nelem ? nelem : 1, 0,
+                                    __func__, "plan->colind");
+  plan->weight=gal_pointer_allocate(GAL_TYPE_FLOAT64, nelem ? nelem : 1,
+                                    0, __func__, "plan->weight");
+  for(t=0;t<nt;++t)
+    {
+      for(e=0;e<bprm.tnum[t];++e)
+        {
+          plan->colind[offsets[t]+e]=bprm.tcols[t][e];
+          plan->weight[offsets[t]+e]=bprm.tweight[t][e];
+        }
+      free(bprm.tcols[t]);
+      free(bprm.tweight[t]);
+    }
+  for(t=0;t<nt;++t)
+    for(e=bprm.tfirst[t]; e<bprm.tfirst[t]+bprm.tsize[t]; ++e)
+      plan->rowptr[e] += offsets[t];
+  plan->rowptr[osize]=nelem;
+
+  /* Align the input with the plan (the output is already allocated). */
+  gal_warp_plan_apply_to(plan, input, out);
+
+  /* Clean up and return. */
+  free(offsets);
+  free(bprm.tnum);
+  free(bprm.tsize);
+  free(bprm.tfirst);
+  free(bprm.tcols);
+  free(bprm.tweight);
+  gal_warp_wcsalign_free(wa);
+  return plan;
+}
+
+
+
+
+
+/* See if the plan can be used on the given input: it should have the same
+   size, and its WCS should give the same pixel coordinates as the WCS
+   that the plan was built with (checked on the corners, the middle of
+   the sides and the center of the image). */
+int
+gal_warp_plan_usable(gal_warp_plan_t *plan, gal_data_t *input)
+{
+  size_t i, n=9;
+  int usable=1;
+  gal_data_t *coords;
+  double *x, *y, ox[9], oy[9];
+  size_t is0=plan->insize[0], is1=plan->insize[1];
+
+  /* The sizes have to be the same. */
+  if(input->ndim!=2 || input->wcs==NULL
+     || input->dsize[0]!=is0 || input->dsize[1]!=is1)
+    return 0;
+
+  /* The test pixels. */
+  coords=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &n, NULL, 0, -1, 1,
+                        NULL, NULL, NULL);
+  coords->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &n, NULL, 0, -1,
+                              1, NULL, NULL, NULL);
+  x=coords->array;
+  y=coords->next->array;
+  for(i=0;i<n;++i)
+    {
+      ox[i] = x[i] = 0.5f + (i%3) * is1 / 2.0f;
+      oy[i] = y[i] = 0.5f + (i/3) * is0 / 2.0f;
+    }
+
+  /* Convert them to world coordinates with the input's WCS and back with
+     the plan's WCS. */
+  gal_wcs_img_to_world(coords, input->wcs, 1);
+  gal_wcs_world_to_img(coords, plan->iwcs, 1);
+
+  /* Compare with the original pixel coordinates. */
+  for(i=0;i<n;++i)
+    if( !( fabs(x[i]-ox[i])<GAL_WARP_PLAN_TOLERANCE
+           && fabs(y[i]-oy[i])<GAL_WARP_PLAN_TOLERANCE ) )
+      { usable=0; break; }
+
+  /* Clean up and return. */
+  gal_list_data_free(coords);
+  return usable;
+}
+
+
+
+
+
+/* Align 'input' into the already allocated 'output' with the plan. */
+void
+gal_warp_plan_apply_to(gal_warp_plan_t *plan, gal_data_t *input,
+                       gal_data_t *output)
+{
+  struct warp_plan_apply_params aprm={plan, input, output};
+
+  /* Basic sanity checks. */
+  if(input->type!=GAL_TYPE_FLOAT64 || output->type!=GAL_TYPE_FLOAT64)
+    error(EXIT_FAILURE, 0, "%s: the input and output must have a double "
+          "precision floating point type", __func__);
+  if(input->ndim!=2 || input->dsize[0]!=plan->insize[0]
+     || input->dsize[1]!=plan->insize[1])
+    error(EXIT_FAILURE, 0, "%s: the input doesn't have the same size as "
+          "the input that the plan was built with", __func__);
+  if(output->ndim!=2 || output->dsize[0]!=plan->outsize[0]
+     || output->dsize[1]!=plan->outsize[1])
+    error(EXIT_FAILURE, 0, "%s: the output doesn't have the same size as "
+          "the plan's output", __func__);
+
+  /* Do the sparse matrix-vector product. */
+  gal_threads_spin_off(warp_plan_apply_onthread, &aprm, output->size,
+                       plan->numthreads, input->minmapsize,
+                       input->quietmmap);
+}
+
+
+
+
+
+/* Align 'input' to the plan's output grid and return the new output. */
+gal_data_t *
+gal_warp_plan_apply(gal_warp_plan_t *plan, gal_data_t *input)
+{
+  gal_data_t *output;
+
+  /* Allocate the output and fill it. */
+  output=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, plan->outsize,
+                        plan->owcs, 0, input->minmapsize, input->quietmmap,
+                        GAL_WARP_OUTPUT_NAME_WARPED, NULL, NULL);
+  gal_warp_plan_apply_to(plan, input, output);
+  return output;
+}
+
+
+
+
+
+/* Free all the allocated space of the plan. */
+void
+gal_warp_plan_free(gal_warp_plan_t *plan)
+{
+  if(plan==NULL) return;
+  gal_wcs_free(plan->iwcs);
+  gal_wcs_free(plan->owcs);
+  free(plan->rowptr);
+  free(plan->colind);
+  free(plan->weight);
+  free(plan->total);
+  free(plan->scale);
+  free(plan);
+}
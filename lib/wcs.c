@@ -39,6 +39,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/tile.h>
 #include <gnuastro/fits.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/dimension.h>
 #include <gnuastro/statistics.h>
 #include <gnuastro/permutation.h>
@@ -2303,15 +2304,32 @@ gal_wcs_coverage(char *filename, char *hdu, size_t *ondim,
 /**************************************************************/
 /**********            Array conversion            ************/
 /**************************************************************/
+/* Number of coordinates that are converted with each call to WCSLIB's
+   conversion functions (the scratch arrays that WCSLIB needs are only
+   allocated for this many coordinates, once per thread). */
+#define WCS_CONVERT_CHUNK 4096
+
+/* Parameters for the threaded conversion. */
+struct wcs_convert_params
+{
+  int           world2img;  /* 1: world to image; 0: image to world.    */
+  struct wcsprm      *wcs;  /* The caller's WCS structure.              */
+  gal_data_t      *coords;  /* Input coordinates (one column per dim).  */
+  gal_data_t         *out;  /* Output coordinates (can be 'coords').    */
+  size_t       numthreads;  /* Number of threads (for copying the WCS). */
+};
+
+
+
+
+
 /* Some sanity checks for the WCS conversion functions. */
 static void
-wcs_convert_sanity_check_alloc(gal_data_t *coords, struct wcsprm *wcs,
-                               const char *func, int **stat, double **phi,
-                               double **theta, double **world,
-                               double **pixcrd, double **imgcrd)
+wcs_convert_sanity_check(gal_data_t *coords, struct wcsprm *wcs,
+                         const char *func)
 {
   gal_data_t *tmp;
-  size_t ndim=0, firstsize=0, size=coords->size;
+  size_t ndim=0, firstsize=0;
 
   /* Make sure a WCS structure is actually given. */
   if(wcs==NULL)
@@ -2349,20 +2367,6 @@ wcs_convert_sanity_check_alloc(gal_data_t *coords, struct wcsprm *wcs,
     error(EXIT_FAILURE, 0, "%s: the number of input coordinates (%zu) does "
           "not match the dimensions of the input WCS structure (%d)", func,
           ndim, wcs->naxis);
-
-  /* Allocate all the necessary arrays. */
-  *phi    = gal_pointer_allocate( GAL_TYPE_FLOAT64, size,      0, __func__,
-                                  "phi");
-  *stat   = gal_pointer_allocate( GAL_TYPE_INT,     size,      1, __func__,
-                                  "stat");
-  *theta  = gal_pointer_allocate( GAL_TYPE_FLOAT64, size,      0, __func__,
-                                  "theta");
-  *world  = gal_pointer_allocate( GAL_TYPE_FLOAT64, ndim*size, 0, __func__,
-                                  "world");
-  *imgcrd = gal_pointer_allocate( GAL_TYPE_FLOAT64, ndim*size, 0, __func__,
-                                  "imgcrd");
-  *pixcrd = gal_pointer_allocate( GAL_TYPE_FLOAT64, ndim*size, 0, __func__,
-                                  "pixcrd");
 }
 
 
@@ -2372,24 +2376,28 @@ wcs_convert_sanity_check_alloc(gal_data_t *coords, struct wcsprm *wcs,
 /* In Gnuastro, each column (coordinate for WCS conversion) is treated as a
    separate array in a 'gal_data_t' that are linked through a linked
    list. But in WCSLIB, the input is a single array (with multiple
-   columns). This function will convert between the two. */
+   columns). This function will convert between the two for the 'num'
+   coordinates that start at 'first'. */
 static void
 wcs_convert_list_to_from_array(gal_data_t *list, double *array, int *stat,
-                               size_t ndim, int to0from1)
+                               size_t ndim, size_t first, size_t num,
+                               int to0from1)
 {
   size_t i, d=0;
   gal_data_t *tmp;
+  double *carr;
 
   for(tmp=list; tmp!=NULL; tmp=tmp->next)
     {
       /* Put all this coordinate's values into the single array that is
          input into or output from WCSLIB. */
-      for(i=0;i<list->size;++i)
+      carr=(double *)(tmp->array)+first;
+      for(i=0;i<num;++i)
         {
           if(to0from1)
-            ((double *)(tmp->array))[i] = stat[i] ? NAN : array[i*ndim+d];
+            carr[i] = stat[i] ? NAN : array[i*ndim+d];
           else
-            array[i*ndim+d] = ((double *)(tmp->array))[i];
+            array[i*ndim+d] = carr[i];
         }
 
       /* Increment the dimension. */
@@ -2423,17 +2431,103 @@ wcs_convert_prepare_out(gal_data_t *coords, struct wcsprm *wcs, int inplace)
 
 
 
-/* Convert world coordinates to image coordinates given the input WCS
-   structure. The input must be a linked list of data structures of float64
-   ('double') type. The top element of the linked list must be the first
-   coordinate and etc. If 'inplace' is non-zero, then the output will be
-   written into the input's allocated space. */
-gal_data_t *
-gal_wcs_world_to_img(gal_data_t *coords, struct wcsprm *wcs, int inplace)
+/* Worker function for the conversion: each job is one chunk of
+   'WCS_CONVERT_CHUNK' coordinates. WCSLIB's conversion functions write
+   intermediate processing steps in the 'wcsprm', so when there is more
+   than one thread, each thread uses its own copy. */
+static void *
+wcs_convert_on_thread(void *in_prm)
+{
+  /* Low-level definitions to be done first. */
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct wcs_convert_params *p=(struct wcs_convert_params *)tprm->params;
+
+  /* Higher-level definitions. */
+  int *stat;
+  size_t i, first, num, size=p->coords->size;
+  double *phi, *theta, *world, *pixcrd, *imgcrd;
+  size_t chunk = size<WCS_CONVERT_CHUNK ? size : WCS_CONVERT_CHUNK;
+  struct wcsprm *wcs = p->numthreads>1 ? gal_wcs_copy(p->wcs) : p->wcs;
+  size_t ndim=wcs->naxis;
+
+  /* Allocate the scratch arrays (only once for all the jobs). */
+  phi    = gal_pointer_allocate( GAL_TYPE_FLOAT64, chunk,      0, __func__,
+                                 "phi");
+  stat   = gal_pointer_allocate( GAL_TYPE_INT,     chunk,      1, __func__,
+                                 "stat");
+  theta  = gal_pointer_allocate( GAL_TYPE_FLOAT64, chunk,      0, __func__,
+                                 "theta");
+  world  = gal_pointer_allocate( GAL_TYPE_FLOAT64, ndim*chunk, 0, __func__,
+                                 "world");
+  imgcrd = gal_pointer_allocate( GAL_TYPE_FLOAT64, ndim*chunk, 0, __func__,
+                                 "imgcrd");
+  pixcrd = gal_pointer_allocate( GAL_TYPE_FLOAT64, ndim*chunk, 0, __func__,
+                                 "pixcrd");
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Range of coordinates in this chunk. */
+      first = tprm->indexs[i] * WCS_CONVERT_CHUNK;
+      num   = first+chunk>size ? size-first : chunk;
+
+      /* Use WCSLIB's wcss2p or wcsp2s for the conversion. We are
+         ignoring the over-all status here, because we will use the
+         'stat' array to set all bad coordinates to NaN. */
+      if(p->world2img)
+        {
+          wcs_convert_list_to_from_array(p->coords, world, stat, ndim,
+                                         first, num, 0);
+          wcss2p(wcs, num, ndim, world, phi, theta, imgcrd, pixcrd, stat);
+          wcs_convert_list_to_from_array(p->out, pixcrd, stat, ndim,
+                                         first, num, 1);
+        }
+      else
+        {
+          wcs_convert_list_to_from_array(p->coords, pixcrd, stat, ndim,
+                                         first, num, 0);
+          wcsp2s(wcs, num, ndim, pixcrd, imgcrd, phi, theta, world, stat);
+          wcs_convert_list_to_from_array(p->out, world, stat, ndim,
+                                         first, num, 1);
+        }
+
+      /* For a check.
+      {
+        size_t j;
+        printf("\n\n%s sanity check (%zu dimensions):\n", __func__, ndim);
+        for(j=0;j<num && ndim==2;++j)
+          printf("(%-10g %-10g) --> (%-10g %-10g), [stat: %d]\n",
+                 pixcrd[j*2], pixcrd[j*2+1],
+                 world[j*2],  world[j*2+1], stat[j]);
+      }
+      */
+    }
+
+  /* Clean up. */
+  free(phi);
+  free(stat);
+  free(theta);
+  free(world);
+  free(imgcrd);
+  free(pixcrd);
+  if(wcs!=p->wcs) gal_wcs_free(wcs);
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Low-level function for all the conversions. */
+static gal_data_t *
+wcs_convert(gal_data_t *coords, struct wcsprm *wcs, int inplace,
+            size_t numthreads, int world2img, const char *func)
 {
-  gal_data_t *out;
-  int *stat=NULL, ncoord=coords->size, nelem;
-  double *phi=NULL, *theta=NULL, *world=NULL, *pixcrd=NULL, *imgcrd=NULL;
+  size_t nchunks;
+  struct wcs_convert_params p;
 
   /* It can happen that the input datasets are empty. In this case, simply
      return them. */
@@ -2442,62 +2536,44 @@ gal_wcs_world_to_img(gal_data_t *coords, struct wcsprm *wcs, int inplace)
       if(inplace) return coords;
       else error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at "
                  "'%s' to fix the problem. The input has no data and "
-                 "'inplace' is not called", __func__, PACKAGE_BUGREPORT);
+                 "'inplace' is not called", func, PACKAGE_BUGREPORT);
     }
 
-
   /* Some sanity checks. */
-  wcs_convert_sanity_check_alloc(coords, wcs, __func__, &stat, &phi,
-                                 &theta, &world, &pixcrd, &imgcrd);
-  nelem=wcs->naxis; /* We have to make sure a WCS is given first. */
-
-
-  /* Write the values from the input list of separate columns into a single
-     array (WCSLIB input). */
-  wcs_convert_list_to_from_array(coords, world, stat, wcs->naxis, 0);
-
-
-  /* Use WCSLIB's wcss2p for the conversion. We are ignoring the over-all
-     status here, because later we will use the 'stat' array to set all bad
-     coordinates to NaN. */
-  wcss2p(wcs, ncoord, nelem, world, phi, theta, imgcrd, pixcrd, stat);
-
-
-  /* For a sanity check.
-  {
-    size_t i;
-    printf("\n\n%s sanity check:\n", __func__);
-    for(i=0;i<coords->size;++i)
-      printf("(%g, %g) --> phi:%g, theta: %g --> (%g, %g) --> (%g, %g) "
-             "[stat: %d]\n",
-             world[i*2],  world[i*2+1],
-             phi[i*2],    theta[i*2],
-             imgcrd[i*2], imgcrd[i*2+1],
-             pixcrd[i*2], pixcrd[i*2+1], stat[i]);
-    printf("stat: %d\n", stat[4]);
-  }
-  */
-
+  wcs_convert_sanity_check(coords, wcs, func);
 
   /* Allocate the output arrays if they were not already allocated. */
-  out=wcs_convert_prepare_out(coords, wcs, inplace);
+  p.wcs=wcs;
+  p.coords=coords;
+  p.world2img=world2img;
+  p.out=wcs_convert_prepare_out(coords, wcs, inplace);
+
+  /* There is no need for more threads than chunks (and copying the WCS
+     is not necessary with one thread). */
+  nchunks = coords->size/WCS_CONVERT_CHUNK
+            + (coords->size%WCS_CONVERT_CHUNK ? 1 : 0);
+  if(numthreads==0) numthreads=gal_threads_number();
+  p.numthreads = numthreads<nchunks ? numthreads : nchunks;
+
+  /* Do the conversion and return the output list of coordinates. */
+  gal_threads_spin_off(wcs_convert_on_thread, &p, nchunks, p.numthreads,
+                       coords->minmapsize, coords->quietmmap);
+  return p.out;
+}
 
 
-  /* Write the output from a single array (WCSLIB output) into the output
-     list of this function. */
-  wcs_convert_list_to_from_array(out, pixcrd, stat, wcs->naxis, 1);
 
 
-  /* Clean up. */
-  free(phi);
-  free(stat);
-  free(theta);
-  free(world);
-  free(imgcrd);
-  free(pixcrd);
 
-  /* Return the output list of coordinates. */
-  return out;
+/* Convert world coordinates to image coordinates given the input WCS
+   structure. The input must be a linked list of data structures of float64
+   ('double') type. The top element of the linked list must be the first
+   coordinate and etc. If 'inplace' is non-zero, then the output will be
+   written into the input's allocated space. */
+gal_data_t *
+gal_wcs_world_to_img(gal_data_t *coords, struct wcsprm *wcs, int inplace)
+{
+  return wcs_convert(coords, wcs, inplace, 1, 1, __func__);
 }
 
 
@@ -2508,67 +2584,32 @@ gal_wcs_world_to_img(gal_data_t *coords, struct wcsprm *wcs, int inplace)
 gal_data_t *
 gal_wcs_img_to_world(gal_data_t *coords, struct wcsprm *wcs, int inplace)
 {
-  gal_data_t *out;
-  int *stat=NULL, ncoord=coords->size, nelem;
-  double *phi=NULL, *theta=NULL, *world=NULL, *pixcrd=NULL, *imgcrd=NULL;
-
-  /* Some sanity checks. */
-  wcs_convert_sanity_check_alloc(coords, wcs, __func__, &stat, &phi, &theta,
-                                 &world, &pixcrd, &imgcrd);
-  nelem=wcs->naxis; /* We have to make sure a WCS is given first. */
-
-
-  /* Write the values from the input list of separate columns into a single
-     array (WCSLIB input). */
-  wcs_convert_list_to_from_array(coords, pixcrd, stat, wcs->naxis, 0);
+  return wcs_convert(coords, wcs, inplace, 1, 0, __func__);
+}
 
 
-  /* Use WCSLIB's wcsp2s for the conversion. We are ignoring the over-all
-     status here, because later we will use the 'stat' array to set all bad
-     coordinates to NaN. */
-  wcsp2s(wcs, ncoord, nelem, pixcrd, imgcrd, phi, theta, world, stat);
 
 
-  /* For a check.
-  {
-    size_t i;
-    printf("\n\n%s sanity check (%d dimensions):\n", __func__, nelem);
-    for(i=0;i<coords->size;++i)
-      switch(nelem)
-        {
-        case 2:
-          printf("(%-10g %-10g) --> (%-10g %-10g), [stat: %d]\n",
-                 pixcrd[i*2], pixcrd[i*2+1],
-                 world[i*2],  world[i*2+1], stat[i]);
-          break;
-        case 3:
-          printf("(%g, %g, %g) --> (%g, %g, %g), [stat: %d]\n",
-                 pixcrd[i*3], pixcrd[i*3+1], pixcrd[i*3+2],
-                 world[i*3],  world[i*3+1],  world[i*3+2], stat[i]);
-          break;
-        }
-  }
-  */
-
-
-  /* Allocate the output arrays if they were not already allocated. */
-  out=wcs_convert_prepare_out(coords, wcs, inplace);
 
+/* Similar to 'gal_wcs_world_to_img', but the coordinates are converted in
+   chunks on 'numthreads' threads (each thread uses its own copy of
+   'wcs'). If 'numthreads' is zero, all the available threads will be
+   used. */
+gal_data_t *
+gal_wcs_world_to_img_parallel(gal_data_t *coords, struct wcsprm *wcs,
+                              int inplace, size_t numthreads)
+{
+  return wcs_convert(coords, wcs, inplace, numthreads, 1, __func__);
+}
 
-  /* Write the output from a single array (WCSLIB output) into the output
-     list of this function. */
-  wcs_convert_list_to_from_array(out, world, stat, wcs->naxis, 1);
 
 
-  /* Clean up. */
-  free(phi);
-  free(stat);
-  free(theta);
-  free(world);
-  free(imgcrd);
-  free(pixcrd);
 
 
-  /* Return the output list of coordinates. */
-  return out;
+/* Similar to 'gal_wcs_world_to_img_parallel'. */
+gal_data_t *
+gal_wcs_img_to_world_parallel(gal_data_t *coords, struct wcsprm *wcs,
+                              int inplace, size_t numthreads)
+{
+  return wcs_convert(coords, wcs, inplace, numthreads, 0, __func__);
 }
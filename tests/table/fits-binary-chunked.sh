@@ -0,0 +1,80 @@
+# Read, process and write a FITS binary table in chunks of rows and
+# compare the result with the same call without chunks.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+# Copyright (C) 2026 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=table
+table=binary-table.fits
+execname=../bin/$prog/ast$prog
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $table    ]; then echo "$table doesn't exist.";  exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like 'Valgrind' or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The chunks are small (2 rows) so the 12 rows of the input are in many
+# chunks (that are processed on separate threads). The outputs are
+# compared with the outputs of the same calls without '--chunksize'. Only
+# the values in each row are compared (the metadata in the comments, or
+# the spaces between the columns can differ).
+$check_with_program $execname $table --chunksize=2 --head=5 \
+                    --output=binary-table-chunked.fits
+$execname $table --head=5 --output=binary-table-unchunked.fits
+$check_with_program $execname $table --chunksize=2 \
+                    --output=binary-table-chunked-all.txt
+$execname $table --output=binary-table-unchunked-all.txt
+for f in chunked unchunked; do
+    $execname binary-table-$f.fits --output=binary-table-$f.txt
+    for n in "" -all; do
+        grep -v '^#' binary-table-$f$n.txt | awk '{$1=$1; print}' \
+             > binary-table-$f$n-values.txt
+    done
+done
+cmp binary-table-chunked-values.txt binary-table-unchunked-values.txt \
+    || exit 1
+cmp binary-table-chunked-all-values.txt \
+    binary-table-unchunked-all-values.txt
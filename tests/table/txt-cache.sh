@@ -0,0 +1,114 @@
+# Write a binary cache of a plain-text table, read the table through it
+# and make sure a stale cache (after the table changes) is not used.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+# Copyright (C) 2026 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=table
+execname=../bin/$prog/ast$prog
+table=$topsrc/tests/$prog/table.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $table    ]; then echo "$table does not exist."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The cache is written beside the table, so the table is first copied
+# here. Its modification time is set explicitly, so it can be kept (or
+# changed) independently of its size below. The values in each row of
+# every read are compared with a read of a copy of the table that has no
+# cache (the spaces between the columns or the comments can differ).
+# Without a usable cache, '--chunksize' can't be used on a plain-text
+# table, so it also shows if the cache was used or not.
+cached=table-cached.txt
+nocache=table-nocache.txt
+rm -f $cached $cached.gtc table-cached-write.txt
+cp $table $cached
+touch -t 202001010000 $cached
+$check_with_program $execname $cached --writecache \
+                    --output=table-cached-write.txt || exit 1
+if [ ! -f $cached.gtc ]; then echo "$cached.gtc not created."; exit 1; fi
+
+# Read the table through the cache, then after the cache becomes stale:
+# first the size of the table changes (one row is added) with the same
+# modification time. Then the cache is re-written and only the
+# modification time of the table changes (one digit of a value is
+# changed, so the size is the same).
+for step in cache size mtime; do
+    case $step in
+        size)
+            grep '^1 ' $table >> $cached
+            touch -t 202001010000 $cached
+            ;;
+        mtime)
+            $execname $cached --writecache > /dev/null || exit 1
+            sed -e 's/1874\.103872/1874.103873/' $cached > table-tmp.txt
+            mv table-tmp.txt $cached
+            touch -t 202101010000 $cached
+            ;;
+    esac
+
+    # Compare the values in each row with a read of the copy.
+    cp $cached $nocache
+    rm -f table-$step-cached.txt table-$step-nocache.txt
+    $check_with_program $execname $cached --output=table-$step-cached.txt
+    $execname $nocache --output=table-$step-nocache.txt
+    for f in cached nocache; do
+        grep -v '^#' table-$step-$f.txt | awk '{$1=$1; print}' \
+             > table-$step-$f-values.txt
+    done
+    cmp table-$step-cached-values.txt table-$step-nocache-values.txt \
+        || exit 1
+
+    # '--chunksize' should only work while the cache is usable.
+    if $execname $cached --chunksize=2 > /dev/null 2>&1; then
+        if [ $step != cache ]; then
+            echo "Stale cache used ($step of the table changed)."; exit 1
+        fi
+    else
+        if [ $step = cache ]; then echo "Cache not used."; exit 1; fi
+    fi
+done
@@ -0,0 +1,101 @@
+# Align several images in one call and compare each output with the
+# alignment of the same image on its own.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+# Copyright (C) 2026 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=warp
+img=convolve_spatial.fits
+execname=$progbdir/ast$prog
+arithprog=$progbdir/astarithmetic
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname  ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img       ]; then echo "$img does not exist.";   exit 77; fi
+if [ ! -f $arithprog ]; then echo "$arithprog does not exist."; exit 77; fi
+
+
+
+
+
+# Prepare the inputs
+# ------------------
+#
+# The second input has the same WCS as the first (so the alignment of the
+# first is re-used for it), but different pixel values. The third is
+# shifted (with a linear warp), so its WCS is different and the
+# alignment has to be re-built for it.
+rm -rf warp-batch
+mkdir warp-batch
+cp $img warp-batch-a.fits
+$arithprog $img 2 x 10 + --output=warp-batch-b.fits
+$execname $img --translate=2.5,1.5 --output=warp-batch-c.fits
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# All the inputs are aligned to the output grid of the first input. So
+# the separate alignments of the second and third inputs are done on the
+# output of the first (with '--gridfile'). The outputs are compared with
+# a relative tolerance (the pixel values are added in different orders)
+# and the blank pixels of the two should be the same.
+$check_with_program $execname warp-batch-a.fits warp-batch-b.fits \
+                              warp-batch-c.fits --type=float64 \
+                              --output=warp-batch || exit 1
+$execname warp-batch-a.fits --type=float64 --output=warp-single-a.fits
+for i in b c; do
+    $execname warp-batch-$i.fits --type=float64 --gridhdu=1 \
+              --gridfile=warp-single-a.fits --output=warp-single-$i.fits
+done
+for i in a b c; do
+    batch=warp-batch/warp-batch-"$i"_aligned.fits
+    single=warp-single-$i.fits
+    if [ ! -f $batch ]; then echo "$batch not created."; exit 1; fi
+    diff=$($arithprog $batch $single - abs $single abs 1e-6 x gt \
+                      sumvalue -g1 --quiet)
+    blank=$($arithprog $batch isblank $single isblank ne \
+                       sumvalue -g1 --quiet)
+    echo "$batch: $diff differing pixels, $blank differing blank pixels"
+    echo "$diff $blank" | $AWK '{exit ($1!=0 || $2!=0)}' || exit 1
+done